@@ -0,0 +1,149 @@
+//===- Benchmark.h - Measuring and reporting benchmarks ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the helpers shared by the benchmark programs to time the
+// iterations of a benchmark and to report the results as JSON.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_BENCHMARKS_BENCHMARK_H
+#define LLVM_BENCHMARKS_BENCHMARK_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+namespace benchmark {
+
+/// Print \p S as a JSON string, quotes included.
+inline void printJSONString(raw_ostream &OS, StringRef S) {
+  OS << '"';
+  for (unsigned char C : S) {
+    switch (C) {
+    case '"':
+      OS << "\\\"";
+      break;
+    case '\\':
+      OS << "\\\\";
+      break;
+    case '\n':
+      OS << "\\n";
+      break;
+    case '\t':
+      OS << "\\t";
+      break;
+    default:
+      // Other control characters must be escaped. The rest, including UTF-8
+      // sequences, is printed as is.
+      if (C < 0x20)
+        OS << format("\\u%04x", C);
+      else
+        OS << C;
+    }
+  }
+  OS << '"';
+}
+
+/// The result of running one benchmark on one corpus.
+class Measurement {
+public:
+  Measurement(StringRef Name, StringRef Corpus)
+      : Name(Name), Corpus(Corpus) {}
+
+  /// Start timing an iteration.
+  void start() {
+    StartMalloc = sys::Process::GetMallocUsage();
+    Start = TimeRecord::getCurrentTime(true);
+  }
+
+  /// Stop timing the current iteration.
+  void stop() {
+    TimeRecord End = TimeRecord::getCurrentTime(false);
+    End -= Start;
+    Time += End;
+    MallocBytes += int64_t(sys::Process::GetMallocUsage()) - StartMalloc;
+    ++Iterations;
+  }
+
+  /// Record that each iteration processes \p N bytes.
+  void setBytesPerIteration(uint64_t N) { Bytes = N; }
+
+  /// Record that each iteration processes \p N items (functions, lookups...).
+  void setItemsPerIteration(uint64_t N) { Items = N; }
+
+  /// Print this measurement as a JSON object.
+  void print(raw_ostream &OS) const {
+    double Wall = Time.getWallTime();
+    OS << "{\"name\": ";
+    printJSONString(OS, Name);
+    OS << ", \"corpus\": ";
+    printJSONString(OS, Corpus);
+    OS << ", \"iterations\": " << Iterations
+       << ", \"bytes\": " << Bytes << ", \"items\": " << Items
+       << ", \"wall_time\": " << Wall
+       << ", \"user_time\": " << Time.getUserTime()
+       << ", \"sys_time\": " << Time.getSystemTime()
+       << ", \"bytes_per_second\": "
+       << (Wall > 0 ? Bytes * Iterations / Wall : 0)
+       << ", \"items_per_second\": "
+       << (Wall > 0 ? Items * Iterations / Wall : 0)
+       << ", \"malloc_bytes\": " << MallocBytes / std::max(Iterations, 1u)
+       << ", \"peak_memory_bytes\": " << sys::Process::GetPeakMemoryUsage()
+       << "}";
+  }
+
+private:
+  std::string Name;
+  std::string Corpus;
+  unsigned Iterations = 0;
+  uint64_t Bytes = 0;
+  uint64_t Items = 0;
+  TimeRecord Start;
+  int64_t StartMalloc = 0;
+  /// The time used by all the iterations.
+  TimeRecord Time;
+  /// The memory allocated and not freed by all the iterations.
+  int64_t MallocBytes = 0;
+};
+
+/// Prints measurements as a JSON document of the form
+///   {"benchmarks": [{"name": ..., "corpus": ..., ...}, ...]}
+///
+/// Times are in seconds and are the sum over all iterations, throughputs are
+/// per second of wall time. "malloc_bytes" is the average amount of memory an
+/// iteration allocated and didn't free, "peak_memory_bytes" the peak resident
+/// set size of the process when the benchmark finished: run one benchmark per
+/// process to get its own peak.
+class JSONReport {
+public:
+  explicit JSONReport(raw_ostream &OS) : OS(OS) { OS << "{\"benchmarks\": ["; }
+  ~JSONReport() { OS << "\n]}\n"; }
+
+  void add(const Measurement &M) {
+    OS << (First ? "\n  " : ",\n  ");
+    M.print(OS);
+    First = false;
+    OS.flush();
+  }
+
+private:
+  raw_ostream &OS;
+  bool First = true;
+};
+
+} // end namespace benchmark
+} // end namespace llvm
+
+#endif // LLVM_BENCHMARKS_BENCHMARK_H
@@ -0,0 +1,476 @@
+//===- BitcodeBench.cpp - Benchmark bitcode reading, writing and linking --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program measures the throughput and memory use of parsing, lazily
+// materializing and writing bitcode, of linking modules with the IRMover, and
+// of building and reading module summary indexes.
+//
+// The corpus is either the modules named on the command line (.ll or .bc
+// files), or a synthetic corpus generated deterministically from -seed. The
+// synthetic corpus can be saved with -write-corpus to be used as a recorded
+// corpus later. The results are printed as JSON, see Benchmark.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Benchmark.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSummaryIndex.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::benchmark;
+
+static cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
+                                            cl::desc("<input files>"));
+
+static cl::opt<std::string> OutputFilename("o",
+                                           cl::desc("Output JSON filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::list<std::string>
+    BenchmarkNames("benchmarks", cl::CommaSeparated,
+                   cl::desc("Benchmarks to run (default: all of parse, "
+                            "lazy-materialize, write, link, summary-build, "
+                            "summary-read)"),
+                   cl::value_desc("name,..."));
+
+static cl::opt<unsigned>
+    Iterations("iterations", cl::desc("Number of runs of each benchmark"),
+               cl::init(5));
+
+static cl::opt<unsigned> Seed("seed",
+                              cl::desc("Seed of the synthetic corpus"),
+                              cl::init(0));
+
+static cl::opt<unsigned>
+    NumModules("modules", cl::desc("Number of modules of the synthetic corpus"),
+               cl::init(4));
+
+static cl::opt<unsigned> NumFunctions(
+    "functions",
+    cl::desc("Number of functions in each module of the synthetic corpus"),
+    cl::init(500));
+
+static cl::opt<unsigned> MaterializeStride(
+    "materialize-stride",
+    cl::desc("Materialize one function in N in the lazy-materialize benchmark"),
+    cl::init(8));
+
+static cl::opt<std::string> WriteCorpus(
+    "write-corpus",
+    cl::desc("Write the synthetic corpus to <prefix>.<N>.bc and exit"),
+    cl::value_desc("prefix"));
+
+static ExitOnError ExitOnErr;
+
+namespace {
+
+/// Generates the modules of the synthetic corpus. They only depend on the
+/// seed and on the sizes requested: random numbers are taken straight from
+/// the engine, as the standard distributions differ between implementations.
+class CorpusGenerator {
+public:
+  explicit CorpusGenerator(unsigned Seed) : Rand(Seed) {}
+
+  /// Generate the module \p ModuleNo of the corpus. Its functions call
+  /// functions of the previous module, so that linking the modules resolves
+  /// declarations.
+  std::unique_ptr<Module> generate(LLVMContext &Ctx, unsigned ModuleNo);
+
+private:
+  unsigned rand(unsigned N) { return Rand() % N; }
+
+  void generateBody(Function &F, DISubprogram *SP,
+                    ArrayRef<GlobalVariable *> Globals,
+                    ArrayRef<Function *> Callees);
+
+  std::minstd_rand Rand;
+};
+
+/// The bitcode of the modules a benchmark runs on.
+struct Corpus {
+  std::string Name;
+  std::vector<SmallVector<char, 0>> Bitcode;
+  uint64_t NumBytes = 0;
+  uint64_t NumFunctions = 0;
+};
+
+} // end anonymous namespace
+
+std::unique_ptr<Module> CorpusGenerator::generate(LLVMContext &Ctx,
+                                                  unsigned ModuleNo) {
+  auto M = llvm::make_unique<Module>("synthetic." + Twine(ModuleNo).str(), Ctx);
+  M->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+  M->addModuleFlag(Module::Warning, "Debug Info Version",
+                   DEBUG_METADATA_VERSION);
+
+  DIBuilder DIB(*M);
+  DIFile *File = DIB.createFile("synthetic." + Twine(ModuleNo).str() + ".c",
+                                "/");
+  DIB.createCompileUnit(dwarf::DW_LANG_C99, File, "llvm-bitcode-bench",
+                        /*isOptimized=*/true, "", 0);
+  DIBasicType *DIIntTy = DIB.createBasicType("int", 32, dwarf::DW_ATE_signed);
+  DISubroutineType *DIFnTy = DIB.createSubroutineType(
+      DIB.getOrCreateTypeArray({DIIntTy, DIIntTy, DIIntTy}));
+
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+  FunctionType *FnTy = FunctionType::get(Int32Ty, {Int32Ty, Int32Ty}, false);
+
+  SmallVector<GlobalVariable *, 16> Globals;
+  for (unsigned I = 0; I != 16; ++I)
+    Globals.push_back(new GlobalVariable(
+        *M, Int32Ty, /*isConstant=*/false, GlobalValue::ExternalLinkage,
+        ConstantInt::get(Int32Ty, I),
+        "g" + Twine(ModuleNo) + "." + Twine(I)));
+
+  std::vector<Function *> Callees;
+  for (unsigned I = 0; I != NumFunctions; ++I) {
+    Function *F =
+        Function::Create(FnTy, GlobalValue::ExternalLinkage,
+                         "f" + Twine(ModuleNo) + "." + Twine(I), M.get());
+    DISubprogram *SP = DIB.createFunction(
+        File, F->getName(), F->getName(), File, I + 1, DIFnTy,
+        /*isLocalToUnit=*/false, /*isDefinition=*/true, I + 1,
+        DINode::FlagPrototyped, /*isOptimized=*/true);
+    F->setSubprogram(SP);
+    generateBody(*F, SP, Globals, Callees);
+    Callees.push_back(F);
+
+    if (ModuleNo != 0 && I % 4 == 0)
+      Callees.push_back(cast<Function>(M->getOrInsertFunction(
+          ("f" + Twine(ModuleNo - 1) + "." + Twine(I)).str(), FnTy)));
+  }
+
+  DIB.finalize();
+  return M;
+}
+
+/// Generate a chain of blocks of arithmetic, memory accesses and calls, each
+/// of which may branch to an exit block.
+void CorpusGenerator::generateBody(Function &F, DISubprogram *SP,
+                                   ArrayRef<GlobalVariable *> Globals,
+                                   ArrayRef<Function *> Callees) {
+  LLVMContext &Ctx = F.getContext();
+  auto ArgI = F.arg_begin();
+  Value *X = &*ArgI++;
+  Value *Y = &*ArgI;
+
+  BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", &F);
+  IRBuilder<> ExitBuilder(Exit);
+  PHINode *Result = ExitBuilder.CreatePHI(Y->getType(), 0);
+  ExitBuilder.CreateRet(Result);
+
+  BasicBlock *BB = BasicBlock::Create(Ctx, "entry", &F, Exit);
+  IRBuilder<> B(BB);
+  Value *Acc = X;
+  unsigned Line = SP->getLine();
+  for (unsigned NumBlocks = 1 + rand(4), I = 0; I != NumBlocks; ++I) {
+    for (unsigned NumInsts = 4 + rand(8), J = 0; J != NumInsts; ++J) {
+      B.SetCurrentDebugLocation(DILocation::get(Ctx, ++Line, 1 + J, SP));
+      switch (rand(6)) {
+      case 0:
+        Acc = B.CreateAdd(Acc, Y);
+        break;
+      case 1:
+        Acc = B.CreateMul(Acc, B.getInt32(1 + rand(16)));
+        break;
+      case 2:
+        Acc = B.CreateXor(Acc, X);
+        break;
+      case 3:
+        Acc = B.CreateAdd(Acc, B.CreateLoad(Globals[rand(Globals.size())]));
+        break;
+      case 4:
+        B.CreateStore(Acc, Globals[rand(Globals.size())]);
+        break;
+      case 5:
+        if (!Callees.empty())
+          Acc = B.CreateCall(Callees[rand(Callees.size())], {Acc, Y});
+        break;
+      }
+    }
+
+    BasicBlock *Next = BasicBlock::Create(Ctx, "bb", &F, Exit);
+    B.CreateCondBr(B.CreateICmpSLT(Acc, Y), Next, Exit);
+    Result->addIncoming(Acc, B.GetInsertBlock());
+    B.SetInsertPoint(Next);
+  }
+  B.CreateBr(Exit);
+  Result->addIncoming(Acc, B.GetInsertBlock());
+}
+
+static MemoryBufferRef getBufferRef(const SmallVectorImpl<char> &Bitcode) {
+  return MemoryBufferRef(StringRef(Bitcode.data(), Bitcode.size()), "corpus");
+}
+
+static void addToCorpus(Corpus &C, const Module &M) {
+  C.Bitcode.emplace_back();
+  raw_svector_ostream OS(C.Bitcode.back());
+  WriteBitcodeToFile(&M, OS);
+  C.NumBytes += C.Bitcode.back().size();
+  C.NumFunctions += std::count_if(M.begin(), M.end(), [](const Function &F) {
+    return !F.isDeclaration();
+  });
+}
+
+static Corpus generateCorpus() {
+  Corpus C;
+  C.Name = "synthetic";
+  CorpusGenerator Generator(Seed);
+  for (unsigned I = 0; I != NumModules; ++I) {
+    LLVMContext Ctx;
+    addToCorpus(C, *Generator.generate(Ctx, I));
+  }
+  return C;
+}
+
+static Corpus loadCorpus() {
+  Corpus C;
+  C.Name = "recorded";
+  for (const std::string &Filename : InputFilenames) {
+    LLVMContext Ctx;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIRFile(Filename, Err, Ctx);
+    if (!M) {
+      Err.print("llvm-bitcode-bench", errs());
+      exit(1);
+    }
+    addToCorpus(C, *M);
+  }
+  return C;
+}
+
+static std::vector<std::unique_ptr<Module>> parseCorpus(const Corpus &C,
+                                                        LLVMContext &Ctx) {
+  std::vector<std::unique_ptr<Module>> Modules;
+  for (const auto &Bitcode : C.Bitcode)
+    Modules.push_back(ExitOnErr(parseBitcodeFile(getBufferRef(Bitcode), Ctx)));
+  return Modules;
+}
+
+static Measurement benchParse(const Corpus &C) {
+  Measurement M("parse", C.Name);
+  M.setBytesPerIteration(C.NumBytes);
+  M.setItemsPerIteration(C.NumFunctions);
+  for (unsigned I = 0; I != Iterations; ++I) {
+    LLVMContext Ctx;
+    M.start();
+    std::vector<std::unique_ptr<Module>> Modules = parseCorpus(C, Ctx);
+    M.stop();
+  }
+  return M;
+}
+
+static Measurement benchLazyMaterialize(const Corpus &C) {
+  Measurement M("lazy-materialize", C.Name);
+  M.setBytesPerIteration(C.NumBytes);
+  for (unsigned I = 0; I != Iterations; ++I) {
+    LLVMContext Ctx;
+    std::vector<std::unique_ptr<Module>> Modules;
+    uint64_t NumMaterialized = 0;
+    M.start();
+    for (const auto &Bitcode : C.Bitcode) {
+      Modules.push_back(
+          ExitOnErr(getLazyBitcodeModule(getBufferRef(Bitcode), Ctx)));
+      unsigned N = 0;
+      for (Function &F : *Modules.back())
+        if (F.isMaterializable() && N++ % MaterializeStride == 0) {
+          ExitOnErr(F.materialize());
+          ++NumMaterialized;
+        }
+    }
+    M.stop();
+    M.setItemsPerIteration(NumMaterialized);
+  }
+  return M;
+}
+
+static Measurement benchWrite(const Corpus &C) {
+  Measurement M("write", C.Name);
+  M.setBytesPerIteration(C.NumBytes);
+  M.setItemsPerIteration(C.NumFunctions);
+  LLVMContext Ctx;
+  std::vector<std::unique_ptr<Module>> Modules = parseCorpus(C, Ctx);
+  SmallVector<char, 0> Buffer;
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (const auto &Mod : Modules) {
+      Buffer.clear();
+      raw_svector_ostream OS(Buffer);
+      WriteBitcodeToFile(Mod.get(), OS);
+    }
+    M.stop();
+  }
+  return M;
+}
+
+static Measurement benchLink(const Corpus &C) {
+  Measurement M("link", C.Name);
+  M.setBytesPerIteration(C.NumBytes);
+  M.setItemsPerIteration(C.NumFunctions);
+  for (unsigned I = 0; I != Iterations; ++I) {
+    LLVMContext Ctx;
+    std::vector<std::unique_ptr<Module>> Modules = parseCorpus(C, Ctx);
+    Module Dest("linked", Ctx);
+    Linker L(Dest);
+    M.start();
+    for (auto &Mod : Modules)
+      if (L.linkInModule(std::move(Mod))) {
+        errs() << "llvm-bitcode-bench: error linking the corpus\n";
+        exit(1);
+      }
+    M.stop();
+  }
+  return M;
+}
+
+static Measurement benchSummaryBuild(const Corpus &C) {
+  Measurement M("summary-build", C.Name);
+  M.setItemsPerIteration(C.NumFunctions);
+  LLVMContext Ctx;
+  std::vector<std::unique_ptr<Module>> Modules = parseCorpus(C, Ctx);
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (const auto &Mod : Modules) {
+      ProfileSummaryInfo PSI(*Mod);
+      buildModuleSummaryIndex(*Mod, nullptr, &PSI);
+    }
+    M.stop();
+  }
+  return M;
+}
+
+static Measurement benchSummaryRead(const Corpus &C) {
+  Measurement M("summary-read", C.Name);
+  M.setItemsPerIteration(C.NumFunctions);
+
+  // Read the summaries out of the bitcode of the modules they describe, like
+  // the thin link does.
+  std::vector<SmallVector<char, 0>> Bitcode;
+  uint64_t NumBytes = 0;
+  {
+    LLVMContext Ctx;
+    for (const auto &Mod : parseCorpus(C, Ctx)) {
+      ProfileSummaryInfo PSI(*Mod);
+      ModuleSummaryIndex Index = buildModuleSummaryIndex(*Mod, nullptr, &PSI);
+      Bitcode.emplace_back();
+      raw_svector_ostream OS(Bitcode.back());
+      WriteBitcodeToFile(Mod.get(), OS, false, &Index);
+      NumBytes += Bitcode.back().size();
+    }
+  }
+  M.setBytesPerIteration(NumBytes);
+
+  for (unsigned I = 0; I != Iterations; ++I) {
+    std::vector<std::unique_ptr<ModuleSummaryIndex>> Indexes;
+    M.start();
+    for (const auto &B : Bitcode)
+      Indexes.push_back(ExitOnErr(getModuleSummaryIndex(getBufferRef(B))));
+    M.stop();
+  }
+  return M;
+}
+
+namespace {
+
+struct BenchmarkInfo {
+  const char *Name;
+  Measurement (*Run)(const Corpus &);
+};
+
+} // end anonymous namespace
+
+static const BenchmarkInfo Benchmarks[] = {
+    {"parse", benchParse},
+    {"lazy-materialize", benchLazyMaterialize},
+    {"write", benchWrite},
+    {"link", benchLink},
+    {"summary-build", benchSummaryBuild},
+    {"summary-read", benchSummaryRead},
+};
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+  cl::ParseCommandLineOptions(argc, argv, "LLVM bitcode benchmarks\n");
+  ExitOnErr.setBanner("llvm-bitcode-bench: ");
+
+  for (const std::string &Name : BenchmarkNames)
+    if (std::none_of(std::begin(Benchmarks), std::end(Benchmarks),
+                     [&](const BenchmarkInfo &B) { return Name == B.Name; })) {
+      errs() << "llvm-bitcode-bench: unknown benchmark '" << Name << "'\n";
+      return 1;
+    }
+
+  if (!WriteCorpus.empty()) {
+    Corpus C = generateCorpus();
+    for (unsigned I = 0, E = C.Bitcode.size(); I != E; ++I) {
+      std::error_code EC;
+      ToolOutputFile Out(WriteCorpus + "." + Twine(I).str() + ".bc", EC,
+                         sys::fs::F_None);
+      if (EC) {
+        errs() << "llvm-bitcode-bench: " << EC.message() << '\n';
+        return 1;
+      }
+      Out.os().write(C.Bitcode[I].data(), C.Bitcode[I].size());
+      Out.keep();
+    }
+    return 0;
+  }
+
+  Corpus C = InputFilenames.empty() ? generateCorpus() : loadCorpus();
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "llvm-bitcode-bench: " << EC.message() << '\n';
+    return 1;
+  }
+  {
+    JSONReport Report(Out.os());
+    for (const BenchmarkInfo &B : Benchmarks)
+      if (BenchmarkNames.empty() ||
+          std::find(BenchmarkNames.begin(), BenchmarkNames.end(), B.Name) !=
+              BenchmarkNames.end())
+        Report.add(B.Run(C));
+  }
+  Out.keep();
+  return 0;
+}
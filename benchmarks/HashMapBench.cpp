@@ -0,0 +1,269 @@
+//===- HashMapBench.cpp - Benchmark DenseMap against SwissMap -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program compares the throughput of DenseMap, SmallDenseMap and SwissMap
+// on the operations the compiler does most: inserting, finding present and
+// missing keys, erasing and reinserting, and iterating.
+//
+// The keys are pointers to heap objects, like the Value and MachineInstr keys
+// of most maps, or sequential or random integers. The results are printed as
+// JSON, see Benchmark.h; the corpus of a measurement is its key kind and map
+// size.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Benchmark.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/SwissMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::benchmark;
+
+static cl::opt<std::string> OutputFilename("o",
+                                           cl::desc("Output JSON filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::opt<unsigned>
+    Iterations("iterations", cl::desc("Number of runs of each benchmark"),
+               cl::init(5));
+
+static cl::opt<unsigned> Seed("seed", cl::desc("Seed of the random keys"),
+                              cl::init(0));
+
+static cl::list<unsigned>
+    Sizes("sizes", cl::desc("Number of keys in the maps (default: 8,1000,"
+                            "100000)"),
+          cl::CommaSeparated);
+
+static cl::opt<unsigned>
+    OpsPerIteration("ops", cl::desc("Minimum number of operations of an "
+                                    "iteration, repeating small maps"),
+                    cl::init(1000000));
+
+namespace {
+
+/// The keys of a benchmark. Present are inserted in the maps, Absent are
+/// looked up to measure misses.
+template <typename KeyT> struct KeySet {
+  std::string Name;
+  std::vector<KeyT> Present;
+  std::vector<KeyT> Absent;
+};
+
+} // end anonymous namespace
+
+/// Pointers to objects allocated one after the other, shuffled so that the
+/// insertion order doesn't follow the addresses.
+static KeySet<void *>
+getPointerKeys(unsigned Size, std::vector<std::unique_ptr<char[]>> &Pool) {
+  KeySet<void *> Keys;
+  Keys.Name = "pointer-" + std::to_string(Size);
+  std::minstd_rand Rand(Seed);
+  for (unsigned I = 0; I != 2 * Size; ++I) {
+    Pool.emplace_back(new char[48]);
+    (I % 2 ? Keys.Absent : Keys.Present).push_back(Pool.back().get());
+  }
+  std::shuffle(Keys.Present.begin(), Keys.Present.end(), Rand);
+  std::shuffle(Keys.Absent.begin(), Keys.Absent.end(), Rand);
+  return Keys;
+}
+
+/// The integers [0, Size) are present and [Size, 2 * Size) absent, like value
+/// numbers or instruction indices.
+static KeySet<unsigned> getSequentialKeys(unsigned Size) {
+  KeySet<unsigned> Keys;
+  Keys.Name = "sequential-" + std::to_string(Size);
+  for (unsigned I = 0; I != Size; ++I) {
+    Keys.Present.push_back(I);
+    Keys.Absent.push_back(Size + I);
+  }
+  return Keys;
+}
+
+/// Distinct random integers, none of them a reserved key of DenseMap.
+static KeySet<unsigned> getRandomKeys(unsigned Size) {
+  KeySet<unsigned> Keys;
+  Keys.Name = "random-" + std::to_string(Size);
+  std::mt19937 Rand(Seed);
+  DenseMap<unsigned, bool> Seen;
+  while (Keys.Absent.size() != Size) {
+    unsigned Key = Rand();
+    if (Key >= ~1U || !Seen.insert({Key, true}).second)
+      continue;
+    (Keys.Present.size() > Keys.Absent.size() ? Keys.Absent : Keys.Present)
+        .push_back(Key);
+  }
+  return Keys;
+}
+
+/// The number of times an iteration processes the keys, so that iterations
+/// of small maps last long enough to be timed.
+template <typename KeyT> static unsigned getRepeat(const KeySet<KeyT> &Keys) {
+  return std::max<size_t>(1, OpsPerIteration / Keys.Present.size());
+}
+
+template <typename MapT, typename KeyT>
+static void fillMap(MapT &Map, const KeySet<KeyT> &Keys) {
+  for (unsigned I = 0, E = Keys.Present.size(); I != E; ++I)
+    Map[Keys.Present[I]] = I;
+}
+
+static void checkFound(StringRef Name, uint64_t NumFound, uint64_t Expected) {
+  if (NumFound != Expected) {
+    errs() << "llvm-hashmap-bench: " << Name << ": unexpected lookup result\n";
+    exit(1);
+  }
+}
+
+template <typename MapT, typename KeyT>
+static Measurement benchInsert(StringRef Name, const KeySet<KeyT> &Keys) {
+  Measurement M(Name, Keys.Name);
+  unsigned Repeat = getRepeat(Keys);
+  M.setItemsPerIteration(uint64_t(Repeat) * Keys.Present.size());
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (unsigned R = 0; R != Repeat; ++R) {
+      MapT Map;
+      fillMap(Map, Keys);
+    }
+    M.stop();
+  }
+  return M;
+}
+
+template <typename MapT, typename KeyT>
+static Measurement benchLookup(StringRef Name, const KeySet<KeyT> &Keys,
+                               bool Hit) {
+  Measurement M(Name, Keys.Name);
+  const std::vector<KeyT> &Lookups = Hit ? Keys.Present : Keys.Absent;
+  unsigned Repeat = getRepeat(Keys);
+  M.setItemsPerIteration(uint64_t(Repeat) * Lookups.size());
+  MapT Map;
+  fillMap(Map, Keys);
+  uint64_t NumFound = 0;
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (unsigned R = 0; R != Repeat; ++R)
+      for (const KeyT &Key : Lookups)
+        NumFound += Map.count(Key);
+    M.stop();
+  }
+  checkFound(Name, NumFound,
+             Hit ? uint64_t(Iterations) * Repeat * Lookups.size() : 0);
+  return M;
+}
+
+/// Erase half of the keys and insert them back, which fills the map with
+/// tombstones or deleted buckets like a worklist map does.
+template <typename MapT, typename KeyT>
+static Measurement benchChurn(StringRef Name, const KeySet<KeyT> &Keys) {
+  Measurement M(Name, Keys.Name);
+  unsigned Repeat = getRepeat(Keys);
+  M.setItemsPerIteration(uint64_t(Repeat) * Keys.Present.size());
+  MapT Map;
+  fillMap(Map, Keys);
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (unsigned R = 0; R != Repeat; ++R) {
+      for (unsigned K = R % 2, E = Keys.Present.size(); K < E; K += 2)
+        Map.erase(Keys.Present[K]);
+      for (unsigned K = R % 2, E = Keys.Present.size(); K < E; K += 2)
+        Map[Keys.Present[K]] = K;
+    }
+    M.stop();
+  }
+  checkFound(Name, Map.size(), Keys.Present.size());
+  return M;
+}
+
+template <typename MapT, typename KeyT>
+static Measurement benchIterate(StringRef Name, const KeySet<KeyT> &Keys) {
+  Measurement M(Name, Keys.Name);
+  unsigned Repeat = getRepeat(Keys);
+  M.setItemsPerIteration(uint64_t(Repeat) * Keys.Present.size());
+  MapT Map;
+  fillMap(Map, Keys);
+  uint64_t Sum = 0;
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (unsigned R = 0; R != Repeat; ++R)
+      for (const auto &KV : Map)
+        Sum += KV.second;
+    M.stop();
+  }
+  uint64_t Expected = uint64_t(Keys.Present.size()) *
+                      (Keys.Present.size() - 1) / 2 * Iterations * Repeat;
+  checkFound(Name, Sum, Expected);
+  return M;
+}
+
+template <typename MapT, typename KeyT>
+static void benchMap(JSONReport &Report, StringRef MapName,
+                     const KeySet<KeyT> &Keys) {
+  std::string Prefix = MapName.str() + "-";
+  Report.add(benchInsert<MapT>(Prefix + "insert", Keys));
+  Report.add(benchLookup<MapT>(Prefix + "lookup-hit", Keys, /*Hit=*/true));
+  Report.add(benchLookup<MapT>(Prefix + "lookup-miss", Keys, /*Hit=*/false));
+  Report.add(benchChurn<MapT>(Prefix + "erase-reinsert", Keys));
+  Report.add(benchIterate<MapT>(Prefix + "iterate", Keys));
+}
+
+template <typename KeyT>
+static void benchAllMaps(JSONReport &Report, const KeySet<KeyT> &Keys) {
+  benchMap<DenseMap<KeyT, unsigned>>(Report, "densemap", Keys);
+  benchMap<SmallDenseMap<KeyT, unsigned, 16>>(Report, "smalldensemap", Keys);
+  benchMap<SwissMap<KeyT, unsigned>>(Report, "swissmap", Keys);
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+  cl::ParseCommandLineOptions(argc, argv, "hash map benchmarks\n");
+
+  SmallVector<unsigned, 3> MapSizes(Sizes.begin(), Sizes.end());
+  if (MapSizes.empty())
+    MapSizes = {8, 1000, 100000};
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "llvm-hashmap-bench: " << EC.message() << '\n';
+    return 1;
+  }
+  {
+    JSONReport Report(Out.os());
+    for (unsigned Size : MapSizes) {
+      if (Size == 0)
+        continue;
+      std::vector<std::unique_ptr<char[]>> Pool;
+      benchAllMaps(Report, getPointerKeys(Size, Pool));
+      benchAllMaps(Report, getSequentialKeys(Size));
+      benchAllMaps(Report, getRandomKeys(Size));
+    }
+  }
+  Out.keep();
+  return 0;
+}
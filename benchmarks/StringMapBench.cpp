@@ -0,0 +1,241 @@
+//===- StringMapBench.cpp - Benchmark string hashing and StringMap --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program measures the throughput of the string hash functions, of
+// inserting and looking up keys in a StringMap, and of adding them to a
+// StringTableBuilder.
+//
+// The keys are either read from a file, one per line (for instance the output
+// of llvm-nm -just-symbol-name), or are synthetic symbol names generated
+// deterministically from -seed. The results are printed as JSON, see
+// Benchmark.h.
+//
+// hash-bernstein measures HashString, which StringMap used before switching to
+// hash_value, and hash-xxhash64 the other word-at-a-time hash of the tree. To
+// compare the containers themselves across a change, run this program built
+// from both revisions on the same keys.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Benchmark.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/MC/StringTableBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::benchmark;
+
+static cl::opt<std::string>
+    InputFilename(cl::Positional, cl::desc("[<file with one key per line>]"),
+                  cl::init(""));
+
+static cl::opt<std::string> OutputFilename("o",
+                                           cl::desc("Output JSON filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::opt<unsigned>
+    Iterations("iterations", cl::desc("Number of runs of each benchmark"),
+               cl::init(5));
+
+static cl::opt<unsigned> Seed("seed", cl::desc("Seed of the synthetic keys"),
+                              cl::init(0));
+
+static cl::opt<unsigned> NumKeys("keys",
+                                 cl::desc("Number of synthetic keys"),
+                                 cl::init(100000));
+
+namespace {
+
+/// The keys a benchmark runs on. Half of them are inserted in the maps, the
+/// other half are looked up to measure misses.
+struct KeySet {
+  std::string Name;
+  std::unique_ptr<MemoryBuffer> Buffer;
+  std::vector<std::string> Storage;
+  std::vector<StringRef> Present;
+  std::vector<StringRef> Absent;
+  uint64_t NumBytes = 0;
+};
+
+} // end anonymous namespace
+
+/// Generate names shaped like mangled C++ symbols: a few nested identifiers
+/// of various lengths, so that the keys share prefixes like real symbols do.
+static void generateKeys(KeySet &Keys) {
+  static const char *const Prefixes[] = {"_ZN4llvm", "_ZNK4llvm", "_ZN5clang",
+                                         "_ZNSt3__1", "_Z", ""};
+  std::minstd_rand Rand(Seed);
+  for (unsigned I = 0; I != NumKeys; ++I) {
+    std::string Key = Prefixes[Rand() % array_lengthof(Prefixes)];
+    for (unsigned NumParts = 1 + Rand() % 4, J = 0; J != NumParts; ++J) {
+      unsigned Len = 2 + Rand() % 24;
+      Key += utostr(Len);
+      for (unsigned K = 0; K != Len; ++K)
+        Key += 'a' + Rand() % 26;
+    }
+    Key += I % 2 ? "Ev" : "";
+    Keys.Storage.push_back(std::move(Key));
+  }
+  Keys.Name = "synthetic";
+}
+
+static void loadKeys(KeySet &Keys) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getFileOrSTDIN(InputFilename);
+  if (!BufferOrErr) {
+    errs() << "llvm-stringmap-bench: " << InputFilename << ": "
+           << BufferOrErr.getError().message() << '\n';
+    exit(1);
+  }
+  Keys.Buffer = std::move(*BufferOrErr);
+  Keys.Name = "recorded";
+}
+
+static KeySet getKeys() {
+  KeySet Keys;
+  SmallVector<StringRef, 0> All;
+  if (InputFilename.empty()) {
+    generateKeys(Keys);
+    All.append(Keys.Storage.begin(), Keys.Storage.end());
+  } else {
+    loadKeys(Keys);
+    Keys.Buffer->getBuffer().split(All, '\n', -1, /*KeepEmpty=*/false);
+  }
+
+  // Drop the duplicates, so that all the keys present are inserted and all
+  // the keys absent are missing.
+  StringMap<bool> Seen;
+  for (StringRef Key : All)
+    if (Seen.insert({Key, true}).second) {
+      (Keys.Present.size() > Keys.Absent.size() ? Keys.Absent : Keys.Present)
+          .push_back(Key);
+      Keys.NumBytes += Key.size();
+    }
+  return Keys;
+}
+
+template <typename HashT>
+static Measurement benchHash(StringRef Name, const KeySet &Keys, HashT Hash) {
+  Measurement M(Name, Keys.Name);
+  M.setItemsPerIteration(Keys.Present.size() + Keys.Absent.size());
+  M.setBytesPerIteration(Keys.NumBytes);
+  uint64_t Sum = 0;
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (StringRef Key : Keys.Present)
+      Sum += Hash(Key);
+    for (StringRef Key : Keys.Absent)
+      Sum += Hash(Key);
+    M.stop();
+  }
+  // Use the hashes, so that they can't be optimized away.
+  volatile uint64_t Sink = Sum;
+  (void)Sink;
+  return M;
+}
+
+static Measurement benchInsert(const KeySet &Keys) {
+  Measurement M("stringmap-insert", Keys.Name);
+  M.setItemsPerIteration(Keys.Present.size());
+  for (unsigned I = 0; I != Iterations; ++I) {
+    StringMap<unsigned> Map;
+    M.start();
+    for (StringRef Key : Keys.Present)
+      Map[Key] = I;
+    M.stop();
+  }
+  return M;
+}
+
+static Measurement benchLookup(StringRef Name, const KeySet &Keys,
+                               const std::vector<StringRef> &Lookups,
+                               bool ExpectFound) {
+  Measurement M(Name, Keys.Name);
+  M.setItemsPerIteration(Lookups.size());
+  StringMap<unsigned> Map;
+  for (StringRef Key : Keys.Present)
+    Map[Key] = Key.size();
+  unsigned NumFound = 0;
+  for (unsigned I = 0; I != Iterations; ++I) {
+    M.start();
+    for (StringRef Key : Lookups)
+      NumFound += Map.count(Key);
+    M.stop();
+  }
+  if (NumFound != (ExpectFound ? Lookups.size() * Iterations : 0)) {
+    errs() << "llvm-stringmap-bench: unexpected lookup result\n";
+    exit(1);
+  }
+  return M;
+}
+
+static Measurement benchStringTable(const KeySet &Keys) {
+  Measurement M("strtab-add", Keys.Name);
+  M.setItemsPerIteration(Keys.Present.size() + Keys.Absent.size());
+  M.setBytesPerIteration(Keys.NumBytes);
+  for (unsigned I = 0; I != Iterations; ++I) {
+    StringTableBuilder Builder(StringTableBuilder::RAW);
+    M.start();
+    for (StringRef Key : Keys.Present)
+      Builder.add(Key);
+    for (StringRef Key : Keys.Absent)
+      Builder.add(Key);
+    M.stop();
+  }
+  return M;
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+  cl::ParseCommandLineOptions(argc, argv, "StringMap benchmarks\n");
+
+  KeySet Keys = getKeys();
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "llvm-stringmap-bench: " << EC.message() << '\n';
+    return 1;
+  }
+  {
+    JSONReport Report(Out.os());
+    Report.add(benchHash("hash-bernstein", Keys,
+                         [](StringRef Key) { return HashString(Key); }));
+    Report.add(benchHash("hash-xxhash64", Keys,
+                         [](StringRef Key) { return xxHash64(Key); }));
+    Report.add(benchHash("hash-hash-value", Keys, [](StringRef Key) {
+      return static_cast<size_t>(hash_value(Key));
+    }));
+    Report.add(benchHash("hash-stringmap", Keys, StringMapImpl::hash));
+    Report.add(benchInsert(Keys));
+    Report.add(benchLookup("stringmap-lookup-hit", Keys, Keys.Present,
+                           /*ExpectFound=*/true));
+    Report.add(benchLookup("stringmap-lookup-miss", Keys, Keys.Absent,
+                           /*ExpectFound=*/false));
+    Report.add(benchStringTable(Keys));
+  }
+  Out.keep();
+  return 0;
+}
@@ -214,7 +214,9 @@ void SplitString(StringRef Source,
 
 /// HashString - Hash function for strings.
 ///
-/// This is the Bernstein hash function.
+/// This is the Bernstein hash function. On-disk hash tables depend on its
+/// values, which must not change. In-memory tables should prefer a faster hash
+/// such as StringMapImpl::hash.
 //
 // FIXME: Investigate whether a modified bernstein hash function performs
 // better: http://eternallyconfuzzled.com/tuts/algorithms/jsw_tut_hashing.aspx
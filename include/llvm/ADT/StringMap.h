@@ -105,6 +105,11 @@ public:
     return reinterpret_cast<StringMapEntryBase *>(Val);
   }
 
+  /// Returns the hash value of \p Key used to place it in the table. This
+  /// hash is only meant to be used in memory: it may change between releases
+  /// and must not be written to disk. It is the same on every host.
+  static unsigned hash(StringRef Key);
+
   unsigned getNumBuckets() const { return NumBuckets; }
   unsigned getNumItems() const { return NumItems; }
 
@@ -0,0 +1,765 @@
+//===- llvm/ADT/SwissMap.h - Group probed hash table ------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the SwissMap class, an open addressing hash table that
+// keeps a byte of metadata per bucket and probes a whole group of buckets with
+// a few vector instructions.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_ADT_SWISSMAP_H
+#define LLVM_ADT_SWISSMAP_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/ADT/EpochTracker.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/type_traits.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LLVM_SWISSMAP_USE_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define LLVM_SWISSMAP_USE_NEON 1
+#endif
+
+namespace llvm {
+
+namespace detail {
+
+/// The control byte of a bucket. A full bucket holds the low 7 bits of the
+/// hash of its key, so that the special values all have their sign bit set.
+enum SwissCtrl : int8_t { SwissEmpty = -128, SwissDeleted = -2 };
+
+/// A set of buckets of a group, as computed by the SwissGroup matchers: one
+/// bit per bucket when Shift is 0, one byte per bucket with only its high bit
+/// set when Shift is 3. Iterating over it yields the indices of the buckets.
+template <typename T, unsigned Width, unsigned Shift> class SwissBitMask {
+  T Mask;
+
+public:
+  explicit SwissBitMask(T Mask) : Mask(Mask) {}
+
+  explicit operator bool() const { return Mask != 0; }
+
+  /// Index of the first bucket of the set, which must not be empty.
+  unsigned lowest() const {
+    return countTrailingZeros(Mask, ZB_Undefined) >> Shift;
+  }
+
+  /// Number of buckets before the first one of the set.
+  unsigned trailingZeros() const {
+    return Mask ? lowest() : Width;
+  }
+
+  /// Number of buckets after the last one of the set.
+  unsigned leadingZeros() const {
+    const unsigned ExtraBits = sizeof(T) * 8 - (Width << Shift);
+    return countLeadingZeros(T(Mask << ExtraBits)) >> Shift;
+  }
+
+  SwissBitMask begin() const { return *this; }
+  SwissBitMask end() const { return SwissBitMask(0); }
+  unsigned operator*() const { return lowest(); }
+  SwissBitMask &operator++() {
+    Mask &= Mask - 1;
+    return *this;
+  }
+  bool operator!=(const SwissBitMask &RHS) const { return Mask != RHS.Mask; }
+};
+
+#if LLVM_SWISSMAP_USE_SSE2
+
+/// The control bytes of 16 consecutive buckets, compared with SSE2.
+struct SwissGroup {
+  enum { Width = 16 };
+  using BitMask = SwissBitMask<uint32_t, Width, 0>;
+
+  __m128i Ctrl;
+
+  explicit SwissGroup(const int8_t *Pos)
+      : Ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(Pos))) {}
+
+  /// The full buckets whose hash has the low 7 bits \p H2.
+  BitMask match(int8_t H2) const {
+    return BitMask(static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(H2), Ctrl))));
+  }
+  BitMask matchEmpty() const { return match(SwissEmpty); }
+  BitMask matchEmptyOrDeleted() const {
+    return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(Ctrl)));
+  }
+};
+
+#elif LLVM_SWISSMAP_USE_NEON
+
+/// The control bytes of 8 consecutive buckets, compared with NEON.
+struct SwissGroup {
+  enum { Width = 8 };
+  using BitMask = SwissBitMask<uint64_t, Width, 3>;
+
+  uint8x8_t Ctrl;
+
+  explicit SwissGroup(const int8_t *Pos)
+      : Ctrl(vld1_u8(reinterpret_cast<const uint8_t *>(Pos))) {}
+
+  /// The full buckets whose hash has the low 7 bits \p H2.
+  BitMask match(int8_t H2) const {
+    uint8x8_t Eq = vceq_u8(Ctrl, vdup_n_u8(static_cast<uint8_t>(H2)));
+    return BitMask(vget_lane_u64(vreinterpret_u64_u8(Eq), 0) &
+                   0x8080808080808080ULL);
+  }
+  BitMask matchEmpty() const { return match(SwissEmpty); }
+  BitMask matchEmptyOrDeleted() const {
+    return BitMask(vget_lane_u64(vreinterpret_u64_u8(Ctrl), 0) &
+                   0x8080808080808080ULL);
+  }
+};
+
+#else
+
+/// The control bytes of 8 consecutive buckets, compared as a 64-bit integer.
+struct SwissGroup {
+  enum { Width = 8 };
+  using BitMask = SwissBitMask<uint64_t, Width, 3>;
+
+  uint64_t Ctrl;
+
+  explicit SwissGroup(const int8_t *Pos)
+      : Ctrl(support::endian::read64le(Pos)) {}
+
+  /// The full buckets whose hash has the low 7 bits \p H2.
+  ///
+  /// This zeroes the matching bytes and finds the zero bytes. The borrow may
+  /// also flag a byte following a match, so callers must check the keys
+  /// anyway, but only ever a full bucket.
+  BitMask match(int8_t H2) const {
+    const uint64_t Lsbs = 0x0101010101010101ULL;
+    uint64_t X = Ctrl ^ (Lsbs * static_cast<uint8_t>(H2));
+    return BitMask((X - Lsbs) & ~X & 0x8080808080808080ULL);
+  }
+  /// SwissEmpty is the only value with the high bit set and bit 1 clear.
+  BitMask matchEmpty() const {
+    return BitMask(Ctrl & (~Ctrl << 6) & 0x8080808080808080ULL);
+  }
+  BitMask matchEmptyOrDeleted() const {
+    return BitMask(Ctrl & 0x8080808080808080ULL);
+  }
+};
+
+#endif
+
+} // end namespace detail
+
+template <typename KeyT, typename ValueT,
+          typename KeyInfoT = DenseMapInfo<KeyT>, bool IsConst = false>
+class SwissMapIterator;
+
+/// SwissMap - A hash map with the interface of DenseMap, implemented as a
+/// "Swiss table".
+///
+/// Next to its array of buckets, the map keeps an array of control bytes, one
+/// per bucket, telling whether the bucket is empty, deleted or full and, when
+/// full, 7 bits of the hash of its key. A lookup loads the control bytes of a
+/// group of 8 or 16 buckets at once and only compares the keys of the buckets
+/// whose 7 bits match, so it rarely compares more than one key, and the load
+/// factor can go up to 7/8.
+///
+/// Unlike DenseMap, the map never compares keys to sentinels: KeyInfoT only
+/// needs getHashValue and isEqual, and all the values of the key type can be
+/// inserted. The hash is mixed before use, so weak hashes such as the ones of
+/// DenseMapInfo for pointers and integers are fine.
+///
+/// Iterators and references to the elements are invalidated by insertions,
+/// like those of DenseMap, but not by erasure.
+template <typename KeyT, typename ValueT,
+          typename KeyInfoT = DenseMapInfo<KeyT>>
+class SwissMap : public DebugEpochBase {
+  template <typename T>
+  using const_arg_type_t = typename const_pointer_or_const_ref<T>::type;
+
+  using Group = detail::SwissGroup;
+
+public:
+  using size_type = unsigned;
+  using key_type = KeyT;
+  using mapped_type = ValueT;
+  using value_type = detail::DenseMapPair<KeyT, ValueT>;
+
+  using iterator = SwissMapIterator<KeyT, ValueT, KeyInfoT>;
+  using const_iterator = SwissMapIterator<KeyT, ValueT, KeyInfoT, true>;
+
+  explicit SwissMap(unsigned InitialReserve = 0) { init(InitialReserve); }
+
+  SwissMap(const SwissMap &Other) { copyFrom(Other); }
+
+  SwissMap(SwissMap &&Other) { swap(Other); }
+
+  template <typename InputIt> SwissMap(const InputIt &I, const InputIt &E) {
+    init(std::distance(I, E));
+    insert(I, E);
+  }
+
+  SwissMap(std::initializer_list<std::pair<KeyT, ValueT>> Vals)
+      : SwissMap(Vals.begin(), Vals.end()) {}
+
+  ~SwissMap() {
+    destroyAll();
+    deallocateBuckets();
+  }
+
+  SwissMap &operator=(const SwissMap &Other) {
+    if (&Other != this) {
+      destroyAll();
+      deallocateBuckets();
+      copyFrom(Other);
+    }
+    return *this;
+  }
+
+  SwissMap &operator=(SwissMap &&Other) {
+    destroyAll();
+    deallocateBuckets();
+    init(0);
+    swap(Other);
+    return *this;
+  }
+
+  void swap(SwissMap &RHS) {
+    this->incrementEpoch();
+    RHS.incrementEpoch();
+    std::swap(Buckets, RHS.Buckets);
+    std::swap(Ctrl, RHS.Ctrl);
+    std::swap(NumBuckets, RHS.NumBuckets);
+    std::swap(NumEntries, RHS.NumEntries);
+    std::swap(GrowthLeft, RHS.GrowthLeft);
+  }
+
+  inline iterator begin() {
+    if (empty())
+      return end();
+    return iterator(Buckets, Ctrl, Buckets + NumBuckets, *this);
+  }
+  inline iterator end() {
+    return iterator(Buckets + NumBuckets, nullptr, Buckets + NumBuckets, *this,
+                    true);
+  }
+  inline const_iterator begin() const {
+    if (empty())
+      return end();
+    return const_iterator(Buckets, Ctrl, Buckets + NumBuckets, *this);
+  }
+  inline const_iterator end() const {
+    return const_iterator(Buckets + NumBuckets, nullptr, Buckets + NumBuckets,
+                          *this, true);
+  }
+
+  LLVM_NODISCARD bool empty() const { return NumEntries == 0; }
+  unsigned size() const { return NumEntries; }
+
+  /// Grow the map so that it can contain at least \p NumEntries items
+  /// before resizing again.
+  void reserve(size_type NumEntries) {
+    unsigned NewNumBuckets = getMinBucketToReserveForEntries(NumEntries);
+    incrementEpoch();
+    if (NewNumBuckets > NumBuckets)
+      rehash(NewNumBuckets);
+  }
+
+  void clear() {
+    incrementEpoch();
+    if (NumEntries == 0 && GrowthLeft == getMaxLoad(NumBuckets))
+      return;
+
+    // If the capacity of the array is huge, and the # elements used is small,
+    // shrink the array.
+    if (NumEntries * 4 < NumBuckets && NumBuckets > 64) {
+      shrink_and_clear();
+      return;
+    }
+
+    destroyAll();
+    std::memset(Ctrl, detail::SwissEmpty, NumBuckets + Group::Width - 1);
+    NumEntries = 0;
+    GrowthLeft = getMaxLoad(NumBuckets);
+  }
+
+  void shrink_and_clear() {
+    unsigned OldNumEntries = NumEntries;
+    destroyAll();
+    deallocateBuckets();
+    init(OldNumEntries);
+  }
+
+  /// Return 1 if the specified key is in the map, 0 otherwise.
+  size_type count(const_arg_type_t<KeyT> Val) const {
+    return findBucket(Val) ? 1 : 0;
+  }
+
+  iterator find(const_arg_type_t<KeyT> Val) {
+    return makeIterator(findBucket(Val));
+  }
+  const_iterator find(const_arg_type_t<KeyT> Val) const {
+    return makeConstIterator(findBucket(Val));
+  }
+
+  /// Alternate version of find() which allows a different, and possibly
+  /// less expensive, key type.
+  /// The KeyInfoT implementation must provide getHashValue(LookupKeyT) and
+  /// isEqual(LookupKeyT, KeyT) for this to work.
+  template <class LookupKeyT> iterator find_as(const LookupKeyT &Val) {
+    return makeIterator(findBucket(Val));
+  }
+  template <class LookupKeyT>
+  const_iterator find_as(const LookupKeyT &Val) const {
+    return makeConstIterator(findBucket(Val));
+  }
+
+  /// lookup - Return the entry for the specified key, or a default
+  /// constructed value if no such entry exists.
+  ValueT lookup(const_arg_type_t<KeyT> Val) const {
+    if (const value_type *B = findBucket(Val))
+      return B->getSecond();
+    return ValueT();
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // If the key is already in the map, it returns false and doesn't update the
+  // value.
+  std::pair<iterator, bool> insert(const std::pair<KeyT, ValueT> &KV) {
+    return try_emplace(KV.first, KV.second);
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // If the key is already in the map, it returns false and doesn't update the
+  // value.
+  std::pair<iterator, bool> insert(std::pair<KeyT, ValueT> &&KV) {
+    return try_emplace(std::move(KV.first), std::move(KV.second));
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // The value is constructed in-place if the key is not in the map, otherwise
+  // it is not moved.
+  template <typename... Ts>
+  std::pair<iterator, bool> try_emplace(KeyT &&Key, Ts &&... Args) {
+    uint64_t Hash = getHash(Key);
+    if (value_type *B = findBucket(Key, Hash))
+      return std::make_pair(makeIterator(B), false);
+    value_type *B = insertIntoBucket(Hash, std::move(Key),
+                                     std::forward<Ts>(Args)...);
+    return std::make_pair(makeIterator(B), true);
+  }
+
+  // Inserts key,value pair into the map if the key isn't already in the map.
+  // The value is constructed in-place if the key is not in the map, otherwise
+  // it is not moved.
+  template <typename... Ts>
+  std::pair<iterator, bool> try_emplace(const KeyT &Key, Ts &&... Args) {
+    uint64_t Hash = getHash(Key);
+    if (value_type *B = findBucket(Key, Hash))
+      return std::make_pair(makeIterator(B), false);
+    value_type *B = insertIntoBucket(Hash, Key, std::forward<Ts>(Args)...);
+    return std::make_pair(makeIterator(B), true);
+  }
+
+  /// insert - Range insertion of pairs.
+  template <typename InputIt> void insert(InputIt I, InputIt E) {
+    for (; I != E; ++I)
+      insert(*I);
+  }
+
+  bool erase(const KeyT &Val) {
+    value_type *B = findBucket(Val);
+    if (!B)
+      return false;
+    eraseBucket(B);
+    return true;
+  }
+  void erase(iterator I) {
+    assert(I.Ptr >= Buckets && I.Ptr < Buckets + NumBuckets &&
+           "erasing an iterator of another map!");
+    eraseBucket(&*I);
+  }
+
+  value_type &FindAndConstruct(const KeyT &Key) {
+    uint64_t Hash = getHash(Key);
+    if (value_type *B = findBucket(Key, Hash))
+      return *B;
+    return *insertIntoBucket(Hash, Key);
+  }
+
+  ValueT &operator[](const KeyT &Key) { return FindAndConstruct(Key).second; }
+
+  value_type &FindAndConstruct(KeyT &&Key) {
+    uint64_t Hash = getHash(Key);
+    if (value_type *B = findBucket(Key, Hash))
+      return *B;
+    return *insertIntoBucket(Hash, std::move(Key));
+  }
+
+  ValueT &operator[](KeyT &&Key) {
+    return FindAndConstruct(std::move(Key)).second;
+  }
+
+  /// Return the approximate size (in bytes) of the actual map.
+  /// This is just the raw memory used by SwissMap.
+  /// If entries are pointers to objects, the sizes of the referenced objects
+  /// are not included.
+  size_t getMemorySize() const {
+    return NumBuckets ? getAllocationSize(NumBuckets) : 0;
+  }
+
+private:
+  /// The buckets, followed in the same allocation by the control bytes.
+  value_type *Buckets = nullptr;
+  /// One control byte per bucket, followed by copies of the first
+  /// Group::Width - 1 ones, so that a group can be loaded at any bucket.
+  int8_t *Ctrl = nullptr;
+  /// The number of buckets, a power of 2 at least Group::Width, or 0.
+  unsigned NumBuckets = 0;
+  unsigned NumEntries = 0;
+  /// The number of entries that can be inserted in empty buckets before the
+  /// table needs to be rehashed.
+  unsigned GrowthLeft = 0;
+
+  static unsigned getMaxLoad(unsigned NumBuckets) {
+    return NumBuckets - NumBuckets / 8;
+  }
+
+  static unsigned getMinBucketToReserveForEntries(unsigned NumEntries) {
+    if (NumEntries == 0)
+      return 0;
+    unsigned NumBuckets = Group::Width;
+    while (getMaxLoad(NumBuckets) < NumEntries)
+      NumBuckets *= 2;
+    return NumBuckets;
+  }
+
+  static size_t getAllocationSize(unsigned NumBuckets) {
+    return sizeof(value_type) * NumBuckets + NumBuckets + Group::Width - 1;
+  }
+
+  /// Mix the hash of the key, so that its low bits select the group and its
+  /// high bits the control byte even for hashes with poor entropy.
+  template <typename LookupKeyT>
+  static uint64_t getHash(const LookupKeyT &Key) {
+    uint64_t Hash =
+        uint64_t(KeyInfoT::getHashValue(Key)) * 0x9E3779B97F4A7C15ULL;
+    return Hash ^ (Hash >> 32);
+  }
+
+  static int8_t getH2(uint64_t Hash) { return Hash & 0x7F; }
+  static unsigned getH1(uint64_t Hash) { return unsigned(Hash >> 7); }
+
+  bool isFull(unsigned I) const { return Ctrl[I] >= 0; }
+
+  void setCtrl(unsigned I, int8_t C) {
+    Ctrl[I] = C;
+    if (I < Group::Width - 1)
+      Ctrl[NumBuckets + I] = C;
+  }
+
+  void init(unsigned InitialReserve) {
+    Buckets = nullptr;
+    Ctrl = nullptr;
+    NumBuckets = 0;
+    NumEntries = 0;
+    GrowthLeft = 0;
+    if (unsigned NewNumBuckets =
+            getMinBucketToReserveForEntries(InitialReserve))
+      allocateBuckets(NewNumBuckets);
+  }
+
+  void allocateBuckets(unsigned Num) {
+    NumBuckets = Num;
+    Buckets =
+        static_cast<value_type *>(operator new(getAllocationSize(NumBuckets)));
+    Ctrl = reinterpret_cast<int8_t *>(Buckets + NumBuckets);
+    std::memset(Ctrl, detail::SwissEmpty, NumBuckets + Group::Width - 1);
+    GrowthLeft = getMaxLoad(NumBuckets);
+  }
+
+  void deallocateBuckets() { operator delete(Buckets); }
+
+  void destroyAll() {
+    if (isPodLike<KeyT>::value && isPodLike<ValueT>::value)
+      return;
+    for (unsigned I = 0; I != NumBuckets; ++I)
+      if (isFull(I)) {
+        Buckets[I].getSecond().~ValueT();
+        Buckets[I].getFirst().~KeyT();
+      }
+  }
+
+  void copyFrom(const SwissMap &Other) {
+    init(0);
+    if (!Other.NumBuckets)
+      return;
+    allocateBuckets(Other.NumBuckets);
+    NumEntries = Other.NumEntries;
+    GrowthLeft = Other.GrowthLeft;
+    std::memcpy(Ctrl, Other.Ctrl, NumBuckets + Group::Width - 1);
+    if (isPodLike<KeyT>::value && isPodLike<ValueT>::value) {
+      std::memcpy(reinterpret_cast<void *>(Buckets), Other.Buckets,
+                  NumBuckets * sizeof(value_type));
+      return;
+    }
+    for (unsigned I = 0; I != NumBuckets; ++I)
+      if (isFull(I)) {
+        ::new (&Buckets[I].getFirst()) KeyT(Other.Buckets[I].getFirst());
+        ::new (&Buckets[I].getSecond()) ValueT(Other.Buckets[I].getSecond());
+      }
+  }
+
+  template <typename LookupKeyT>
+  value_type *findBucket(const LookupKeyT &Key) const {
+    if (NumBuckets == 0)
+      return nullptr;
+    return findBucket(Key, getHash(Key));
+  }
+
+  /// Return the bucket holding \p Key, or null if the key isn't in the map.
+  ///
+  /// The probe sequence visits groups at triangular offsets from the group at
+  /// H1, which visits all the groups of a table whose size is a power of 2. A
+  /// key can't be after a group with an empty bucket: it would have been
+  /// inserted there.
+  template <typename LookupKeyT>
+  value_type *findBucket(const LookupKeyT &Key, uint64_t Hash) const {
+    if (NumBuckets == 0)
+      return nullptr;
+    unsigned Mask = NumBuckets - 1;
+    unsigned Pos = getH1(Hash) & Mask;
+    for (unsigned Step = 0;;) {
+      Group G(Ctrl + Pos);
+      for (unsigned I : G.match(getH2(Hash))) {
+        value_type *B = Buckets + ((Pos + I) & Mask);
+        if (LLVM_LIKELY(KeyInfoT::isEqual(Key, B->getFirst())))
+          return B;
+      }
+      if (LLVM_LIKELY(G.matchEmpty()))
+        return nullptr;
+      Step += Group::Width;
+      assert(Step <= NumBuckets && "no empty bucket in the map!");
+      Pos = (Pos + Step) & Mask;
+    }
+  }
+
+  /// Return the first empty or deleted bucket of the probe sequence of \p Hash.
+  unsigned findFirstNonFull(uint64_t Hash) const {
+    unsigned Mask = NumBuckets - 1;
+    unsigned Pos = getH1(Hash) & Mask;
+    for (unsigned Step = 0;;) {
+      if (auto M = Group(Ctrl + Pos).matchEmptyOrDeleted())
+        return (Pos + M.lowest()) & Mask;
+      Step += Group::Width;
+      assert(Step <= NumBuckets && "no empty bucket in the map!");
+      Pos = (Pos + Step) & Mask;
+    }
+  }
+
+  template <typename KeyArg, typename... ValueArgs>
+  value_type *insertIntoBucket(uint64_t Hash, KeyArg &&Key,
+                               ValueArgs &&... Values) {
+    incrementEpoch();
+    unsigned I = NumBuckets ? findFirstNonFull(Hash) : 0;
+    if (LLVM_UNLIKELY(GrowthLeft == 0 &&
+                      (NumBuckets == 0 || Ctrl[I] == detail::SwissEmpty))) {
+      rehashForInsert();
+      I = findFirstNonFull(Hash);
+    }
+    GrowthLeft -= Ctrl[I] == detail::SwissEmpty;
+    setCtrl(I, getH2(Hash));
+    ++NumEntries;
+
+    value_type *B = Buckets + I;
+    ::new (&B->getFirst()) KeyT(std::forward<KeyArg>(Key));
+    ::new (&B->getSecond()) ValueT(std::forward<ValueArgs>(Values)...);
+    return B;
+  }
+
+  /// Make room for an insertion into an empty bucket. When most of the used
+  /// buckets are deleted, rehashing at the same size is enough to get rid of
+  /// them, otherwise the table doubles.
+  void rehashForInsert() {
+    if (NumBuckets && NumEntries * 2 < getMaxLoad(NumBuckets))
+      rehash(NumBuckets);
+    else
+      rehash(std::max<unsigned>(Group::Width, NumBuckets * 2));
+  }
+
+  void rehash(unsigned NewNumBuckets) {
+    value_type *OldBuckets = Buckets;
+    int8_t *OldCtrl = Ctrl;
+    unsigned OldNumBuckets = NumBuckets;
+
+    allocateBuckets(NewNumBuckets);
+    GrowthLeft -= NumEntries;
+    for (unsigned I = 0; I != OldNumBuckets; ++I) {
+      if (OldCtrl[I] < 0)
+        continue;
+      value_type &OldB = OldBuckets[I];
+      uint64_t Hash = getHash(OldB.getFirst());
+      unsigned J = findFirstNonFull(Hash);
+      setCtrl(J, getH2(Hash));
+      ::new (&Buckets[J].getFirst()) KeyT(std::move(OldB.getFirst()));
+      ::new (&Buckets[J].getSecond()) ValueT(std::move(OldB.getSecond()));
+      OldB.getSecond().~ValueT();
+      OldB.getFirst().~KeyT();
+    }
+    operator delete(OldBuckets);
+  }
+
+  /// Destroy the entry of \p B. The bucket can become empty again when it has
+  /// never been part of a full group, since no probe sequence went past it,
+  /// otherwise it must be marked deleted so that lookups keep probing.
+  void eraseBucket(value_type *B) {
+    B->getSecond().~ValueT();
+    B->getFirst().~KeyT();
+
+    unsigned Mask = NumBuckets - 1;
+    unsigned I = B - Buckets;
+    auto EmptyAfter = Group(Ctrl + I).matchEmpty();
+    auto EmptyBefore = Group(Ctrl + ((I - Group::Width) & Mask)).matchEmpty();
+    bool WasNeverFull = EmptyBefore && EmptyAfter &&
+                        EmptyAfter.trailingZeros() +
+                                EmptyBefore.leadingZeros() <
+                            Group::Width;
+    setCtrl(I, WasNeverFull ? detail::SwissEmpty : detail::SwissDeleted);
+    GrowthLeft += WasNeverFull;
+    --NumEntries;
+  }
+
+  iterator makeIterator(value_type *B) {
+    if (!B)
+      return end();
+    return iterator(B, Ctrl + (B - Buckets), Buckets + NumBuckets, *this,
+                    true);
+  }
+  const_iterator makeConstIterator(const value_type *B) const {
+    if (!B)
+      return end();
+    return const_iterator(B, Ctrl + (B - Buckets), Buckets + NumBuckets, *this,
+                          true);
+  }
+};
+
+template <typename KeyT, typename ValueT, typename KeyInfoT, bool IsConst>
+class SwissMapIterator : DebugEpochBase::HandleBase {
+  friend class SwissMapIterator<KeyT, ValueT, KeyInfoT, true>;
+  friend class SwissMapIterator<KeyT, ValueT, KeyInfoT, false>;
+  friend class SwissMap<KeyT, ValueT, KeyInfoT>;
+
+  using ConstIterator = SwissMapIterator<KeyT, ValueT, KeyInfoT, true>;
+  using Bucket = detail::DenseMapPair<KeyT, ValueT>;
+
+public:
+  using difference_type = ptrdiff_t;
+  using value_type =
+      typename std::conditional<IsConst, const Bucket, Bucket>::type;
+  using pointer = value_type *;
+  using reference = value_type &;
+  using iterator_category = std::forward_iterator_tag;
+
+private:
+  pointer Ptr = nullptr;
+  /// The control byte of Ptr.
+  const int8_t *CtrlPtr = nullptr;
+  pointer End = nullptr;
+
+public:
+  SwissMapIterator() = default;
+
+  SwissMapIterator(pointer Pos, const int8_t *PosCtrl, pointer E,
+                   const DebugEpochBase &Epoch, bool NoAdvance = false)
+      : DebugEpochBase::HandleBase(&Epoch), Ptr(Pos), CtrlPtr(PosCtrl),
+        End(E) {
+    assert(isHandleInSync() && "invalid construction!");
+    if (!NoAdvance)
+      AdvancePastEmptyBuckets();
+  }
+
+  // Converting ctor from non-const iterators to const iterators. SFINAE'd out
+  // for const iterator destinations so it doesn't end up as a user defined copy
+  // constructor.
+  template <bool IsConstSrc,
+            typename = typename std::enable_if<!IsConstSrc && IsConst>::type>
+  SwissMapIterator(
+      const SwissMapIterator<KeyT, ValueT, KeyInfoT, IsConstSrc> &I)
+      : DebugEpochBase::HandleBase(I), Ptr(I.Ptr), CtrlPtr(I.CtrlPtr),
+        End(I.End) {}
+
+  reference operator*() const {
+    assert(isHandleInSync() && "invalid iterator access!");
+    return *Ptr;
+  }
+  pointer operator->() const {
+    assert(isHandleInSync() && "invalid iterator access!");
+    return Ptr;
+  }
+
+  bool operator==(const ConstIterator &RHS) const {
+    assert((!Ptr || isHandleInSync()) && "handle not in sync!");
+    assert((!RHS.Ptr || RHS.isHandleInSync()) && "handle not in sync!");
+    assert(getEpochAddress() == RHS.getEpochAddress() &&
+           "comparing incomparable iterators!");
+    return Ptr == RHS.Ptr;
+  }
+  bool operator!=(const ConstIterator &RHS) const {
+    assert((!Ptr || isHandleInSync()) && "handle not in sync!");
+    assert((!RHS.Ptr || RHS.isHandleInSync()) && "handle not in sync!");
+    assert(getEpochAddress() == RHS.getEpochAddress() &&
+           "comparing incomparable iterators!");
+    return Ptr != RHS.Ptr;
+  }
+
+  inline SwissMapIterator &operator++() { // Preincrement
+    assert(isHandleInSync() && "invalid iterator access!");
+    ++Ptr;
+    ++CtrlPtr;
+    AdvancePastEmptyBuckets();
+    return *this;
+  }
+  SwissMapIterator operator++(int) { // Postincrement
+    assert(isHandleInSync() && "invalid iterator access!");
+    SwissMapIterator tmp = *this; ++*this; return tmp;
+  }
+
+private:
+  void AdvancePastEmptyBuckets() {
+    assert(Ptr <= End);
+    while (Ptr != End && *CtrlPtr < 0) {
+      ++Ptr;
+      ++CtrlPtr;
+    }
+  }
+};
+
+template <typename KeyT, typename ValueT, typename KeyInfoT>
+inline size_t capacity_in_bytes(const SwissMap<KeyT, ValueT, KeyInfoT> &X) {
+  return X.getMemorySize();
+}
+
+} // end namespace llvm
+
+#endif // LLVM_ADT_SWISSMAP_H
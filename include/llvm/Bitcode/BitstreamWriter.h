@@ -96,6 +96,25 @@ public:
   /// \brief Retrieve the number of bits currently used to encode an abbrev ID.
   unsigned GetAbbrevIDWidth() const { return CurCodeSize; }
 
+  /// Set up this stream, which must be empty, to write blocks that can be
+  /// spliced into the block \p Other is currently in with AppendWords: use the
+  /// same abbrev ID width and BLOCKINFO abbreviations as \p Other.
+  void ShareBlockInfo(const BitstreamWriter &Other) {
+    assert(GetCurrentBitNo() == 0 && BlockScope.empty() &&
+           "Stream already written to");
+    CurCodeSize = Other.CurCodeSize;
+    BlockInfoRecords = Other.BlockInfoRecords;
+  }
+
+  /// Append \p Words, which must hold whole blocks written by a stream set up
+  /// with ShareBlockInfo, at the current position, which must be 32-bit
+  /// aligned.
+  void AppendWords(ArrayRef<char> Words) {
+    assert(CurBit == 0 && "Not 32-bit aligned");
+    assert((Words.size() & 3) == 0 && "Not a whole number of words");
+    Out.append(Words.begin(), Words.end());
+  }
+
   //===--------------------------------------------------------------------===//
   // Basic Primitives for emitting bits to the stream.
   //===--------------------------------------------------------------------===//
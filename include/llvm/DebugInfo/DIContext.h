@@ -179,7 +179,8 @@ class DIContext {
 public:
   enum DIContextKind {
     CK_DWARF,
-    CK_PDB
+    CK_PDB,
+    CK_LineIndex
   };
 
   DIContext(DIContextKind K) : Kind(K) {}
@@ -11,6 +11,7 @@
 #define LLVM_DEBUGINFO_DWARFDEBUGARANGES_H
 
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/DataExtractor.h"
 #include <cstdint>
 #include <vector>
@@ -24,6 +25,11 @@ public:
   void generate(DWARFContext *CTX);
   uint32_t findAddress(uint64_t Address) const;
 
+  /// Calls \p Callback with the [LowPC, HighPC) bounds of every address range
+  /// mapped to a compile unit.
+  void forEachRange(
+      function_ref<void(uint64_t LowPC, uint64_t HighPC)> Callback) const;
+
 private:
   void clear();
   void extract(DataExtractor DebugArangesData);
@@ -10,12 +10,15 @@
 #ifndef LLVM_DEBUGINFO_DWARF_DWARFVERIFIER_H
 #define LLVM_DEBUGINFO_DWARF_DWARFVERIFIER_H
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFDebugLine.h"
 #include "llvm/DebugInfo/DWARF/DWARFDebugRangeList.h"
 #include "llvm/DebugInfo/DWARF/DWARFDie.h"
 
 #include <cstdint>
 #include <map>
+#include <mutex>
 #include <set>
 
 namespace llvm {
@@ -95,11 +98,29 @@ private:
   /// lies between to valid DIEs.
   std::map<uint64_t, std::set<uint32_t>> ReferenceToDIEOffsets;
   uint32_t NumDebugLineErrors = 0;
+  /// Serializes DIE dumps when units are verified in parallel, as dumping a
+  /// DIE may parse units and line tables through the shared DWARFContext.
+  std::mutex *DumpMutex = nullptr;
 
   raw_ostream &error() const;
   raw_ostream &warn() const;
   raw_ostream &note() const;
 
+  /// Dumps \p Die to the output stream.
+  void dump(const DWARFDie &Die, DIDumpOptions Opts) const;
+
+  /// Returns true if units and line tables should be verified in parallel.
+  /// Their output is buffered, which loses colors, so terminals are served
+  /// sequentially.
+  bool shouldVerifyInParallel() const;
+
+  /// Calls \p Verify for each index in [0, \p Count) with a fresh verifier.
+  /// When verifying in parallel, each verifier writes to its own buffer and
+  /// the buffers are emitted in index order, so that the output does not
+  /// depend on scheduling.
+  void forEachBuffered(size_t Count,
+                       function_ref<void(size_t, DWARFVerifier &)> Verify);
+
   /// Verifies the abbreviations section.
   ///
   /// This function currently checks that:
@@ -205,12 +226,16 @@ private:
   /// compile units that have the same DW_AT_stmt_list value.
   void verifyDebugLineStmtOffsets();
 
-  /// Verify that all of the rows in the line table are valid.
+  /// Verify that all of the rows in the line tables are valid.
+  void verifyDebugLineRows();
+
+  /// Verify that all of the rows in the line table of a unit are valid.
   ///
   /// This function currently checks for:
   /// - addresses within a sequence that decrease in value
   /// - invalid file indexes
-  void verifyDebugLineRows();
+  void verifyLineTableRows(DWARFUnit &CU,
+                           const DWARFDebugLine::LineTable &LineTable);
 
   /// Verify that an Apple-style accelerator table is valid.
   ///
@@ -22,6 +22,7 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -33,6 +34,11 @@ using namespace object;
 
 using FunctionNameKind = DILineInfoSpecifier::FunctionNameKind;
 
+/// Symbolizes addresses in object files, caching the parsed objects and debug
+/// info across queries. The symbolize* methods may be called concurrently
+/// from several threads; queries against different modules run in parallel,
+/// while queries against the same module are serialized. flush() must not be
+/// called while other threads are symbolizing.
 class LLVMSymbolizer {
 public:
   struct Options {
@@ -42,6 +48,9 @@ public:
     bool RelativeAddresses : 1;
     std::string DefaultArch;
     std::vector<std::string> DsymHints;
+    /// Directory holding the on-disk address-to-line index cache. Empty
+    /// disables the cache.
+    std::string CacheDir;
 
     Options(FunctionNameKind PrintFunctions = FunctionNameKind::LinkageName,
             bool UseSymbolTable = true, bool Demangle = true,
@@ -76,12 +85,25 @@ private:
   // corresponding debug info. These objects can be the same.
   using ObjectPair = std::pair<ObjectFile *, ObjectFile *>;
 
+  /// Loads the debug info of a module. Called once per module, outside of
+  /// the cache lock.
+  Expected<std::unique_ptr<SymbolizableModule>>
+  createModuleInfo(const std::string &ModuleName, StringRef DWPName);
+
+  /// Creates the DWARF debug info context for \p Obj, or loads its line index
+  /// from the cache directory instead if one was saved for this exact file.
+  std::unique_ptr<DIContext> createDWARFContext(const ObjectFile &Obj,
+                                                const std::string &ArchName,
+                                                StringRef DWPName);
+
   /// Returns a SymbolizableModule or an error if loading debug info failed.
   /// Only one attempt is made to load a module, and errors during loading are
   /// only reported once. Subsequent calls to get module info for a module that
-  /// failed to load will return nullptr.
+  /// failed to load will return nullptr. On success, if a module is returned,
+  /// \p ModuleLock holds the lock serializing queries against it.
   Expected<SymbolizableModule *>
-  getOrCreateModuleInfo(const std::string &ModuleName, StringRef DWPName = "");
+  getAndLockModuleInfo(const std::string &ModuleName, StringRef DWPName,
+                       std::unique_lock<std::mutex> &ModuleLock);
 
   ObjectFile *lookUpDsymFile(const std::string &Path,
                              const MachOObjectFile *ExeObj,
@@ -100,7 +122,20 @@ private:
   Expected<ObjectFile *> getOrCreateObject(const std::string &Path,
                                           const std::string &ArchName);
 
-  std::map<std::string, std::unique_ptr<SymbolizableModule>> Modules;
+  struct ModuleEntry {
+    /// \brief Set once Module has been created, or failed to load.
+    std::once_flag Created;
+    std::unique_ptr<SymbolizableModule> Module;
+    /// \brief Serializes queries against Module, as the debug info contexts
+    /// parse lazily and are not thread-safe.
+    std::mutex QueryMutex;
+  };
+
+  /// \brief Guards all of the caches below. Modules is only guarded for
+  /// lookups and insertions, each entry is filled in by its own once-flag.
+  std::mutex Mutex;
+
+  std::map<std::string, ModuleEntry> Modules;
 
   /// \brief Contains cached results of getOrCreateObjectPair().
   std::map<std::pair<std::string, std::string>, ObjectPair>
@@ -221,6 +221,9 @@ public:
   }
 
   /// @brief Add a module to the compile-on-demand layer.
+  ///
+  ///   The module may be lazily loaded (e.g. by getOwningLazyModule): function
+  /// bodies are only materialized when their partition is first called.
   Expected<ModuleHandleT>
   addModule(std::shared_ptr<Module> M,
             std::shared_ptr<JITSymbolResolver> Resolver) {
@@ -305,6 +308,11 @@ private:
 
   Error addLogicalModule(LogicalDylib &LD, std::shared_ptr<Module> SrcMPtr) {
 
+    // Load the module-level metadata (e.g. module flags) if the module is
+    // lazily loaded. Function bodies are left alone until they are needed.
+    if (auto Err = SrcMPtr->materializeMetadata())
+      return Err;
+
     // Rename all static functions / globals to $static.X :
     // This will unique the names across all modules in the logical dylib,
     // simplifying symbol lookup.
@@ -499,6 +507,11 @@ private:
     // Grab the name of the function being called here.
     std::string CalledFnName = mangle(F.getName(), SrcM.getDataLayout());
 
+    // Load the body of F if it has not been loaded yet, so that the
+    // partitioning functor can inspect it.
+    if (auto Err = F.materialize())
+      return std::move(Err);
+
     JITTargetAddress CalledAddr = 0;
     auto Part = Partition(F);
     if (auto PartHOrErr = emitPartition(LD, LMId, Part)) {
@@ -588,6 +601,11 @@ private:
       return nullptr;
     });
 
+    // Load the bodies of the functions in the partition, if needed.
+    for (auto *F : Part)
+      if (auto Err = F->materialize())
+        return std::move(Err);
+
     // Create decls in the new module.
     for (auto *F : Part)
       cloneFunctionDecl(*M, *F, &VMap);
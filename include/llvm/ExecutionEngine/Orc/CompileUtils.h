@@ -26,6 +26,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include <algorithm>
+#include <functional>
 #include <memory>
 
 namespace llvm {
@@ -106,6 +107,37 @@ private:
   ObjectCache *ObjCache = nullptr;
 };
 
+/// @brief Thread-safe compile functor: Takes a single IR module and returns an
+///        ObjectFile.
+///
+///   A TargetMachine cannot be used by several threads at once, so this
+/// functor creates a fresh TargetMachine for each module it compiles. Modules
+/// compiled concurrently must belong to different LLVMContexts.
+class ConcurrentIRCompiler {
+public:
+
+  using CompileResult = SimpleCompiler::CompileResult;
+
+  /// @brief Functor creating the TargetMachine used for a compile.
+  using TargetMachineBuilder = std::function<std::unique_ptr<TargetMachine>()>;
+
+  /// @brief Construct a concurrent compile functor. The object cache, if any,
+  ///        must be thread-safe.
+  ConcurrentIRCompiler(TargetMachineBuilder CreateTM,
+                       ObjectCache *ObjCache = nullptr)
+    : CreateTM(std::move(CreateTM)), ObjCache(ObjCache) {}
+
+  /// @brief Compile a Module to an ObjectFile.
+  CompileResult operator()(Module &M) {
+    std::unique_ptr<TargetMachine> TM = CreateTM();
+    return SimpleCompiler(*TM, ObjCache)(M);
+  }
+
+private:
+  TargetMachineBuilder CreateTM;
+  ObjectCache *ObjCache = nullptr;
+};
+
 } // end namespace orc
 
 } // end namespace llvm
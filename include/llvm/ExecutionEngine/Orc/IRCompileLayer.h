@@ -31,6 +31,9 @@ namespace orc {
 ///   This layer immediately compiles each IR module added via addModule to an
 /// object file and adds this module file to the layer below, which must
 /// implement the object layer concept.
+///
+///   Modules can be added from several threads if both the compile functor
+/// (e.g. ConcurrentIRCompiler) and the base layer are thread-safe.
 template <typename BaseLayerT, typename CompileFtor>
 class IRCompileLayer {
 public:
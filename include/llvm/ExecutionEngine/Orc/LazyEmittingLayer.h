@@ -18,6 +18,7 @@
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/OrcError.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Module.h"
@@ -25,9 +26,13 @@
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cassert>
+#include <condition_variable>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace llvm {
 namespace orc {
@@ -38,19 +43,36 @@ namespace orc {
 /// immediately emit them the layer below. Instead, emissing to the base layer
 /// is deferred until the first time the client requests the address (via
 /// JITSymbol::getAddress) for a symbol contained in this layer.
+///
+///   Symbols may be looked up and materialized from several threads. Each
+/// module is emitted once: threads requesting a symbol in a module that is
+/// being emitted wait for that emission, while different modules can be
+/// emitted concurrently (provided the base layer supports it, and the modules
+/// live in different LLVMContexts).
 template <typename BaseLayerT> class LazyEmittingLayer {
 public:
 
   using BaseLayerHandleT = typename BaseLayerT::ModuleHandleT;
 
 private:
-  class EmissionDeferredModule {
+  class EmissionDeferredModule
+      : public std::enable_shared_from_this<EmissionDeferredModule> {
   public:
     EmissionDeferredModule(std::shared_ptr<Module> M,
                            std::shared_ptr<JITSymbolResolver> Resolver)
       : M(std::move(M)), Resolver(std::move(Resolver)) {}
 
     JITSymbol find(StringRef Name, bool ExportedSymbolsOnly, BaseLayerT &B) {
+      std::unique_lock<std::mutex> Lock(EmitMutex);
+      // Only wait for another thread to emit this module if it defines Name.
+      if (EmitState == Emitting &&
+          EmittingThread != std::this_thread::get_id()) {
+        auto SI = EmittingSymbols->find(Name);
+        if (SI == EmittingSymbols->end() ||
+            (ExportedSymbolsOnly && !SI->second))
+          return nullptr;
+        waitForEmission(Lock);
+      }
       switch (EmitState) {
       case NotEmitted:
         if (auto GV = searchGVs(Name, ExportedSymbolsOnly)) {
@@ -59,35 +81,46 @@ private:
           // FIXME: Use capture-init when we move to C++14.
           std::string PName = Name;
           JITSymbolFlags Flags = JITSymbolFlags::fromGlobalValue(*GV);
-          auto GetAddress =
-            [this, ExportedSymbolsOnly, PName, &B]() -> Expected<JITTargetAddress> {
-              if (this->EmitState == Emitting)
-                return 0;
-              else if (this->EmitState == NotEmitted) {
-                this->EmitState = Emitting;
-                if (auto HandleOrErr = this->emitToBaseLayer(B))
-                  Handle = std::move(*HandleOrErr);
-                else
-                  return HandleOrErr.takeError();
-                this->EmitState = Emitted;
-              }
-              if (auto Sym = B.findSymbolIn(Handle, PName, ExportedSymbolsOnly))
-                return Sym.getAddress();
-              else if (auto Err = Sym.takeError())
+          // The symbol keeps this module alive if it is removed from the
+          // layer in the meantime.
+          auto Self = this->shared_from_this();
+          auto GetAddress = [Self, ExportedSymbolsOnly, PName,
+                             &B]() -> Expected<JITTargetAddress> {
+            std::unique_lock<std::mutex> Lock(Self->EmitMutex);
+            Self->waitForEmission(Lock);
+            if (Self->EmitState == Emitting || Self->EmitState == EmitFailed)
+              return 0;
+            if (Self->EmitState == Removed)
+              return make_error<JITSymbolNotFound>(PName);
+            if (Self->EmitState == NotEmitted)
+              if (auto Err = Self->emit(B, Lock))
                 return std::move(Err);
-              else
-                llvm_unreachable("Successful symbol lookup should return "
-                                 "definition address here");
+            // Look the symbol up before another thread can remove the
+            // module, but materialize it without the lock.
+            auto Sym =
+                B.findSymbolIn(Self->Handle, PName, ExportedSymbolsOnly);
+            Lock.unlock();
+            if (Sym)
+              return Sym.getAddress();
+            else if (auto Err = Sym.takeError())
+              return std::move(Err);
+            else
+              llvm_unreachable("Successful symbol lookup should return "
+                               "definition address here");
           };
           return JITSymbol(std::move(GetAddress), Flags);
         } else
           return nullptr;
       case Emitting:
+      case EmitFailed:
         // Calling "emit" can trigger a recursive call to 'find' (e.g. to check
         // for pre-existing definitions of common-symbol), but any symbol in
         // this module would already have been found internally (in the
         // RuntimeDyld that did the lookup), so just return a nullptr here.
         return nullptr;
+      case Removed:
+        // Another thread removed the module after finding it in the list.
+        return nullptr;
       case Emitted:
         return B.findSymbolIn(Handle, Name, ExportedSymbolsOnly);
       }
@@ -95,19 +128,24 @@ private:
     }
 
     Error removeModuleFromBaseLayer(BaseLayerT& BaseLayer) {
-      return EmitState != NotEmitted ? BaseLayer.removeModule(Handle)
-                                     : Error::success();
+      std::unique_lock<std::mutex> Lock(EmitMutex);
+      waitForEmission(Lock);
+      bool WasEmitted = EmitState == Emitted;
+      EmitState = Removed;
+      return WasEmitted ? BaseLayer.removeModule(Handle) : Error::success();
     }
 
-    void emitAndFinalize(BaseLayerT &BaseLayer) {
-      assert(EmitState != Emitting &&
-             "Cannot emitAndFinalize while already emitting");
-      if (EmitState == NotEmitted) {
-        EmitState = Emitting;
-        Handle = emitToBaseLayer(BaseLayer);
-        EmitState = Emitted;
+    Error emitAndFinalize(BaseLayerT &BaseLayer) {
+      {
+        std::unique_lock<std::mutex> Lock(EmitMutex);
+        waitForEmission(Lock);
+        assert(EmitState != Emitting &&
+               "Cannot emitAndFinalize while already emitting");
+        if (EmitState == NotEmitted)
+          if (auto Err = emit(BaseLayer, Lock))
+            return Err;
       }
-      BaseLayer.emitAndFinalize(Handle);
+      return BaseLayer.emitAndFinalize(Handle);
     }
 
   private:
@@ -135,6 +173,44 @@ private:
       return buildMangledSymbols(Name, ExportedSymbolsOnly);
     }
 
+    // Wait until no other thread is emitting this module. If this thread is
+    // emitting it, the state is left as Emitting.
+    void waitForEmission(std::unique_lock<std::mutex> &Lock) {
+      EmitCV.wait(Lock, [this]() {
+        return EmitState != Emitting ||
+               EmittingThread == std::this_thread::get_id();
+      });
+    }
+
+    // Emit the module to the base layer. The lock is released while emitting,
+    // so that the base layer can look up symbols (and emit other modules) in
+    // the meantime.
+    Error emit(BaseLayerT &BaseLayer, std::unique_lock<std::mutex> &Lock) {
+      assert(EmitState == NotEmitted && "Module already emitted");
+      // The module belongs to the base layer once emission starts, so record
+      // the symbols it defines for the lookups made in the meantime.
+      if (!MangledSymbols)
+        buildMangledSymbols("", false);
+      EmittingSymbols = llvm::make_unique<StringMap<bool>>();
+      for (const auto &S : *MangledSymbols)
+        (*EmittingSymbols)[S.first()] = S.second->hasDefaultVisibility();
+      EmitState = Emitting;
+      EmittingThread = std::this_thread::get_id();
+      Lock.unlock();
+      auto HandleOrErr = emitToBaseLayer(BaseLayer);
+      Lock.lock();
+      EmittingThread = std::thread::id();
+      EmittingSymbols.reset();
+      EmitCV.notify_all();
+      if (!HandleOrErr) {
+        EmitState = EmitFailed;
+        return HandleOrErr.takeError();
+      }
+      Handle = std::move(*HandleOrErr);
+      EmitState = Emitted;
+      return Error::success();
+    }
+
     Expected<BaseLayerHandleT> emitToBaseLayer(BaseLayerT &BaseLayer) {
       // We don't need the mangled names set any more: Once we've emitted this
       // to the base layer we'll just look for symbols there.
@@ -191,17 +267,30 @@ private:
       return nullptr;
     }
 
-    enum { NotEmitted, Emitting, Emitted } EmitState = NotEmitted;
+    enum {
+      NotEmitted,
+      Emitting,
+      Emitted,
+      EmitFailed,
+      Removed
+    } EmitState = NotEmitted;
+    std::mutex EmitMutex;
+    std::condition_variable EmitCV;
+    std::thread::id EmittingThread;
     BaseLayerHandleT Handle;
     std::shared_ptr<Module> M;
     std::shared_ptr<JITSymbolResolver> Resolver;
     mutable std::unique_ptr<StringMap<const GlobalValue*>> MangledSymbols;
+    // While the module is being emitted, whether each of its symbols is
+    // exported.
+    std::unique_ptr<StringMap<bool>> EmittingSymbols;
   };
 
-  using ModuleListT = std::list<std::unique_ptr<EmissionDeferredModule>>;
+  using ModuleListT = std::list<std::shared_ptr<EmissionDeferredModule>>;
 
   BaseLayerT &BaseLayer;
   ModuleListT ModuleList;
+  std::mutex ModuleListMutex;
 
 public:
 
@@ -215,10 +304,11 @@ public:
   Expected<ModuleHandleT>
   addModule(std::shared_ptr<Module> M,
             std::shared_ptr<JITSymbolResolver> Resolver) {
+    std::lock_guard<std::mutex> Lock(ModuleListMutex);
     return ModuleList.insert(
         ModuleList.end(),
-        llvm::make_unique<EmissionDeferredModule>(std::move(M),
-                                                  std::move(Resolver)));
+        std::make_shared<EmissionDeferredModule>(std::move(M),
+                                                 std::move(Resolver)));
   }
 
   /// @brief Remove the module represented by the given handle.
@@ -227,6 +317,7 @@ public:
   /// in this layer, and the base layer.
   Error removeModule(ModuleHandleT H) {
     Error Err = (*H)->removeModuleFromBaseLayer(BaseLayer);
+    std::lock_guard<std::mutex> Lock(ModuleListMutex);
     ModuleList.erase(H);
     return Err;
   }
@@ -243,7 +334,15 @@ public:
     // If not found then search the deferred modules. If any of these contain a
     // definition of 'Name' then they will return a JITSymbol that will emit
     // the corresponding module when the symbol address is requested.
-    for (auto &DeferredMod : ModuleList)
+    // Searching a module may wait for another thread to emit it, so search a
+    // snapshot of the list rather than holding the lock. The snapshot keeps
+    // the modules alive if they are removed in the meantime.
+    std::vector<std::shared_ptr<EmissionDeferredModule>> DeferredMods;
+    {
+      std::lock_guard<std::mutex> Lock(ModuleListMutex);
+      DeferredMods.assign(ModuleList.begin(), ModuleList.end());
+    }
+    for (auto &DeferredMod : DeferredMods)
       if (auto Symbol = DeferredMod->find(Name, ExportedSymbolsOnly, BaseLayer))
         return Symbol;
 
@@ -22,11 +22,14 @@
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Error.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <functional>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -64,20 +67,35 @@ protected:
                                    JITTargetAddress TargetAddr) const = 0;
 
     JITSymbol getSymbol(StringRef Name, bool ExportedSymbolsOnly) {
-      auto SymEntry = SymbolTable.find(Name);
-      if (SymEntry == SymbolTable.end())
+      auto FlagsEntry = SymbolFlags.find(Name);
+      if (FlagsEntry == SymbolFlags.end())
         return nullptr;
-      if (!SymEntry->second.getFlags().isExported() && ExportedSymbolsOnly)
+      // The resolved symbols are written by the thread finalizing this object,
+      // which holds the FinalizeMutex and sees them as they are resolved.
+      // Everyone else may only read them once Finalized is set.
+      if (!Finalized.load(std::memory_order_acquire) &&
+          FinalizingThread != std::this_thread::get_id()) {
+        JITSymbolFlags Flags = FlagsEntry->second;
+        if (!Flags.isExported() && ExportedSymbolsOnly)
+          return nullptr;
+        return JITSymbol(getSymbolMaterializer(Name), Flags);
+      }
+      // Use the flags RuntimeDyld settled on, e.g. a weak definition it kept
+      // is strong from then on, so that other objects use it.
+      const JITEvaluatedSymbol &Sym = ResolvedSymbols.find(Name)->second;
+      if (!Sym.getFlags().isExported() && ExportedSymbolsOnly)
         return nullptr;
-      if (!Finalized)
-        return JITSymbol(getSymbolMaterializer(Name),
-                         SymEntry->second.getFlags());
-      return JITSymbol(SymEntry->second);
+      return JITSymbol(Sym);
     }
 
   protected:
-    StringMap<JITEvaluatedSymbol> SymbolTable;
-    bool Finalized = false;
+    /// The flags of the symbols defined by this object. Built on construction
+    /// and never written afterwards, so it can be read without a lock.
+    StringMap<JITSymbolFlags> SymbolFlags;
+    /// The symbols as resolved by RuntimeDyld, filled in during finalization.
+    StringMap<JITEvaluatedSymbol> ResolvedSymbols;
+    std::atomic<bool> Finalized{false};
+    std::atomic<std::thread::id> FinalizingThread{std::thread::id()};
   };
 
   using LinkedObjectListT = std::list<std::unique_ptr<LinkedObject>>;
@@ -93,6 +111,11 @@ public:
 /// object files to be loaded into memory, linked, and the addresses of their
 /// symbols queried. All objects added to this layer can see each other's
 /// symbols.
+///
+///   Objects may be added and symbols looked up and materialized from several
+/// threads. Finalization is serialized across the layer: a thread that asks
+/// for the address of a symbol in an object being finalized by another thread
+/// waits for that finalization to complete.
 class RTDyldObjectLinkingLayer : public RTDyldObjectLinkingLayerBase {
 public:
 
@@ -116,8 +139,9 @@ private:
     ConcreteLinkedObject(ObjectPtr Obj, MemoryManagerPtrT MemMgr,
                          SymbolResolverPtrT Resolver,
                          FinalizerFtor Finalizer,
-                         bool ProcessAllSections)
-      : MemMgr(std::move(MemMgr)),
+                         bool ProcessAllSections,
+                         std::recursive_mutex &FinalizeMutex)
+      : MemMgr(std::move(MemMgr)), FinalizeMutex(FinalizeMutex),
         PFC(llvm::make_unique<PreFinalizeContents>(std::move(Obj),
                                                    std::move(Resolver),
                                                    std::move(Finalizer),
@@ -134,13 +158,22 @@ private:
     }
 
     void finalize() override {
-      assert(PFC && "mapSectionAddress called on finalized LinkedObject");
+      std::lock_guard<std::recursive_mutex> Lock(FinalizeMutex);
+
+      // Another thread may have finalized this object while we were waiting
+      // for the lock, or this thread may be finalizing it already (resolving
+      // its symbols can recursively look up symbols in this object).
+      if (this->Finalized ||
+          this->FinalizingThread == std::this_thread::get_id())
+        return;
+
+      assert(PFC && "finalize called on finalized LinkedObject");
 
       RuntimeDyld RTDyld(*MemMgr, *PFC->Resolver);
       RTDyld.setProcessAllSections(PFC->ProcessAllSections);
       PFC->RTDyld = &RTDyld;
 
-      this->Finalized = true;
+      this->FinalizingThread = std::this_thread::get_id();
       PFC->Finalizer(PFC->Handle, RTDyld, std::move(PFC->Obj),
                      [&]() {
                        this->updateSymbolTable(RTDyld);
@@ -148,6 +181,8 @@ private:
 
       // Release resources.
       PFC = nullptr;
+      this->Finalized.store(true, std::memory_order_release);
+      this->FinalizingThread = std::thread::id();
     }
 
     JITSymbol::GetAddressFtor getSymbolMaterializer(std::string Name) override {
@@ -155,7 +190,7 @@ private:
         [this, Name]() {
           // The symbol may be materialized between the creation of this lambda
           // and its execution, so we need to double check.
-          if (!this->Finalized)
+          if (!this->Finalized.load(std::memory_order_acquire))
             this->finalize();
           return this->getSymbol(Name, false).getAddress();
         };
@@ -181,13 +216,14 @@ private:
           continue;
         }
         auto Flags = JITSymbolFlags::fromObjectSymbol(Symbol);
-        SymbolTable.insert(
-          std::make_pair(*SymbolName, JITEvaluatedSymbol(0, Flags)));
+        SymbolFlags.insert(std::make_pair(*SymbolName, Flags));
+        ResolvedSymbols.insert(
+            std::make_pair(*SymbolName, JITEvaluatedSymbol(0, Flags)));
       }
     }
 
     void updateSymbolTable(const RuntimeDyld &RTDyld) {
-      for (auto &SymEntry : SymbolTable)
+      for (auto &SymEntry : ResolvedSymbols)
         SymEntry.second = RTDyld.getSymbol(SymEntry.first());
     }
 
@@ -209,6 +245,7 @@ private:
     };
 
     MemoryManagerPtrT MemMgr;
+    std::recursive_mutex &FinalizeMutex;
     std::unique_ptr<PreFinalizeContents> PFC;
   };
 
@@ -219,12 +256,13 @@ private:
   createLinkedObject(ObjectPtr Obj, MemoryManagerPtrT MemMgr,
                      SymbolResolverPtrT Resolver,
                      FinalizerFtor Finalizer,
-                     bool ProcessAllSections) {
+                     bool ProcessAllSections,
+                     std::recursive_mutex &FinalizeMutex) {
     using LOS = ConcreteLinkedObject<MemoryManagerPtrT, SymbolResolverPtrT,
                                      FinalizerFtor>;
     return llvm::make_unique<LOS>(std::move(Obj), std::move(MemMgr),
                                   std::move(Resolver), std::move(Finalizer),
-                                  ProcessAllSections);
+                                  ProcessAllSections, FinalizeMutex);
   }
 
 public:
@@ -280,11 +318,12 @@ public:
     auto LO =
       createLinkedObject(std::move(Obj), GetMemMgr(),
                          std::move(Resolver), std::move(Finalizer),
-                         ProcessAllSections);
+                         ProcessAllSections, FinalizeMutex);
     // LOS is an owning-ptr. Keep a non-owning one so that we can set the handle
     // below.
     auto *LOPtr = LO.get();
 
+    std::lock_guard<std::mutex> Lock(LinkedObjListMutex);
     ObjHandleT Handle = LinkedObjList.insert(LinkedObjList.end(), std::move(LO));
     LOPtr->setHandle(Handle);
 
@@ -301,6 +340,7 @@ public:
   /// layer.
   Error removeObject(ObjHandleT H) {
     // How do we invalidate the symbols in H?
+    std::lock_guard<std::mutex> Lock(LinkedObjListMutex);
     LinkedObjList.erase(H);
     return Error::success();
   }
@@ -310,6 +350,7 @@ public:
   /// @param ExportedSymbolsOnly If true, search only for exported symbols.
   /// @return A handle for the given named symbol, if it exists.
   JITSymbol findSymbol(StringRef Name, bool ExportedSymbolsOnly) {
+    std::lock_guard<std::mutex> Lock(LinkedObjListMutex);
     for (auto I = LinkedObjList.begin(), E = LinkedObjList.end(); I != E;
          ++I)
       if (auto Symbol = findSymbolIn(I, Name, ExportedSymbolsOnly))
@@ -347,6 +388,8 @@ public:
 private:
 
   LinkedObjectListT LinkedObjList;
+  std::mutex LinkedObjListMutex;
+  std::recursive_mutex FinalizeMutex;
   MemoryManagerGetter GetMemMgr;
   NotifyLoadedFtor NotifyLoaded;
   NotifyFinalizedFtor NotifyFinalized;
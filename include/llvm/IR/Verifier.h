@@ -99,6 +99,15 @@ bool verifyFunction(const Function &F, raw_ostream *OS = nullptr);
 bool verifyModule(const Module &M, raw_ostream *OS = nullptr,
                   bool *BrokenDebugInfo = nullptr);
 
+/// \brief Check a module for errors like verifyModule above, verifying the
+/// bodies of its functions concurrently on \p Threads threads. The
+/// module-level checks are still done serially.
+///
+/// The diagnostics are the same as those of the serial verifier: if a function
+/// is broken, the module is verified again serially to print them.
+bool verifyModule(const Module &M, raw_ostream *OS, bool *BrokenDebugInfo,
+                  unsigned Threads);
+
 FunctionPass *createVerifierPass(bool FatalErrors = true);
 
 /// Check a module for errors, and report separate error states for IR
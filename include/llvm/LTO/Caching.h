@@ -7,15 +7,17 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file defines the localCache function, which allows clients to add a
-// filesystem cache to ThinLTO.
+// This file defines the localCache and localCodeGenCache functions, which allow
+// clients to add a filesystem cache to ThinLTO.
 //
 //===----------------------------------------------------------------------===//
 
 #ifndef LLVM_LTO_CACHING_H
 #define LLVM_LTO_CACHING_H
 
+#include "llvm/ADT/Optional.h"
 #include "llvm/LTO/LTO.h"
+#include "llvm/Support/CachePruning.h"
 #include <string>
 
 namespace llvm {
@@ -36,8 +38,27 @@ typedef std::function<void(unsigned Task, std::unique_ptr<MemoryBuffer> MB,
 /// Create a local file system cache which uses the given cache directory and
 /// file callback. This function also creates the cache directory if it does not
 /// already exist.
-Expected<NativeObjectCache> localCache(StringRef CacheDirectoryPath,
-                                       AddBufferFn AddBuffer);
+///
+/// Concurrent misses on the same key, from this or other processes, are
+/// serialized with a lock file so that only one of them computes the entry.
+///
+/// If \p Policy is provided, the entries are tracked in a CacheIndex shared by
+/// every process using the directory, and the cache is pruned incrementally
+/// according to the policy whenever an entry is added, without scanning the
+/// directory. If the index can't be opened, the cache is pruned once with
+/// pruneCache() instead, as it is when an entry can't be tracked. Entries only
+/// expire when something prunes them, so clients should still call
+/// pruneCache() once the link is done.
+Expected<NativeObjectCache>
+localCache(StringRef CacheDirectoryPath, AddBufferFn AddBuffer,
+           Optional<CachePruningPolicy> Policy = None);
+
+/// Create a local file system cache for the object files produced by the code
+/// generation of ThinLTO backends (see Config::CodeGenCacheDir). The entries
+/// are stored, locked and pruned as with localCache().
+Expected<CodeGenObjectCache>
+localCodeGenCache(StringRef CacheDirectoryPath,
+                  Optional<CachePruningPolicy> Policy = None);
 
 } // namespace lto
 } // namespace llvm
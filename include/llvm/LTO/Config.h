@@ -15,7 +15,9 @@
 #ifndef LLVM_LTO_CONFIG_H
 #define LLVM_LTO_CONFIG_H
 
+#include "llvm/ADT/Optional.h"
 #include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/Support/CachePruning.h"
 #include "llvm/Support/CodeGen.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
@@ -52,6 +54,20 @@ struct Config {
   /// Disable entirely the optimizer, including importing for ThinLTO
   bool CodeGenOnly = false;
 
+  /// If not empty, ThinLTO backends also cache their object files in this
+  /// directory under a key computed from the optimized module, so that code
+  /// generation is skipped when a change to an imported module does not affect
+  /// the optimized module. This is usually the directory of the cache passed
+  /// to LTO::run(), which opens this cache once for all the backends. The
+  /// PreCodeGenModuleHook is still called when the object file is a hit.
+  std::string CodeGenCacheDir;
+
+  /// The pruning policy of CodeGenCacheDir. As for the cache passed to
+  /// LTO::run(), see localCache(), the entries are tracked in the index of the
+  /// directory and pruned according to the policy if it is set. This is
+  /// usually the policy of the cache passed to LTO::run().
+  Optional<CachePruningPolicy> CodeGenCachePolicy;
+
   /// If this field is set, the set of passes run in the middle-end optimizer
   /// will be the one specified by the string. Only works with the new pass
   /// manager as the old one doesn't have this ability.
@@ -189,13 +189,23 @@ typedef std::function<std::unique_ptr<NativeObjectStream>(unsigned Task)>
 typedef std::function<AddStreamFn(unsigned Task, StringRef Key)>
     NativeObjectCache;
 
+/// This is the type of the cache of the object files produced by the code
+/// generation of ThinLTO backends (see Config::CodeGenCacheDir). It works like
+/// a NativeObjectCache, except that for hits the cached file is returned in
+/// \p Hit rather than added to the link: the backend still has to write it to
+/// its own output.
+typedef std::function<AddStreamFn(unsigned Task, StringRef Key,
+                                  std::unique_ptr<MemoryBuffer> &Hit)>
+    CodeGenObjectCache;
+
 /// A ThinBackend defines what happens after the thin-link phase during ThinLTO.
 /// The details of this type definition aren't important; clients can only
 /// create a ThinBackend using one of the create*ThinBackend() functions below.
 typedef std::function<std::unique_ptr<ThinBackendProc>(
     Config &C, ModuleSummaryIndex &CombinedIndex,
     StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
-    AddStreamFn AddStream, NativeObjectCache Cache)>
+    AddStreamFn AddStream, NativeObjectCache Cache,
+    CodeGenObjectCache CodeGenCache)>
     ThinBackend;
 
 /// This ThinBackend runs the individual backend jobs in-process.
@@ -40,12 +40,16 @@ Error backend(Config &C, AddStreamFn AddStream,
               unsigned ParallelCodeGenParallelismLevel,
               std::unique_ptr<Module> M, ModuleSummaryIndex &CombinedIndex);
 
-/// Runs a ThinLTO backend.
+/// Runs a ThinLTO backend. If \p CodeGenCache is set, the object file is
+/// looked up there using a key computed from the optimized module, and code
+/// generation is skipped on a hit. LTO::run() opens the cache of
+/// C.CodeGenCacheDir once for all its backends.
 Error thinBackend(Config &C, unsigned Task, AddStreamFn AddStream, Module &M,
                   const ModuleSummaryIndex &CombinedIndex,
                   const FunctionImporter::ImportMapTy &ImportList,
                   const GVSummaryMapTy &DefinedGlobals,
-                  MapVector<StringRef, BitcodeModule> &ModuleMap);
+                  MapVector<StringRef, BitcodeModule> &ModuleMap,
+                  CodeGenObjectCache CodeGenCache = nullptr);
 }
 }
 
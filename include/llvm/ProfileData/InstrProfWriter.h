@@ -23,11 +23,15 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace llvm {
 
 /// Writer for instrumentation based profile data.
+class InstrProfMergedSpill;
 class InstrProfRecordWriterTrait;
+class InstrProfSpillFile;
 class ProfOStream;
 class raw_fd_ostream;
 
@@ -42,6 +46,15 @@ private:
   ProfKind ProfileKind = PF_Unknown;
   // Use raw pointer here for the incomplete type object.
   InstrProfRecordWriterTrait *InfoObj;
+  // The maximum number of functions kept in FunctionData before they are
+  // spilled to a temporary file, or 0 if spilling is disabled.
+  size_t SpillThreshold = 0;
+  // Temporary files holding name-sorted records spilled from FunctionData,
+  // oldest first.
+  std::vector<std::unique_ptr<InstrProfSpillFile>> SpillFiles;
+  // Why records could not be spilled, if they couldn't. The error is returned
+  // when the profile is written.
+  std::string SpillFailure;
 
 public:
   InstrProfWriter(bool Sparse = false);
@@ -63,9 +76,20 @@ public:
   /// Write the profile to \c OS
   void write(raw_fd_ostream &OS);
 
+  /// Write the profile to \c OS. Conflicts found while merging records that
+  /// were spilled to disk are reported through \p Warn, along with the name of
+  /// the function.
+  Error write(raw_fd_ostream &OS, function_ref<void(Error, StringRef)> Warn);
+
   /// Write the profile in text format to \c OS
   Error writeText(raw_fd_ostream &OS);
 
+  /// Write the profile in text format to \c OS. Conflicts found while merging
+  /// records that were spilled to disk are reported through \p Warn, along
+  /// with the name of the function.
+  Error writeText(raw_fd_ostream &OS,
+                  function_ref<void(Error, StringRef)> Warn);
+
   /// Write \c Record in text format to \c OS
   static void writeRecordInText(StringRef Name, uint64_t Hash,
                                 const InstrProfRecord &Counters,
@@ -86,6 +110,14 @@ public:
                      instrprof_error::unsupported_version);
   }
 
+  /// Bound the memory used by the writer: once more than \p MaxFunctions
+  /// functions are held in memory, their records are sorted by name and
+  /// spilled to a temporary file. The spill files are merged back when the
+  /// profile is written, which produces the same output as keeping every
+  /// record in memory. A value of 0 disables spilling. If records can't be
+  /// spilled, they are kept in memory and writing the profile fails.
+  void setSpillThreshold(size_t MaxFunctions) { SpillThreshold = MaxFunctions; }
+
   // Internal interface for testing purpose only.
   void setValueProfDataEndianness(support::endianness Endianness);
   void setOutputSparse(bool Sparse);
@@ -94,7 +126,10 @@ private:
   void addRecord(StringRef Name, uint64_t Hash, InstrProfRecord &&I,
                  uint64_t Weight, function_ref<void(Error)> Warn);
   bool shouldEncodeData(const ProfilingData &PD);
-  void writeImpl(ProfOStream &OS);
+  Error spillFunctionData();
+  Error mergeSpillFiles(InstrProfMergedSpill &Merged,
+                        function_ref<void(Error, StringRef)> Warn);
+  Error writeImpl(ProfOStream &OS, function_ref<void(Error, StringRef)> Warn);
 };
 
 } // end namespace llvm
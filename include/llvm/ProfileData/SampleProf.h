@@ -24,6 +24,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MathExtras.h"
 #include <algorithm>
 #include <cstdint>
@@ -78,15 +79,42 @@ struct is_error_code_enum<llvm::sampleprof_error> : std::true_type {};
 namespace llvm {
 namespace sampleprof {
 
-static inline uint64_t SPMagic() {
+enum SampleProfileFormat {
+  SPF_None = 0,
+  SPF_Text = 0x1,
+  SPF_Compact_Binary = 0x2,
+  SPF_GCC = 0x3,
+  SPF_Binary = 0xff
+};
+
+static inline uint64_t SPMagic(SampleProfileFormat Format = SPF_Binary) {
   return uint64_t('S') << (64 - 8) | uint64_t('P') << (64 - 16) |
          uint64_t('R') << (64 - 24) | uint64_t('O') << (64 - 32) |
          uint64_t('F') << (64 - 40) | uint64_t('4') << (64 - 48) |
-         uint64_t('2') << (64 - 56) | uint64_t(0xff);
+         uint64_t('2') << (64 - 56) | uint64_t(Format);
 }
 
 static inline uint64_t SPVersion() { return 103; }
 
+/// Flags stored in the header of compact binary profiles.
+enum SampleProfileFlags : uint64_t {
+  /// Function names in the name table are MD5 hashes instead of strings.
+  SPF_Flag_MD5Names = 0x1
+};
+
+/// Get the representation of function name \p Name in a profile.
+///
+/// Profiles that use MD5 names key every function by the decimal string of
+/// the MD5 hash of its name. \p GUIDBuf provides the storage for the result
+/// in that case.
+static inline StringRef getRepInFormat(StringRef Name, bool UseMD5,
+                                       std::string &GUIDBuf) {
+  if (Name.empty() || !UseMD5)
+    return Name;
+  GUIDBuf = std::to_string(MD5Hash(Name));
+  return GUIDBuf;
+}
+
 /// Represents the relative location of an instruction.
 ///
 /// Instruction locations are specified by the line offset from the
@@ -333,6 +361,10 @@ public:
 
   /// Merge the samples in \p Other into this one.
   /// Optionally scale samples by \p Weight.
+  ///
+  /// The names of the merged inlined callees refer to the keys of this
+  /// profile's callsite maps, so only the name of this function itself
+  /// depends on \p Other staying alive.
   sampleprof_error merge(const FunctionSamples &Other, uint64_t Weight = 1) {
     sampleprof_error Result = sampleprof_error::success;
     Name = Other.getName();
@@ -346,8 +378,11 @@ public:
     for (const auto &I : Other.getCallsiteSamples()) {
       const LineLocation &Loc = I.first;
       FunctionSamplesMap &FSMap = functionSamplesAt(Loc);
-      for (const auto &Rec : I.second)
-        MergeResult(Result, FSMap[Rec.first()].merge(Rec.second, Weight));
+      for (const auto &Rec : I.second) {
+        auto &Callee = *FSMap.try_emplace(Rec.first()).first;
+        MergeResult(Result, Callee.second.merge(Rec.second, Weight));
+        Callee.second.setName(Callee.getKey());
+      }
     }
     return Result;
   }
@@ -356,23 +391,34 @@ public:
   /// corresponding function is no less than \p Threshold, add its corresponding
   /// GUID to \p S. Also traverse the BodySamples to add hot CallTarget's GUID
   /// to \p S.
+  ///
+  /// If \p UseMD5 is true, the names in this profile are MD5 hashes.
   void findInlinedFunctions(DenseSet<GlobalValue::GUID> &S, const Module *M,
-                            uint64_t Threshold) const {
+                            uint64_t Threshold, bool UseMD5 = false) const {
     if (TotalSamples <= Threshold)
       return;
-    S.insert(Function::getGUID(Name));
+    S.insert(getGUID(Name, UseMD5));
     // Import hot CallTargets, which may not be available in IR because full
     // profile annotation cannot be done until backend compilation in ThinLTO.
     for (const auto &BS : BodySamples)
       for (const auto &TS : BS.second.getCallTargets())
         if (TS.getValue() > Threshold) {
-          Function *Callee = M->getFunction(TS.getKey());
+          Function *Callee = UseMD5 ? nullptr : M->getFunction(TS.getKey());
           if (!Callee || !Callee->getSubprogram())
-            S.insert(Function::getGUID(TS.getKey()));
+            S.insert(getGUID(TS.getKey(), UseMD5));
         }
     for (const auto &CS : CallsiteSamples)
       for (const auto &NameFS : CS.second)
-        NameFS.second.findInlinedFunctions(S, M, Threshold);
+        NameFS.second.findInlinedFunctions(S, M, Threshold, UseMD5);
+  }
+
+  /// Return the GUID of the function named \p Name. If \p UseMD5 is true,
+  /// \p Name is already the decimal representation of the GUID.
+  static GlobalValue::GUID getGUID(StringRef Name, bool UseMD5) {
+    GlobalValue::GUID GUID;
+    if (UseMD5 && !Name.getAsInteger(10, GUID))
+      return GUID;
+    return Function::getGUID(Name);
   }
 
   /// Set the name of the function.
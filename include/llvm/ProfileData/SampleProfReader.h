@@ -204,14 +204,61 @@
 //          in the text format documentation above).
 //        FUNCTION BODY
 //          A FUNCTION BODY entry describing the inlined function.
+//
+//
+// Compact binary format
+// ---------------------
+//
+// This is the binary format with an index that lets the reader decode only
+// the profiles of the functions it needs, and optionally with function names
+// replaced by their MD5 hashes. The file is organized as follows:
+//
+// MAGIC (uint64_t)
+//    File identifier computed by SPMagic(SPF_Compact_Binary)
+//    (0x5350524f46343202)
+//
+// VERSION (uint32_t)
+//    File format version number computed by SPVersion()
+//
+// FLAGS (uint64_t)
+//    A combination of SampleProfileFlags. SPF_Flag_MD5Names means the name
+//    table holds MD5 hashes.
+//
+// SUMMARY
+//    Same as in the binary format.
+//
+// NAME TABLE
+//    SIZE (uint32_t)
+//        Number of entries in the name table.
+//    NAMES
+//        A NUL-separated list of SIZE strings, or, with SPF_Flag_MD5Names,
+//        a list of SIZE MD5 hashes (uint64_t).
+//
+// FUNCTION BODY (one for each uninlined function body present in the profile)
+//    Same as in the binary format, including HEAD_SAMPLES.
+//
+// FUNCTION OFFSET TABLE
+//    NUM_FUNCTIONS (uint64_t)
+//        Number of top-level functions in the profile.
+//    A list of NUM_FUNCTIONS entries. Each entry contains:
+//        NAME_IDX (uint32_t)
+//            Index into the name table indicating the function name.
+//        OFFSET (uint64_t)
+//            Offset of the HEAD_SAMPLES of the function from the start of
+//            the file.
+//
+// FUNCTION OFFSET TABLE OFFSET (fixed size 64-bit little-endian)
+//    Offset of the function offset table from the start of the file.
 //===----------------------------------------------------------------------===//
 
 #ifndef LLVM_PROFILEDATA_SAMPLEPROFREADER_H
 #define LLVM_PROFILEDATA_SAMPLEPROFREADER_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Function.h"
@@ -231,6 +278,7 @@
 
 namespace llvm {
 
+class Module;
 class raw_ostream;
 
 namespace sampleprof {
@@ -259,9 +307,10 @@ namespace sampleprof {
 ///      protection against source code shuffling, line numbers should
 ///      be relative to the start of the function.
 ///
-/// The reader supports two file formats: text and binary. The text format
-/// is useful for debugging and testing, while the binary format is more
-/// compact and I/O efficient. They can both be used interchangeably.
+/// The reader supports text, binary, compact binary and GCC file formats.
+/// The text format is useful for debugging and testing, while the binary
+/// formats are more compact and I/O efficient. They can all be used
+/// interchangeably.
 class SampleProfileReader {
 public:
   SampleProfileReader(std::unique_ptr<MemoryBuffer> B, LLVMContext &C)
@@ -278,19 +327,36 @@ public:
   /// \brief Print the profile for \p FName on stream \p OS.
   void dumpFunctionProfile(StringRef FName, raw_ostream &OS = dbgs());
 
-  /// \brief Print all the profiles on stream \p OS.
+  /// \brief Print all the profiles on stream \p OS, sorted by name.
   void dump(raw_ostream &OS = dbgs());
 
+  /// \brief Collect the functions defined in \p M whose profiles are
+  /// needed. Readers that support on-demand loading only decode those in
+  /// read(); other readers ignore this.
+  virtual void collectFuncsToUse(const Module &M) {}
+
   /// \brief Return the samples collected for function \p F.
   FunctionSamples *getSamplesFor(const Function &F) {
     // The function name may have been updated by adding suffix. In sample
     // profile, the function names are all stripped, so we need to strip
     // the function name suffix before matching with profile.
-    if (Profiles.count(F.getName().split('.').first))
-      return &Profiles[(F.getName().split('.').first)];
+    return getSamplesFor(F.getName().split('.').first);
+  }
+
+  /// \brief Return the samples collected for the function named \p Fname.
+  FunctionSamples *getSamplesFor(StringRef Fname) {
+    std::string FGUID;
+    Fname = getRepInFormat(Fname, ProfileIsMD5, FGUID);
+    auto It = Profiles.find(Fname);
+    if (It != Profiles.end())
+      return &It->second;
     return nullptr;
   }
 
+  /// \brief Return true if the function names in the profile are MD5
+  /// hashes.
+  bool useMD5() const { return ProfileIsMD5; }
+
   /// \brief Return all the profiles.
   StringMap<FunctionSamples> &getProfiles() { return Profiles; }
 
@@ -330,6 +396,9 @@ protected:
 
   /// \brief Compute summary for this profile.
   void computeSummary();
+
+  /// \brief Whether function names in the profile are MD5 hashes.
+  bool ProfileIsMD5 = false;
 };
 
 class SampleProfileReaderText : public SampleProfileReader {
@@ -387,6 +456,18 @@ protected:
   /// Read the contents of the given profile instance.
   std::error_code readProfile(FunctionSamples &FProfile);
 
+  /// Read the profile of the top-level function at the current location.
+  std::error_code readFuncProfile();
+
+  /// \brief Read and check the magic identifier and the format version.
+  virtual std::error_code readMagicIdent();
+
+  /// \brief Read the function name table.
+  virtual std::error_code readNameTable();
+
+  /// \brief Read profile summary.
+  std::error_code readSummary();
+
   /// \brief Points to the current location in the buffer.
   const uint8_t *Data = nullptr;
 
@@ -398,9 +479,52 @@ protected:
 
 private:
   std::error_code readSummaryEntry(std::vector<ProfileSummaryEntry> &Entries);
+};
 
-  /// \brief Read profile summary.
-  std::error_code readSummary();
+/// \brief Reader for the compact binary format.
+///
+/// The compact binary format is the binary format followed by a table with
+/// the offset of the profile of every top-level function. Once
+/// collectFuncsToUse() has been called, read() only decodes the profiles of
+/// the functions defined in that module. Function names can be stored as MD5
+/// hashes.
+class SampleProfileReaderCompactBinary : public SampleProfileReaderBinary {
+public:
+  SampleProfileReaderCompactBinary(std::unique_ptr<MemoryBuffer> B,
+                                   LLVMContext &C)
+      : SampleProfileReaderBinary(std::move(B), C) {}
+
+  /// \brief Read and validate the file header and the function offset table.
+  std::error_code readHeader() override;
+
+  /// \brief Read the sample profiles of the functions to use.
+  std::error_code read() override;
+
+  /// \brief Only decode the profiles of the functions defined in \p M.
+  void collectFuncsToUse(const Module &M) override;
+
+  /// \brief Return true if \p Buffer is in the format supported by this class.
+  static bool hasFormat(const MemoryBuffer &Buffer);
+
+protected:
+  std::error_code readMagicIdent() override;
+  std::error_code readNameTable() override;
+
+  /// \brief Read the table of offsets of the top-level function profiles.
+  std::error_code readFuncOffsetTable();
+
+private:
+  /// Offset of the profile of every top-level function, keyed by name.
+  DenseMap<StringRef, uint64_t> FuncOffsetTable;
+
+  /// Functions whose profiles read() decodes.
+  StringSet<> FuncsToUse;
+
+  /// Whether read() decodes all the profiles in the file.
+  bool UseAllFuncs = true;
+
+  /// Storage for the decimal strings of MD5 names.
+  std::vector<std::string> MD5StringBuf;
 };
 
 using InlineCallStack = SmallVector<FunctionSamples *, 10>;
@@ -23,13 +23,12 @@
 #include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <set>
 #include <system_error>
 
 namespace llvm {
 namespace sampleprof {
 
-enum SampleProfileFormat { SPF_None = 0, SPF_Text, SPF_Binary, SPF_GCC };
-
 /// \brief Sample-based profile writer. Base class.
 class SampleProfileWriter {
 public:
@@ -47,6 +46,13 @@ public:
 
   raw_ostream &getOutputStream() { return *OutputStream; }
 
+  /// Store function names as MD5 hashes, if the format supports it.
+  ///
+  /// If \p NamesAreMD5 is true, the names of the profiles passed to the
+  /// writer are already the decimal representation of their MD5 hashes, as
+  /// read from a profile that uses MD5 names.
+  virtual void setUseMD5(bool NamesAreMD5 = false) {}
+
   /// Profile writer factory.
   ///
   /// Create a new file writer based on the value of \p Format.
@@ -66,6 +72,9 @@ protected:
   virtual std::error_code
   writeHeader(const StringMap<FunctionSamples> &ProfileMap) = 0;
 
+  /// \brief Write the data that follows all the function profiles.
+  virtual std::error_code writeTrailer() { return sampleprof_error::success; }
+
   /// \brief Output stream where to emit the profile to.
   std::unique_ptr<raw_ostream> OutputStream;
 
@@ -116,11 +125,57 @@ protected:
   std::error_code writeNameIdx(StringRef FName);
   std::error_code writeBody(const FunctionSamples &S);
 
+  /// Write the magic identifier and the version of the file format.
+  virtual void writeMagicIdent();
+
+  /// Write the names in \p V, whose indices have been assigned in NameTable.
+  virtual std::error_code writeNameTable(const std::set<StringRef> &V);
+
+  MapVector<StringRef, uint32_t> NameTable;
+
 private:
   void addName(StringRef FName);
   void addNames(const FunctionSamples &S);
 
-  MapVector<StringRef, uint32_t> NameTable;
+  friend ErrorOr<std::unique_ptr<SampleProfileWriter>>
+  SampleProfileWriter::create(std::unique_ptr<raw_ostream> &OS,
+                              SampleProfileFormat Format);
+};
+
+/// \brief Sample-based profile writer (compact binary format).
+///
+/// The compact binary format extends the binary format with an index of the
+/// offset of every top-level function profile, so readers can decode only
+/// the profiles they need. Function names can optionally be stored as MD5
+/// hashes.
+class SampleProfileWriterCompactBinary : public SampleProfileWriterBinary {
+public:
+  std::error_code write(const FunctionSamples &S) override;
+
+  void setUseMD5(bool NamesAreMD5 = false) override {
+    UseMD5 = true;
+    this->NamesAreMD5 = NamesAreMD5;
+  }
+
+protected:
+  SampleProfileWriterCompactBinary(std::unique_ptr<raw_ostream> &OS)
+      : SampleProfileWriterBinary(OS) {}
+
+  void writeMagicIdent() override;
+  std::error_code writeNameTable(const std::set<StringRef> &V) override;
+
+  /// Write the function offset table and the offset of that table.
+  std::error_code writeTrailer() override;
+
+private:
+  /// Offset of the profile of every top-level function in the output.
+  MapVector<StringRef, uint64_t> FuncOffsetTable;
+
+  /// Whether function names are written as MD5 hashes.
+  bool UseMD5 = false;
+
+  /// Whether the input function names already are MD5 hashes.
+  bool NamesAreMD5 = false;
 
   friend ErrorOr<std::unique_ptr<SampleProfileWriter>>
   SampleProfileWriter::create(std::unique_ptr<raw_ostream> &OS,
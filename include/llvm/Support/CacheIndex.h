@@ -0,0 +1,149 @@
+//===- CacheIndex.h - Shared index of a cache directory ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines CacheIndex, a memory mapped index of the entries of a cache
+// directory that tracks their sizes and access times, so that the cache can be
+// pruned incrementally without scanning the directory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_SUPPORT_CACHEINDEX_H
+#define LLVM_SUPPORT_CACHEINDEX_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include <cstdint>
+#include <memory>
+
+namespace llvm {
+
+/// An index of the "llvmcache-<key>" files of a cache directory, stored in the
+/// file "llvmcache.index" of that directory and shared by every process using
+/// the cache.
+///
+/// The index is a fixed size open addressing hash table mapped into memory.
+/// Lookups and access time updates only use atomic loads and stores on the
+/// mapping, and entries are added and removed with compare-and-swap, so
+/// processes never take a lock on the index. An entry is claimed with a single
+/// compare-and-swap on its slot, so the same key is never tracked twice.
+///
+/// The files remain the source of truth: the index is only used to decide what
+/// to evict between two runs of pruneCache(). Not every client adds its entries
+/// to the index (ThinLTOCodeGenerator and localCache() without a policy don't),
+/// and the table doesn't grow: keys longer than MaxKeySize, and entries that
+/// find no free slot near their home slot, are not tracked. pruneCache() thus
+/// always scans the directory, and then syncs the index with the files that
+/// are left.
+class CacheIndex {
+public:
+  /// The longest key the index can track.
+  static const size_t MaxKeySize = 40;
+
+  /// The default number of entries an index is created with.
+  static const uint32_t DefaultNumSlots = 1 << 18;
+
+  ~CacheIndex();
+
+  /// Open the index of the cache directory \p Path, creating it with room for
+  /// \p NumSlots entries (rounded up to a power of two) if it doesn't exist.
+  /// An index that is corrupt or was written by another version of LLVM is
+  /// replaced. A new index starts out with the entries already in \p Path.
+  static Expected<std::unique_ptr<CacheIndex>>
+  open(StringRef Path, uint32_t NumSlots = DefaultNumSlots);
+
+  /// Record an access to the entry for \p Key. Returns false if the entry is
+  /// not tracked by the index.
+  bool touch(StringRef Key);
+
+  /// Add the entry for \p Key, of \p Size bytes, to the index. Returns false
+  /// if the entry could not be tracked.
+  bool insert(StringRef Key, uint64_t Size);
+
+  /// Remove the entry for \p Key from the index, without removing its file.
+  /// Returns false if the entry was not tracked by the index.
+  bool erase(StringRef Key);
+
+  /// Incrementally prune the cache according to \p Policy. Visits the next
+  /// \p MaxVisited slots of the table, starting where the previous call (of
+  /// any process) stopped, removes the visited entries that expired and, while
+  /// the cache is over its size limit, the least recently used of the others.
+  /// When the cache is over its size limit and the visited slots are all
+  /// empty, more slots are visited until an entry is found. Returns the number
+  /// of files removed.
+  ///
+  /// Policy.Interval is ignored: the amount of work done by a call is bounded
+  /// by \p MaxVisited instead. A \p MaxVisited of at least the number of slots
+  /// visits the whole table.
+  unsigned prune(const CachePruningPolicy &Policy, unsigned MaxVisited = 1024);
+
+  /// Returns true if some entries may have been added to the cache directory
+  /// without being tracked by the index, since the index was created or last
+  /// synced.
+  bool hasUntrackedEntries() const;
+
+  /// Sync the index with the cache directory: track the entries of the
+  /// directory that the index is missing, and forget the tracked entries whose
+  /// files were removed. This scans the directory.
+  void sync();
+
+  /// Sync the index with \p Entries, the status of the "llvmcache-<key>" files
+  /// found by a scan of the cache directory, keyed by <key>. The tracked
+  /// entries missing from \p Entries are forgotten once their file is gone.
+  void sync(const StringMap<sys::fs::basic_file_status> &Entries);
+
+  /// The total size of the entries tracked by the index.
+  uint64_t getTotalSize() const;
+
+  /// The number of entries tracked by the index.
+  uint64_t getNumEntries() const;
+
+private:
+  struct Header;
+  struct Slot;
+
+  CacheIndex(StringRef Path, std::unique_ptr<sys::fs::mapped_file_region> Map);
+
+  /// Create an empty index in the cache directory \p Path, replacing the
+  /// existing one if \p Replace is set. Sets \p Created unless another
+  /// process created the index first.
+  static Error create(StringRef Path, uint32_t NumSlots, bool Replace,
+                      bool &Created);
+
+  /// Map the index of the cache directory \p Path. Returns null if the file
+  /// isn't a valid index.
+  static Expected<std::unique_ptr<CacheIndex>> map(StringRef Path);
+
+  /// Return the status of the "llvmcache-<key>" files of the cache directory
+  /// \p Path, keyed by <key>.
+  static StringMap<sys::fs::basic_file_status> scanEntries(StringRef Path);
+
+  /// Add the entries of \p Entries that aren't tracked yet to the index.
+  void addEntries(const StringMap<sys::fs::basic_file_status> &Entries);
+
+  void syncWith(const StringMap<sys::fs::basic_file_status> &Entries);
+
+  Header &getHeader() const;
+  Slot &getSlot(uint64_t I) const;
+  Slot *find(StringRef Key, uint64_t Hash) const;
+  Slot *claim(uint64_t Hash) const;
+  bool isClaimedElsewhere(uint64_t Hash, const Slot &Claimed) const;
+  bool insert(StringRef Key, uint64_t Size, uint64_t AccessTime);
+  bool release(Slot &S, uint64_t Hash, bool RemoveFile);
+
+  SmallString<128> Path;
+  std::unique_ptr<sys::fs::mapped_file_region> Map;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_SUPPORT_CACHEINDEX_H
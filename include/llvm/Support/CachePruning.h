@@ -61,6 +61,9 @@ Expected<CachePruningPolicy> parseCachePruningPolicy(StringRef PolicyStr);
 /// As a safeguard against data loss if the user specifies the wrong directory
 /// as their cache directory, this function will ignore files not matching the
 /// pattern "llvmcache-*".
+///
+/// If the directory has a CacheIndex, the index is synced with the entries
+/// left once the directory is pruned.
 bool pruneCache(StringRef Path, CachePruningPolicy Policy);
 
 } // namespace llvm
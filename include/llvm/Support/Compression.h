@@ -35,6 +35,15 @@ bool isAvailable();
 Error compress(StringRef InputBuffer, SmallVectorImpl<char> &CompressedBuffer,
                CompressionLevel Level = DefaultCompression);
 
+/// Compress \p InputBuffer into a single zlib stream like compress, but
+/// compress its chunks of \p ChunkSize bytes concurrently. Each chunk is
+/// compressed without the history of the previous ones, which slightly lowers
+/// the compression ratio. The stream can be decompressed by any zlib reader.
+Error compressParallel(StringRef InputBuffer,
+                       SmallVectorImpl<char> &CompressedBuffer,
+                       CompressionLevel Level = DefaultCompression,
+                       size_t ChunkSize = 1 << 20);
+
 Error uncompress(StringRef InputBuffer, char *UncompressedBuffer,
                  size_t &UncompressedSize);
 
@@ -70,15 +70,25 @@ public:
     std::unique_lock<std::mutex> lock(Mutex);
     Cond.wait(lock, [&] { return Count == 0; });
   }
+
+  bool isDone() const {
+    std::unique_lock<std::mutex> lock(Mutex);
+    return Count == 0;
+  }
 };
 
 class TaskGroup {
   Latch L;
 
 public:
+  ~TaskGroup() { sync(); }
+
   void spawn(std::function<void()> f);
 
-  void sync() const { L.sync(); }
+  /// \brief Wait for all the spawned tasks to finish. When called from a task,
+  ///   this runs other pending tasks while waiting, so task groups can be
+  ///   nested.
+  void sync() const;
 };
 
 #if defined(_MSC_VER)
@@ -52,6 +52,11 @@ public:
   /// allocated space.
   static size_t GetMallocUsage();
 
+  /// This static function will return the largest amount of physical memory
+  /// the process has used at any time since it started, in bytes, or 0 if the
+  /// operating system does not support it.
+  static size_t GetPeakMemoryUsage();
+
   /// This static function will set \p user_time to the amount of CPU time
   /// spent in user (non-kernel) mode and \p sys_time to the amount of CPU
   /// time spent in system (kernel) mode.  If the operating system does not
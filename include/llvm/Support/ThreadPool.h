@@ -7,14 +7,16 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file defines a crude C++11 based thread pool.
+// This file defines a C++11 based thread pool, which runs its tasks on the
+// executor shared with the parallel algorithms.
 //
 //===----------------------------------------------------------------------===//
 
 #ifndef LLVM_SUPPORT_THREAD_POOL_H
 #define LLVM_SUPPORT_THREAD_POOL_H
 
-#include "llvm/Support/thread.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Parallel.h"
 
 #include <future>
 
@@ -28,11 +30,16 @@
 
 namespace llvm {
 
-/// A ThreadPool for asynchronous parallel execution on a defined number of
-/// threads.
+/// A ThreadPool for asynchronous parallel execution on at most a defined
+/// number of threads.
 ///
-/// The pool keeps a vector of threads alive, waiting on a condition variable
-/// for some work to become available.
+/// The pool doesn't own any thread: its tasks run on the workers of the
+/// executor used by the parallel algorithms in Parallel.h, so that nested
+/// pools and parallel algorithms share a single set of hardware_concurrency()
+/// threads instead of multiplying them. The thread count of a pool only caps
+/// how many of its tasks run at once. Since a task may wait for workers that
+/// are busy elsewhere, a task must not block on another task of the pool other
+/// than through wait().
 class ThreadPool {
 public:
   using TaskTy = std::function<void()>;
@@ -42,10 +49,10 @@ public:
   /// hardware_concurrency().
   ThreadPool();
 
-  /// Construct a pool of \p ThreadCount threads
+  /// Construct a pool running at most \p ThreadCount tasks at once.
   ThreadPool(unsigned ThreadCount);
 
-  /// Blocking destructor: the pool will wait for all the threads to complete.
+  /// Blocking destructor: the pool will wait for all the tasks to complete.
   ~ThreadPool();
 
   /// Asynchronous submission of a task to the pool. The returned future can be
@@ -64,8 +71,10 @@ public:
     return asyncImpl(std::forward<Function>(F));
   }
 
-  /// Blocking wait for all the threads to complete and the queue to be empty.
-  /// It is an error to try to add new tasks while blocking on this call.
+  /// Blocking wait for all the tasks to complete and the queue to be empty.
+  /// When called from a task of the shared executor, this runs other tasks
+  /// while waiting. It is an error to try to add new tasks while blocking on
+  /// this call, other than from the tasks of the pool.
   void wait();
 
 private:
@@ -73,26 +82,25 @@ private:
   /// used to wait for the task to finish and is *non-blocking* on destruction.
   std::shared_future<void> asyncImpl(TaskTy F);
 
-  /// Threads in flight
-  std::vector<llvm::thread> Threads;
-
   /// Tasks waiting for execution in the pool.
   std::queue<PackagedTaskTy> Tasks;
 
-  /// Locking and signaling for accessing the Tasks queue.
+#if LLVM_ENABLE_THREADS // avoids warning for unused variable
+  /// Run the queued tasks until the queue is empty.
+  void runTasks();
+
+  /// Locking for accessing the Tasks queue and ActiveThreads.
   std::mutex QueueLock;
-  std::condition_variable QueueCondition;
 
-  /// Locking and signaling for job completion
-  std::mutex CompletionLock;
-  std::condition_variable CompletionCondition;
+  /// Maximum number of tasks of this pool running at once.
+  unsigned ThreadCount;
 
-  /// Keep track of the number of thread actually busy
-  std::atomic<unsigned> ActiveThreads;
+  /// Number of runTasks() calls spawned on the executor that haven't found the
+  /// queue empty yet.
+  unsigned ActiveThreads = 0;
 
-#if LLVM_ENABLE_THREADS // avoids warning for unused variable
-  /// Signal for the destruction of the pool, asking thread to exit.
-  bool EnableFlag;
+  /// The runTasks() calls spawned on the executor.
+  parallel::detail::TaskGroup Workers;
 #endif
 };
 }
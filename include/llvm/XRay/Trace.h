@@ -16,6 +16,7 @@
 #include <cstdint>
 #include <vector>
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
@@ -65,6 +66,32 @@ public:
 /// |Filename|.
 Expected<Trace> loadTraceFile(StringRef Filename, bool Sort = false);
 
+/// This function will attempt to read the XRay trace records from the provided
+/// |Filename| and call |Callback| with each of them, in the order in which they
+/// appear in the file. Unlike loadTraceFile, the records of binary logs are
+/// decoded one at a time from the mapped file and are not kept around, so
+/// tools that only need a single pass over the records can handle traces
+/// larger than memory. |FileHeader| is filled in before the first record is
+/// passed to |Callback|. An error returned by |Callback| stops the iteration
+/// and is returned.
+Error streamTraceFile(StringRef Filename, XRayFileHeader &FileHeader,
+                      function_ref<Error(const XRayRecord &)> Callback);
+
+/// Like the function above, but only calls |Callback| with the records of the
+/// thread |ThreadId|. The buffers of other threads in FDR mode logs are skipped
+/// without being decoded, so the threads of a trace can be streamed
+/// independently, and concurrently.
+Error streamTraceFile(StringRef Filename, uint32_t ThreadId,
+                      XRayFileHeader &FileHeader,
+                      function_ref<Error(const XRayRecord &)> Callback);
+
+/// This function will attempt to read the XRay trace file header from the
+/// provided |Filename| into |FileHeader|, and the ids of the threads with
+/// records in it, in increasing order, into |ThreadIds|. Only the first record
+/// of the per-thread buffers of FDR mode logs is read.
+Error listTraceThreads(StringRef Filename, XRayFileHeader &FileHeader,
+                       std::vector<uint32_t> &ThreadIds);
+
 } // namespace xray
 } // namespace llvm
 
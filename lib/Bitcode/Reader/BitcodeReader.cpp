@@ -18,6 +18,7 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/ADT/Twine.h"
@@ -70,6 +71,7 @@
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cassert>
@@ -87,11 +89,21 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "bitcode-reader"
+
+STATISTIC(NumFunctionBodiesMaterialized,
+          "Number of function bodies materialized");
+
 static cl::opt<bool> PrintSummaryGUIDs(
     "print-summary-global-ids", cl::init(false), cl::Hidden,
     cl::desc(
         "Print the global id for each value when reading the module summary"));
 
+static cl::opt<unsigned> ReaderThreads(
+    "bitcode-reader-threads", cl::init(1), cl::Hidden,
+    cl::desc("Number of threads used to decode function blocks when "
+             "materializing a whole module"));
+
 namespace {
 
 enum {
@@ -437,6 +449,31 @@ BitcodeReaderBase::readNameFromStrtab(ArrayRef<uint64_t> Record) {
 
 namespace {
 
+/// The records of a function block, decoded by another thread ahead of
+/// parseFunctionBody. Nested blocks and the end of the block are not decoded:
+/// their entries record where to read them from the stream instead.
+struct DecodedFunctionBody {
+  struct Entry {
+    /// Whether this is a record, rather than a nested block or the end of the
+    /// block.
+    bool IsRecord;
+    /// The code of a record.
+    unsigned Code;
+    /// The number of operands of a record, which follow those of the previous
+    /// records in Ops.
+    unsigned NumOps;
+    /// The position in the stream of a nested block or of the end of the block.
+    uint64_t BitNo;
+  };
+
+  std::vector<Entry> Entries;
+  std::vector<uint64_t> Ops;
+
+  /// Decode the function block at \p BitNo using \p Stream. Returns false if
+  /// the block is malformed.
+  bool decode(BitstreamCursor &Stream, uint64_t BitNo);
+};
+
 class BitcodeReader : public BitcodeReaderBase, public GVMaterializer {
   LLVMContext &Context;
   Module *TheModule = nullptr;
@@ -493,6 +530,11 @@ class BitcodeReader : public BitcodeReaderBase, public GVMaterializer {
   /// where to find deferred function body in the stream.
   DenseMap<Function*, uint64_t> DeferredFunctionInfo;
 
+  /// The function bodies decoded ahead of parsing by
+  /// materializeFunctionBodiesConcurrently.
+  DenseMap<Function *, std::unique_ptr<DecodedFunctionBody>>
+      DecodedFunctionBodies;
+
   /// When Metadata block is initially scanned when parsing the module, we may
   /// choose to defer parsing of the metadata. This vector contains info about
   /// which Metadata blocks are deferred.
@@ -671,6 +713,7 @@ private:
   Error rememberAndSkipMetadata();
   Error typeCheckLoadStoreInst(Type *ValType, Type *PtrType);
   Error parseFunctionBody(Function *F);
+  Error materializeFunctionBodiesConcurrently(unsigned Threads);
   Error globalCleanup();
   Error resolveGlobalAndIndirectSymbolInits();
   Error parseUseLists();
@@ -3331,6 +3374,109 @@ Error BitcodeReader::typeCheckLoadStoreInst(Type *ValType, Type *PtrType) {
   return Error::success();
 }
 
+/// Read the records of a function block without resolving their operands, so
+/// that parseFunctionBody doesn't have to go through the stream for them.
+bool DecodedFunctionBody::decode(BitstreamCursor &Stream, uint64_t BitNo) {
+  Stream.JumpToBit(BitNo);
+  if (Stream.EnterSubBlock(bitc::FUNCTION_BLOCK_ID))
+    return false;
+
+  SmallVector<uint64_t, 64> Record;
+  while (true) {
+    uint64_t EntryBitNo = Stream.GetCurrentBitNo();
+    BitstreamEntry Entry =
+        Stream.advance(BitstreamCursor::AF_DontAutoprocessAbbrevs);
+    switch (Entry.Kind) {
+    case BitstreamEntry::Error:
+      return false;
+    case BitstreamEntry::EndBlock:
+      Entries.push_back({false, 0, 0, EntryBitNo});
+      return true;
+    case BitstreamEntry::SubBlock:
+      Entries.push_back({false, 0, 0, EntryBitNo});
+      if (Stream.SkipBlock())
+        return false;
+      break;
+    case BitstreamEntry::Record:
+      // Abbreviations are read here so that the stream position of the next
+      // entry is that of its abbrev ID.
+      if (Entry.ID == bitc::DEFINE_ABBREV) {
+        Stream.ReadAbbrevRecord();
+        break;
+      }
+      Record.clear();
+      unsigned Code = Stream.readRecord(Entry.ID, Record);
+      Entries.push_back({true, Code, unsigned(Record.size()), 0});
+      Ops.insert(Ops.end(), Record.begin(), Record.end());
+      break;
+    }
+  }
+}
+
+/// Materialize the remaining function bodies of the module, in order, while
+/// other threads decode the records of the function blocks that follow.
+///
+/// Creating instructions, constants and metadata can't be done concurrently,
+/// so only decoding is. Function blocks are decoded in windows, the next one
+/// while the bodies of the current one are parsed from their decoded records.
+Error BitcodeReader::materializeFunctionBodiesConcurrently(unsigned Threads) {
+  std::vector<Function *> Functions;
+  for (Function &F : *TheModule)
+    Functions.push_back(&F);
+
+  using DecodedWindow =
+      std::vector<std::pair<Function *, std::unique_ptr<DecodedFunctionBody>>>;
+  DecodedWindow Current, Next;
+  // Destroyed first, which waits for any decoding still in progress.
+  ThreadPool Pool(Threads);
+
+  const size_t WindowSize = 64 * Threads;
+  auto decodeWindow = [&](size_t Begin, DecodedWindow &Window) {
+    Window.clear();
+    for (size_t I = Begin, E = std::min(Begin + WindowSize, Functions.size());
+         I != E; ++I) {
+      Function *F = Functions[I];
+      if (!F->isMaterializable())
+        continue;
+      // Bodies that haven't been found in the stream yet are parsed as usual.
+      auto DFII = DeferredFunctionInfo.find(F);
+      if (DFII == DeferredFunctionInfo.end() || DFII->second == 0)
+        continue;
+      Window.emplace_back(F, llvm::make_unique<DecodedFunctionBody>());
+      Pool.async(
+          [](DecodedFunctionBody &Body, BitstreamCursor &Cursor,
+             uint64_t BitNo) {
+            // Malformed blocks are left for parseFunctionBody to diagnose.
+            if (!Body.decode(Cursor, BitNo))
+              Body.Entries.clear();
+          },
+          std::ref(*Window.back().second), Stream, DFII->second);
+    }
+  };
+
+  decodeWindow(0, Current);
+  Pool.wait();
+  for (size_t Begin = 0; Begin < Functions.size(); Begin += WindowSize) {
+    for (auto &Body : Current)
+      if (!Body.second->Entries.empty())
+        DecodedFunctionBodies[Body.first] = std::move(Body.second);
+
+    if (Begin + WindowSize < Functions.size())
+      decodeWindow(Begin + WindowSize, Next);
+    for (size_t I = Begin, E = std::min(Begin + WindowSize, Functions.size());
+         I != E; ++I)
+      if (Error Err = materialize(Functions[I]))
+        return Err;
+    Pool.wait();
+
+    // Drop the bodies of functions that were materialized early, through a
+    // blockaddress.
+    DecodedFunctionBodies.clear();
+    std::swap(Current, Next);
+  }
+  return Error::success();
+}
+
 /// Lazily parse the specified function body block.
 Error BitcodeReader::parseFunctionBody(Function *F) {
   if (Stream.EnterSubBlock(bitc::FUNCTION_BLOCK_ID))
@@ -3364,11 +3510,33 @@ Error BitcodeReader::parseFunctionBody(Function *F) {
 
   std::vector<OperandBundleDef> OperandBundles;
 
-  // Read all the records.
+  // Read all the records, from the decoded body if the block was decoded
+  // ahead of time.
   SmallVector<uint64_t, 64> Record;
+  std::unique_ptr<DecodedFunctionBody> Decoded;
+  auto DecodedI = DecodedFunctionBodies.find(F);
+  if (DecodedI != DecodedFunctionBodies.end()) {
+    Decoded = std::move(DecodedI->second);
+    DecodedFunctionBodies.erase(DecodedI);
+  }
+  auto NextDecodedEntry = Decoded ? Decoded->Entries.begin()
+                                  : std::vector<DecodedFunctionBody::Entry>::
+                                        iterator();
+  auto NextDecodedOp =
+      Decoded ? Decoded->Ops.begin() : std::vector<uint64_t>::iterator();
 
   while (true) {
-    BitstreamEntry Entry = Stream.advance();
+    BitstreamEntry Entry;
+    if (!Decoded)
+      Entry = Stream.advance();
+    else if (NextDecodedEntry->IsRecord)
+      Entry = BitstreamEntry::getRecord(NextDecodedEntry->Code);
+    else {
+      // Nested blocks are read from the stream.
+      Stream.JumpToBit(NextDecodedEntry->BitNo);
+      Entry = Stream.advance();
+      ++NextDecodedEntry;
+    }
 
     switch (Entry.Kind) {
     case BitstreamEntry::Error:
@@ -3416,7 +3584,14 @@ Error BitcodeReader::parseFunctionBody(Function *F) {
     // Read a record.
     Record.clear();
     Instruction *I = nullptr;
-    unsigned BitCode = Stream.readRecord(Entry.ID, Record);
+    unsigned BitCode;
+    if (Decoded) {
+      BitCode = NextDecodedEntry->Code;
+      Record.append(NextDecodedOp, NextDecodedOp + NextDecodedEntry->NumOps);
+      NextDecodedOp += NextDecodedEntry->NumOps;
+      ++NextDecodedEntry;
+    } else
+      BitCode = Stream.readRecord(Entry.ID, Record);
     switch (BitCode) {
     default: // Default behavior: reject
       return error("Invalid value");
@@ -4675,6 +4850,7 @@ Error BitcodeReader::materialize(GlobalValue *GV) {
   if (Error Err = parseFunctionBody(F))
     return Err;
   F->setIsMaterializable(false);
+  ++NumFunctionBodiesMaterialized;
 
   if (StripDebugInfo)
     stripDebugInfo(*F);
@@ -4726,9 +4902,14 @@ Error BitcodeReader::materializeModule() {
 
   // Iterate over the module, deserializing any functions that are still on
   // disk.
-  for (Function &F : *TheModule) {
-    if (Error Err = materialize(&F))
+  if (ReaderThreads > 1) {
+    if (Error Err = materializeFunctionBodiesConcurrently(ReaderThreads))
       return Err;
+  } else {
+    for (Function &F : *TheModule) {
+      if (Error Err = materialize(&F))
+        return Err;
+    }
   }
   // At this point, if there are any function bodies, parse the rest of
   // the bits in the module past the last function block we have recorded
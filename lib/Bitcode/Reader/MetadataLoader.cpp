@@ -1361,12 +1361,24 @@ Error MetadataLoader::MetadataLoaderImpl::parseOneMetadata(
     // Ignore Record[0], which indicates whether this compile unit is
     // distinct.  It's always distinct.
     IsDistinct = true;
+
+    // When lazy-loading a module for ThinLTO importing, the enums, retained
+    // types, global variables and macros listed on the compile unit are not
+    // mapped into the importing module (see
+    // IRLinker::prepareCompileUnitsForImport). Don't load these lists, which
+    // hold most of the debug info of a module: the nodes they list are
+    // loaded on-demand if an imported function references them.
+    bool SkipImportedLists = IsImporting && !GlobalMetadataBitPosIndex.empty();
+    auto getListOrNull = [&](unsigned ID) -> Metadata * {
+      return SkipImportedLists ? nullptr : getMDOrNull(ID);
+    };
+
     auto *CU = DICompileUnit::getDistinct(
         Context, Record[1], getMDOrNull(Record[2]), getMDString(Record[3]),
         Record[4], getMDString(Record[5]), Record[6], getMDString(Record[7]),
-        Record[8], getMDOrNull(Record[9]), getMDOrNull(Record[10]),
-        getMDOrNull(Record[12]), getMDOrNull(Record[13]),
-        Record.size() <= 15 ? nullptr : getMDOrNull(Record[15]),
+        Record[8], getListOrNull(Record[9]), getListOrNull(Record[10]),
+        getListOrNull(Record[12]), getMDOrNull(Record[13]),
+        Record.size() <= 15 ? nullptr : getListOrNull(Record[15]),
         Record.size() <= 14 ? 0 : Record[14],
         Record.size() <= 16 ? true : Record[16],
         Record.size() <= 17 ? false : Record[17],
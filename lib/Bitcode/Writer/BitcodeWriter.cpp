@@ -67,8 +67,10 @@
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/SHA1.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -86,6 +88,10 @@ static cl::opt<unsigned>
                    cl::desc("Number of metadatas above which we emit an index "
                             "to enable lazy-loading"));
 
+static cl::opt<unsigned> WriterThreads(
+    "bitcode-writer-threads", cl::Hidden, cl::init(1),
+    cl::desc("Number of threads used to encode function blocks"));
+
 namespace {
 
 /// These are manifest constants used by the bitcode writer. They do not need to
@@ -229,6 +235,15 @@ private:
   }
 
   std::map<GlobalValue::GUID, unsigned> &valueIds() { return GUIDToValueIdMap; }
+
+protected:
+  /// Constructs a ModuleBitcodeWriterBase object that writes to \p Stream
+  /// using a copy of the value enumeration of \p Parent, so that both can
+  /// write function blocks concurrently.
+  ModuleBitcodeWriterBase(const ModuleBitcodeWriterBase &Parent,
+                          BitstreamWriter &Stream)
+      : BitcodeWriterBase(Stream, Parent.StrtabBuilder), M(Parent.M),
+        VE(Parent.VE), Index(nullptr), GlobalValueId(Parent.GlobalValueId) {}
 };
 
 /// Class to manage the bitcode writing for a module.
@@ -265,6 +280,14 @@ public:
   void write();
 
 private:
+  /// Constructs a ModuleBitcodeWriter object that writes the function blocks
+  /// of the module of \p Parent to \p Stream, to be spliced into the module
+  /// block of \p Parent.
+  ModuleBitcodeWriter(const ModuleBitcodeWriter &Parent,
+                      SmallVectorImpl<char> &Buffer, BitstreamWriter &Stream)
+      : ModuleBitcodeWriterBase(Parent, Stream), Buffer(Buffer),
+        GenerateHash(false), ModHash(nullptr), BitcodeStartBit(0) {}
+
   uint64_t bitcodeStartBit() { return BitcodeStartBit; }
 
   size_t addToStrtab(StringRef Str);
@@ -375,6 +398,8 @@ private:
   void
   writeFunction(const Function &F,
                 DenseMap<const Function *, uint64_t> &FunctionToBitcodeIndex);
+  void writeFunctionBlocks(
+      DenseMap<const Function *, uint64_t> &FunctionToBitcodeIndex);
   void writeBlockInfo();
   void writeModuleHash(size_t BlockStartPos);
 
@@ -3055,6 +3080,81 @@ void ModuleBitcodeWriter::writeFunction(
   Stream.ExitBlock();
 }
 
+/// Emit the blocks of the functions defined in the module, concurrently if
+/// -bitcode-writer-threads is set.
+///
+/// Each thread writes function blocks with its own copy of the value
+/// enumerator to its own stream, which starts at a word boundary and shares the
+/// BLOCKINFO abbreviations of the module stream. A block written at a word
+/// boundary doesn't depend on where it is, so the blocks are then spliced into
+/// the module stream in order, and the output is the same as when they are
+/// written one after another.
+void ModuleBitcodeWriter::writeFunctionBlocks(
+    DenseMap<const Function *, uint64_t> &FunctionToBitcodeIndex) {
+  std::vector<const Function *> Functions;
+  for (const Function &F : M)
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+
+  unsigned Threads = std::min<size_t>(WriterThreads, Functions.size());
+  // The use-list orders are computed for all functions up front, and consumed
+  // as the blocks are written in order.
+  if (Threads <= 1 || VE.shouldPreserveUseListOrder()) {
+    for (const Function *F : Functions)
+      writeFunction(*F, FunctionToBitcodeIndex);
+    return;
+  }
+
+  // Blocks end at a word boundary, so only the first block may not start at
+  // one. Write it directly to the module stream.
+  size_t Next = 0;
+  if (Stream.GetCurrentBitNo() & 31)
+    writeFunction(*Functions[Next++], FunctionToBitcodeIndex);
+
+  // Arguments are created lazily; create them before the threads read them.
+  for (const Function *F : Functions)
+    (void)F->arg_begin();
+
+  struct Worker {
+    SmallVector<char, 0> Buffer;
+    BitstreamWriter Stream;
+    ModuleBitcodeWriter Writer;
+    DenseMap<const Function *, uint64_t> Unused;
+
+    Worker(const ModuleBitcodeWriter &Parent)
+        : Stream(Buffer), Writer(Parent, Buffer, Stream) {}
+  };
+  std::vector<std::unique_ptr<Worker>> Workers;
+  for (unsigned I = 0; I != Threads; ++I) {
+    Workers.push_back(llvm::make_unique<Worker>(*this));
+    Workers.back()->Stream.ShareBlockInfo(Stream);
+  }
+
+  // Encode the blocks in batches to bound the memory they use before being
+  // spliced.
+  const size_t BatchSize = 64 * Threads;
+  std::vector<SmallVector<char, 0>> Blocks(BatchSize);
+  ThreadPool Pool(Threads);
+  while (Next != Functions.size()) {
+    size_t BatchEnd = std::min(Next + BatchSize, Functions.size());
+    std::atomic<size_t> NextInBatch(Next);
+    for (auto &W : Workers)
+      Pool.async([&](Worker &W) {
+        for (size_t I = NextInBatch++; I < BatchEnd; I = NextInBatch++) {
+          W.Writer.writeFunction(*Functions[I], W.Unused);
+          std::swap(Blocks[I % BatchSize], W.Buffer);
+          W.Buffer.clear();
+        }
+      }, std::ref(*W));
+    Pool.wait();
+
+    for (; Next != BatchEnd; ++Next) {
+      FunctionToBitcodeIndex[Functions[Next]] = Stream.GetCurrentBitNo();
+      Stream.AppendWords(Blocks[Next % BatchSize]);
+    }
+  }
+}
+
 // Emit blockinfo, which defines the standard abbreviations etc.
 void ModuleBitcodeWriter::writeBlockInfo() {
   // We only want to emit block info records for blocks that have multiple
@@ -3833,9 +3933,7 @@ void ModuleBitcodeWriter::write() {
 
   // Emit function bodies.
   DenseMap<const Function *, uint64_t> FunctionToBitcodeIndex;
-  for (Module::const_iterator F = M.begin(), E = M.end(); F != E; ++F)
-    if (!F->isDeclaration())
-      writeFunction(*F, FunctionToBitcodeIndex);
+  writeFunctionBlocks(FunctionToBitcodeIndex);
 
   // Need to write after the above call to WriteFunction which populates
   // the summary information in the index.
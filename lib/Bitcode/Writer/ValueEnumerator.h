@@ -141,7 +141,9 @@ private:
 
 public:
   ValueEnumerator(const Module &M, bool ShouldPreserveUseListOrder);
-  ValueEnumerator(const ValueEnumerator &) = delete;
+  /// Copying an enumerator is only meant to let several threads write the
+  /// blocks of different functions of the module.
+  ValueEnumerator(const ValueEnumerator &) = default;
   ValueEnumerator &operator=(const ValueEnumerator &) = delete;
 
   void dump() const;
@@ -90,6 +90,17 @@ void DwarfAccelTable::FinalizeTable(AsmPrinter *Asm, StringRef Prefix) {
     Data.push_back(Entry);
   }
 
+  // Entries iterates in the order of its hash table. Order the names by their
+  // first DIE instead, so that names whose hashes collide are emitted in the
+  // same order whatever the hash function of StringMap.
+  std::sort(Data.begin(), Data.end(), [](HashData *LHS, HashData *RHS) {
+    unsigned LOffset = LHS->Data.Values.front()->Die->getOffset();
+    unsigned ROffset = RHS->Data.Values.front()->Die->getOffset();
+    if (LOffset != ROffset)
+      return LOffset < ROffset;
+    return LHS->Str < RHS->Str;
+  });
+
   // Figure out how many buckets we need, then compute the bucket
   // contents and the final ordering. We'll emit the hashes and offsets
   // by doing a walk during the emission phase. We add temporary
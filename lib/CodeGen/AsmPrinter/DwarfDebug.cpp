@@ -1548,10 +1548,24 @@ void DwarfDebug::emitDebugPubSection(bool GnuStyle, StringRef Name,
   Asm->OutStreamer->AddComment("Compilation Unit Length");
   Asm->EmitInt32(TheU->getLength());
 
-  // Emit the pubnames for this compilation unit.
-  for (const auto &GI : Globals) {
-    const char *Name = GI.getKeyData();
-    const DIE *Entity = GI.second;
+  // Emit the pubnames for this compilation unit, in the order of their DIEs
+  // rather than in the order of the hash table.
+  std::vector<const StringMapEntry<const DIE *> *> SortedGlobals;
+  SortedGlobals.reserve(Globals.size());
+  for (const auto &GI : Globals)
+    SortedGlobals.push_back(&GI);
+  std::sort(SortedGlobals.begin(), SortedGlobals.end(),
+            [](const StringMapEntry<const DIE *> *L,
+               const StringMapEntry<const DIE *> *R) {
+              unsigned LOffset = L->second->getOffset();
+              unsigned ROffset = R->second->getOffset();
+              if (LOffset != ROffset)
+                return LOffset < ROffset;
+              return L->getKey() < R->getKey();
+            });
+  for (const auto *GI : SortedGlobals) {
+    const char *Name = GI->getKeyData();
+    const DIE *Entity = GI->second;
 
     Asm->OutStreamer->AddComment("DIE offset");
     Asm->EmitInt32(Entity->getOffset());
@@ -1565,7 +1579,7 @@ void DwarfDebug::emitDebugPubSection(bool GnuStyle, StringRef Name,
     }
 
     Asm->OutStreamer->AddComment("External Name");
-    Asm->OutStreamer->EmitBytes(StringRef(Name, GI.getKeyLength() + 1));
+    Asm->OutStreamer->EmitBytes(StringRef(Name, GI->getKeyLength() + 1));
   }
 
   Asm->OutStreamer->AddComment("End Mark");
@@ -51,14 +51,23 @@ std::unique_ptr<Module> llvm::splitCodeGen(
   }
 
   // Create ThreadPool in nested scope so that threads will be joined
-  // on destruction.
+  // on destruction. SplitModule hands us the last partition in M's own context,
+  // so we generate code for it on this thread and only need a worker for each
+  // of the others.
   {
-    ThreadPool CodegenThreadPool(OSs.size());
-    int ThreadCount = 0;
+    ThreadPool CodegenThreadPool(OSs.size() - 1);
+    unsigned ThreadCount = 0;
 
     SplitModule(
         std::move(M), OSs.size(),
         [&](std::unique_ptr<Module> MPart) {
+          if (ThreadCount == OSs.size() - 1) {
+            if (!BCOSs.empty())
+              WriteBitcodeToFile(MPart.get(), *BCOSs[ThreadCount]);
+            codegen(MPart.get(), *OSs[ThreadCount++], TMFactory, FileType);
+            return;
+          }
+
           // We want to clone the module in a new context to multi-thread the
           // codegen. We do it by serializing partition modules to bitcode
           // (while still on the main thread, in order to avoid data races) and
@@ -8,10 +8,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/DebugInfo/DWARF/DWARFDebugAranges.h"
+#include "llvm/BinaryFormat/Dwarf.h"
 #include "llvm/DebugInfo/DWARF/DWARFCompileUnit.h"
 #include "llvm/DebugInfo/DWARF/DWARFContext.h"
 #include "llvm/DebugInfo/DWARF/DWARFDebugArangeSet.h"
 #include "llvm/Support/DataExtractor.h"
+#include "llvm/Support/Parallel.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
@@ -50,15 +52,40 @@ void DWARFDebugAranges::generate(DWARFContext *CTX) {
   // Generate aranges from DIEs: even if .debug_aranges section is present,
   // it may describe only a small subset of compilation units, so we need to
   // manually build aranges for the rest of them.
-  for (const auto &CU : CTX->compile_units()) {
-    uint32_t CUOffset = CU->getOffset();
-    if (ParsedCUOffsets.insert(CUOffset).second) {
-      DWARFAddressRangesVector CURanges;
-      CU->collectAddressRanges(CURanges);
-      for (const auto &R : CURanges)
-        appendRange(CUOffset, R.LowPC, R.HighPC);
-    }
+  std::vector<DWARFCompileUnit *> Units;
+  for (const auto &CU : CTX->compile_units())
+    if (ParsedCUOffsets.insert(CU->getOffset()).second)
+      Units.push_back(CU.get());
+
+  // Collecting the ranges of a unit may require walking all of its DIEs, so
+  // units are processed in parallel. The abbreviation tables and the unit
+  // DIEs are resolved up front since they go through caches shared between
+  // units. Units referring to a .dwo file load it through the context, so
+  // they are handled sequentially.
+  std::vector<DWARFAddressRangesVector> UnitRanges(Units.size());
+  std::vector<size_t> ParallelUnits;
+  std::vector<size_t> SequentialUnits;
+  for (size_t I = 0, E = Units.size(); I != E; ++I) {
+    DWARFCompileUnit *CU = Units[I];
+    CU->getAbbreviations();
+    DWARFDie UnitDie = CU->getUnitDIE();
+    if (UnitDie && UnitDie.find({dwarf::DW_AT_GNU_dwo_name,
+                                 dwarf::DW_AT_dwo_name}))
+      SequentialUnits.push_back(I);
+    else
+      ParallelUnits.push_back(I);
   }
+  parallel::for_each(parallel::par, ParallelUnits.begin(),
+                     ParallelUnits.end(), [&](size_t I) {
+                       Units[I]->collectAddressRanges(UnitRanges[I]);
+                     });
+  for (size_t I : SequentialUnits)
+    Units[I]->collectAddressRanges(UnitRanges[I]);
+
+  // Append the ranges in unit order to keep the result deterministic.
+  for (size_t I = 0, E = Units.size(); I != E; ++I)
+    for (const auto &R : UnitRanges[I])
+      appendRange(Units[I]->getOffset(), R.LowPC, R.HighPC);
 
   construct();
 }
@@ -129,3 +156,9 @@ uint32_t DWARFDebugAranges::findAddress(uint64_t Address) const {
   }
   return -1U;
 }
+
+void DWARFDebugAranges::forEachRange(
+    function_ref<void(uint64_t LowPC, uint64_t HighPC)> Callback) const {
+  for (const Range &R : Aranges)
+    Callback(R.LowPC, R.HighPC());
+}
@@ -18,9 +18,12 @@
 #include "llvm/DebugInfo/DWARF/DWARFSection.h"
 #include "llvm/DebugInfo/DWARF/DWARFAcceleratorTable.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/raw_ostream.h"
 #include <map>
+#include <mutex>
 #include <set>
+#include <string>
 #include <vector>
 
 using namespace llvm;
@@ -266,10 +269,28 @@ bool DWARFVerifier::handleDebugInfo() {
   bool hasDIE = DebugInfoData.isValidOffset(Offset);
   DWARFUnitSection<DWARFTypeUnit> TUSection{};
   DWARFUnitSection<DWARFCompileUnit> CUSection{};
+
+  // The header chain is walked sequentially. The contents of the units with
+  // a valid header are verified afterwards, possibly in parallel, and the
+  // output of each unit follows the output of its header.
+  struct UnitInfo {
+    std::string HeaderOutput;
+    std::unique_ptr<DWARFUnit> Unit;
+    uint8_t UnitType = 0;
+  };
+  std::vector<UnitInfo> Units;
   while (hasDIE) {
     OffsetStart = Offset;
-    if (!verifyUnitHeader(DebugInfoData, &Offset, UnitIdx, UnitType,
-                          isUnitDWARF64)) {
+    Units.emplace_back();
+    UnitInfo &Info = Units.back();
+    bool ValidHeader;
+    {
+      raw_string_ostream HeaderOS(Info.HeaderOutput);
+      DWARFVerifier HeaderVerifier(HeaderOS, DCtx, DumpOpts);
+      ValidHeader = HeaderVerifier.verifyUnitHeader(
+          DebugInfoData, &Offset, UnitIdx, UnitType, isUnitDWARF64);
+    }
+    if (!ValidHeader) {
       isHeaderChainValid = false;
       if (isUnitDWARF64)
         break;
@@ -304,12 +325,36 @@ bool DWARFVerifier::handleDebugInfo() {
       default: { llvm_unreachable("Invalid UnitType."); }
       }
       Unit->extract(DebugInfoData, &OffsetStart);
-      if (!verifyUnitContents(*Unit, UnitType))
-        ++NumDebugInfoErrors;
+      // The abbreviation set is looked up through a cache shared by all
+      // units, so resolve it before verifying units in parallel.
+      Unit->getAbbreviations();
+      Info.Unit = std::move(Unit);
+      Info.UnitType = UnitType;
     }
     hasDIE = DebugInfoData.isValidOffset(Offset);
     ++UnitIdx;
   }
+
+  // Dumping a DIE may look up other units of the context.
+  DCtx.getNumCompileUnits();
+
+  std::mutex ResultMutex;
+  forEachBuffered(Units.size(), [&](size_t I, DWARFVerifier &UnitVerifier) {
+    UnitInfo &Info = Units[I];
+    UnitVerifier.OS << Info.HeaderOutput;
+    if (!Info.Unit)
+      return;
+    bool Valid = UnitVerifier.verifyUnitContents(*Info.Unit, Info.UnitType);
+    Info.Unit.reset();
+
+    std::lock_guard<std::mutex> Lock(ResultMutex);
+    if (!Valid)
+      ++NumDebugInfoErrors;
+    for (auto &Pair : UnitVerifier.ReferenceToDIEOffsets)
+      ReferenceToDIEOffsets[Pair.first].insert(Pair.second.begin(),
+                                               Pair.second.end());
+  });
+
   if (UnitIdx == 0 && !hasDIE) {
     warn() << ".debug_info is empty.\n";
     isHeaderChainValid = true;
@@ -352,8 +397,8 @@ unsigned DWARFVerifier::verifyDieRanges(const DWARFDie &Die,
   if (IntersectingChild != ParentRI.Children.end()) {
     ++NumErrors;
     error() << "DIEs have overlapping address ranges:";
-    Die.dump(OS, 0);
-    IntersectingChild->Die.dump(OS, 0);
+    dump(Die, DIDumpOptions());
+    dump(IntersectingChild->Die, DIDumpOptions());
     OS << "\n";
   }
 
@@ -365,8 +410,8 @@ unsigned DWARFVerifier::verifyDieRanges(const DWARFDie &Die,
     ++NumErrors;
     error() << "DIE address ranges are not "
                "contained in its parent's ranges:";
-    Die.dump(OS, 0);
-    ParentRI.Die.dump(OS, 0);
+    dump(Die, DIDumpOptions());
+    dump(ParentRI.Die, DIDumpOptions());
     OS << "\n";
   }
 
@@ -383,7 +428,7 @@ unsigned DWARFVerifier::verifyDebugInfoAttribute(const DWARFDie &Die,
   auto ReportError = [&](const Twine &TitleMsg) {
     ++NumErrors;
     error() << TitleMsg << '\n';
-    Die.dump(OS, 0, DumpOpts);
+    dump(Die, DumpOpts);
     OS << "\n";
   };
 
@@ -459,7 +504,7 @@ unsigned DWARFVerifier::verifyDebugInfoForm(const DWARFDie &Die,
                 << format("0x%08" PRIx64, CUOffset)
                 << " is invalid (must be less than CU size of "
                 << format("0x%08" PRIx32, CUSize) << "):\n";
-        Die.dump(OS, 0, DumpOpts);
+        dump(Die, DumpOpts);
         OS << "\n";
       } else {
         // Valid reference, but we will verify it points to an actual
@@ -479,7 +524,7 @@ unsigned DWARFVerifier::verifyDebugInfoForm(const DWARFDie &Die,
         ++NumErrors;
         error() << "DW_FORM_ref_addr offset beyond .debug_info "
                    "bounds:\n";
-        Die.dump(OS, 0, DumpOpts);
+        dump(Die, DumpOpts);
         OS << "\n";
       } else {
         // Valid reference, but we will verify it points to an actual
@@ -495,7 +540,7 @@ unsigned DWARFVerifier::verifyDebugInfoForm(const DWARFDie &Die,
     if (SecOffset && *SecOffset >= DObj.getStringSection().size()) {
       ++NumErrors;
       error() << "DW_FORM_strp offset beyond .debug_str bounds:\n";
-      Die.dump(OS, 0, DumpOpts);
+      dump(Die, DumpOpts);
       OS << "\n";
     }
     break;
@@ -574,90 +619,106 @@ void DWARFVerifier::verifyDebugLineStmtOffsets() {
 }
 
 void DWARFVerifier::verifyDebugLineRows() {
+  // Parse the line tables up front: they are cached in the context, which is
+  // not safe to update from several threads.
+  std::vector<std::pair<DWARFUnit *, const DWARFDebugLine::LineTable *>>
+      LineTables;
   for (const auto &CU : DCtx.compile_units()) {
-    auto Die = CU->getUnitDIE();
     auto LineTable = DCtx.getLineTableForUnit(CU.get());
     // If there is no line table we will have created an error in the
     // .debug_info verifier or in verifyDebugLineStmtOffsets().
     if (!LineTable)
       continue;
+    LineTables.emplace_back(CU.get(), LineTable);
+  }
 
-    // Verify prologue.
-    uint32_t MaxFileIndex = LineTable->Prologue.FileNames.size();
-    uint32_t MaxDirIndex = LineTable->Prologue.IncludeDirectories.size();
-    uint32_t FileIndex = 1;
-    StringMap<uint16_t> FullPathMap;
-    for (const auto &FileName : LineTable->Prologue.FileNames) {
-      // Verify directory index.
-      if (FileName.DirIdx > MaxDirIndex) {
-        ++NumDebugLineErrors;
-        error() << ".debug_line["
-                << format("0x%08" PRIx64,
-                          *toSectionOffset(Die.find(DW_AT_stmt_list)))
-                << "].prologue.file_names[" << FileIndex
-                << "].dir_idx contains an invalid index: " << FileName.DirIdx
-                << "\n";
-      }
+  std::mutex ResultMutex;
+  forEachBuffered(LineTables.size(), [&](size_t I, DWARFVerifier &Verifier) {
+    Verifier.verifyLineTableRows(*LineTables[I].first, *LineTables[I].second);
+    std::lock_guard<std::mutex> Lock(ResultMutex);
+    NumDebugLineErrors += Verifier.NumDebugLineErrors;
+  });
+}
 
-      // Check file paths for duplicates.
-      std::string FullPath;
-      const bool HasFullPath = LineTable->getFileNameByIndex(
-          FileIndex, CU->getCompilationDir(),
-          DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath, FullPath);
-      assert(HasFullPath && "Invalid index?");
-      (void)HasFullPath;
-      auto It = FullPathMap.find(FullPath);
-      if (It == FullPathMap.end())
-        FullPathMap[FullPath] = FileIndex;
-      else if (It->second != FileIndex) {
-        warn() << ".debug_line["
-               << format("0x%08" PRIx64,
-                         *toSectionOffset(Die.find(DW_AT_stmt_list)))
-               << "].prologue.file_names[" << FileIndex
-               << "] is a duplicate of file_names[" << It->second << "]\n";
-      }
+void DWARFVerifier::verifyLineTableRows(
+    DWARFUnit &CU, const DWARFDebugLine::LineTable &LineTable) {
+  auto Die = CU.getUnitDIE();
+
+  // Verify prologue.
+  uint32_t MaxFileIndex = LineTable.Prologue.FileNames.size();
+  uint32_t MaxDirIndex = LineTable.Prologue.IncludeDirectories.size();
+  uint32_t FileIndex = 1;
+  StringMap<uint16_t> FullPathMap;
+  for (const auto &FileName : LineTable.Prologue.FileNames) {
+    // Verify directory index.
+    if (FileName.DirIdx > MaxDirIndex) {
+      ++NumDebugLineErrors;
+      error() << ".debug_line["
+              << format("0x%08" PRIx64,
+                        *toSectionOffset(Die.find(DW_AT_stmt_list)))
+              << "].prologue.file_names[" << FileIndex
+              << "].dir_idx contains an invalid index: " << FileName.DirIdx
+              << "\n";
+    }
 
-      FileIndex++;
+    // Check file paths for duplicates.
+    std::string FullPath;
+    const bool HasFullPath = LineTable.getFileNameByIndex(
+        FileIndex, CU.getCompilationDir(),
+        DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath, FullPath);
+    assert(HasFullPath && "Invalid index?");
+    (void)HasFullPath;
+    auto It = FullPathMap.find(FullPath);
+    if (It == FullPathMap.end())
+      FullPathMap[FullPath] = FileIndex;
+    else if (It->second != FileIndex) {
+      warn() << ".debug_line["
+             << format("0x%08" PRIx64,
+                       *toSectionOffset(Die.find(DW_AT_stmt_list)))
+             << "].prologue.file_names[" << FileIndex
+             << "] is a duplicate of file_names[" << It->second << "]\n";
     }
 
-    // Verify rows.
-    uint64_t PrevAddress = 0;
-    uint32_t RowIndex = 0;
-    for (const auto &Row : LineTable->Rows) {
-      // Verify row address.
-      if (Row.Address < PrevAddress) {
-        ++NumDebugLineErrors;
-        error() << ".debug_line["
-                << format("0x%08" PRIx64,
-                          *toSectionOffset(Die.find(DW_AT_stmt_list)))
-                << "] row[" << RowIndex
-                << "] decreases in address from previous row:\n";
-
-        DWARFDebugLine::Row::dumpTableHeader(OS);
-        if (RowIndex > 0)
-          LineTable->Rows[RowIndex - 1].dump(OS);
-        Row.dump(OS);
-        OS << '\n';
-      }
+    FileIndex++;
+  }
 
-      // Verify file index.
-      if (Row.File > MaxFileIndex) {
-        ++NumDebugLineErrors;
-        error() << ".debug_line["
-                << format("0x%08" PRIx64,
-                          *toSectionOffset(Die.find(DW_AT_stmt_list)))
-                << "][" << RowIndex << "] has invalid file index " << Row.File
-                << " (valid values are [1," << MaxFileIndex << "]):\n";
-        DWARFDebugLine::Row::dumpTableHeader(OS);
-        Row.dump(OS);
-        OS << '\n';
-      }
-      if (Row.EndSequence)
-        PrevAddress = 0;
-      else
-        PrevAddress = Row.Address;
-      ++RowIndex;
+  // Verify rows.
+  uint64_t PrevAddress = 0;
+  uint32_t RowIndex = 0;
+  for (const auto &Row : LineTable.Rows) {
+    // Verify row address.
+    if (Row.Address < PrevAddress) {
+      ++NumDebugLineErrors;
+      error() << ".debug_line["
+              << format("0x%08" PRIx64,
+                        *toSectionOffset(Die.find(DW_AT_stmt_list)))
+              << "] row[" << RowIndex
+              << "] decreases in address from previous row:\n";
+
+      DWARFDebugLine::Row::dumpTableHeader(OS);
+      if (RowIndex > 0)
+        LineTable.Rows[RowIndex - 1].dump(OS);
+      Row.dump(OS);
+      OS << '\n';
+    }
+
+    // Verify file index.
+    if (Row.File > MaxFileIndex) {
+      ++NumDebugLineErrors;
+      error() << ".debug_line["
+              << format("0x%08" PRIx64,
+                        *toSectionOffset(Die.find(DW_AT_stmt_list)))
+              << "][" << RowIndex << "] has invalid file index " << Row.File
+              << " (valid values are [1," << MaxFileIndex << "]):\n";
+      DWARFDebugLine::Row::dumpTableHeader(OS);
+      Row.dump(OS);
+      OS << '\n';
     }
+    if (Row.EndSequence)
+      PrevAddress = 0;
+    else
+      PrevAddress = Row.Address;
+    ++RowIndex;
   }
 }
 
@@ -792,6 +853,45 @@ bool DWARFVerifier::handleAccelTables() {
   return NumErrors == 0;
 }
 
+void DWARFVerifier::dump(const DWARFDie &Die, DIDumpOptions Opts) const {
+  if (!DumpMutex) {
+    Die.dump(OS, 0, Opts);
+    return;
+  }
+  std::lock_guard<std::mutex> Lock(*DumpMutex);
+  Die.dump(OS, 0, Opts);
+}
+
+bool DWARFVerifier::shouldVerifyInParallel() const {
+#if LLVM_ENABLE_THREADS
+  return !OS.has_colors();
+#else
+  return false;
+#endif
+}
+
+void DWARFVerifier::forEachBuffered(
+    size_t Count, function_ref<void(size_t, DWARFVerifier &)> Verify) {
+  if (!shouldVerifyInParallel()) {
+    for (size_t I = 0; I != Count; ++I) {
+      DWARFVerifier Verifier(OS, DCtx, DumpOpts);
+      Verify(I, Verifier);
+    }
+    return;
+  }
+
+  std::vector<std::string> Outputs(Count);
+  std::mutex Mutex;
+  parallel::for_each_n(parallel::par, size_t(0), Count, [&](size_t I) {
+    raw_string_ostream BufferOS(Outputs[I]);
+    DWARFVerifier Verifier(BufferOS, DCtx, DumpOpts);
+    Verifier.DumpMutex = &Mutex;
+    Verify(I, Verifier);
+  });
+  for (const std::string &Output : Outputs)
+    OS << Output;
+}
+
 raw_ostream &DWARFVerifier::error() const {
   return WithColor(OS, syntax::Error).get() << "error: ";
 }
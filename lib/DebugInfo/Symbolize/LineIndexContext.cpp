@@ -0,0 +1,304 @@
+//===- LineIndexContext.cpp -----------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Implementation of the LineIndexContext class.
+//
+// The serialized index is little-endian:
+//   "LLVMSYMI" magic, u32 version, u32 function name kind
+//   u32 count, then that many NUL-terminated strings
+//   u32 count, then that many frames as six u32 (file name and function name
+//       string ids, line, column, start line, discriminator)
+//   u32 count, then that many u32 frame ids (the inlined frame lists)
+//   u32 count, then that many ranges as u64 start address and three u32 (line
+//       frame id, first inlined frame, number of inlined frames), sorted by
+//       strictly increasing start address
+//
+//===----------------------------------------------------------------------===//
+
+#include "LineIndexContext.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFDebugAranges.h"
+#include "llvm/DebugInfo/DWARF/DWARFDebugLine.h"
+#include "llvm/DebugInfo/DWARF/DWARFDie.h"
+#include "llvm/DebugInfo/DWARF/DWARFUnit.h"
+#include "llvm/Support/DataExtractor.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+using namespace llvm;
+using namespace symbolize;
+
+static const char IndexMagic[] = "LLVMSYMI";
+static const uint32_t IndexVersion = 1;
+
+std::unique_ptr<LineIndexContext>
+LineIndexContext::build(DWARFContext &DICtx, DINameKind FNKind) {
+  // The results of the DWARF queries can only change at the start or end of
+  // a compile unit range, a DIE range or a line table row, so it is enough to
+  // query each of these addresses.
+  std::vector<uint64_t> Boundaries;
+  Boundaries.push_back(0);
+  for (const auto &CU : DICtx.compile_units()) {
+    if (CU->getDWOId())
+      return nullptr;
+    if (const DWARFDebugLine::LineTable *LineTable =
+            DICtx.getLineTableForUnit(CU.get()))
+      for (const DWARFDebugLine::Row &Row : LineTable->Rows)
+        Boundaries.push_back(Row.Address);
+    for (unsigned I = 0, E = CU->getNumDIEs(); I != E; ++I) {
+      for (const DWARFAddressRange &R :
+           CU->getDIEAtIndex(I).getAddressRanges()) {
+        Boundaries.push_back(R.LowPC);
+        Boundaries.push_back(R.HighPC);
+      }
+    }
+  }
+  DICtx.getDebugAranges()->forEachRange([&](uint64_t LowPC, uint64_t HighPC) {
+    Boundaries.push_back(LowPC);
+    Boundaries.push_back(HighPC);
+  });
+  std::sort(Boundaries.begin(), Boundaries.end());
+  Boundaries.erase(std::unique(Boundaries.begin(), Boundaries.end()),
+                   Boundaries.end());
+
+  std::unique_ptr<LineIndexContext> Index(new LineIndexContext(FNKind));
+  StringMap<uint32_t> StringIds;
+  auto GetStringId = [&](const std::string &S) {
+    auto Inserted = StringIds.insert(std::make_pair(S, Index->Strings.size()));
+    if (Inserted.second)
+      Index->Strings.push_back(S);
+    return Inserted.first->second;
+  };
+  std::map<DILineInfo, uint32_t> FrameIds;
+  auto GetFrameId = [&](const DILineInfo &Info) {
+    auto Inserted = FrameIds.insert(std::make_pair(Info, Index->Frames.size()));
+    if (Inserted.second)
+      Index->Frames.push_back({GetStringId(Info.FileName),
+                               GetStringId(Info.FunctionName), Info.Line,
+                               Info.Column, Info.StartLine,
+                               Info.Discriminator});
+    return Inserted.first->second;
+  };
+
+  DILineInfoSpecifier Spec(
+      DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath, FNKind);
+  SmallVector<uint32_t, 4> Inlined;
+  for (uint64_t Address : Boundaries) {
+    uint32_t LineFrame = GetFrameId(DICtx.getLineInfoForAddress(Address, Spec));
+    DIInliningInfo InliningInfo =
+        DICtx.getInliningInfoForAddress(Address, Spec);
+    Inlined.clear();
+    for (uint32_t I = 0, E = InliningInfo.getNumberOfFrames(); I != E; ++I)
+      Inlined.push_back(GetFrameId(InliningInfo.getFrame(I)));
+
+    // Extend the previous range if nothing changed at this address.
+    if (!Index->Ranges.empty()) {
+      const Range &Last = Index->Ranges.back();
+      if (Last.LineFrame == LineFrame &&
+          makeArrayRef(Index->InlinedFrames)
+              .slice(Last.FirstInlined, Last.NumInlined)
+              .equals(Inlined))
+        continue;
+    }
+    Index->Ranges.push_back({Address, LineFrame,
+                             static_cast<uint32_t>(Index->InlinedFrames.size()),
+                             static_cast<uint32_t>(Inlined.size())});
+    Index->InlinedFrames.insert(Index->InlinedFrames.end(), Inlined.begin(),
+                                Inlined.end());
+  }
+  return Index;
+}
+
+Expected<std::unique_ptr<LineIndexContext>>
+LineIndexContext::load(StringRef Buffer, DINameKind FNKind) {
+  auto Malformed = [] {
+    return make_error<StringError>("malformed line index",
+                                   inconvertibleErrorCode());
+  };
+  DataExtractor Data(Buffer, /*IsLittleEndian=*/true, 8);
+  uint32_t Offset = 0;
+  // Checks that Count records of Size bytes fit in the rest of the buffer.
+  auto Fits = [&](uint64_t Count, uint64_t Size) {
+    return Count * Size <= Buffer.size() - Offset;
+  };
+
+  StringRef Magic(IndexMagic);
+  if (!Buffer.startswith(Magic))
+    return Malformed();
+  Offset = Magic.size();
+  if (!Fits(2, 4))
+    return Malformed();
+  if (Data.getU32(&Offset) != IndexVersion ||
+      Data.getU32(&Offset) != static_cast<uint32_t>(FNKind))
+    return Malformed();
+
+  std::unique_ptr<LineIndexContext> Index(new LineIndexContext(FNKind));
+  if (!Fits(1, 4))
+    return Malformed();
+  uint32_t NumStrings = Data.getU32(&Offset);
+  if (!Fits(NumStrings, 1))
+    return Malformed();
+  Index->Strings.reserve(NumStrings);
+  for (uint32_t I = 0; I != NumStrings; ++I) {
+    const char *S = Data.getCStr(&Offset);
+    if (!S)
+      return Malformed();
+    Index->Strings.push_back(S);
+  }
+
+  if (!Fits(1, 4))
+    return Malformed();
+  uint32_t NumFrames = Data.getU32(&Offset);
+  if (!Fits(NumFrames, 6 * 4))
+    return Malformed();
+  Index->Frames.resize(NumFrames);
+  for (Frame &F : Index->Frames) {
+    F.FileName = Data.getU32(&Offset);
+    F.FunctionName = Data.getU32(&Offset);
+    F.Line = Data.getU32(&Offset);
+    F.Column = Data.getU32(&Offset);
+    F.StartLine = Data.getU32(&Offset);
+    F.Discriminator = Data.getU32(&Offset);
+    if (F.FileName >= NumStrings || F.FunctionName >= NumStrings)
+      return Malformed();
+  }
+
+  if (!Fits(1, 4))
+    return Malformed();
+  uint32_t NumInlined = Data.getU32(&Offset);
+  if (!Fits(NumInlined, 4))
+    return Malformed();
+  Index->InlinedFrames.resize(NumInlined);
+  for (uint32_t &Id : Index->InlinedFrames) {
+    Id = Data.getU32(&Offset);
+    if (Id >= NumFrames)
+      return Malformed();
+  }
+
+  if (!Fits(1, 4))
+    return Malformed();
+  uint32_t NumRanges = Data.getU32(&Offset);
+  if (!Fits(NumRanges, 8 + 3 * 4))
+    return Malformed();
+  Index->Ranges.resize(NumRanges);
+  for (uint32_t I = 0; I != NumRanges; ++I) {
+    Range &R = Index->Ranges[I];
+    R.Start = Data.getU64(&Offset);
+    R.LineFrame = Data.getU32(&Offset);
+    R.FirstInlined = Data.getU32(&Offset);
+    R.NumInlined = Data.getU32(&Offset);
+    if (R.LineFrame >= NumFrames ||
+        uint64_t(R.FirstInlined) + R.NumInlined > NumInlined ||
+        (I && R.Start <= Index->Ranges[I - 1].Start))
+      return Malformed();
+  }
+
+  if (Offset != Buffer.size())
+    return Malformed();
+  return std::move(Index);
+}
+
+void LineIndexContext::write(raw_ostream &OS) const {
+  support::endian::Writer<support::little> W(OS);
+  OS << IndexMagic;
+  W.write<uint32_t>(IndexVersion);
+  W.write<uint32_t>(static_cast<uint32_t>(FNKind));
+  W.write<uint32_t>(Strings.size());
+  for (const std::string &S : Strings)
+    OS << S << '\0';
+  W.write<uint32_t>(Frames.size());
+  for (const Frame &F : Frames) {
+    W.write<uint32_t>(F.FileName);
+    W.write<uint32_t>(F.FunctionName);
+    W.write<uint32_t>(F.Line);
+    W.write<uint32_t>(F.Column);
+    W.write<uint32_t>(F.StartLine);
+    W.write<uint32_t>(F.Discriminator);
+  }
+  W.write<uint32_t>(InlinedFrames.size());
+  W.write<uint32_t>(InlinedFrames);
+  W.write<uint32_t>(Ranges.size());
+  for (const Range &R : Ranges) {
+    W.write<uint64_t>(R.Start);
+    W.write<uint32_t>(R.LineFrame);
+    W.write<uint32_t>(R.FirstInlined);
+    W.write<uint32_t>(R.NumInlined);
+  }
+}
+
+void LineIndexContext::dump(raw_ostream &OS, DIDumpOptions DumpOpts) {
+  OS << "Line index: " << Ranges.size() << " ranges, " << Frames.size()
+     << " frames\n";
+  for (const Range &R : Ranges) {
+    DILineInfo Info = getFrame(R.LineFrame);
+    OS << format_hex(R.Start, 18) << ": " << Info.FileName << ':' << Info.Line
+       << ':' << Info.Column << ' ' << Info.FunctionName << '\n';
+  }
+}
+
+bool LineIndexContext::matches(DILineInfoSpecifier Specifier) const {
+  return Specifier.FLIKind ==
+             DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath &&
+         Specifier.FNKind == FNKind;
+}
+
+const LineIndexContext::Range *
+LineIndexContext::findRange(uint64_t Address) const {
+  auto It = std::upper_bound(
+      Ranges.begin(), Ranges.end(), Address,
+      [](uint64_t Address, const Range &R) { return Address < R.Start; });
+  if (It == Ranges.begin())
+    return nullptr;
+  return &*std::prev(It);
+}
+
+DILineInfo LineIndexContext::getFrame(uint32_t Index) const {
+  const Frame &F = Frames[Index];
+  DILineInfo Info;
+  Info.FileName = Strings[F.FileName];
+  Info.FunctionName = Strings[F.FunctionName];
+  Info.Line = F.Line;
+  Info.Column = F.Column;
+  Info.StartLine = F.StartLine;
+  Info.Discriminator = F.Discriminator;
+  return Info;
+}
+
+DILineInfo LineIndexContext::getLineInfoForAddress(
+    uint64_t Address, DILineInfoSpecifier Specifier) {
+  const Range *R = matches(Specifier) ? findRange(Address) : nullptr;
+  if (!R)
+    return DILineInfo();
+  return getFrame(R->LineFrame);
+}
+
+DILineInfoTable LineIndexContext::getLineInfoForAddressRange(
+    uint64_t Address, uint64_t Size, DILineInfoSpecifier Specifier) {
+  // Only the queries made by the symbolizer are indexed.
+  return DILineInfoTable();
+}
+
+DIInliningInfo LineIndexContext::getInliningInfoForAddress(
+    uint64_t Address, DILineInfoSpecifier Specifier) {
+  DIInliningInfo InliningInfo;
+  const Range *R = matches(Specifier) ? findRange(Address) : nullptr;
+  if (!R)
+    return InliningInfo;
+  for (uint32_t I = 0; I != R->NumInlined; ++I)
+    InliningInfo.addFrame(getFrame(InlinedFrames[R->FirstInlined + I]));
+  return InliningInfo;
+}
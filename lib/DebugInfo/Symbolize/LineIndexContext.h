@@ -0,0 +1,106 @@
+//===- LineIndexContext.h ---------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the LineIndexContext class, a DIContext answering
+// symbolizer queries from a precomputed address-to-line index that can be
+// saved to and loaded from disk.
+//
+//===----------------------------------------------------------------------===//
+#ifndef LLVM_LIB_DEBUGINFO_SYMBOLIZE_LINEINDEXCONTEXT_H
+#define LLVM_LIB_DEBUGINFO_SYMBOLIZE_LINEINDEXCONTEXT_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/Support/Error.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+class DWARFContext;
+
+namespace symbolize {
+
+/// A DIContext backed by a sorted table of address ranges, each mapped to the
+/// line info and inlined frames the DWARF context returns for every address
+/// in the range. The index only answers queries made with the specifier it
+/// was built for (absolute file paths and the given function name kind);
+/// other queries return empty results.
+class LineIndexContext : public DIContext {
+public:
+  static bool classof(const DIContext *DICtx) {
+    return DICtx->getKind() == CK_LineIndex;
+  }
+
+  /// Indexes every address covered by \p DICtx. Returns nullptr if the debug
+  /// info refers to split DWARF units, whose contents are not part of the
+  /// indexed object.
+  static std::unique_ptr<LineIndexContext>
+  build(DWARFContext &DICtx, DINameKind FNKind);
+
+  /// Reads an index written by write(). Fails if \p Buffer is not a valid
+  /// index or was built for a different function name kind.
+  static Expected<std::unique_ptr<LineIndexContext>> load(StringRef Buffer,
+                                                          DINameKind FNKind);
+
+  /// Serializes the index into \p OS.
+  void write(raw_ostream &OS) const;
+
+  void dump(raw_ostream &OS, DIDumpOptions DumpOpts) override;
+
+  DILineInfo getLineInfoForAddress(
+      uint64_t Address,
+      DILineInfoSpecifier Specifier = DILineInfoSpecifier()) override;
+  DILineInfoTable getLineInfoForAddressRange(
+      uint64_t Address, uint64_t Size,
+      DILineInfoSpecifier Specifier = DILineInfoSpecifier()) override;
+  DIInliningInfo getInliningInfoForAddress(
+      uint64_t Address,
+      DILineInfoSpecifier Specifier = DILineInfoSpecifier()) override;
+
+private:
+  struct Frame {
+    uint32_t FileName;
+    uint32_t FunctionName;
+    uint32_t Line;
+    uint32_t Column;
+    uint32_t StartLine;
+    uint32_t Discriminator;
+  };
+
+  /// Addresses from Start up to the Start of the next range share the line
+  /// info LineFrame and the inlined frames
+  /// InlinedFrames[FirstInlined, FirstInlined + NumInlined).
+  struct Range {
+    uint64_t Start;
+    uint32_t LineFrame;
+    uint32_t FirstInlined;
+    uint32_t NumInlined;
+  };
+
+  explicit LineIndexContext(DINameKind FNKind)
+      : DIContext(CK_LineIndex), FNKind(FNKind) {}
+
+  bool matches(DILineInfoSpecifier Specifier) const;
+  const Range *findRange(uint64_t Address) const;
+  DILineInfo getFrame(uint32_t Index) const;
+
+  DINameKind FNKind;
+  std::vector<std::string> Strings;
+  std::vector<Frame> Frames;
+  std::vector<Range> Ranges;
+  std::vector<uint32_t> InlinedFrames;
+};
+
+} // end namespace symbolize
+} // end namespace llvm
+
+#endif // LLVM_LIB_DEBUGINFO_SYMBOLIZE_LINEINDEXCONTEXT_H
@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "SymbolizableObjectFile.h"
+#include "LineIndexContext.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Triple.h"
@@ -211,11 +212,13 @@ bool SymbolizableObjectFile::getNameFromSymbolTable(SymbolRef::Type Type,
 bool SymbolizableObjectFile::shouldOverrideWithSymbolTable(
     FunctionNameKind FNKind, bool UseSymbolTable) const {
   // When DWARF is used with -gline-tables-only / -gmlt, the symbol table gives
-  // better answers for linkage names than the DIContext. Otherwise, we are
-  // probably using PEs and PDBs, and we shouldn't do the override. PE files
-  // generally only contain the names of exported symbols.
+  // better answers for linkage names than the DIContext. This also holds for
+  // line indexes, which are built from DWARF. Otherwise, we are probably using
+  // PEs and PDBs, and we shouldn't do the override. PE files generally only
+  // contain the names of exported symbols.
   return FNKind == FunctionNameKind::LinkageName && UseSymbolTable &&
-         isa<DWARFContext>(DebugInfoContext.get());
+         (isa<DWARFContext>(DebugInfoContext.get()) ||
+          isa<LineIndexContext>(DebugInfoContext.get()));
 }
 
 DILineInfo SymbolizableObjectFile::symbolizeCode(uint64_t ModuleOffset,
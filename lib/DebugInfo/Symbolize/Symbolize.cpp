@@ -13,8 +13,10 @@
 
 #include "llvm/DebugInfo/Symbolize/Symbolize.h"
 
+#include "LineIndexContext.h"
 #include "SymbolizableObjectFile.h"
 
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/BinaryFormat/COFF.h"
 #include "llvm/Config/config.h"
@@ -28,10 +30,13 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/Compression.h"
 #include "llvm/Support/DataExtractor.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdlib>
@@ -56,8 +61,9 @@ namespace symbolize {
 Expected<DILineInfo>
 LLVMSymbolizer::symbolizeCode(const std::string &ModuleName,
                               uint64_t ModuleOffset, StringRef DWPName) {
+  std::unique_lock<std::mutex> ModuleLock;
   SymbolizableModule *Info;
-  if (auto InfoOrErr = getOrCreateModuleInfo(ModuleName, DWPName))
+  if (auto InfoOrErr = getAndLockModuleInfo(ModuleName, DWPName, ModuleLock))
     Info = InfoOrErr.get();
   else
     return InfoOrErr.takeError();
@@ -82,8 +88,9 @@ LLVMSymbolizer::symbolizeCode(const std::string &ModuleName,
 Expected<DIInliningInfo>
 LLVMSymbolizer::symbolizeInlinedCode(const std::string &ModuleName,
                                      uint64_t ModuleOffset, StringRef DWPName) {
+  std::unique_lock<std::mutex> ModuleLock;
   SymbolizableModule *Info;
-  if (auto InfoOrErr = getOrCreateModuleInfo(ModuleName, DWPName))
+  if (auto InfoOrErr = getAndLockModuleInfo(ModuleName, DWPName, ModuleLock))
     Info = InfoOrErr.get();
   else
     return InfoOrErr.takeError();
@@ -111,8 +118,9 @@ LLVMSymbolizer::symbolizeInlinedCode(const std::string &ModuleName,
 
 Expected<DIGlobal> LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
                                                  uint64_t ModuleOffset) {
+  std::unique_lock<std::mutex> ModuleLock;
   SymbolizableModule *Info;
-  if (auto InfoOrErr = getOrCreateModuleInfo(ModuleName))
+  if (auto InfoOrErr = getAndLockModuleInfo(ModuleName, "", ModuleLock))
     Info = InfoOrErr.get();
   else
     return InfoOrErr.takeError();
@@ -135,6 +143,7 @@ Expected<DIGlobal> LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
 }
 
 void LLVMSymbolizer::flush() {
+  std::lock_guard<std::mutex> Lock(Mutex);
   ObjectForUBPathAndArch.clear();
   BinaryForPath.clear();
   ObjectPairForPathArch.clear();
@@ -240,6 +249,73 @@ bool darwinDsymMatchesBinary(const MachOObjectFile *DbgObj,
   return !memcmp(dbg_uuid.data(), bin_uuid.data(), dbg_uuid.size());
 }
 
+// Returns the path of the line index cache entry for the debug info in Obj.
+// The key covers the file's path, modification time and size, its build ID
+// (or Mach-O UUID) when it has one, and everything else the index depends on.
+// Returns an empty string if the file backing Obj can't be identified.
+std::string getLineIndexCachePath(StringRef CacheDir, const ObjectFile &Obj,
+                                  StringRef ArchName, FunctionNameKind FNKind) {
+  SmallString<128> Path(Obj.getFileName());
+  sys::fs::file_status Status;
+  if (sys::fs::make_absolute(Path) || sys::fs::status(Path, Status))
+    return "";
+
+  MD5 Hasher;
+  auto AddInteger = [&](uint64_t Value) {
+    uint8_t Bytes[8];
+    support::endian::write64le(Bytes, Value);
+    Hasher.update(Bytes);
+  };
+  Hasher.update(Path);
+  Hasher.update(ArchName);
+  AddInteger(Status.getLastModificationTime().time_since_epoch().count());
+  AddInteger(Status.getSize());
+  AddInteger(static_cast<uint64_t>(FNKind));
+  if (auto *MachObj = dyn_cast<MachOObjectFile>(&Obj)) {
+    Hasher.update(MachObj->getUuid());
+  } else {
+    for (const SectionRef &Section : Obj.sections()) {
+      StringRef Name, Contents;
+      Section.getName(Name);
+      if (Name == ".note.gnu.build-id" && !Section.getContents(Contents))
+        Hasher.update(Contents);
+    }
+  }
+  MD5::MD5Result Result;
+  Hasher.final(Result);
+
+  SmallString<128> EntryPath;
+  sys::path::append(EntryPath, CacheDir, "llvmsym-" + Result.digest());
+  return EntryPath.str();
+}
+
+// Saves Index as the cache entry at EntryPath. The index is written to a
+// temporary file which is then renamed into place, so that concurrent
+// symbolizers never read a partial entry. Failures are ignored, as the cache
+// only saves work.
+void writeLineIndexCacheEntry(const LineIndexContext &Index,
+                              StringRef CacheDir, StringRef EntryPath) {
+  if (sys::fs::create_directories(CacheDir))
+    return;
+  SmallString<128> TempModel, TempPath;
+  sys::path::append(TempModel, CacheDir, "llvmsym-%%%%%%.tmp");
+  int TempFD;
+  if (sys::fs::createUniqueFile(TempModel, TempFD, TempPath))
+    return;
+  {
+    raw_fd_ostream OS(TempFD, /*shouldClose=*/true);
+    Index.write(OS);
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath, EntryPath))
+    sys::fs::remove(TempPath);
+}
+
 } // end anonymous namespace
 
 ObjectFile *LLVMSymbolizer::lookUpDsymFile(const std::string &ExePath,
@@ -364,13 +440,41 @@ LLVMSymbolizer::getOrCreateObject(const std::string &Path,
   return errorCodeToError(object_error::arch_not_found);
 }
 
-Expected<SymbolizableModule *>
-LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName,
-                                      StringRef DWPName) {
-  const auto &I = Modules.find(ModuleName);
-  if (I != Modules.end()) {
-    return I->second.get();
+std::unique_ptr<DIContext>
+LLVMSymbolizer::createDWARFContext(const ObjectFile &Obj,
+                                   const std::string &ArchName,
+                                   StringRef DWPName) {
+  std::string CachePath;
+  if (!Opts.CacheDir.empty())
+    CachePath = getLineIndexCachePath(Opts.CacheDir, Obj, ArchName,
+                                      Opts.PrintFunctions);
+  if (!CachePath.empty()) {
+    if (auto BufferOrErr = MemoryBuffer::getFile(CachePath)) {
+      auto IndexOrErr = LineIndexContext::load((*BufferOrErr)->getBuffer(),
+                                               Opts.PrintFunctions);
+      if (IndexOrErr)
+        return std::move(*IndexOrErr);
+      // A stale or corrupt entry is rebuilt and overwritten below.
+      consumeError(IndexOrErr.takeError());
+    }
   }
+
+  std::unique_ptr<DWARFContext> DICtx = DWARFContext::create(
+      Obj, nullptr, DWARFContext::defaultErrorHandler, DWPName);
+  if (CachePath.empty())
+    return std::move(DICtx);
+  // Split DWARF lives outside of Obj, so it can't be indexed under Obj's key.
+  std::unique_ptr<LineIndexContext> Index =
+      LineIndexContext::build(*DICtx, Opts.PrintFunctions);
+  if (!Index)
+    return std::move(DICtx);
+  writeLineIndexCacheEntry(*Index, Opts.CacheDir, CachePath);
+  return std::move(Index);
+}
+
+Expected<std::unique_ptr<SymbolizableModule>>
+LLVMSymbolizer::createModuleInfo(const std::string &ModuleName,
+                                 StringRef DWPName) {
   std::string BinaryName = ModuleName;
   std::string ArchName = Opts.DefaultArch;
   size_t ColonPos = ModuleName.find_last_of(':');
@@ -382,14 +486,16 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName,
       ArchName = ArchStr;
     }
   }
-  auto ObjectsOrErr = getOrCreateObjectPair(BinaryName, ArchName);
-  if (!ObjectsOrErr) {
-    // Failed to find valid object file.
-    Modules.insert(
-        std::make_pair(ModuleName, std::unique_ptr<SymbolizableModule>()));
-    return ObjectsOrErr.takeError();
+  ObjectPair Objects;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto ObjectsOrErr = getOrCreateObjectPair(BinaryName, ArchName);
+    if (!ObjectsOrErr) {
+      // Failed to find valid object file.
+      return ObjectsOrErr.takeError();
+    }
+    Objects = ObjectsOrErr.get();
   }
-  ObjectPair Objects = ObjectsOrErr.get();
 
   std::unique_ptr<DIContext> Context;
   // If this is a COFF object containing PDB info, use a PDBContext to
@@ -402,29 +508,48 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName,
       using namespace pdb;
       std::unique_ptr<IPDBSession> Session;
       if (auto Err = loadDataForEXE(PDB_ReaderType::DIA,
-                                    Objects.first->getFileName(), Session)) {
-        Modules.insert(
-            std::make_pair(ModuleName, std::unique_ptr<SymbolizableModule>()));
+                                    Objects.first->getFileName(), Session))
         return std::move(Err);
-      }
       Context.reset(new PDBContext(*CoffObject, std::move(Session)));
     }
   }
   if (!Context)
-    Context = DWARFContext::create(*Objects.second, nullptr,
-                                   DWARFContext::defaultErrorHandler, DWPName);
+    Context = createDWARFContext(*Objects.second, ArchName, DWPName);
   assert(Context);
   auto InfoOrErr =
       SymbolizableObjectFile::create(Objects.first, std::move(Context));
-  std::unique_ptr<SymbolizableModule> SymMod;
-  if (InfoOrErr)
-    SymMod = std::move(InfoOrErr.get());
-  auto InsertResult =
-      Modules.insert(std::make_pair(ModuleName, std::move(SymMod)));
-  assert(InsertResult.second);
   if (auto EC = InfoOrErr.getError())
     return errorCodeToError(EC);
-  return InsertResult.first->second.get();
+  return std::move(InfoOrErr.get());
+}
+
+Expected<SymbolizableModule *>
+LLVMSymbolizer::getAndLockModuleInfo(const std::string &ModuleName,
+                                     StringRef DWPName,
+                                     std::unique_lock<std::mutex> &ModuleLock) {
+  ModuleEntry *Entry;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Entry = &Modules[ModuleName];
+  }
+  // Load the module outside of the cache lock, so that reading the debug info
+  // of one module does not block threads working on other modules. Threads
+  // asking for the same module wait on its once-flag, and only the thread
+  // which tried to load it reports the error.
+  Optional<Error> Err;
+  std::call_once(Entry->Created, [&] {
+    auto ModuleOrErr = createModuleInfo(ModuleName, DWPName);
+    if (ModuleOrErr)
+      Entry->Module = std::move(ModuleOrErr.get());
+    else
+      Err = ModuleOrErr.takeError();
+  });
+  if (Err)
+    return std::move(*Err);
+  if (!Entry->Module)
+    return nullptr;
+  ModuleLock = std::unique_lock<std::mutex>(Entry->QueryMutex);
+  return Entry->Module.get();
 }
 
 namespace {
@@ -485,6 +610,9 @@ LLVMSymbolizer::DemangleName(const std::string &Name,
   if (!Name.empty() && Name.front() == '?') {
     // Only do MSVC C++ demangling on symbols starting with '?'.
     char DemangledName[1024] = {0};
+    // DbgHelp functions are not thread-safe.
+    static std::mutex DbgHelpMutex;
+    std::lock_guard<std::mutex> Lock(DbgHelpMutex);
     DWORD result = ::UnDecorateSymbolName(
         Name.c_str(), DemangledName, 1023,
         UNDNAME_NO_ACCESS_SPECIFIERS |       // Strip public, private, protected
@@ -95,6 +95,7 @@
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Statepoint.h"
 #include "llvm/IR/Type.h"
+#include "llvm/IR/TypeFinder.h"
 #include "llvm/IR/Use.h"
 #include "llvm/IR/User.h"
 #include "llvm/IR/Value.h"
@@ -105,8 +106,10 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <memory>
@@ -115,6 +118,11 @@
 
 using namespace llvm;
 
+static cl::opt<unsigned> VerifierThreads(
+    "verifier-threads", cl::init(1), cl::Hidden,
+    cl::desc("Number of threads the verifier pass uses to verify the "
+             "functions of a module"));
+
 namespace llvm {
 
 struct VerifierSupport {
@@ -306,6 +314,10 @@ class Verifier : public InstVisitor<Verifier>, VerifierSupport {
 
   TBAAVerifier TBAAVerifyHelper;
 
+  /// Whether the prototypes of the intrinsic declarations of the module have
+  /// been checked already.
+  bool IntrinsicSignaturesVerified = false;
+
   void checkAtomicMemAccessSize(Type *Ty, const Instruction *I);
 
 public:
@@ -357,6 +369,15 @@ public:
     return !Broken;
   }
 
+  /// Verify the functions of the module on \p Threads threads, as verify(F)
+  /// would, and record what the module-level checks need to know about them.
+  ///
+  /// Each thread uses its own \c Verifier, which doesn't print anything.
+  /// Returns false if a function is broken, or if its debug info is, without
+  /// telling which one; the caller is expected to verify the module serially
+  /// then to get the diagnostics.
+  bool verifyFunctionsConcurrently(unsigned Threads);
+
   /// Verify the module that this instance of \c Verifier was initialized with.
   bool verify() {
     Broken = false;
@@ -1491,10 +1512,13 @@ void Verifier::verifyParameterAttrs(AttributeSet Attrs, Type *Ty,
          "'noinline and alwaysinline' are incompatible!",
          V);
 
+  // Only unique the incompatible attributes in the context when printing them:
+  // functions may be verified concurrently.
   AttrBuilder IncompatibleAttrs = AttributeFuncs::typeIncompatible(Ty);
   Assert(!AttrBuilder(Attrs).overlaps(IncompatibleAttrs),
          "Wrong types for attribute: " +
-             AttributeSet::get(Context, IncompatibleAttrs).getAsString(),
+             (OS ? AttributeSet::get(Context, IncompatibleAttrs).getAsString()
+                 : std::string()),
          V);
 
   if (PointerType *PTy = dyn_cast<PointerType>(Ty)) {
@@ -3903,15 +3927,14 @@ void Verifier::visitInstruction(Instruction &I) {
   InstsInThisBlock.insert(&I);
 }
 
-/// Allow intrinsics to be verified in different ways.
-void Verifier::visitIntrinsicCallSite(Intrinsic::ID ID, CallSite CS) {
-  Function *IF = CS.getCalledFunction();
-  Assert(IF->isDeclaration(), "Intrinsic functions should never be defined!",
-         IF);
-
-  // Verify that the intrinsic prototype lines up with what the .td files
-  // describe.
-  FunctionType *IFTy = IF->getFunctionType();
+/// Check that the prototype of the declaration \p IF of intrinsic \p ID lines
+/// up with what the .td files describe, and that its name is mangled from the
+/// overloaded types. Returns the diagnostic if it doesn't.
+///
+/// This may create the types the .td files describe in the context.
+static std::string verifyIntrinsicSignature(Intrinsic::ID ID,
+                                            const Function &IF) {
+  FunctionType *IFTy = IF.getFunctionType();
   bool IsVarArg = IFTy->isVarArg();
 
   SmallVector<Intrinsic::IITDescriptor, 8> Table;
@@ -3919,36 +3942,46 @@ void Verifier::visitIntrinsicCallSite(Intrinsic::ID ID, CallSite CS) {
   ArrayRef<Intrinsic::IITDescriptor> TableRef = Table;
 
   SmallVector<Type *, 4> ArgTys;
-  Assert(!Intrinsic::matchIntrinsicType(IFTy->getReturnType(),
-                                        TableRef, ArgTys),
-         "Intrinsic has incorrect return type!", IF);
+  if (Intrinsic::matchIntrinsicType(IFTy->getReturnType(), TableRef, ArgTys))
+    return "Intrinsic has incorrect return type!";
   for (unsigned i = 0, e = IFTy->getNumParams(); i != e; ++i)
-    Assert(!Intrinsic::matchIntrinsicType(IFTy->getParamType(i),
-                                          TableRef, ArgTys),
-           "Intrinsic has incorrect argument type!", IF);
+    if (Intrinsic::matchIntrinsicType(IFTy->getParamType(i), TableRef, ArgTys))
+      return "Intrinsic has incorrect argument type!";
 
   // Verify if the intrinsic call matches the vararg property.
-  if (IsVarArg)
-    Assert(!Intrinsic::matchIntrinsicVarArg(IsVarArg, TableRef),
-           "Intrinsic was not defined with variable arguments!", IF);
-  else
-    Assert(!Intrinsic::matchIntrinsicVarArg(IsVarArg, TableRef),
-           "Callsite was not defined with variable arguments!", IF);
+  if (Intrinsic::matchIntrinsicVarArg(IsVarArg, TableRef))
+    return IsVarArg ? "Intrinsic was not defined with variable arguments!"
+                    : "Callsite was not defined with variable arguments!";
 
   // All descriptors should be absorbed by now.
-  Assert(TableRef.empty(), "Intrinsic has too few arguments!", IF);
+  if (!TableRef.empty())
+    return "Intrinsic has too few arguments!";
 
   // Now that we have the intrinsic ID and the actual argument types (and we
   // know they are legal for the intrinsic!) get the intrinsic name through the
   // usual means.  This allows us to verify the mangling of argument types into
   // the name.
   const std::string ExpectedName = Intrinsic::getName(ID, ArgTys);
-  Assert(ExpectedName == IF->getName(),
-         "Intrinsic name not mangled correctly for type arguments! "
-         "Should be: " +
-             ExpectedName,
+  if (ExpectedName != IF.getName())
+    return "Intrinsic name not mangled correctly for type arguments! "
+           "Should be: " +
+           ExpectedName;
+  return std::string();
+}
+
+/// Allow intrinsics to be verified in different ways.
+void Verifier::visitIntrinsicCallSite(Intrinsic::ID ID, CallSite CS) {
+  Function *IF = CS.getCalledFunction();
+  Assert(IF->isDeclaration(), "Intrinsic functions should never be defined!",
          IF);
 
+  // Concurrent verifiers share the context, so verifyFunctionsConcurrently
+  // checks the intrinsic declarations before starting them.
+  if (!IntrinsicSignaturesVerified) {
+    std::string Error = verifyIntrinsicSignature(ID, *IF);
+    Assert(Error.empty(), Error, IF);
+  }
+
   // If the intrinsic takes MDNode arguments, verify that they are either global
   // or are local to *this* function.
   for (Value *V : CS.args())
@@ -4635,6 +4668,71 @@ bool llvm::verifyFunction(const Function &f, raw_ostream *OS) {
   return !V.verify(F);
 }
 
+bool Verifier::verifyFunctionsConcurrently(unsigned Threads) {
+  // Verifying a function only reads the module and its context, except for
+  // state that is created or cached lazily. Set it up now so that the threads
+  // don't race to do it: the arguments of functions, the sized bit of struct
+  // types, and the none token used by the funclet checks. Matching intrinsic
+  // prototypes creates types too, so the declarations are checked here.
+  std::vector<const Function *> Functions;
+  for (const Function &F : M) {
+    (void)F.arg_begin();
+    Functions.push_back(&F);
+    if (Intrinsic::ID ID = F.getIntrinsicID())
+      if (!verifyIntrinsicSignature(ID, F).empty())
+        return false;
+  }
+  TypeFinder StructTypes;
+  StructTypes.run(M, /*onlyNamed=*/false);
+  for (StructType *STy : StructTypes)
+    (void)STy->isSized();
+  (void)ConstantTokenNone::get(Context);
+
+  Threads = std::max(1u, std::min<unsigned>(Threads, Functions.size()));
+  std::vector<std::unique_ptr<Verifier>> Workers;
+  for (unsigned I = 0; I != Threads; ++I) {
+    Workers.push_back(
+        llvm::make_unique<Verifier>(nullptr, TreatBrokenDebugInfoAsError, M));
+    Workers.back()->IntrinsicSignaturesVerified = true;
+  }
+
+  // Hand out functions one at a time, as their sizes vary widely.
+  std::atomic<size_t> NextFunction(0);
+  std::atomic<bool> SawBrokenFunction(false);
+  ThreadPool Pool(Threads);
+  for (auto &Worker : Workers)
+    Pool.async(
+        [&](Verifier &W) {
+          for (size_t I = NextFunction++;
+               I < Functions.size() && !SawBrokenFunction; I = NextFunction++)
+            if (!W.verify(*Functions[I]) || W.hasBrokenDebugInfo())
+              SawBrokenFunction = true;
+        },
+        std::ref(*Worker));
+  Pool.wait();
+  if (SawBrokenFunction)
+    return false;
+
+  for (auto &W : Workers) {
+    // A subprogram attached to functions verified by different threads is
+    // only caught here.
+    for (auto &Attachment : W->DISubprogramAttachments) {
+      auto Inserted = DISubprogramAttachments.insert(Attachment);
+      if (!Inserted.second && Inserted.first->second != Attachment.second)
+        return false;
+    }
+    for (auto &Info : W->FrameEscapeInfo) {
+      auto &Entry = FrameEscapeInfo[Info.first];
+      Entry.first = std::max(Entry.first, Info.second.first);
+      Entry.second = std::max(Entry.second, Info.second.second);
+    }
+    CUVisited.insert(W->CUVisited.begin(), W->CUVisited.end());
+    // The metadata reachable from the functions has been verified already.
+    MDNodes.insert(W->MDNodes.begin(), W->MDNodes.end());
+  }
+  return true;
+}
+
 bool llvm::verifyModule(const Module &M, raw_ostream *OS,
                         bool *BrokenDebugInfo) {
   // Don't use a raw_null_ostream.  Printing IR is expensive.
@@ -4652,6 +4750,23 @@ bool llvm::verifyModule(const Module &M, raw_ostream *OS,
   return Broken;
 }
 
+bool llvm::verifyModule(const Module &M, raw_ostream *OS, bool *BrokenDebugInfo,
+                        unsigned Threads) {
+  if (Threads <= 1)
+    return verifyModule(M, OS, BrokenDebugInfo);
+
+  Verifier V(OS, /*ShouldTreatBrokenDebugInfoAsError=*/!BrokenDebugInfo, M);
+  // The diagnostics of a broken module are printed by the serial verifier, so
+  // that they don't depend on how the functions were scheduled.
+  if (!V.verifyFunctionsConcurrently(Threads))
+    return verifyModule(M, OS, BrokenDebugInfo);
+
+  bool Broken = !V.verify();
+  if (BrokenDebugInfo)
+    *BrokenDebugInfo = V.hasBrokenDebugInfo();
+  return Broken;
+}
+
 namespace {
 
 struct VerifierLegacyPass : public FunctionPass {
@@ -4982,7 +5097,8 @@ AnalysisKey VerifierAnalysis::Key;
 VerifierAnalysis::Result VerifierAnalysis::run(Module &M,
                                                ModuleAnalysisManager &) {
   Result Res;
-  Res.IRBroken = llvm::verifyModule(M, &dbgs(), &Res.DebugInfoBroken);
+  Res.IRBroken =
+      llvm::verifyModule(M, &dbgs(), &Res.DebugInfoBroken, VerifierThreads);
   return Res;
 }
 
@@ -12,37 +12,94 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/LTO/Caching.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CacheIndex.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LockFileManager.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
+#include <mutex>
 
 using namespace llvm;
 using namespace llvm::lto;
 
-Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
-                                            AddBufferFn AddBuffer) {
+Expected<NativeObjectCache>
+lto::localCache(StringRef CacheDirectoryPath, AddBufferFn AddBuffer,
+                Optional<CachePruningPolicy> Policy) {
   if (std::error_code EC = sys::fs::create_directories(CacheDirectoryPath))
     return errorCodeToError(EC);
 
+  std::shared_ptr<CacheIndex> Index;
+  if (Policy) {
+    auto IndexOrErr = CacheIndex::open(CacheDirectoryPath);
+    if (IndexOrErr) {
+      Index = std::move(*IndexOrErr);
+    } else {
+      // The index only speeds up pruning, so don't fail the link without one.
+      // Prune by scanning the directory instead.
+      consumeError(IndexOrErr.takeError());
+      pruneCache(CacheDirectoryPath, *Policy);
+    }
+  }
+
   return [=](unsigned Task, StringRef Key) -> AddStreamFn {
     // This choice of file name allows the cache to be pruned (see pruneCache()
     // in include/llvm/Support/CachePruning.h).
     SmallString<64> EntryPath;
     sys::path::append(EntryPath, CacheDirectoryPath, "llvmcache-" + Key);
-    // First, see if we have a cache hit.
-    ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
-        MemoryBuffer::getFile(EntryPath);
-    if (MBOrErr) {
+
+    // See if we have a cache hit.
+    auto TryHit = [&]() {
+      ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+          MemoryBuffer::getFile(EntryPath);
+      if (!MBOrErr) {
+        if (MBOrErr.getError() != errc::no_such_file_or_directory)
+          report_fatal_error(Twine("Failed to open cache file ") + EntryPath +
+                             ": " + MBOrErr.getError().message() + "\n");
+        return false;
+      }
+      if (Index)
+        Index->touch(Key);
       AddBuffer(Task, std::move(*MBOrErr), EntryPath);
+      return true;
+    };
+    if (TryHit())
       return AddStreamFn();
-    }
 
-    if (MBOrErr.getError() != errc::no_such_file_or_directory)
-      report_fatal_error(Twine("Failed to open cache file ") + EntryPath +
-                         ": " + MBOrErr.getError().message() + "\n");
+    // If another task or process is computing the same entry, wait for it to
+    // be committed instead of computing it again. The lock is held until the
+    // entry is committed, or until the returned AddStreamFn is dropped.
+    // The lock file is named so that pruneCache() and the index leave it alone.
+    SmallString<64> LockPath;
+    sys::path::append(LockPath, CacheDirectoryPath, "llvmlock-" + Key);
+    auto Lock = std::make_shared<LockFileManager>(LockPath);
+    switch (Lock->getState()) {
+    case LockFileManager::LFS_Owned:
+      // The entry may have been committed since we last looked.
+      if (TryHit())
+        return AddStreamFn();
+      break;
+    case LockFileManager::LFS_Shared:
+      // The result of waitForUnlock() is ignored: it tells whether the locked
+      // file exists, and the lock file is not the entry. Look for the entry
+      // instead.
+      Lock->waitForUnlock();
+      if (TryHit())
+        return AddStreamFn();
+      // The owner failed to produce the entry, or is still computing it after
+      // waitForUnlock() gave up waiting (after a minute and a half). Compute
+      // the entry without the lock: the lock only avoids duplicate work, and
+      // each task writes its own temporary file and renames it into place, so
+      // a reader never sees a partially written entry whichever task wins.
+      Lock.reset();
+      break;
+    case LockFileManager::LFS_Error:
+      Lock.reset();
+      break;
+    }
 
     // This native object stream is responsible for commiting the resulting
     // file to the cache and calling AddBuffer to add it to the link.
@@ -50,14 +107,25 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
       AddBufferFn AddBuffer;
       std::string TempFilename;
       std::string EntryPath;
+      std::string Key;
+      std::string CacheDirectoryPath;
       unsigned Task;
+      std::shared_ptr<CacheIndex> Index;
+      Optional<CachePruningPolicy> Policy;
+      std::shared_ptr<LockFileManager> Lock;
 
       CacheStream(std::unique_ptr<raw_pwrite_stream> OS, AddBufferFn AddBuffer,
                   std::string TempFilename, std::string EntryPath,
-                  unsigned Task)
+                  std::string Key, std::string CacheDirectoryPath,
+                  unsigned Task, std::shared_ptr<CacheIndex> Index,
+                  Optional<CachePruningPolicy> Policy,
+                  std::shared_ptr<LockFileManager> Lock)
           : NativeObjectStream(std::move(OS)), AddBuffer(std::move(AddBuffer)),
             TempFilename(std::move(TempFilename)),
-            EntryPath(std::move(EntryPath)), Task(Task) {}
+            EntryPath(std::move(EntryPath)), Key(std::move(Key)),
+            CacheDirectoryPath(std::move(CacheDirectoryPath)), Task(Task),
+            Index(std::move(Index)), Policy(std::move(Policy)),
+            Lock(std::move(Lock)) {}
 
       ~CacheStream() {
         // Make sure the file is closed before committing it.
@@ -77,11 +145,24 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
                              TempFilename + " to " + EntryPath + ": " +
                              EC.message() + "\n");
 
+        // Let the tasks waiting for this entry pick it up.
+        Lock.reset();
+
+        if (Index) {
+          bool Tracked = Index->insert(Key, (*MBOrErr)->getBufferSize());
+          Index->prune(*Policy);
+          // The index alone can't keep the cache within the policy once it
+          // misses an entry. pruneCache() then scans the directory, at most
+          // once per pruning interval.
+          if (!Tracked)
+            pruneCache(CacheDirectoryPath, *Policy);
+        }
+
         AddBuffer(Task, std::move(*MBOrErr), EntryPath);
       }
     };
 
-    return [=](size_t Task) -> std::unique_ptr<NativeObjectStream> {
+    return [=](size_t Task) mutable -> std::unique_ptr<NativeObjectStream> {
       // Write to a temporary to avoid race condition
       int TempFD;
       SmallString<64> TempFilenameModel, TempFilename;
@@ -97,7 +178,46 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
       // This CacheStream will move the temporary file into the cache when done.
       return llvm::make_unique<CacheStream>(
           llvm::make_unique<raw_fd_ostream>(TempFD, /* ShouldClose */ true),
-          AddBuffer, TempFilename.str(), EntryPath.str(), Task);
+          AddBuffer, TempFilename.str(), EntryPath.str(), Key.str(),
+          CacheDirectoryPath.str(), Task, Index, Policy, std::move(Lock));
     };
   };
 }
+
+Expected<CodeGenObjectCache>
+lto::localCodeGenCache(StringRef CacheDirectoryPath,
+                       Optional<CachePruningPolicy> Policy) {
+  // localCache() adds hits to the link while looking them up, and the entries
+  // it computes once they are committed. Only the hits are of interest here:
+  // each lookup registers where the hit of its task should go.
+  struct PendingLookups {
+    std::mutex Mutex;
+    DenseMap<unsigned, std::unique_ptr<MemoryBuffer> *> Hits;
+  };
+  auto Pending = std::make_shared<PendingLookups>();
+
+  Expected<NativeObjectCache> CacheOrErr = localCache(
+      CacheDirectoryPath,
+      [=](unsigned Task, std::unique_ptr<MemoryBuffer> MB, StringRef) {
+        std::lock_guard<std::mutex> Lock(Pending->Mutex);
+        auto I = Pending->Hits.find(Task);
+        if (I != Pending->Hits.end())
+          *I->second = std::move(MB);
+      },
+      std::move(Policy));
+  if (!CacheOrErr)
+    return CacheOrErr.takeError();
+
+  NativeObjectCache Cache = std::move(*CacheOrErr);
+  return [=](unsigned Task, StringRef Key,
+             std::unique_ptr<MemoryBuffer> &Hit) -> AddStreamFn {
+    {
+      std::lock_guard<std::mutex> Lock(Pending->Mutex);
+      Pending->Hits[Task] = &Hit;
+    }
+    AddStreamFn AddStream = Cache(Task, Key);
+    std::lock_guard<std::mutex> Lock(Pending->Mutex);
+    Pending->Hits.erase(Task);
+    return AddStream;
+  };
+}
@@ -22,9 +22,11 @@
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Metadata.h"
+#include "llvm/LTO/Caching.h"
 #include "llvm/LTO/LTOBackend.h"
 #include "llvm/Linker/IRMover.h"
 #include "llvm/Object/IRObjectFile.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -34,6 +36,7 @@
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/Threading.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/VCSRevision.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
@@ -42,7 +45,9 @@
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Utils/SplitModule.h"
 
+#include <condition_variable>
 #include <set>
+#include <thread>
 
 using namespace llvm;
 using namespace lto;
@@ -50,6 +55,16 @@ using namespace object;
 
 #define DEBUG_TYPE "lto"
 
+static cl::opt<bool>
+    TimeThinLTOBackendJobs("time-thinlto-backend-jobs", cl::Hidden,
+                           cl::desc("Report the time taken by each in-process "
+                                    "ThinLTO backend job"));
+
+static cl::opt<unsigned> ThinLTOBackendPrefetch(
+    "thinlto-backend-prefetch", cl::Hidden, cl::init(1),
+    cl::desc("Number of queued in-process ThinLTO backend jobs to look up in "
+             "the cache and parse while other jobs run (0 to disable)"));
+
 // The values are (type identifier, summary) pairs.
 typedef DenseMap<
     GlobalValue::GUID,
@@ -858,8 +873,10 @@ public:
 namespace {
 class InProcessThinBackend : public ThinBackendProc {
   ThreadPool BackendThreadPool;
+  unsigned ThreadCount;
   AddStreamFn AddStream;
   NativeObjectCache Cache;
+  CodeGenObjectCache CodeGenCache;
   TypeIdSummariesByGuidTy TypeIdSummariesByGuid;
   std::set<GlobalValue::GUID> CfiFunctionDefs;
   std::set<GlobalValue::GUID> CfiFunctionDecls;
@@ -867,15 +884,61 @@ class InProcessThinBackend : public ThinBackendProc {
   Optional<Error> Err;
   std::mutex ErrMu;
 
+  /// A backend job recorded by start(). Jobs are only handed to the thread
+  /// pool in wait(), once all of them are known and can be ordered by cost.
+  struct BackendJob {
+    unsigned Task;
+    BitcodeModule BM;
+    const FunctionImporter::ImportMapTy *ImportList;
+    const FunctionImporter::ExportSetTy *ExportList;
+    const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes> *ResolvedODR;
+    const GVSummaryMapTy *DefinedGlobals;
+    MapVector<StringRef, BitcodeModule> *ModuleMap;
+    uint64_t Cost;
+  };
+  std::vector<BackendJob> PendingJobs;
+
+  /// The first stage of a backend job: looking up its cache entry and, on a
+  /// miss, parsing its module. A job normally prepares itself, but the jobs
+  /// queued behind those the thread pool starts right away are prepared ahead
+  /// of time by a prefetch thread, so that reading and parsing their bitcode
+  /// overlaps with the backends of the running jobs.
+  struct PreparedJob {
+    /// Set once the job or the prefetch thread started preparing the job.
+    bool Claimed = false;
+    /// Set once the job is prepared.
+    bool Ready = false;
+    /// Null if the cache had the output of the job.
+    AddStreamFn AddStream;
+    std::unique_ptr<LTOLLVMContext> Context;
+    std::unique_ptr<Module> M;
+    Optional<Error> Err;
+  };
+  /// Indexed like PendingJobs once wait() sorted them. The flags and the
+  /// number of started jobs are guarded by PrefetchMu.
+  std::vector<PreparedJob> PreparedJobs;
+  size_t NumStartedJobs = 0;
+  std::mutex PrefetchMu;
+  std::condition_variable PrefetchCV;
+
+  /// With -time-thinlto-backend-jobs, each backend job is timed separately.
+  /// The timers are declared after their group so that they are reported when
+  /// the backend is destroyed.
+  TimerGroup JobTimerGroup{"thinlto-backend", "ThinLTO Backend Jobs"};
+  std::vector<Timer> JobTimers;
+
 public:
   InProcessThinBackend(
       Config &Conf, ModuleSummaryIndex &CombinedIndex,
       unsigned ThinLTOParallelismLevel,
       const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
-      AddStreamFn AddStream, NativeObjectCache Cache)
+      AddStreamFn AddStream, NativeObjectCache Cache,
+      CodeGenObjectCache CodeGenCache)
       : ThinBackendProc(Conf, CombinedIndex, ModuleToDefinedGVSummaries),
         BackendThreadPool(ThinLTOParallelismLevel),
-        AddStream(std::move(AddStream)), Cache(std::move(Cache)) {
+        ThreadCount(ThinLTOParallelismLevel),
+        AddStream(std::move(AddStream)), Cache(std::move(Cache)),
+        CodeGenCache(std::move(CodeGenCache)) {
     // Create a mapping from type identifier GUIDs to type identifier summaries.
     // This allows backends to use the type identifier GUIDs stored in the
     // function summaries to determine which type identifier summaries affect
@@ -890,43 +953,111 @@ public:
           GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
   }
 
-  Error runThinLTOBackendThread(
-      AddStreamFn AddStream, NativeObjectCache Cache, unsigned Task,
-      BitcodeModule BM, ModuleSummaryIndex &CombinedIndex,
-      const FunctionImporter::ImportMapTy &ImportList,
-      const FunctionImporter::ExportSetTy &ExportList,
-      const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes> &ResolvedODR,
-      const GVSummaryMapTy &DefinedGlobals,
-      MapVector<StringRef, BitcodeModule> &ModuleMap,
-      const TypeIdSummariesByGuidTy &TypeIdSummariesByGuid) {
-    auto RunThinBackend = [&](AddStreamFn AddStream) {
-      LTOLLVMContext BackendContext(Conf);
-      Expected<std::unique_ptr<Module>> MOrErr = BM.parseModule(BackendContext);
-      if (!MOrErr)
-        return MOrErr.takeError();
-
-      return thinBackend(Conf, Task, AddStream, **MOrErr, CombinedIndex,
-                         ImportList, DefinedGlobals, ModuleMap);
-    };
-
-    auto ModuleID = BM.getModuleIdentifier();
-
-    if (!Cache || !CombinedIndex.modulePaths().count(ModuleID) ||
-        all_of(CombinedIndex.getModuleHash(ModuleID),
-               [](uint32_t V) { return V == 0; }))
-      // Cache disabled or no entry for this module in the combined index or
-      // no module hash.
-      return RunThinBackend(AddStream);
-
-    SmallString<40> Key;
-    // The module may be cached, this helps handling it.
-    computeCacheKey(Key, Conf, CombinedIndex, ModuleID, ImportList, ExportList,
-                    ResolvedODR, DefinedGlobals, TypeIdSummariesByGuid,
-                    CfiFunctionDefs, CfiFunctionDecls);
-    if (AddStreamFn CacheAddStream = Cache(Task, Key))
-      return RunThinBackend(CacheAddStream);
+  /// Look up the output of \p Job in the cache and, unless it is there, parse
+  /// the module of the job into a new context.
+  void prepareJob(BackendJob &Job, PreparedJob &P) {
+    P.AddStream = AddStream;
+    auto ModuleID = Job.BM.getModuleIdentifier();
+
+    // Skip the cache if it is disabled, or if there is no entry for this
+    // module in the combined index, or no module hash.
+    if (Cache && CombinedIndex.modulePaths().count(ModuleID) &&
+        !all_of(CombinedIndex.getModuleHash(ModuleID),
+                [](uint32_t V) { return V == 0; })) {
+      SmallString<40> Key;
+      // The module may be cached, this helps handling it.
+      computeCacheKey(Key, Conf, CombinedIndex, ModuleID, *Job.ImportList,
+                      *Job.ExportList, *Job.ResolvedODR, *Job.DefinedGlobals,
+                      TypeIdSummariesByGuid, CfiFunctionDefs,
+                      CfiFunctionDecls);
+      P.AddStream = Cache(Job.Task, Key);
+      if (!P.AddStream)
+        return;
+    }
 
-    return Error::success();
+    P.Context = llvm::make_unique<LTOLLVMContext>(Conf);
+    Expected<std::unique_ptr<Module>> MOrErr = Job.BM.parseModule(*P.Context);
+    if (MOrErr)
+      P.M = std::move(*MOrErr);
+    else
+      P.Err = MOrErr.takeError();
+  }
+
+  /// Run the I-th job of PendingJobs, preparing it first unless the prefetch
+  /// thread already does.
+  Error runJob(size_t I) {
+    BackendJob &Job = PendingJobs[I];
+    PreparedJob &P = PreparedJobs[I];
+    bool Prefetched;
+    {
+      std::lock_guard<std::mutex> L(PrefetchMu);
+      Prefetched = P.Claimed;
+      P.Claimed = true;
+      ++NumStartedJobs;
+    }
+    PrefetchCV.notify_all();
+    if (Prefetched) {
+      std::unique_lock<std::mutex> L(PrefetchMu);
+      PrefetchCV.wait(L, [&] { return P.Ready; });
+    } else {
+      prepareJob(Job, P);
+    }
+
+    Error E = Error::success();
+    if (P.Err)
+      E = std::move(*P.Err);
+    else if (P.M)
+      E = thinBackend(Conf, Job.Task, P.AddStream, *P.M, CombinedIndex,
+                      *Job.ImportList, *Job.DefinedGlobals, *Job.ModuleMap,
+                      CodeGenCache);
+    // The module must go before its context.
+    P.M.reset();
+    P.Context.reset();
+    P.AddStream = nullptr;
+    return E;
+  }
+
+  /// Prepare the jobs queued behind those that the thread pool starts right
+  /// away, in the order the pool starts them, staying at most
+  /// -thinlto-backend-prefetch jobs ahead of the pool to bound the memory
+  /// taken by the parsed modules.
+  void prefetchJobs() {
+    for (size_t I = ThreadCount, E = PendingJobs.size(); I < E; ++I) {
+      PreparedJob &P = PreparedJobs[I];
+      {
+        std::unique_lock<std::mutex> L(PrefetchMu);
+        PrefetchCV.wait(L, [&] {
+          return P.Claimed || I < NumStartedJobs + ThinLTOBackendPrefetch;
+        });
+        if (P.Claimed)
+          continue;
+        P.Claimed = true;
+      }
+      prepareJob(PendingJobs[I], P);
+      {
+        std::lock_guard<std::mutex> L(PrefetchMu);
+        P.Ready = true;
+      }
+      PrefetchCV.notify_all();
+    }
+  }
+
+  /// Estimate how long the backend for a module will take from the number of
+  /// instructions it defines and imports, as recorded in the combined index.
+  uint64_t
+  estimateBackendCost(const GVSummaryMapTy &DefinedGlobals,
+                      const FunctionImporter::ImportMapTy &ImportList) const {
+    uint64_t Cost = 0;
+    for (auto &Def : DefinedGlobals)
+      if (auto *FS = dyn_cast<FunctionSummary>(Def.second))
+        Cost += FS->instCount();
+    for (auto &FromModule : ImportList)
+      for (auto &Import : FromModule.second)
+        if (auto *S = CombinedIndex.findSummaryInModule(Import.first,
+                                                        FromModule.first()))
+          if (auto *FS = dyn_cast<FunctionSummary>(S->getBaseObject()))
+            Cost += FS->instCount();
+    return Cost;
   }
 
   Error start(
@@ -939,34 +1070,65 @@ public:
     assert(ModuleToDefinedGVSummaries.count(ModulePath));
     const GVSummaryMapTy &DefinedGlobals =
         ModuleToDefinedGVSummaries.find(ModulePath)->second;
-    BackendThreadPool.async(
-        [=](BitcodeModule BM, ModuleSummaryIndex &CombinedIndex,
-            const FunctionImporter::ImportMapTy &ImportList,
-            const FunctionImporter::ExportSetTy &ExportList,
-            const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes>
-                &ResolvedODR,
-            const GVSummaryMapTy &DefinedGlobals,
-            MapVector<StringRef, BitcodeModule> &ModuleMap,
-            const TypeIdSummariesByGuidTy &TypeIdSummariesByGuid) {
-          Error E = runThinLTOBackendThread(
-              AddStream, Cache, Task, BM, CombinedIndex, ImportList, ExportList,
-              ResolvedODR, DefinedGlobals, ModuleMap, TypeIdSummariesByGuid);
-          if (E) {
-            std::unique_lock<std::mutex> L(ErrMu);
-            if (Err)
-              Err = joinErrors(std::move(*Err), std::move(E));
-            else
-              Err = std::move(E);
-          }
-        },
-        BM, std::ref(CombinedIndex), std::ref(ImportList), std::ref(ExportList),
-        std::ref(ResolvedODR), std::ref(DefinedGlobals), std::ref(ModuleMap),
-        std::ref(TypeIdSummariesByGuid));
+    PendingJobs.push_back({Task, BM, &ImportList, &ExportList, &ResolvedODR,
+                           &DefinedGlobals, &ModuleMap,
+                           estimateBackendCost(DefinedGlobals, ImportList)});
     return Error::success();
   }
 
+  void scheduleJob(size_t I, Timer *JobTimer) {
+    BackendThreadPool.async([=] {
+      TimeRegion R(JobTimer);
+      if (Error E = runJob(I)) {
+        std::unique_lock<std::mutex> L(ErrMu);
+        if (Err)
+          Err = joinErrors(std::move(*Err), std::move(E));
+        else
+          Err = std::move(E);
+      }
+    });
+  }
+
   Error wait() override {
+    // Start the most expensive backends first, so that a large module that
+    // happens to come last in the link doesn't end up running on its own
+    // after all the other threads are done. The bitcode size breaks ties,
+    // e.g. when the summaries don't record instruction counts. This is purely
+    // a compile-time optimization: each job keeps its task number.
+    std::stable_sort(PendingJobs.begin(), PendingJobs.end(),
+                     [](const BackendJob &L, const BackendJob &R) {
+                       if (L.Cost != R.Cost)
+                         return L.Cost > R.Cost;
+                       return L.BM.getBuffer().size() >
+                              R.BM.getBuffer().size();
+                     });
+    if (TimeThinLTOBackendJobs) {
+      // The user and system times are those of the whole process, so only
+      // the wall time of a job is meaningful when several run in parallel.
+      JobTimers.resize(PendingJobs.size());
+      for (size_t I = 0, E = PendingJobs.size(); I != E; ++I)
+        JobTimers[I].init("thinlto-backend-job",
+                          ("Task " + Twine(PendingJobs[I].Task) + ": " +
+                           PendingJobs[I].BM.getModuleIdentifier())
+                              .str(),
+                          JobTimerGroup);
+    }
+    PreparedJobs.resize(PendingJobs.size());
+#if LLVM_ENABLE_THREADS
+    std::thread Prefetcher;
+    if (ThinLTOBackendPrefetch && PendingJobs.size() > ThreadCount)
+      Prefetcher = std::thread([this] { prefetchJobs(); });
+#endif
+    for (size_t I = 0, E = PendingJobs.size(); I != E; ++I)
+      scheduleJob(I, JobTimers.empty() ? nullptr : &JobTimers[I]);
+
     BackendThreadPool.wait();
+#if LLVM_ENABLE_THREADS
+    if (Prefetcher.joinable())
+      Prefetcher.join();
+#endif
+    PendingJobs.clear();
+    PreparedJobs.clear();
     if (Err)
       return std::move(*Err);
     else
@@ -978,10 +1140,11 @@ public:
 ThinBackend lto::createInProcessThinBackend(unsigned ParallelismLevel) {
   return [=](Config &Conf, ModuleSummaryIndex &CombinedIndex,
              const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
-             AddStreamFn AddStream, NativeObjectCache Cache) {
+             AddStreamFn AddStream, NativeObjectCache Cache,
+             CodeGenObjectCache CodeGenCache) {
     return llvm::make_unique<InProcessThinBackend>(
         Conf, CombinedIndex, ParallelismLevel, ModuleToDefinedGVSummaries,
-        AddStream, Cache);
+        AddStream, Cache, CodeGenCache);
   };
 }
 
@@ -1071,7 +1234,8 @@ ThinBackend lto::createWriteIndexesThinBackend(std::string OldPrefix,
                                                std::string LinkedObjectsFile) {
   return [=](Config &Conf, ModuleSummaryIndex &CombinedIndex,
              const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
-             AddStreamFn AddStream, NativeObjectCache Cache) {
+             AddStreamFn AddStream, NativeObjectCache Cache,
+             CodeGenObjectCache CodeGenCache) {
     return llvm::make_unique<WriteIndexesThinBackend>(
         Conf, CombinedIndex, ModuleToDefinedGVSummaries, OldPrefix, NewPrefix,
         ShouldEmitImportsFiles, LinkedObjectsFile);
@@ -1160,9 +1324,20 @@ Error LTO::runThinLTO(AddStreamFn AddStream, NativeObjectCache Cache,
   thinLTOResolveWeakForLinkerInIndex(ThinLTO.CombinedIndex, isPrevailing,
                                      recordNewLinkage);
 
+  // The codegen cache is opened once for the whole link, rather than by each
+  // backend.
+  CodeGenObjectCache CodeGenCache;
+  if (!Conf.CodeGenCacheDir.empty()) {
+    Expected<CodeGenObjectCache> CodeGenCacheOrErr =
+        localCodeGenCache(Conf.CodeGenCacheDir, Conf.CodeGenCachePolicy);
+    if (!CodeGenCacheOrErr)
+      return CodeGenCacheOrErr.takeError();
+    CodeGenCache = std::move(*CodeGenCacheOrErr);
+  }
+
   std::unique_ptr<ThinBackendProc> BackendProc =
       ThinLTO.Backend(Conf, ThinLTO.CombinedIndex, ModuleToDefinedGVSummaries,
-                      AddStream, Cache);
+                      AddStream, Cache, CodeGenCache);
 
   // Task numbers start at ParallelCodeGenParallelismLevel if an LTO
   // module is present, as tasks 0 through ParallelCodeGenParallelismLevel-1
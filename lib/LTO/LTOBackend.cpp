@@ -15,6 +15,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/LTO/LTOBackend.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
@@ -24,14 +25,17 @@
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/LTO/Caching.h"
 #include "llvm/LTO/LTO.h"
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Object/ModuleSymbolTable.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SHA1.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/VCSRevision.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
@@ -273,11 +277,8 @@ bool opt(Config &Conf, TargetMachine *TM, unsigned Task, Module &Mod,
   return !Conf.PostOptModuleHook || Conf.PostOptModuleHook(Task, Mod);
 }
 
-void codegen(Config &Conf, TargetMachine *TM, AddStreamFn AddStream,
-             unsigned Task, Module &Mod) {
-  if (Conf.PreCodeGenModuleHook && !Conf.PreCodeGenModuleHook(Task, Mod))
-    return;
-
+void emitObjectFile(Config &Conf, TargetMachine *TM, AddStreamFn AddStream,
+                    unsigned Task, Module &Mod) {
   auto Stream = AddStream(Task);
   legacy::PassManager CodeGenPasses;
   if (TM->addPassesToEmitFile(CodeGenPasses, *Stream->OS, Conf.CGFileType))
@@ -285,6 +286,13 @@ void codegen(Config &Conf, TargetMachine *TM, AddStreamFn AddStream,
   CodeGenPasses.run(Mod);
 }
 
+void codegen(Config &Conf, TargetMachine *TM, AddStreamFn AddStream,
+             unsigned Task, Module &Mod) {
+  if (Conf.PreCodeGenModuleHook && !Conf.PreCodeGenModuleHook(Task, Mod))
+    return;
+  emitObjectFile(Conf, TM, AddStream, Task, Mod);
+}
+
 void splitCodeGen(Config &C, TargetMachine *TM, AddStreamFn AddStream,
                   unsigned ParallelCodeGenParallelismLevel,
                   std::unique_ptr<Module> Mod) {
@@ -393,11 +401,71 @@ Error lto::backend(Config &C, AddStreamFn AddStream,
   return Error::success();
 }
 
+/// Compute a cache key for the object file produced by code generation from
+/// the optimized module \p Mod. Unlike the key computed by the ThinLTO backend
+/// before optimization, which depends on the hashes of every module the backend
+/// imports from, this only depends on the optimized IR and on the parts of the
+/// configuration used by code generation.
+static void computeCodeGenCacheKey(SmallString<40> &Key, const Config &Conf,
+                                   const Module &Mod) {
+  SHA1 Hasher;
+
+  // Keep codegen keys apart from the keys of the whole backend.
+  Hasher.update("codegen");
+  Hasher.update(LLVM_VERSION_STRING);
+#ifdef LLVM_REVISION
+  Hasher.update(LLVM_REVISION);
+#endif
+
+  auto AddString = [&](StringRef Str) {
+    Hasher.update(Str);
+    Hasher.update(ArrayRef<uint8_t>{0});
+  };
+  auto AddUnsigned = [&](unsigned I) {
+    uint8_t Data[4];
+    Data[0] = I;
+    Data[1] = I >> 8;
+    Data[2] = I >> 16;
+    Data[3] = I >> 24;
+    Hasher.update(ArrayRef<uint8_t>{Data, 4});
+  };
+  AddString(Conf.CPU);
+  AddUnsigned(Conf.Options.RelaxELFRelocations);
+  AddUnsigned(Conf.Options.FunctionSections);
+  AddUnsigned(Conf.Options.DataSections);
+  AddUnsigned((unsigned)Conf.Options.DebuggerTuning);
+  for (auto &A : Conf.MAttrs)
+    AddString(A);
+  if (Conf.RelocModel)
+    AddUnsigned(*Conf.RelocModel);
+  else
+    AddUnsigned(-1);
+  if (Conf.CodeModel)
+    AddUnsigned(*Conf.CodeModel);
+  else
+    AddUnsigned(-1);
+  AddUnsigned(Conf.CGOptLevel);
+  AddUnsigned(Conf.CGFileType);
+  AddString(Conf.OverrideTriple);
+  AddString(Conf.DefaultTriple);
+
+  // The optimized module already reflects importing, internalization and the
+  // type identifier resolutions, so its bitcode stands in for all of them.
+  SmallVector<char, 0> Buffer;
+  raw_svector_ostream OS(Buffer);
+  WriteBitcodeToFile(&Mod, OS);
+  Hasher.update(
+      ArrayRef<uint8_t>((const uint8_t *)Buffer.data(), Buffer.size()));
+
+  Key = toHex(Hasher.result());
+}
+
 Error lto::thinBackend(Config &Conf, unsigned Task, AddStreamFn AddStream,
                        Module &Mod, const ModuleSummaryIndex &CombinedIndex,
                        const FunctionImporter::ImportMapTy &ImportList,
                        const GVSummaryMapTy &DefinedGlobals,
-                       MapVector<StringRef, BitcodeModule> &ModuleMap) {
+                       MapVector<StringRef, BitcodeModule> &ModuleMap,
+                       CodeGenObjectCache CodeGenCache) {
   Expected<const Target *> TOrErr = initAndLookupTarget(Conf, Mod);
   if (!TOrErr)
     return TOrErr.takeError();
@@ -447,6 +515,40 @@ Error lto::thinBackend(Config &Conf, unsigned Task, AddStreamFn AddStream,
            /*ExportSummary=*/nullptr, /*ImportSummary=*/&CombinedIndex))
     return Error::success();
 
-  codegen(Conf, TM.get(), AddStream, Task, Mod);
+  if (!CodeGenCache) {
+    codegen(Conf, TM.get(), AddStream, Task, Mod);
+    return Error::success();
+  }
+
+  // The hook sees the module whether or not its object file is in the cache,
+  // so that e.g. -save-temps still writes it.
+  if (Conf.PreCodeGenModuleHook && !Conf.PreCodeGenModuleHook(Task, Mod))
+    return Error::success();
+
+  // A change to a module we import from invalidates the backend's cache entry
+  // even when none of the imported functions changed. Code generation is
+  // usually the most expensive part of the backend, so reuse its output if the
+  // optimized module is the same as in a previous link. Either way the object
+  // file is also written to AddStream, so that the backend's own entry is
+  // committed and the next link hits it without running the optimizer.
+  SmallString<40> Key;
+  computeCodeGenCacheKey(Key, Conf, Mod);
+  std::unique_ptr<MemoryBuffer> Hit;
+  AddStreamFn CodeGenAddStream = CodeGenCache(Task, Key, Hit);
+  if (!CodeGenAddStream) {
+    *AddStream(Task)->OS << Hit->getBuffer();
+    return Error::success();
+  }
+
+  SmallVector<char, 0> Object;
+  emitObjectFile(Conf, TM.get(),
+                 [&](unsigned) {
+                   return llvm::make_unique<NativeObjectStream>(
+                       llvm::make_unique<raw_svector_ostream>(Object));
+                 },
+                 Task, Mod);
+  StringRef ObjectRef(Object.data(), Object.size());
+  *CodeGenAddStream(Task)->OS << ObjectRef;
+  *AddStream(Task)->OS << ObjectRef;
   return Error::success();
 }
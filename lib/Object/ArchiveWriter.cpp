@@ -15,16 +15,20 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/BinaryFormat/Magic.h"
+#include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/Object/Archive.h"
+#include "llvm/Object/IRObjectFile.h"
+#include "llvm/Object/IRSymtab.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Object/SymbolicFile.h"
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileOutputBuffer.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/Path.h"
-#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
 
 #if !defined(_MSC_VER) && !defined(__MINGW32__)
@@ -375,8 +379,29 @@ static void writeSymbolTable(raw_ostream &Out, object::Archive::Kind Kind,
 static Expected<std::vector<unsigned>>
 getSymbols(MemoryBufferRef Buf, raw_ostream &SymNames, bool &HasObject) {
   std::vector<unsigned> Ret;
-  LLVMContext Context;
 
+  // Read the symbols of bitcode from its irsymtab rather than by materializing
+  // its modules. The irsymtab is only rebuilt from the modules if it is
+  // missing or out of date. If it can't be built, for instance because a
+  // module has no data layout, fall back to reading the modules.
+  if (identify_magic(Buf.getBuffer()) == file_magic::bitcode) {
+    Expected<object::IRSymtabFile> FOrErr = object::readIRSymtab(Buf);
+    if (FOrErr) {
+      HasObject = true;
+      for (const irsymtab::Reader::SymbolRef &S :
+           FOrErr->TheReader.symbols()) {
+        if (S.isFormatSpecific() || !S.isGlobal() ||
+            (S.isUndefined() && !S.isIndirect()))
+          continue;
+        Ret.push_back(SymNames.tell());
+        SymNames << S.getName() << '\0';
+      }
+      return Ret;
+    }
+    consumeError(FOrErr.takeError());
+  }
+
+  LLVMContext Context;
   Expected<std::unique_ptr<object::SymbolicFile>> ObjOrErr =
       object::SymbolicFile::createSymbolicFile(Buf, llvm::file_magic::unknown,
                                                &Context);
@@ -399,19 +424,54 @@ getSymbols(MemoryBufferRef Buf, raw_ostream &SymNames, bool &HasObject) {
   return Ret;
 }
 
+namespace {
+/// The archive symbols of a member, read by one of the threads of
+/// computeMemberData.
+struct MemberSymbols {
+  std::string Names;
+  std::vector<unsigned> Offsets;
+  bool HasObject = false;
+  Error Err = Error::success();
+};
+} // namespace
+
 static Expected<std::vector<MemberData>>
 computeMemberData(raw_ostream &StringTable, raw_ostream &SymNames,
                   object::Archive::Kind Kind, bool Thin, StringRef ArcName,
                   ArrayRef<NewArchiveMember> NewMembers) {
   static char PaddingData[8] = {'\n', '\n', '\n', '\n', '\n', '\n', '\n', '\n'};
 
+  // Reading the symbols of the members is independent of the layout of the
+  // archive and dominates the time it takes to write archives of objects, so
+  // do it for all members concurrently. The names are then appended to
+  // SymNames in the order of the members.
+  std::vector<MemberSymbols> Symbols(NewMembers.size());
+  parallel::for_each_n(parallel::par, size_t(0), NewMembers.size(),
+                       [&](size_t I) {
+    MemberSymbols &MS = Symbols[I];
+    raw_string_ostream Names(MS.Names);
+    Expected<std::vector<unsigned>> OffsetsOrErr = getSymbols(
+        NewMembers[I].Buf->getMemBufferRef(), Names, MS.HasObject);
+    if (OffsetsOrErr)
+      MS.Offsets = std::move(*OffsetsOrErr);
+    else
+      MS.Err = OffsetsOrErr.takeError();
+  });
+
+  Error Err = Error::success();
+  for (MemberSymbols &MS : Symbols)
+    Err = joinErrors(std::move(Err), std::move(MS.Err));
+  if (Err)
+    return std::move(Err);
+
   // This ignores the symbol table, but we only need the value mod 8 and the
   // symbol table is aligned to be a multiple of 8 bytes
   uint64_t Pos = 0;
 
   std::vector<MemberData> Ret;
   bool HasObject = false;
-  for (const NewArchiveMember &M : NewMembers) {
+  for (unsigned I = 0, E = NewMembers.size(); I != E; ++I) {
+    const NewArchiveMember &M = NewMembers[I];
     std::string Header;
     raw_string_ostream Out(Header);
 
@@ -432,13 +492,15 @@ computeMemberData(raw_ostream &StringTable, raw_ostream &SymNames,
                       Buf.getBufferSize() + MemberPadding);
     Out.flush();
 
-    Expected<std::vector<unsigned>> Symbols =
-        getSymbols(Buf, SymNames, HasObject);
-    if (auto E = Symbols.takeError())
-      return std::move(E);
+    MemberSymbols &MS = Symbols[I];
+    HasObject |= MS.HasObject;
+    unsigned Base = SymNames.tell();
+    for (unsigned &Offset : MS.Offsets)
+      Offset += Base;
+    SymNames << MS.Names;
 
     Pos += Header.size() + Data.size() + Padding.size();
-    Ret.push_back({std::move(*Symbols), std::move(Header), Data, Padding});
+    Ret.push_back({std::move(MS.Offsets), std::move(Header), Data, Padding});
   }
   // If there are no symbols, emit an empty symbol table, to satisfy Solaris
   // tools, older versions of which expect a symbol table in a non-empty
@@ -488,27 +550,44 @@ Error llvm::writeArchive(StringRef ArcName,
       Kind = object::Archive::K_GNU64;
   }
 
-  SmallString<128> TmpArchive;
-  int TmpArchiveFD;
-  if (auto EC = sys::fs::createUniqueFile(ArcName + ".temp-archive-%%%%%%%.a",
-                                          TmpArchiveFD, TmpArchive))
-    return errorCodeToError(EC);
-
-  ToolOutputFile Output(TmpArchive, TmpArchiveFD);
-  raw_fd_ostream &Out = Output.os();
+  // The archive starts with its magic and its symbol table, which are small.
+  // Its members are then copied into the output buffer straight from their
+  // own buffers.
+  SmallString<0> HeadBuf;
+  raw_svector_ostream Head(HeadBuf);
   if (Thin)
-    Out << "!<thin>\n";
+    Head << "!<thin>\n";
   else
-    Out << "!<arch>\n";
+    Head << "!<arch>\n";
 
   if (WriteSymtab)
-    writeSymbolTable(Out, Kind, Deterministic, Data, SymNamesBuf);
-
-  for (const MemberData &M : Data)
-    Out << M.Header << M.Data << M.Padding;
+    writeSymbolTable(Head, Kind, Deterministic, Data, SymNamesBuf);
+
+  std::vector<uint64_t> Offsets;
+  Offsets.reserve(Data.size());
+  uint64_t Size = HeadBuf.size();
+  for (const MemberData &M : Data) {
+    Offsets.push_back(Size);
+    Size += M.Header.size() + M.Data.size() + M.Padding.size();
+  }
 
-  Output.keep();
-  Out.close();
+  ErrorOr<std::unique_ptr<FileOutputBuffer>> BufferOrErr =
+      FileOutputBuffer::create(ArcName, Size);
+  if (!BufferOrErr)
+    return errorCodeToError(BufferOrErr.getError());
+  std::unique_ptr<FileOutputBuffer> &Buffer = *BufferOrErr;
+
+  uint8_t *Buf = Buffer->getBufferStart();
+  memcpy(Buf, HeadBuf.data(), HeadBuf.size());
+  parallel::for_each_n(parallel::par, size_t(0), Data.size(), [&](size_t I) {
+    const MemberData &M = Data[I];
+    uint8_t *P = Buf + Offsets[I];
+    memcpy(P, M.Header.data(), M.Header.size());
+    P += M.Header.size();
+    memcpy(P, M.Data.data(), M.Data.size());
+    P += M.Data.size();
+    memcpy(P, M.Padding.data(), M.Padding.size());
+  });
 
   // At this point, we no longer need whatever backing memory
   // was used to generate the NewMembers. On Windows, this buffer
@@ -522,6 +601,5 @@ Error llvm::writeArchive(StringRef ArcName,
   // closed before we attempt to rename.
   OldArchiveBuf.reset();
 
-  sys::fs::rename(TmpArchive, ArcName);
-  return Error::success();
+  return errorCodeToError(Buffer->commit());
 }
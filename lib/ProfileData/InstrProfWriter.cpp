@@ -14,18 +14,24 @@
 
 #include "llvm/ProfileData/InstrProfWriter.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/ProfileSummary.h"
 #include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/InstrProfReader.h"
 #include "llvm/ProfileData/ProfileCommon.h"
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/OnDiskHashTable.h"
+#include "llvm/Support/Signals.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cstdint>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -42,6 +48,24 @@ struct PatchItem {
   int N;        // Number of elements in \c D array.
 };
 
+using ProfilingData = InstrProfWriter::ProfilingData;
+
+// Return the records of \c PD ordered by function hash, so that the emitted
+// data does not depend on the insertion history of the map.
+static SmallVector<const ProfilingData::value_type *, 4>
+getSortedRecords(const ProfilingData &PD) {
+  SmallVector<const ProfilingData::value_type *, 4> Records;
+  for (const auto &ProfileData : PD)
+    Records.push_back(&ProfileData);
+  if (Records.size() > 1)
+    std::sort(Records.begin(), Records.end(),
+              [](const ProfilingData::value_type *L,
+                 const ProfilingData::value_type *R) {
+                return L->first < R->first;
+              });
+  return Records;
+}
+
 namespace llvm {
 
 // A wrapper class to abstract writer stream with support of bytes
@@ -100,7 +124,7 @@ public:
   using offset_type = uint64_t;
 
   support::endianness ValueProfDataEndianness = support::little;
-  InstrProfSummaryBuilder *SummaryBuilder;
+  InstrProfSummaryBuilder *SummaryBuilder = nullptr;
 
   InstrProfRecordWriterTrait() = default;
 
@@ -140,18 +164,19 @@ public:
     using namespace support;
 
     endian::Writer<little> LE(Out);
-    for (const auto &ProfileData : *V) {
-      const InstrProfRecord &ProfRecord = ProfileData.second;
-      SummaryBuilder->addRecord(ProfRecord);
+    for (const auto *ProfileData : getSortedRecords(*V)) {
+      const InstrProfRecord &ProfRecord = ProfileData->second;
+      if (SummaryBuilder)
+        SummaryBuilder->addRecord(ProfRecord);
 
-      LE.write<uint64_t>(ProfileData.first); // Function hash
+      LE.write<uint64_t>(ProfileData->first); // Function hash
       LE.write<uint64_t>(ProfRecord.Counts.size());
       for (uint64_t I : ProfRecord.Counts)
         LE.write<uint64_t>(I);
 
       // Write value data
       std::unique_ptr<ValueProfData> VDataPtr =
-          ValueProfData::serializeFrom(ProfileData.second);
+          ValueProfData::serializeFrom(ProfRecord);
       uint32_t S = VDataPtr->getSize();
       VDataPtr->swapBytesFromHost(ValueProfDataEndianness);
       Out.write((const char *)VDataPtr.get(), S);
@@ -159,8 +184,178 @@ public:
   }
 };
 
+// Emits records that were already encoded by InstrProfRecordWriterTrait into
+// the merged spill file. The key and data are copied verbatim.
+class InstrProfSpilledRecordWriterTrait {
+public:
+  using key_type = StringRef;
+  using key_type_ref = StringRef;
+
+  using data_type = StringRef;
+  using data_type_ref = StringRef;
+
+  using hash_value_type = uint64_t;
+  using offset_type = uint64_t;
+
+  static hash_value_type ComputeHash(key_type_ref K) {
+    return IndexedInstrProf::ComputeHash(K);
+  }
+
+  static std::pair<offset_type, offset_type>
+  EmitKeyDataLength(raw_ostream &Out, key_type_ref K, data_type_ref V) {
+    using namespace support;
+
+    endian::Writer<little> LE(Out);
+    LE.write<offset_type>(K.size());
+    LE.write<offset_type>(V.size());
+    return std::make_pair(K.size(), V.size());
+  }
+
+  static void EmitKey(raw_ostream &Out, key_type_ref K, offset_type N) {
+    Out.write(K.data(), N);
+  }
+
+  static void EmitData(raw_ostream &Out, key_type_ref, data_type_ref V,
+                       offset_type N) {
+    Out.write(V.data(), N);
+  }
+};
+
+// A temporary file created by a writer. It is removed when destroyed, or when
+// the process is interrupted by a signal or report_fatal_error() first.
+class InstrProfSpillFile {
+public:
+  explicit InstrProfSpillFile(StringRef Path) : Path(Path) {
+    sys::RemoveFileOnSignal(Path);
+  }
+  ~InstrProfSpillFile() {
+    sys::fs::remove(Path);
+    sys::DontRemoveFileOnSignal(Path);
+  }
+
+  const std::string Path;
+};
+
+// The result of merging all spill files of a writer: a temporary file holding
+// one entry per function, sorted by name, in the format emitted by
+// InstrProfRecordWriterTrait.
+class InstrProfMergedSpill {
+public:
+  std::unique_ptr<InstrProfSpillFile> File;
+  std::unique_ptr<MemoryBuffer> Buffer;
+  // The name and the encoded data of each function, pointing into Buffer.
+  std::vector<std::pair<StringRef, StringRef>> Functions;
+};
+
 } // end namespace llvm
 
+namespace {
+
+// Sequentially reads the entries of a spill file.
+class SpillFileCursor {
+public:
+  SpillFileCursor(std::unique_ptr<MemoryBuffer> Buffer, unsigned Index,
+                  support::endianness ValueProfDataEndianness)
+      : Index(Index), Buffer(std::move(Buffer)),
+        Cur(this->Buffer->getBufferStart()),
+        End(this->Buffer->getBufferEnd()),
+        Trait(IndexedInstrProf::HashType,
+              IndexedInstrProf::ProfVersion::CurrentVersion) {
+    Trait.setValueProfDataEndianness(ValueProfDataEndianness);
+  }
+
+  // The position of the spill file in the spill order; older files come
+  // first.
+  const unsigned Index;
+
+  bool atEnd() const { return Name.data() == nullptr; }
+  StringRef getName() const { return Name; }
+  ArrayRef<NamedInstrProfRecord> getRecords() const { return Records; }
+
+  // Read the next entry, or move to the end of the file.
+  Error advance() {
+    Name = StringRef();
+    Records = ArrayRef<NamedInstrProfRecord>();
+    if (Cur == End)
+      return Error::success();
+
+    using offset_type = InstrProfLookupTrait::offset_type;
+    auto *D = reinterpret_cast<const unsigned char *>(Cur);
+    if (size_t(End - Cur) < 2 * sizeof(offset_type))
+      return make_error<InstrProfError>(instrprof_error::truncated);
+    offset_type KeyLen, DataLen;
+    std::tie(KeyLen, DataLen) = InstrProfLookupTrait::ReadKeyDataLength(D);
+    Cur = reinterpret_cast<const char *>(D);
+    if (uint64_t(End - Cur) < KeyLen + DataLen)
+      return make_error<InstrProfError>(instrprof_error::truncated);
+
+    Name = Trait.ReadKey(D, KeyLen);
+    Records = Trait.ReadData(Name, D + KeyLen, DataLen);
+    Cur += KeyLen + DataLen;
+    if (Records.empty())
+      return make_error<InstrProfError>(instrprof_error::malformed);
+    return Error::success();
+  }
+
+private:
+  std::unique_ptr<MemoryBuffer> Buffer;
+  const char *Cur;
+  const char *End;
+  InstrProfLookupTrait Trait;
+  StringRef Name;
+  ArrayRef<NamedInstrProfRecord> Records;
+};
+
+} // end anonymous namespace
+
+// Write one function entry in the format of the indexed hash table payload,
+// returning the offset of the key and the length of the data.
+static std::pair<uint64_t, uint64_t>
+emitFunctionEntry(raw_fd_ostream &OS, InstrProfRecordWriterTrait &Trait,
+                  StringRef Name, const ProfilingData &PD) {
+  uint64_t DataLen;
+  std::tie(std::ignore, DataLen) = Trait.EmitKeyDataLength(OS, Name, &PD);
+  uint64_t KeyOffset = OS.tell();
+  Trait.EmitKey(OS, Name, Name.size());
+  Trait.EmitData(OS, Name, &PD, DataLen);
+  return std::make_pair(KeyOffset, DataLen);
+}
+
+static std::vector<const StringMapEntry<ProfilingData> *>
+getSortedFunctions(const StringMap<ProfilingData> &FunctionData) {
+  std::vector<const StringMapEntry<ProfilingData> *> Functions;
+  Functions.reserve(FunctionData.size());
+  for (const auto &I : FunctionData)
+    Functions.push_back(&I);
+  std::sort(Functions.begin(), Functions.end(),
+            [](const StringMapEntry<ProfilingData> *L,
+               const StringMapEntry<ProfilingData> *R) {
+              return L->getKey() < R->getKey();
+            });
+  return Functions;
+}
+
+static Error createSpillFile(int &FD,
+                             std::unique_ptr<InstrProfSpillFile> &File) {
+  SmallString<128> Path;
+  if (std::error_code EC =
+          sys::fs::createTemporaryFile("instrprof", "spill", FD, Path))
+    return make_error<StringError>("Failed to create a spill file: " +
+                                       EC.message(),
+                                   EC);
+  File = llvm::make_unique<InstrProfSpillFile>(Path);
+  return Error::success();
+}
+
+static Error closeSpillFile(raw_fd_ostream &OS, StringRef Path) {
+  OS.close();
+  if (!OS.has_error())
+    return Error::success();
+  OS.clear_error();
+  return make_error<StringError>("Failed to write the spill file " + Path,
+                                 inconvertibleErrorCode());
+}
+
 InstrProfWriter::InstrProfWriter(bool Sparse)
     : Sparse(Sparse), InfoObj(new InstrProfRecordWriterTrait()) {}
 
@@ -183,11 +378,9 @@ void InstrProfWriter::addRecord(NamedInstrProfRecord &&I, uint64_t Weight,
   addRecord(Name, Hash, std::move(I), Weight, Warn);
 }
 
-void InstrProfWriter::addRecord(StringRef Name, uint64_t Hash,
-                                InstrProfRecord &&I, uint64_t Weight,
-                                function_ref<void(Error)> Warn) {
-  auto &ProfileDataMap = FunctionData[Name];
-
+static void addRecordTo(ProfilingData &ProfileDataMap, uint64_t Hash,
+                        InstrProfRecord &&I, uint64_t Weight,
+                        function_ref<void(Error)> Warn) {
   bool NewFunc;
   ProfilingData::iterator Where;
   std::tie(Where, NewFunc) =
@@ -211,13 +404,165 @@ void InstrProfWriter::addRecord(StringRef Name, uint64_t Hash,
   Dest.sortValueData();
 }
 
+void InstrProfWriter::addRecord(StringRef Name, uint64_t Hash,
+                                InstrProfRecord &&I, uint64_t Weight,
+                                function_ref<void(Error)> Warn) {
+  addRecordTo(FunctionData[Name], Hash, std::move(I), Weight, Warn);
+
+  if (SpillThreshold && FunctionData.size() > SpillThreshold) {
+    if (Error E = spillFunctionData()) {
+      // Keep the records in memory and stop trying to spill them. Warn only
+      // reports conflicts between records, so the failure is returned when
+      // the profile is written instead.
+      SpillThreshold = 0;
+      SpillFailure = toString(std::move(E));
+    }
+  }
+}
+
 void InstrProfWriter::mergeRecordsFromWriter(InstrProfWriter &&IPW,
                                              function_ref<void(Error)> Warn) {
+  if (SpillFailure.empty())
+    SpillFailure = std::move(IPW.SpillFailure);
+
+  // Spilled records are merged when the profile is written, so just take
+  // ownership of the other writer's spill files. Our own records go to disk
+  // first, so that the records are still merged in the order they were added.
+  if (!IPW.SpillFiles.empty()) {
+    if (Error E = spillFunctionData()) {
+      SpillThreshold = 0;
+      if (SpillFailure.empty())
+        SpillFailure = toString(std::move(E));
+      else
+        consumeError(std::move(E));
+    }
+    std::move(IPW.SpillFiles.begin(), IPW.SpillFiles.end(),
+              std::back_inserter(SpillFiles));
+    IPW.SpillFiles.clear();
+  }
+
   for (auto &I : IPW.FunctionData)
     for (auto &Func : I.getValue())
       addRecord(I.getKey(), Func.first, std::move(Func.second), 1, Warn);
 }
 
+Error InstrProfWriter::spillFunctionData() {
+  if (FunctionData.empty())
+    return Error::success();
+
+  int FD;
+  std::unique_ptr<InstrProfSpillFile> File;
+  if (Error E = createSpillFile(FD, File))
+    return E;
+
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  // Spill files are private to the writer, so always use the default
+  // endianness for the value profile data.
+  InstrProfRecordWriterTrait Trait;
+  for (const auto *I : getSortedFunctions(FunctionData))
+    emitFunctionEntry(OS, Trait, I->getKey(), I->getValue());
+  if (Error E = closeSpillFile(OS, File->Path))
+    return E;
+
+  SpillFiles.push_back(std::move(File));
+  FunctionData.clear();
+  return Error::success();
+}
+
+Error InstrProfWriter::mergeSpillFiles(
+    InstrProfMergedSpill &Merged, function_ref<void(Error, StringRef)> Warn) {
+  // Move the remaining in-memory records to disk too, so that every input of
+  // the merge is a sorted spill file.
+  if (Error E = spillFunctionData())
+    return E;
+
+  std::vector<std::unique_ptr<SpillFileCursor>> Cursors;
+  for (const auto &File : SpillFiles) {
+    auto BufferOrErr = MemoryBuffer::getFile(File->Path, /*FileSize=*/-1,
+                                             /*RequiresNullTerminator=*/false);
+    if (std::error_code EC = BufferOrErr.getError())
+      return errorCodeToError(EC);
+    Cursors.push_back(llvm::make_unique<SpillFileCursor>(
+        std::move(BufferOrErr.get()), Cursors.size(), support::little));
+  }
+
+  // A min-heap on (name, spill order) of the cursors that are not at the end.
+  auto Greater = [](const SpillFileCursor *L, const SpillFileCursor *R) {
+    int Cmp = L->getName().compare(R->getName());
+    return Cmp > 0 || (Cmp == 0 && L->Index > R->Index);
+  };
+  std::vector<SpillFileCursor *> Heap;
+  for (auto &C : Cursors) {
+    if (Error E = C->advance())
+      return E;
+    if (!C->atEnd())
+      Heap.push_back(C.get());
+  }
+  std::make_heap(Heap.begin(), Heap.end(), Greater);
+
+  int FD;
+  if (Error E = createSpillFile(FD, Merged.File))
+    return E;
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+
+  // The key offset, key length and data length of each merged function,
+  // which become references into the merged file once it is mapped.
+  std::vector<std::tuple<uint64_t, uint64_t, uint64_t>> Entries;
+  SmallVector<SpillFileCursor *, 8> Same;
+  while (!Heap.empty()) {
+    // Collect every cursor positioned on the smallest name. They come off the
+    // heap in spill order, so the records are merged in the order in which
+    // they were added to the writer.
+    Same.clear();
+    do {
+      std::pop_heap(Heap.begin(), Heap.end(), Greater);
+      Same.push_back(Heap.back());
+      Heap.pop_back();
+    } while (!Heap.empty() &&
+             Heap.front()->getName() == Same.front()->getName());
+
+    StringRef Name = Same.front()->getName();
+    auto WarnFunction = [&](Error E) { Warn(std::move(E), Name); };
+    ProfilingData PD;
+    for (SpillFileCursor *C : Same)
+      for (const NamedInstrProfRecord &Record : C->getRecords())
+        addRecordTo(PD, Record.Hash, InstrProfRecord(Record), 1, WarnFunction);
+    if (shouldEncodeData(PD)) {
+      uint64_t KeyOffset, DataLen;
+      std::tie(KeyOffset, DataLen) = emitFunctionEntry(OS, *InfoObj, Name, PD);
+      Entries.emplace_back(KeyOffset, Name.size(), DataLen);
+    }
+
+    for (SpillFileCursor *C : Same) {
+      if (Error E = C->advance())
+        return E;
+      if (!C->atEnd()) {
+        Heap.push_back(C);
+        std::push_heap(Heap.begin(), Heap.end(), Greater);
+      }
+    }
+  }
+  Cursors.clear();
+
+  if (Error E = closeSpillFile(OS, Merged.File->Path))
+    return E;
+  auto BufferOrErr = MemoryBuffer::getFile(Merged.File->Path, /*FileSize=*/-1,
+                                           /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = BufferOrErr.getError())
+    return errorCodeToError(EC);
+  Merged.Buffer = std::move(BufferOrErr.get());
+
+  StringRef Contents = Merged.Buffer->getBuffer();
+  Merged.Functions.reserve(Entries.size());
+  for (const auto &Entry : Entries) {
+    uint64_t KeyOffset, KeyLen, DataLen;
+    std::tie(KeyOffset, KeyLen, DataLen) = Entry;
+    Merged.Functions.emplace_back(Contents.substr(KeyOffset, KeyLen),
+                                  Contents.substr(KeyOffset + KeyLen, DataLen));
+  }
+  return Error::success();
+}
+
 bool InstrProfWriter::shouldEncodeData(const ProfilingData &PD) {
   if (!Sparse)
     return true;
@@ -246,23 +591,19 @@ static void setSummary(IndexedInstrProf::Summary *TheSummary,
     TheSummary->setEntry(I, Res[I]);
 }
 
-void InstrProfWriter::writeImpl(ProfOStream &OS) {
+// Write the indexed profile to \c OS. \p EmitHashTable writes the on-disk hash
+// table and returns its offset; the records it emits must be added to \p ISB.
+static void writeIndexedProfile(ProfOStream &OS,
+                                InstrProfWriter::ProfKind ProfileKind,
+                                InstrProfSummaryBuilder &ISB,
+                                function_ref<uint64_t()> EmitHashTable) {
   using namespace IndexedInstrProf;
 
-  OnDiskChainedHashTableGenerator<InstrProfRecordWriterTrait> Generator;
-
-  InstrProfSummaryBuilder ISB(ProfileSummaryBuilder::DefaultCutoffs);
-  InfoObj->SummaryBuilder = &ISB;
-
-  // Populate the hash table generator.
-  for (const auto &I : FunctionData)
-    if (shouldEncodeData(I.getValue()))
-      Generator.insert(I.getKey(), &I.getValue());
   // Write the header.
   IndexedInstrProf::Header Header;
   Header.Magic = IndexedInstrProf::Magic;
   Header.Version = IndexedInstrProf::ProfVersion::CurrentVersion;
-  if (ProfileKind == PF_IRLevel)
+  if (ProfileKind == InstrProfWriter::PF_IRLevel)
     Header.Version |= VARIANT_MASK_IR_PROF;
   Header.Unused = 0;
   Header.HashType = static_cast<uint64_t>(IndexedInstrProf::HashType);
@@ -289,7 +630,7 @@ void InstrProfWriter::writeImpl(ProfOStream &OS) {
     OS.write(0);
 
   // Write the hash table.
-  uint64_t HashTableStart = Generator.Emit(OS.OS, *InfoObj);
+  uint64_t HashTableStart = EmitHashTable();
 
   // Allocate space for data to be serialized out.
   std::unique_ptr<IndexedInstrProf::Summary> TheSummary =
@@ -298,7 +639,6 @@ void InstrProfWriter::writeImpl(ProfOStream &OS) {
   // structure to be serialized out (to disk or buffer).
   std::unique_ptr<ProfileSummary> PS = ISB.getSummary();
   setSummary(TheSummary.get(), *PS);
-  InfoObj->SummaryBuilder = nullptr;
 
   // Now do the final patch:
   PatchItem PatchItems[] = {
@@ -310,10 +650,61 @@ void InstrProfWriter::writeImpl(ProfOStream &OS) {
   OS.patch(PatchItems, sizeof(PatchItems) / sizeof(*PatchItems));
 }
 
+Error InstrProfWriter::writeImpl(ProfOStream &OS,
+                                 function_ref<void(Error, StringRef)> Warn) {
+  if (!SpillFailure.empty())
+    return make_error<StringError>(SpillFailure, inconvertibleErrorCode());
+
+  InstrProfSummaryBuilder ISB(ProfileSummaryBuilder::DefaultCutoffs);
+
+  // The functions are inserted into the hash table in name order both here
+  // and when merging spill files, which makes the two paths produce the same
+  // bytes.
+  if (SpillFiles.empty()) {
+    OnDiskChainedHashTableGenerator<InstrProfRecordWriterTrait> Generator;
+    for (const auto *I : getSortedFunctions(FunctionData))
+      if (shouldEncodeData(I->getValue()))
+        Generator.insert(I->getKey(), &I->getValue());
+
+    InfoObj->SummaryBuilder = &ISB;
+    writeIndexedProfile(OS, ProfileKind, ISB,
+                        [&] { return Generator.Emit(OS.OS, *InfoObj); });
+    InfoObj->SummaryBuilder = nullptr;
+    return Error::success();
+  }
+
+  // The records are added to the summary as they are merged.
+  InstrProfMergedSpill Merged;
+  InfoObj->SummaryBuilder = &ISB;
+  Error E = mergeSpillFiles(Merged, Warn);
+  InfoObj->SummaryBuilder = nullptr;
+  if (E)
+    return E;
+
+  OnDiskChainedHashTableGenerator<InstrProfSpilledRecordWriterTrait> Generator;
+  for (const auto &Func : Merged.Functions)
+    Generator.insert(Func.first, Func.second);
+
+  InstrProfSpilledRecordWriterTrait Trait;
+  writeIndexedProfile(OS, ProfileKind, ISB,
+                      [&] { return Generator.Emit(OS.OS, Trait); });
+  return Error::success();
+}
+
+static void consumeMergeWarning(Error E, StringRef) {
+  consumeError(std::move(E));
+}
+
 void InstrProfWriter::write(raw_fd_ostream &OS) {
+  if (Error E = write(OS, consumeMergeWarning))
+    report_fatal_error(toString(std::move(E)));
+}
+
+Error InstrProfWriter::write(raw_fd_ostream &OS,
+                             function_ref<void(Error, StringRef)> Warn) {
   // Write the hash table.
   ProfOStream POS(OS);
-  writeImpl(POS);
+  return writeImpl(POS, Warn);
 }
 
 std::unique_ptr<MemoryBuffer> InstrProfWriter::writeBuffer() {
@@ -321,7 +712,8 @@ std::unique_ptr<MemoryBuffer> InstrProfWriter::writeBuffer() {
   raw_string_ostream OS(Data);
   ProfOStream POS(OS);
   // Write the hash table.
-  writeImpl(POS);
+  if (Error E = writeImpl(POS, consumeMergeWarning))
+    report_fatal_error(toString(std::move(E)));
   // Return this in an aligned memory buffer.
   return MemoryBuffer::getMemBufferCopy(Data);
 }
@@ -372,18 +764,48 @@ void InstrProfWriter::writeRecordInText(StringRef Name, uint64_t Hash,
 }
 
 Error InstrProfWriter::writeText(raw_fd_ostream &OS) {
+  return writeText(OS, consumeMergeWarning);
+}
+
+Error InstrProfWriter::writeText(raw_fd_ostream &OS,
+                                 function_ref<void(Error, StringRef)> Warn) {
+  if (!SpillFailure.empty())
+    return make_error<StringError>(SpillFailure, inconvertibleErrorCode());
+
   if (ProfileKind == PF_IRLevel)
     OS << "# IR level Instrumentation Flag\n:ir\n";
   InstrProfSymtab Symtab;
+
+  if (!SpillFiles.empty()) {
+    InstrProfMergedSpill Merged;
+    if (Error E = mergeSpillFiles(Merged, Warn))
+      return E;
+    for (const auto &Func : Merged.Functions)
+      if (Error E = Symtab.addFuncName(Func.first))
+        return E;
+    Symtab.finalizeSymtab();
+
+    InstrProfLookupTrait Trait(IndexedInstrProf::HashType,
+                               IndexedInstrProf::ProfVersion::CurrentVersion);
+    Trait.setValueProfDataEndianness(InfoObj->ValueProfDataEndianness);
+    for (const auto &Func : Merged.Functions)
+      for (const NamedInstrProfRecord &Record : Trait.ReadData(
+               Func.first, Func.second.bytes_begin(), Func.second.size()))
+        writeRecordInText(Func.first, Record.Hash, Record, Symtab, OS);
+    return Error::success();
+  }
+
   for (const auto &I : FunctionData)
     if (shouldEncodeData(I.getValue()))
       if (Error E = Symtab.addFuncName(I.getKey()))
         return E;
   Symtab.finalizeSymtab();
 
-  for (const auto &I : FunctionData)
-    if (shouldEncodeData(I.getValue()))
-      for (const auto &Func : I.getValue())
-        writeRecordInText(I.getKey(), Func.first, Func.second, Symtab, OS);
+  // Emit functions by name and records by hash, as the spill path does, so
+  // that the output doesn't depend on whether the writer spilled.
+  for (const auto *I : getSortedFunctions(FunctionData))
+    if (shouldEncodeData(I->getValue()))
+      for (const auto *Func : getSortedRecords(I->getValue()))
+        writeRecordInText(I->getKey(), Func->first, Func->second, Symtab, OS);
   return Error::success();
 }
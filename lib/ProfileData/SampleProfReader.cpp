@@ -8,15 +8,17 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements the class that reads LLVM sample profiles. It
-// supports three file formats: text, binary and gcov.
+// supports four file formats: text, binary, compact binary and gcov.
 //
 // The textual representation is useful for debugging and testing purposes. The
-// binary representation is more compact, resulting in smaller file sizes.
+// binary representation is more compact, resulting in smaller file sizes. The
+// compact binary representation also indexes the function profiles, so only
+// the ones needed by a module are decoded.
 //
 // The gcov encoding is the one generated by GCC's AutoFDO profile creation
 // tool (https://github.com/google/autofdo)
 //
-// All three encodings can be used interchangeably as an input sample profile.
+// All four encodings can be used interchangeably as an input sample profile.
 //
 //===----------------------------------------------------------------------===//
 
@@ -24,9 +26,11 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/ProfileSummary.h"
 #include "llvm/ProfileData/ProfileCommon.h"
 #include "llvm/ProfileData/SampleProf.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/LEB128.h"
 #include "llvm/Support/LineIterator.h"
@@ -52,10 +56,15 @@ void SampleProfileReader::dumpFunctionProfile(StringRef FName,
   OS << "Function: " << FName << ": " << Profiles[FName];
 }
 
-/// \brief Dump all the function profiles found on stream \p OS.
+/// \brief Dump all the function profiles found on stream \p OS, sorted by
+/// name.
 void SampleProfileReader::dump(raw_ostream &OS) {
+  std::vector<StringRef> Names;
   for (const auto &I : Profiles)
-    dumpFunctionProfile(I.getKey(), OS);
+    Names.push_back(I.getKey());
+  std::sort(Names.begin(), Names.end());
+  for (StringRef Name : Names)
+    dumpFunctionProfile(Name, OS);
 }
 
 /// \brief Parse \p Input as function head.
@@ -373,33 +382,34 @@ SampleProfileReaderBinary::readProfile(FunctionSamples &FProfile) {
   return sampleprof_error::success;
 }
 
-std::error_code SampleProfileReaderBinary::read() {
-  while (!at_eof()) {
-    auto NumHeadSamples = readNumber<uint64_t>();
-    if (std::error_code EC = NumHeadSamples.getError())
-      return EC;
+std::error_code SampleProfileReaderBinary::readFuncProfile() {
+  auto NumHeadSamples = readNumber<uint64_t>();
+  if (std::error_code EC = NumHeadSamples.getError())
+    return EC;
 
-    auto FName(readStringFromTable());
-    if (std::error_code EC = FName.getError())
-      return EC;
+  auto FName(readStringFromTable());
+  if (std::error_code EC = FName.getError())
+    return EC;
+
+  Profiles[*FName] = FunctionSamples();
+  FunctionSamples &FProfile = Profiles[*FName];
+  FProfile.setName(*FName);
 
-    Profiles[*FName] = FunctionSamples();
-    FunctionSamples &FProfile = Profiles[*FName];
-    FProfile.setName(*FName);
+  FProfile.addHeadSamples(*NumHeadSamples);
 
-    FProfile.addHeadSamples(*NumHeadSamples);
+  return readProfile(FProfile);
+}
 
-    if (std::error_code EC = readProfile(FProfile))
+std::error_code SampleProfileReaderBinary::read() {
+  while (!at_eof()) {
+    if (std::error_code EC = readFuncProfile())
       return EC;
   }
 
   return sampleprof_error::success;
 }
 
-std::error_code SampleProfileReaderBinary::readHeader() {
-  Data = reinterpret_cast<const uint8_t *>(Buffer->getBufferStart());
-  End = Data + Buffer->getBufferSize();
-
+std::error_code SampleProfileReaderBinary::readMagicIdent() {
   // Read and check the magic identifier.
   auto Magic = readNumber<uint64_t>();
   if (std::error_code EC = Magic.getError())
@@ -414,10 +424,10 @@ std::error_code SampleProfileReaderBinary::readHeader() {
   else if (*Version != SPVersion())
     return sampleprof_error::unsupported_version;
 
-  if (std::error_code EC = readSummary())
-    return EC;
+  return sampleprof_error::success;
+}
 
-  // Read the name table.
+std::error_code SampleProfileReaderBinary::readNameTable() {
   auto Size = readNumber<uint32_t>();
   if (std::error_code EC = Size.getError())
     return EC;
@@ -432,6 +442,23 @@ std::error_code SampleProfileReaderBinary::readHeader() {
   return sampleprof_error::success;
 }
 
+std::error_code SampleProfileReaderBinary::readHeader() {
+  Data = reinterpret_cast<const uint8_t *>(Buffer->getBufferStart());
+  End = Data + Buffer->getBufferSize();
+
+  if (std::error_code EC = readMagicIdent())
+    return EC;
+
+  if (std::error_code EC = readSummary())
+    return EC;
+
+  // Read the name table.
+  if (std::error_code EC = readNameTable())
+    return EC;
+
+  return sampleprof_error::success;
+}
+
 std::error_code SampleProfileReaderBinary::readSummaryEntry(
     std::vector<ProfileSummaryEntry> &Entries) {
   auto Cutoff = readNumber<uint64_t>();
@@ -495,6 +522,140 @@ bool SampleProfileReaderBinary::hasFormat(const MemoryBuffer &Buffer) {
   return Magic == SPMagic();
 }
 
+std::error_code SampleProfileReaderCompactBinary::readMagicIdent() {
+  // Read and check the magic identifier.
+  auto Magic = readNumber<uint64_t>();
+  if (std::error_code EC = Magic.getError())
+    return EC;
+  else if (*Magic != SPMagic(SPF_Compact_Binary))
+    return sampleprof_error::bad_magic;
+
+  // Read the version number.
+  auto Version = readNumber<uint64_t>();
+  if (std::error_code EC = Version.getError())
+    return EC;
+  else if (*Version != SPVersion())
+    return sampleprof_error::unsupported_version;
+
+  auto Flags = readNumber<uint64_t>();
+  if (std::error_code EC = Flags.getError())
+    return EC;
+  ProfileIsMD5 = *Flags & SPF_Flag_MD5Names;
+
+  return sampleprof_error::success;
+}
+
+std::error_code SampleProfileReaderCompactBinary::readNameTable() {
+  if (!ProfileIsMD5)
+    return SampleProfileReaderBinary::readNameTable();
+
+  auto Size = readNumber<uint32_t>();
+  if (std::error_code EC = Size.getError())
+    return EC;
+  // NameTable refers to the strings in MD5StringBuf, which must not be
+  // reallocated.
+  NameTable.reserve(*Size);
+  MD5StringBuf.reserve(*Size);
+  for (uint32_t I = 0; I < *Size; ++I) {
+    auto Hash = readNumber<uint64_t>();
+    if (std::error_code EC = Hash.getError())
+      return EC;
+    MD5StringBuf.push_back(std::to_string(*Hash));
+    NameTable.push_back(MD5StringBuf.back());
+  }
+
+  return sampleprof_error::success;
+}
+
+std::error_code SampleProfileReaderCompactBinary::readFuncOffsetTable() {
+  const uint8_t *BufStart =
+      reinterpret_cast<const uint8_t *>(Buffer->getBufferStart());
+  const uint8_t *BodyStart = Data;
+
+  // The offset of the table is stored in the last 8 bytes of the file.
+  if (End - BodyStart < static_cast<ptrdiff_t>(sizeof(uint64_t)))
+    return sampleprof_error::truncated;
+  const uint8_t *TableEnd = End - sizeof(uint64_t);
+  uint64_t TableOffset = support::endian::read64le(TableEnd);
+  if (TableOffset < static_cast<uint64_t>(BodyStart - BufStart) ||
+      TableOffset > static_cast<uint64_t>(TableEnd - BufStart))
+    return sampleprof_error::malformed;
+
+  Data = BufStart + TableOffset;
+  End = TableEnd;
+  auto NumFuncs = readNumber<uint64_t>();
+  if (std::error_code EC = NumFuncs.getError())
+    return EC;
+
+  FuncOffsetTable.reserve(*NumFuncs);
+  for (uint64_t I = 0; I < *NumFuncs; ++I) {
+    auto FName(readStringFromTable());
+    if (std::error_code EC = FName.getError())
+      return EC;
+
+    auto Offset = readNumber<uint64_t>();
+    if (std::error_code EC = Offset.getError())
+      return EC;
+    if (*Offset < static_cast<uint64_t>(BodyStart - BufStart) ||
+        *Offset >= TableOffset)
+      return sampleprof_error::malformed;
+
+    FuncOffsetTable[*FName] = *Offset;
+  }
+
+  // The function profiles end where the table starts.
+  End = BufStart + TableOffset;
+  Data = BodyStart;
+  return sampleprof_error::success;
+}
+
+std::error_code SampleProfileReaderCompactBinary::readHeader() {
+  if (std::error_code EC = SampleProfileReaderBinary::readHeader())
+    return EC;
+
+  return readFuncOffsetTable();
+}
+
+void SampleProfileReaderCompactBinary::collectFuncsToUse(const Module &M) {
+  UseAllFuncs = false;
+  FuncsToUse.clear();
+  for (const auto &F : M) {
+    if (F.isDeclaration())
+      continue;
+    // Profiles are keyed by the names without suffixes, see getSamplesFor().
+    std::string FGUID;
+    FuncsToUse.insert(
+        getRepInFormat(F.getName().split('.').first, ProfileIsMD5, FGUID));
+  }
+}
+
+std::error_code SampleProfileReaderCompactBinary::read() {
+  if (UseAllFuncs)
+    return SampleProfileReaderBinary::read();
+
+  const uint8_t *BufStart =
+      reinterpret_cast<const uint8_t *>(Buffer->getBufferStart());
+  for (const auto &Name : FuncsToUse) {
+    auto Iter = FuncOffsetTable.find(Name.getKey());
+    if (Iter == FuncOffsetTable.end())
+      continue;
+
+    Data = BufStart + Iter->second;
+    if (std::error_code EC = readFuncProfile())
+      return EC;
+  }
+
+  Data = End;
+  return sampleprof_error::success;
+}
+
+bool SampleProfileReaderCompactBinary::hasFormat(const MemoryBuffer &Buffer) {
+  const uint8_t *Data =
+      reinterpret_cast<const uint8_t *>(Buffer.getBufferStart());
+  uint64_t Magic = decodeULEB128(Data);
+  return Magic == SPMagic(SPF_Compact_Binary);
+}
+
 std::error_code SampleProfileReaderGCC::skipNextWord() {
   uint32_t dummy;
   if (!GcovBuffer.readInt(dummy))
@@ -782,6 +943,8 @@ SampleProfileReader::create(std::unique_ptr<MemoryBuffer> &B, LLVMContext &C) {
   std::unique_ptr<SampleProfileReader> Reader;
   if (SampleProfileReaderBinary::hasFormat(*B))
     Reader.reset(new SampleProfileReaderBinary(std::move(B), C));
+  else if (SampleProfileReaderCompactBinary::hasFormat(*B))
+    Reader.reset(new SampleProfileReaderCompactBinary(std::move(B), C));
   else if (SampleProfileReaderGCC::hasFormat(*B))
     Reader.reset(new SampleProfileReaderGCC(std::move(B), C));
   else if (SampleProfileReaderText::hasFormat(*B))
@@ -8,10 +8,11 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements the class that writes LLVM sample profiles. It
-// supports two file formats: text and binary. The textual representation
-// is useful for debugging and testing purposes. The binary representation
-// is more compact, resulting in smaller file sizes. However, they can
-// both be used interchangeably.
+// supports three file formats: text, binary and compact binary. The textual
+// representation is useful for debugging and testing purposes. The binary
+// representation is more compact, resulting in smaller file sizes. The
+// compact binary representation adds an index that lets readers decode only
+// the profiles they need. However, they can all be used interchangeably.
 //
 // See lib/ProfileData/SampleProfReader.cpp for documentation on each of the
 // supported formats.
@@ -22,9 +23,11 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ProfileData/ProfileCommon.h"
 #include "llvm/ProfileData/SampleProf.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/LEB128.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cstdint>
@@ -60,7 +63,7 @@ SampleProfileWriter::write(const StringMap<FunctionSamples> &ProfileMap) {
     if (std::error_code EC = write(*I.second))
       return EC;
   }
-  return sampleprof_error::success;
+  return writeTrailer();
 }
 
 /// \brief Write samples to a text file.
@@ -144,13 +147,28 @@ void SampleProfileWriterBinary::addNames(const FunctionSamples &S) {
     }
 }
 
-std::error_code SampleProfileWriterBinary::writeHeader(
-    const StringMap<FunctionSamples> &ProfileMap) {
+void SampleProfileWriterBinary::writeMagicIdent() {
   auto &OS = *OutputStream;
 
   // Write file magic identifier.
   encodeULEB128(SPMagic(), OS);
   encodeULEB128(SPVersion(), OS);
+}
+
+std::error_code
+SampleProfileWriterBinary::writeNameTable(const std::set<StringRef> &V) {
+  auto &OS = *OutputStream;
+  encodeULEB128(V.size(), OS);
+  for (auto N : V) {
+    OS << N;
+    encodeULEB128(0, OS);
+  }
+  return sampleprof_error::success;
+}
+
+std::error_code SampleProfileWriterBinary::writeHeader(
+    const StringMap<FunctionSamples> &ProfileMap) {
+  writeMagicIdent();
 
   computeSummary(ProfileMap);
   if (auto EC = writeSummary())
@@ -171,12 +189,7 @@ std::error_code SampleProfileWriterBinary::writeHeader(
     NameTable[N] = i++;
 
   // Write out the name table.
-  encodeULEB128(NameTable.size(), OS);
-  for (auto N : V) {
-    OS << N;
-    encodeULEB128(0, OS);
-  }
-  return sampleprof_error::success;
+  return writeNameTable(V);
 }
 
 std::error_code SampleProfileWriterBinary::writeSummary() {
@@ -247,6 +260,58 @@ std::error_code SampleProfileWriterBinary::write(const FunctionSamples &S) {
   return writeBody(S);
 }
 
+void SampleProfileWriterCompactBinary::writeMagicIdent() {
+  auto &OS = *OutputStream;
+
+  // Write file magic identifier, version and flags.
+  encodeULEB128(SPMagic(SPF_Compact_Binary), OS);
+  encodeULEB128(SPVersion(), OS);
+  encodeULEB128(UseMD5 ? uint64_t(SPF_Flag_MD5Names) : 0, OS);
+}
+
+std::error_code SampleProfileWriterCompactBinary::writeNameTable(
+    const std::set<StringRef> &V) {
+  if (!UseMD5)
+    return SampleProfileWriterBinary::writeNameTable(V);
+
+  auto &OS = *OutputStream;
+  encodeULEB128(V.size(), OS);
+  for (auto N : V) {
+    uint64_t Hash;
+    if (!NamesAreMD5)
+      Hash = MD5Hash(N);
+    else if (N.getAsInteger(10, Hash))
+      return sampleprof_error::malformed;
+    encodeULEB128(Hash, OS);
+  }
+  return sampleprof_error::success;
+}
+
+/// \brief Write samples of a top-level function to a compact binary file,
+/// recording where they start in the function offset table.
+std::error_code
+SampleProfileWriterCompactBinary::write(const FunctionSamples &S) {
+  FuncOffsetTable[S.getName()] = OutputStream->tell();
+  return SampleProfileWriterBinary::write(S);
+}
+
+std::error_code SampleProfileWriterCompactBinary::writeTrailer() {
+  auto &OS = *OutputStream;
+  uint64_t TableOffset = OS.tell();
+
+  encodeULEB128(FuncOffsetTable.size(), OS);
+  for (const auto &Entry : FuncOffsetTable) {
+    if (std::error_code EC = writeNameIdx(Entry.first))
+      return EC;
+    encodeULEB128(Entry.second, OS);
+  }
+
+  // The offset of the table is written with a fixed size at the very end of
+  // the file, so readers can find it without decoding the profiles.
+  support::endian::Writer<support::little>(OS).write<uint64_t>(TableOffset);
+  return sampleprof_error::success;
+}
+
 /// \brief Create a sample profile file writer based on the specified format.
 ///
 /// \param Filename The file to create.
@@ -258,7 +323,7 @@ ErrorOr<std::unique_ptr<SampleProfileWriter>>
 SampleProfileWriter::create(StringRef Filename, SampleProfileFormat Format) {
   std::error_code EC;
   std::unique_ptr<raw_ostream> OS;
-  if (Format == SPF_Binary)
+  if (Format == SPF_Binary || Format == SPF_Compact_Binary)
     OS.reset(new raw_fd_ostream(Filename, EC, sys::fs::F_None));
   else
     OS.reset(new raw_fd_ostream(Filename, EC, sys::fs::F_Text));
@@ -283,6 +348,8 @@ SampleProfileWriter::create(std::unique_ptr<raw_ostream> &OS,
 
   if (Format == SPF_Binary)
     Writer.reset(new SampleProfileWriterBinary(OS));
+  else if (Format == SPF_Compact_Binary)
+    Writer.reset(new SampleProfileWriterCompactBinary(OS));
   else if (Format == SPF_Text)
     Writer.reset(new SampleProfileWriterText(OS));
   else if (Format == SPF_GCC)
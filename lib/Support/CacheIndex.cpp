@@ -0,0 +1,539 @@
+//===- CacheIndex.cpp - Shared index of a cache directory -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the memory mapped index used to prune a cache directory
+// incrementally.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CacheIndex.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <tuple>
+
+#define DEBUG_TYPE "cache-index"
+
+using namespace llvm;
+
+// Values of Slot::Hash with a special meaning. The hashes of the keys are
+// mapped out of this range.
+enum : uint64_t {
+  // The slot has never been used. Probing for a key stops here.
+  EmptySlot = 0,
+  // The slot is being filled in or released by some process.
+  BusySlot = 1,
+  // The entry of the slot was removed, and the slot may be reused.
+  DeletedSlot = 2,
+  FirstKeyHash = 3,
+  // Set in the hash of a slot claimed for a key that is still being filled
+  // in. The hashes of the keys never have it set.
+  PendingBit = 1ULL << 63
+};
+
+// The maximum number of slots looked at when probing for a key.
+static const unsigned MaxProbes = 32;
+
+static const uint64_t IndexMagic = 0x78646e4963766c6cULL; // "llvcIndx"
+static const uint32_t IndexVersion = 3;
+
+struct CacheIndex::Header {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t NumSlots;
+  std::atomic<uint64_t> TotalSize;
+  std::atomic<uint64_t> NumEntries;
+  // The slot at which the next call to prune() starts.
+  std::atomic<uint64_t> Hand;
+  // The number of entries that couldn't be tracked since the index was
+  // created or last synced.
+  std::atomic<uint64_t> NumUntracked;
+  uint64_t Reserved[2];
+};
+
+struct CacheIndex::Slot {
+  // The hash of the key, possibly with PendingBit set, or one of EmptySlot,
+  // BusySlot and DeletedSlot.
+  std::atomic<uint64_t> Hash;
+  std::atomic<uint64_t> Size;
+  // The time of the last access, in seconds since the epoch.
+  std::atomic<uint64_t> AccessTime;
+  // The key, padded with zeros. It is written before Hash is published, and
+  // readers check Hash again after comparing it, so a slot reused by another
+  // process while it is being read is never mistaken for a match.
+  char Key[CacheIndex::MaxKeySize];
+};
+
+static uint64_t hashKey(StringRef Key) {
+  uint64_t Hash = xxHash64(Key) & ~uint64_t(PendingBit);
+  return Hash < FirstKeyHash ? Hash + FirstKeyHash : Hash;
+}
+
+static uint64_t getCurrentTime() {
+  return sys::toTimeT(std::chrono::system_clock::now());
+}
+
+static bool keyEquals(const char *SlotKey, StringRef Key) {
+  return std::memcmp(SlotKey, Key.data(), Key.size()) == 0 &&
+         (Key.size() == CacheIndex::MaxKeySize || SlotKey[Key.size()] == 0);
+}
+
+static uint64_t getIndexSize(uint32_t NumSlots, size_t HeaderSize,
+                             size_t SlotSize) {
+  return HeaderSize + uint64_t(NumSlots) * SlotSize;
+}
+
+CacheIndex::CacheIndex(StringRef Path,
+                       std::unique_ptr<sys::fs::mapped_file_region> Map)
+    : Path(Path), Map(std::move(Map)) {
+  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+                "The index relies on lock-free 64-bit atomics");
+  static_assert(sizeof(Header) == 64 && sizeof(Slot) == 64,
+                "Changing the layout requires bumping IndexVersion");
+}
+
+CacheIndex::~CacheIndex() = default;
+
+Error CacheIndex::create(StringRef Path, uint32_t NumSlots, bool Replace,
+                         bool &Created) {
+  SmallString<128> IndexPath(Path);
+  sys::path::append(IndexPath, "llvmcache.index");
+
+  // Build the index in a temporary file and move it into place, so that other
+  // processes never see a partially initialized index. The name of the
+  // temporary doesn't match "llvmcache-*", so pruneCache() ignores it.
+  NumSlots = PowerOf2Ceil(std::max(NumSlots, 1u));
+  SmallString<128> TempModel(Path), TempPath;
+  sys::path::append(TempModel, "llvmcache.index-%%%%%%");
+  int FD;
+  if (std::error_code EC = sys::fs::createUniqueFile(TempModel, FD, TempPath))
+    return errorCodeToError(EC);
+
+  uint64_t Size = getIndexSize(NumSlots, sizeof(Header), sizeof(Slot));
+  std::error_code EC = sys::fs::resize_file(FD, Size);
+  if (!EC) {
+    sys::fs::mapped_file_region Region(
+        FD, sys::fs::mapped_file_region::readwrite, Size, 0, EC);
+    if (!EC) {
+      // The file is zero filled, which leaves every slot empty.
+      auto *H = reinterpret_cast<Header *>(Region.data());
+      H->Magic = IndexMagic;
+      H->Version = IndexVersion;
+      H->NumSlots = NumSlots;
+    }
+  }
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  if (EC) {
+    sys::fs::remove(TempPath);
+    return errorCodeToError(EC);
+  }
+
+  if (Replace) {
+    EC = sys::fs::rename(TempPath, IndexPath);
+    if (EC)
+      sys::fs::remove(TempPath);
+  } else {
+    EC = sys::fs::create_hard_link(TempPath, IndexPath);
+    sys::fs::remove(TempPath);
+    // Another process may have won the race to create the index.
+    if (EC == errc::file_exists)
+      return Error::success();
+  }
+  if (EC)
+    return errorCodeToError(EC);
+  Created = true;
+  return Error::success();
+}
+
+Expected<std::unique_ptr<CacheIndex>> CacheIndex::map(StringRef Path) {
+  SmallString<128> IndexPath(Path);
+  sys::path::append(IndexPath, "llvmcache.index");
+
+  int FD;
+  if (std::error_code EC = sys::fs::openFileForWrite(
+          IndexPath, FD, sys::fs::F_RW | sys::fs::F_Append))
+    return errorCodeToError(EC);
+
+  auto InvalidIndex = [&]() {
+    sys::Process::SafelyCloseFileDescriptor(FD);
+    DEBUG(dbgs() << "Invalid cache index " << IndexPath << "\n");
+    return nullptr;
+  };
+
+  sys::fs::file_status Status;
+  if (std::error_code EC = sys::fs::status(FD, Status)) {
+    sys::Process::SafelyCloseFileDescriptor(FD);
+    return errorCodeToError(EC);
+  }
+  uint64_t Size = Status.getSize();
+  if (Size < sizeof(Header))
+    return InvalidIndex();
+
+  std::error_code EC;
+  auto Map = llvm::make_unique<sys::fs::mapped_file_region>(
+      FD, sys::fs::mapped_file_region::readwrite, Size, 0, EC);
+  if (EC) {
+    sys::Process::SafelyCloseFileDescriptor(FD);
+    return errorCodeToError(EC);
+  }
+
+  const auto *H = reinterpret_cast<const Header *>(Map->const_data());
+  if (H->Magic != IndexMagic || H->Version != IndexVersion ||
+      !isPowerOf2_32(H->NumSlots) ||
+      Size != getIndexSize(H->NumSlots, sizeof(Header), sizeof(Slot)))
+    return InvalidIndex();
+
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  return std::unique_ptr<CacheIndex>(new CacheIndex(Path, std::move(Map)));
+}
+
+Expected<std::unique_ptr<CacheIndex>> CacheIndex::open(StringRef Path,
+                                                        uint32_t NumSlots) {
+  SmallString<128> IndexPath(Path);
+  sys::path::append(IndexPath, "llvmcache.index");
+
+  bool Created = false;
+  if (!sys::fs::exists(IndexPath))
+    if (Error E = create(Path, NumSlots, /*Replace=*/false, Created))
+      return std::move(E);
+  auto IndexOrErr = map(Path);
+  if (!IndexOrErr)
+    return IndexOrErr.takeError();
+
+  // Replace an index that is corrupt or was written by another version of
+  // LLVM. A process that still uses the old file only loses track of the
+  // entries it adds, which pruneCache() still handles.
+  if (!*IndexOrErr) {
+    if (Error E = create(Path, NumSlots, /*Replace=*/true, Created))
+      return std::move(E);
+    IndexOrErr = map(Path);
+    if (!IndexOrErr)
+      return IndexOrErr.takeError();
+    if (!*IndexOrErr)
+      return make_error<StringError>("Invalid cache index " + IndexPath,
+                                     inconvertibleErrorCode());
+  }
+
+  // A new index for an existing cache starts out with the entries that are
+  // already there.
+  if (Created)
+    (*IndexOrErr)->addEntries(scanEntries(Path));
+  return IndexOrErr;
+}
+
+StringMap<sys::fs::basic_file_status> CacheIndex::scanEntries(StringRef Path) {
+  StringMap<sys::fs::basic_file_status> Entries;
+  std::error_code EC;
+  for (sys::fs::directory_iterator File(Path, EC), FileEnd;
+       File != FileEnd && !EC; File.increment(EC)) {
+    StringRef Name = sys::path::filename(File->path());
+    if (!Name.startswith("llvmcache-"))
+      continue;
+    ErrorOr<sys::fs::basic_file_status> StatusOrErr = File->status();
+    if (!StatusOrErr)
+      continue;
+    Entries[Name.drop_front(strlen("llvmcache-"))] = *StatusOrErr;
+  }
+  return Entries;
+}
+
+void CacheIndex::addEntries(
+    const StringMap<sys::fs::basic_file_status> &Entries) {
+  for (const auto &Entry : Entries) {
+    StringRef Key = Entry.getKey();
+    if (Key.size() <= MaxKeySize && find(Key, hashKey(Key)))
+      continue;
+    insert(Key, Entry.getValue().getSize(),
+           sys::toTimeT(Entry.getValue().getLastAccessedTime()));
+  }
+}
+
+bool CacheIndex::hasUntrackedEntries() const {
+  return getHeader().NumUntracked.load() != 0;
+}
+
+void CacheIndex::sync() {
+  // Reset the count before scanning the directory. An entry that another
+  // process fails to track concurrently either has its file renamed into place
+  // before the scan starts, and is then seen by the scan, or counts again.
+  getHeader().NumUntracked.store(0);
+  syncWith(scanEntries(Path));
+}
+
+void CacheIndex::sync(const StringMap<sys::fs::basic_file_status> &Entries) {
+  // An entry that another process failed to track since the scan that found
+  // Entries started may be missed here, but the next scan finds it.
+  getHeader().NumUntracked.store(0);
+  syncWith(Entries);
+}
+
+void CacheIndex::syncWith(
+    const StringMap<sys::fs::basic_file_status> &Entries) {
+  Header &H = getHeader();
+
+  // Forget the removed entries first, to make room for the missing ones.
+  for (uint64_t I = 0; I != H.NumSlots; ++I) {
+    Slot &S = getSlot(I);
+    uint64_t Hash = S.Hash.load(std::memory_order_acquire);
+    if (Hash < FirstKeyHash || (Hash & PendingBit))
+      continue;
+    StringRef Key(S.Key, strnlen(S.Key, MaxKeySize));
+    if (Entries.count(Key))
+      continue;
+    // The entry may have been added since the scan, so only forget it once its
+    // file is known to be gone. release() fails if the slot was reused since
+    // its hash was loaded, so a key read from a slot in the middle of being
+    // reused is harmless.
+    SmallString<64> EntryPath(Path);
+    sys::path::append(EntryPath, "llvmcache-" + Key);
+    if (!sys::fs::exists(EntryPath))
+      release(S, Hash, /*RemoveFile=*/false);
+  }
+  addEntries(Entries);
+}
+
+CacheIndex::Header &CacheIndex::getHeader() const {
+  return *reinterpret_cast<Header *>(Map->data());
+}
+
+CacheIndex::Slot &CacheIndex::getSlot(uint64_t I) const {
+  auto *Slots = reinterpret_cast<Slot *>(Map->data() + sizeof(Header));
+  return Slots[I & (getHeader().NumSlots - 1)];
+}
+
+uint64_t CacheIndex::getTotalSize() const {
+  return getHeader().TotalSize.load(std::memory_order_relaxed);
+}
+
+uint64_t CacheIndex::getNumEntries() const {
+  return getHeader().NumEntries.load(std::memory_order_relaxed);
+}
+
+CacheIndex::Slot *CacheIndex::find(StringRef Key, uint64_t Hash) const {
+  for (unsigned I = 0; I != MaxProbes; ++I) {
+    Slot &S = getSlot(Hash + I);
+    uint64_t SlotHash = S.Hash.load(std::memory_order_acquire);
+    if (SlotHash == EmptySlot)
+      return nullptr;
+    if (SlotHash == Hash && keyEquals(S.Key, Key) &&
+        S.Hash.load(std::memory_order_acquire) == Hash)
+      return &S;
+  }
+  return nullptr;
+}
+
+bool CacheIndex::touch(StringRef Key) {
+  if (Key.size() > MaxKeySize)
+    return false;
+  Slot *S = find(Key, hashKey(Key));
+  if (!S)
+    return false;
+  // Avoid dirtying the page when the entry was already accessed this second.
+  uint64_t Now = getCurrentTime();
+  if (S->AccessTime.load(std::memory_order_relaxed) != Now)
+    S->AccessTime.store(Now, std::memory_order_relaxed);
+  return true;
+}
+
+bool CacheIndex::insert(StringRef Key, uint64_t Size) {
+  return insert(Key, Size, getCurrentTime());
+}
+
+CacheIndex::Slot *CacheIndex::claim(uint64_t Hash) const {
+  for (unsigned I = 0; I != MaxProbes; ++I) {
+    Slot &S = getSlot(Hash + I);
+    uint64_t SlotHash = S.Hash.load(std::memory_order_relaxed);
+    if (SlotHash != EmptySlot && SlotHash != DeletedSlot)
+      continue;
+    if (S.Hash.compare_exchange_strong(SlotHash, Hash | PendingBit))
+      return &S;
+  }
+  return nullptr;
+}
+
+bool CacheIndex::isClaimedElsewhere(uint64_t Hash, const Slot &Claimed) const {
+  for (unsigned I = 0; I != MaxProbes; ++I) {
+    Slot &S = getSlot(Hash + I);
+    if (&S == &Claimed)
+      continue;
+    uint64_t SlotHash = S.Hash.load();
+    if (SlotHash == EmptySlot)
+      return false;
+    if ((SlotHash & ~uint64_t(PendingBit)) == Hash)
+      return true;
+  }
+  return false;
+}
+
+bool CacheIndex::insert(StringRef Key, uint64_t Size, uint64_t AccessTime) {
+  Header &H = getHeader();
+  if (Key.size() > MaxKeySize) {
+    DEBUG(dbgs() << "Key too long for the cache index, not tracking " << Key
+                 << "\n");
+    H.NumUntracked.fetch_add(1);
+    return false;
+  }
+
+  uint64_t Hash = hashKey(Key);
+  for (unsigned Attempt = 0; Attempt != MaxProbes; ++Attempt) {
+    if (Slot *S = find(Key, Hash)) {
+      uint64_t OldSize = S->Size.exchange(Size, std::memory_order_relaxed);
+      H.TotalSize.fetch_add(Size - OldSize, std::memory_order_relaxed);
+      S->AccessTime.store(AccessTime, std::memory_order_relaxed);
+      return true;
+    }
+
+    // Claim a free slot for the key with a single compare-and-swap. Another
+    // process adding the same key may have claimed a different slot at the
+    // same time: whoever then sees the other's claim backs off and looks
+    // again. The claims and the checks are sequentially consistent, so two
+    // claims can't both miss each other.
+    Slot *S = claim(Hash);
+    if (!S)
+      break;
+    if (isClaimedElsewhere(Hash, *S)) {
+      S->Hash.store(DeletedSlot);
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::memset(S->Key, 0, MaxKeySize);
+    std::memcpy(S->Key, Key.data(), Key.size());
+    uint64_t OldSize = S->Size.exchange(Size, std::memory_order_relaxed);
+    S->AccessTime.store(AccessTime, std::memory_order_relaxed);
+    S->Hash.store(Hash, std::memory_order_release);
+    H.TotalSize.fetch_add(Size - OldSize, std::memory_order_relaxed);
+    H.NumEntries.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  DEBUG(dbgs() << "No room in the cache index, not tracking " << Key << "\n");
+  H.NumUntracked.fetch_add(1);
+  return false;
+}
+
+bool CacheIndex::release(Slot &S, uint64_t Hash, bool RemoveFile) {
+  // Claim the slot so that its key can't change while it is copied.
+  if (!S.Hash.compare_exchange_strong(Hash, BusySlot,
+                                      std::memory_order_acquire))
+    return false;
+
+  SmallString<64> EntryPath(Path);
+  StringRef Key(S.Key, strnlen(S.Key, MaxKeySize));
+  sys::path::append(EntryPath, "llvmcache-" + Key);
+  // Take the size out of the slot. An insert that found the entry just before
+  // it was released may still store a size here, which is then subtracted when
+  // the slot is reused.
+  uint64_t Size = S.Size.exchange(0, std::memory_order_relaxed);
+  S.Hash.store(DeletedSlot, std::memory_order_release);
+
+  Header &H = getHeader();
+  H.TotalSize.fetch_sub(Size, std::memory_order_relaxed);
+  H.NumEntries.fetch_sub(1, std::memory_order_relaxed);
+  if (RemoveFile) {
+    DEBUG(dbgs() << "Remove " << EntryPath << " (size " << Size << ")\n");
+    sys::fs::remove(EntryPath);
+  }
+  return true;
+}
+
+bool CacheIndex::erase(StringRef Key) {
+  if (Key.size() > MaxKeySize)
+    return false;
+  uint64_t Hash = hashKey(Key);
+  Slot *S = find(Key, Hash);
+  return S && release(*S, Hash, /*RemoveFile=*/false);
+}
+
+unsigned CacheIndex::prune(const CachePruningPolicy &Policy,
+                           unsigned MaxVisited) {
+  Header &H = getHeader();
+
+  // Compute the size limit the same way as pruneCache().
+  uint64_t SizeLimit = UINT64_MAX;
+  unsigned Percentage =
+      std::min(Policy.MaxSizePercentageOfAvailableSpace, 100u);
+  if (Percentage > 0 || Policy.MaxSizeBytes > 0) {
+    auto ErrOrSpaceInfo = sys::fs::disk_space(Path);
+    if (ErrOrSpaceInfo) {
+      uint64_t AvailableSpace = getTotalSize() + ErrOrSpaceInfo->free;
+      if (Percentage == 0)
+        Percentage = 100;
+      uint64_t MaxSizeBytes =
+          Policy.MaxSizeBytes ? Policy.MaxSizeBytes : AvailableSpace;
+      SizeLimit =
+          std::min<uint64_t>(AvailableSpace * Percentage / 100, MaxSizeBytes);
+    } else if (Policy.MaxSizeBytes > 0) {
+      SizeLimit = Policy.MaxSizeBytes;
+    }
+  }
+
+  uint64_t Now = getCurrentTime();
+  uint64_t Expiration = Policy.Expiration.count();
+  unsigned WindowSize = std::max(1u, std::min(MaxVisited, H.NumSlots));
+
+  // Visit the next slots in turn, like the hand of a clock, so that repeated
+  // calls eventually look at every entry. If the cache is over its size limit
+  // but the window holds no entry, which happens when a few large entries
+  // populate a mostly empty table, keep moving until one is found.
+  unsigned NumRemoved = 0;
+  unsigned NumVisited = 0;
+  // The candidates for eviction: access time, size, hash and slot.
+  using Candidate = std::tuple<uint64_t, uint64_t, uint64_t, Slot *>;
+  SmallVector<Candidate, 64> Candidates;
+  do {
+    uint64_t Start = H.Hand.fetch_add(WindowSize, std::memory_order_relaxed);
+    for (unsigned I = 0; I != WindowSize; ++I) {
+      Slot &S = getSlot(Start + I);
+      uint64_t Hash = S.Hash.load(std::memory_order_acquire);
+      if (Hash < FirstKeyHash || (Hash & PendingBit))
+        continue;
+      uint64_t AccessTime = S.AccessTime.load(std::memory_order_relaxed);
+      if (Expiration && AccessTime < Now && Now - AccessTime > Expiration) {
+        NumRemoved += release(S, Hash, /*RemoveFile=*/true);
+        continue;
+      }
+      Candidates.emplace_back(AccessTime,
+                              S.Size.load(std::memory_order_relaxed), Hash,
+                              &S);
+    }
+    NumVisited += WindowSize;
+  } while (Candidates.empty() && NumVisited < H.NumSlots &&
+           getTotalSize() > SizeLimit);
+
+  if (getTotalSize() <= SizeLimit)
+    return NumRemoved;
+
+  // Remove the least recently used of the visited entries until the cache
+  // fits again. Access times only have a resolution of a second: among the
+  // entries accessed in the same second, remove the largest first, as
+  // pruneCache() does.
+  std::sort(Candidates.begin(), Candidates.end(),
+            [](const Candidate &A, const Candidate &B) {
+              if (std::get<0>(A) != std::get<0>(B))
+                return std::get<0>(A) < std::get<0>(B);
+              return std::get<1>(A) > std::get<1>(B);
+            });
+  for (const auto &C : Candidates) {
+    if (getTotalSize() <= SizeLimit)
+      break;
+    NumRemoved += release(*std::get<3>(C), std::get<2>(C), /*RemoveFile=*/true);
+  }
+  return NumRemoved;
+}
@@ -13,6 +13,7 @@
 
 #include "llvm/Support/CachePruning.h"
 
+#include "llvm/Support/CacheIndex.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/Error.h"
@@ -22,6 +23,7 @@
 
 #define DEBUG_TYPE "cache-pruning"
 
+#include <cstring>
 #include <set>
 #include <system_error>
 
@@ -161,7 +163,7 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
       return false;
     }
   } else {
-    if (Policy.Interval == seconds(0)) {
+    if (Policy.Interval != seconds(0)) {
       // Check whether the time stamp is older than our pruning interval.
       // If not, do nothing.
       const auto TimeStampModTime = FileStatus.getLastModificationTime();
@@ -179,6 +181,26 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
     writeTimestampFile(TimestampFile);
   }
 
+  // The directory is the source of truth, since not every client tracks its
+  // entries in the index of the cache (see CacheIndex). If there is one, it is
+  // synced with the files that are left once they are pruned.
+  std::unique_ptr<CacheIndex> Index;
+  SmallString<128> IndexFile(Path);
+  sys::path::append(IndexFile, "llvmcache.index");
+  if (sys::fs::exists(IndexFile)) {
+    auto IndexOrErr = CacheIndex::open(Path);
+    if (IndexOrErr)
+      Index = std::move(*IndexOrErr);
+    else
+      consumeError(IndexOrErr.takeError());
+  }
+
+  // The entries left in the cache, keyed as in the index.
+  StringMap<sys::fs::basic_file_status> RemainingEntries;
+  auto KeyOf = [](StringRef File) {
+    return sys::path::filename(File).drop_front(strlen("llvmcache-"));
+  };
+
   bool ShouldComputeSize =
       (Policy.MaxSizePercentageOfAvailableSpace > 0 || Policy.MaxSizeBytes > 0);
 
@@ -219,6 +241,8 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
     }
 
     // Leave it here for now, but add it to the list of size-based pruning.
+    if (Index)
+      RemainingEntries[KeyOf(File->path())] = *StatusOrErr;
     if (!ShouldComputeSize)
       continue;
     TotalSize += StatusOrErr->getSize();
@@ -251,6 +275,7 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
     while (TotalSize > TotalSizeTarget && FileAndSize != FileSizes.rend()) {
       // Remove the file.
       sys::fs::remove(FileAndSize->second);
+      RemainingEntries.erase(KeyOf(FileAndSize->second));
       // Update size
       TotalSize -= FileAndSize->first;
       DEBUG(dbgs() << " - Remove " << FileAndSize->second << " (size "
@@ -259,5 +284,8 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
       ++FileAndSize;
     }
   }
+
+  if (Index)
+    Index->sync(RemainingEntries);
   return true;
 }
@@ -18,6 +18,10 @@
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <vector>
 #if LLVM_ENABLE_ZLIB == 1 && HAVE_ZLIB_H
 #include <zlib.h>
 #endif
@@ -73,6 +77,84 @@ Error zlib::compress(StringRef InputBuffer,
   return Res ? createError(convertZlibCodeToString(Res)) : Error::success();
 }
 
+/// Compress \p Input into raw deflate blocks, without the zlib header and
+/// trailer. Unless \p Last, the blocks end with an empty stored block instead
+/// of a final block, so that the blocks of the next chunk can follow them.
+static int deflateChunk(StringRef Input, SmallVectorImpl<char> &Output,
+                        int CLevel, bool Last) {
+  z_stream Stream = {};
+  int Res = deflateInit2(&Stream, CLevel, Z_DEFLATED, -MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY);
+  if (Res != Z_OK)
+    return Res;
+  // Leave room for the empty stored block of Z_SYNC_FLUSH.
+  Output.resize(deflateBound(&Stream, Input.size()) + 8);
+  // zlib doesn't write through next_in.
+  Stream.next_in =
+      const_cast<Bytef *>(reinterpret_cast<const Bytef *>(Input.data()));
+  Stream.avail_in = Input.size();
+  Stream.next_out = (Bytef *)Output.data();
+  Stream.avail_out = Output.size();
+  Res = deflate(&Stream, Last ? Z_FINISH : Z_SYNC_FLUSH);
+  __msan_unpoison(Output.data(), Stream.total_out);
+  Output.resize(Stream.total_out);
+  deflateEnd(&Stream);
+  if (Res == Z_STREAM_END ||
+      (!Last && Res == Z_OK && Stream.avail_in == 0 && Stream.avail_out != 0))
+    return Z_OK;
+  return Res == Z_OK ? Z_BUF_ERROR : Res;
+}
+
+Error zlib::compressParallel(StringRef InputBuffer,
+                             SmallVectorImpl<char> &CompressedBuffer,
+                             CompressionLevel Level, size_t ChunkSize) {
+  assert(ChunkSize != 0 && "Invalid chunk size!");
+  size_t NumChunks = (InputBuffer.size() + ChunkSize - 1) / ChunkSize;
+  if (NumChunks <= 1)
+    return compress(InputBuffer, CompressedBuffer, Level);
+
+  int CLevel = encodeZlibCompressionLevel(Level);
+  std::vector<SmallVector<char, 0>> Chunks(NumChunks);
+  std::vector<uLong> Checksums(NumChunks);
+  std::vector<int> Results(NumChunks);
+  parallel::for_each_n(parallel::par, size_t(0), NumChunks, [&](size_t I) {
+    StringRef Input = InputBuffer.substr(I * ChunkSize, ChunkSize);
+    Results[I] = deflateChunk(Input, Chunks[I], CLevel, I == NumChunks - 1);
+    Checksums[I] = ::adler32(::adler32(0, nullptr, 0),
+                             (const Bytef *)Input.data(), Input.size());
+  });
+  for (int Res : Results)
+    if (Res != Z_OK)
+      return createError(convertZlibCodeToString(Res));
+
+  // The zlib header: deflate with a 32K window, and the compression level in
+  // FLEVEL as zlib would set it. FCHECK makes the header a multiple of 31.
+  unsigned FLevel = 2;
+  if (CLevel >= 0 && CLevel < 2)
+    FLevel = 0;
+  else if (CLevel > 0 && CLevel < 6)
+    FLevel = 1;
+  else if (CLevel > 6)
+    FLevel = 3;
+  unsigned Header = (0x78 << 8) | (FLevel << 6);
+  Header += 31 - Header % 31;
+
+  CompressedBuffer.clear();
+  CompressedBuffer.push_back(Header >> 8);
+  CompressedBuffer.push_back(Header & 0xff);
+  uLong Checksum = Checksums[0];
+  for (size_t I = 0; I != NumChunks; ++I) {
+    CompressedBuffer.append(Chunks[I].begin(), Chunks[I].end());
+    if (I != 0)
+      Checksum = ::adler32_combine(
+          Checksum, Checksums[I],
+          std::min(ChunkSize, InputBuffer.size() - I * ChunkSize));
+  }
+  for (int Shift = 24; Shift >= 0; Shift -= 8)
+    CompressedBuffer.push_back((Checksum >> Shift) & 0xff);
+  return Error::success();
+}
+
 Error zlib::uncompress(StringRef InputBuffer, char *UncompressedBuffer,
                        size_t &UncompressedSize) {
   int Res =
@@ -105,6 +187,11 @@ Error zlib::compress(StringRef InputBuffer,
                      CompressionLevel Level) {
   llvm_unreachable("zlib::compress is unavailable");
 }
+Error zlib::compressParallel(StringRef InputBuffer,
+                             SmallVectorImpl<char> &CompressedBuffer,
+                             CompressionLevel Level, size_t ChunkSize) {
+  llvm_unreachable("zlib::compressParallel is unavailable");
+}
 Error zlib::uncompress(StringRef InputBuffer, char *UncompressedBuffer,
                        size_t &UncompressedSize) {
   llvm_unreachable("zlib::uncompress is unavailable");
@@ -8,12 +8,21 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/Parallel.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Config/config.h"
 #include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Compiler.h"
 #include "llvm/Support/Threading.h"
 
 #include <atomic>
-#include <stack>
+#include <deque>
+#include <memory>
 #include <thread>
+#include <vector>
+
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
 
 using namespace llvm;
 
@@ -25,6 +34,11 @@ public:
   virtual ~Executor() = default;
   virtual void add(std::function<void()> func) = 0;
 
+#if LLVM_ENABLE_THREADS
+  /// \brief Block until \p L is done.
+  virtual void wait(const parallel::detail::Latch &L) { L.sync(); }
+#endif
+
   static Executor *getDefaultExecutor();
 };
 
@@ -67,19 +81,30 @@ Executor *Executor::getDefaultExecutor() {
 }
 
 #else
-/// \brief An implementation of an Executor that runs closures on a thread pool
-///   in filo order.
+/// \brief The index of the ThreadPoolExecutor worker running on this thread, or
+///   -1 for threads that don't belong to the executor.
+static LLVM_THREAD_LOCAL int WorkerIndex = -1;
+
+/// \brief An implementation of an Executor that runs closures on a thread pool.
+///
+/// Every worker owns a deque of tasks. A worker pushes the tasks it spawns to
+/// the back of its own deque and runs them in filo order, and steals from the
+/// front of the other workers' deques when its own is empty, so that workers
+/// don't all contend on a single lock. Tasks added from outside the pool are
+/// distributed over the deques round-robin.
 class ThreadPoolExecutor : public Executor {
 public:
   explicit ThreadPoolExecutor(unsigned ThreadCount = hardware_concurrency())
       : Done(ThreadCount) {
+    for (unsigned I = 0; I < ThreadCount; ++I)
+      Queues.push_back(llvm::make_unique<TaskQueue>());
     // Spawn all but one of the threads in another thread as spawning threads
     // can take a while.
     std::thread([&, ThreadCount] {
-      for (size_t i = 1; i < ThreadCount; ++i) {
-        std::thread([=] { work(); }).detach();
+      for (unsigned I = 1; I < ThreadCount; ++I) {
+        std::thread([=] { work(I); }).detach();
       }
-      work();
+      work(0);
     }).detach();
   }
 
@@ -92,42 +117,134 @@ public:
   }
 
   void add(std::function<void()> F) override {
+    unsigned Index = WorkerIndex >= 0 ? WorkerIndex
+                                      : NextQueue++ % Queues.size();
+    {
+      std::lock_guard<std::mutex> Lock(Queues[Index]->Mutex);
+      Queues[Index]->Tasks.push_back(std::move(F));
+      ++Pending;
+    }
+    // Taking the lock orders this with a worker that is about to go to sleep,
+    // so that the notification can't get lost.
     std::unique_lock<std::mutex> Lock(Mutex);
-    WorkStack.push(F);
     Lock.unlock();
     Cond.notify_one();
   }
 
+  void wait(const parallel::detail::Latch &L) override {
+    // A task waiting for the tasks it spawned keeps running other tasks in the
+    // meantime. Otherwise nested parallel algorithms could block every worker
+    // while the tasks they wait on are still queued.
+    if (WorkerIndex < 0)
+      return L.sync();
+
+    while (!L.isDone()) {
+      if (runTask(WorkerIndex))
+        continue;
+      std::unique_lock<std::mutex> Lock(Mutex);
+      ++Waiting;
+      Cond.wait(Lock, [&] { return Pending || L.isDone(); });
+      --Waiting;
+    }
+  }
+
 private:
-  void work() {
+  struct TaskQueue {
+    std::mutex Mutex;
+    std::deque<std::function<void()>> Tasks;
+  };
+
+  /// Run one task, taken from the back of the queue of worker \p Index or
+  /// stolen from the front of another worker's queue.
+  /// \returns false if there was no task to run.
+  bool runTask(unsigned Index) {
+    std::function<void()> Task;
+    for (unsigned I = 0, E = Queues.size(); I != E && !Task; ++I) {
+      TaskQueue &Q = *Queues[(Index + I) % E];
+      std::lock_guard<std::mutex> Lock(Q.Mutex);
+      if (Q.Tasks.empty())
+        continue;
+      if (I == 0) {
+        Task = std::move(Q.Tasks.back());
+        Q.Tasks.pop_back();
+      } else {
+        Task = std::move(Q.Tasks.front());
+        Q.Tasks.pop_front();
+      }
+      --Pending;
+    }
+    if (!Task)
+      return false;
+
+    Task();
+    // The task may have completed a latch that a worker is waiting on.
+    if (Waiting) {
+      std::unique_lock<std::mutex> Lock(Mutex);
+      Lock.unlock();
+      Cond.notify_all();
+    }
+    return true;
+  }
+
+  void work(unsigned Index) {
+    WorkerIndex = Index;
     while (true) {
+      if (runTask(Index))
+        continue;
       std::unique_lock<std::mutex> Lock(Mutex);
-      Cond.wait(Lock, [&] { return Stop || !WorkStack.empty(); });
+      Cond.wait(Lock, [&] { return Stop || Pending; });
       if (Stop)
         break;
-      auto Task = WorkStack.top();
-      WorkStack.pop();
-      Lock.unlock();
-      Task();
     }
     Done.dec();
   }
 
   std::atomic<bool> Stop{false};
-  std::stack<std::function<void()>> WorkStack;
+  std::vector<std::unique_ptr<TaskQueue>> Queues;
+  std::atomic<unsigned> NextQueue{0};
+  /// Number of tasks sitting in the queues.
+  std::atomic<size_t> Pending{0};
+  /// Number of workers blocked in wait().
+  std::atomic<unsigned> Waiting{0};
+  /// Protects sleeping and waking up, but not the queues.
   std::mutex Mutex;
   std::condition_variable Cond;
   parallel::detail::Latch Done;
 };
 
+/// \brief Owns the default ThreadPoolExecutor, which is stopped at exit.
+///
+/// A forked child, like a death test, has none of the workers of its parent,
+/// and its copy of the executor may still record them as waiting on its
+/// condition variable. Destroying the executor there would hang, so the child
+/// leaks it instead.
+struct DefaultExecutor {
+  ThreadPoolExecutor *Exec = new ThreadPoolExecutor();
+#if defined(HAVE_UNISTD_H)
+  pid_t CreatorPid = getpid();
+#endif
+
+  ~DefaultExecutor() {
+#if defined(HAVE_UNISTD_H)
+    if (getpid() != CreatorPid)
+      return;
+#endif
+    delete Exec;
+  }
+};
+
 Executor *Executor::getDefaultExecutor() {
-  static ThreadPoolExecutor exec;
-  return &exec;
+  static DefaultExecutor Default;
+  return Default.Exec;
 }
 #endif
 }
 
 #if LLVM_ENABLE_THREADS
+void parallel::detail::TaskGroup::sync() const {
+  Executor::getDefaultExecutor()->wait(L);
+}
+
 void parallel::detail::TaskGroup::spawn(std::function<void()> F) {
   L.inc();
   Executor::getDefaultExecutor()->add([&, F] {
@@ -12,7 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/StringMap.h"
-#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/MathExtras.h"
 #include <cassert>
@@ -72,6 +72,30 @@ void StringMapImpl::init(unsigned InitSize) {
   TheTable[NumBuckets] = (StringMapEntryBase*)2;
 }
 
+/// Hash the keys as hash_value does, a word at a time rather than a byte at a
+/// time, which is faster than xxHash64 on keys of symbol name length. Its low
+/// bits are as well mixed as the high ones, so truncating it is fine.
+///
+/// hash_value itself isn't used: its seed is a size_t, which would make the
+/// iteration order of a StringMap depend on the host, and tests may override
+/// it. The seed here is the 64-bit one hash_value uses by default.
+unsigned StringMapImpl::hash(StringRef Key) {
+  using namespace hashing::detail;
+  const uint64_t Seed = 0xff51afd7ed558ccdULL;
+  const char *S = Key.data();
+  size_t Length = Key.size();
+  if (Length <= 64)
+    return hash_short(S, Length, Seed);
+
+  const char *AlignedEnd = S + (Length & ~63);
+  hash_state State = hash_state::create(S, Seed);
+  for (S += 64; S != AlignedEnd; S += 64)
+    State.mix(S);
+  if (Length & 63)
+    State.mix(Key.end() - 64);
+  return State.finalize(Length);
+}
+
 /// LookupBucketFor - Look up the bucket that the specified string should end
 /// up in.  If it already exists as a key in the map, the Item pointer for the
 /// specified bucket will be non-null.  Otherwise, it will be null.  In either
@@ -83,7 +107,7 @@ unsigned StringMapImpl::LookupBucketFor(StringRef Name) {
     init(16);
     HTSize = NumBuckets;
   }
-  unsigned FullHashValue = HashString(Name);
+  unsigned FullHashValue = hash(Name);
   unsigned BucketNo = FullHashValue & (HTSize-1);
   unsigned *HashTable = (unsigned *)(TheTable + NumBuckets + 1);
 
@@ -137,7 +161,7 @@ unsigned StringMapImpl::LookupBucketFor(StringRef Name) {
 int StringMapImpl::FindKey(StringRef Key) const {
   unsigned HTSize = NumBuckets;
   if (HTSize == 0) return -1;  // Really empty table?
-  unsigned FullHashValue = HashString(Key);
+  unsigned FullHashValue = hash(Key);
   unsigned BucketNo = FullHashValue & (HTSize-1);
   unsigned *HashTable = (unsigned *)(TheTable + NumBuckets + 1);
 
@@ -7,7 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements a crude C++11 based thread pool.
+// This file implements a C++11 based thread pool on top of the executor of the
+// parallel algorithms.
 //
 //===----------------------------------------------------------------------===//
 
@@ -24,96 +25,60 @@ using namespace llvm;
 // Default to hardware_concurrency
 ThreadPool::ThreadPool() : ThreadPool(hardware_concurrency()) {}
 
-ThreadPool::ThreadPool(unsigned ThreadCount)
-    : ActiveThreads(0), EnableFlag(true) {
-  // Create ThreadCount threads that will loop forever, wait on QueueCondition
-  // for tasks to be queued or the Pool to be destroyed.
-  Threads.reserve(ThreadCount);
-  for (unsigned ThreadID = 0; ThreadID < ThreadCount; ++ThreadID) {
-    Threads.emplace_back([&] {
-      while (true) {
-        PackagedTaskTy Task;
-        {
-          std::unique_lock<std::mutex> LockGuard(QueueLock);
-          // Wait for tasks to be pushed in the queue
-          QueueCondition.wait(LockGuard,
-                              [&] { return !EnableFlag || !Tasks.empty(); });
-          // Exit condition
-          if (!EnableFlag && Tasks.empty())
-            return;
-          // Yeah, we have a task, grab it and release the lock on the queue
-
-          // We first need to signal that we are active before popping the queue
-          // in order for wait() to properly detect that even if the queue is
-          // empty, there is still a task in flight.
-          {
-            ++ActiveThreads;
-            std::unique_lock<std::mutex> LockGuard(CompletionLock);
-          }
-          Task = std::move(Tasks.front());
-          Tasks.pop();
-        }
-        // Run the task we just grabbed
-        Task();
-
-        {
-          // Adjust `ActiveThreads`, in case someone waits on ThreadPool::wait()
-          std::unique_lock<std::mutex> LockGuard(CompletionLock);
-          --ActiveThreads;
-        }
-
-        // Notify task completion, in case someone waits on ThreadPool::wait()
-        CompletionCondition.notify_all();
+ThreadPool::ThreadPool(unsigned ThreadCount) : ThreadCount(ThreadCount) {}
+
+void ThreadPool::runTasks() {
+  while (true) {
+    PackagedTaskTy Task;
+    {
+      std::unique_lock<std::mutex> LockGuard(QueueLock);
+      // Give up the slot under the lock, so that asyncImpl() either sees the
+      // slot taken and its task is run here, or sees it free and spawns a new
+      // runTasks().
+      if (Tasks.empty()) {
+        --ActiveThreads;
+        return;
       }
-    });
+      Task = std::move(Tasks.front());
+      Tasks.pop();
+    }
+    Task();
   }
 }
 
 void ThreadPool::wait() {
-  // Wait for all threads to complete and the queue to be empty
-  std::unique_lock<std::mutex> LockGuard(CompletionLock);
-  // The order of the checks for ActiveThreads and Tasks.empty() matters because
-  // any active threads might be modifying the Tasks queue, and this would be a
-  // race.
-  CompletionCondition.wait(LockGuard,
-                           [&] { return !ActiveThreads && Tasks.empty(); });
+  // Every queued task is run by a runTasks() call in flight, which only
+  // returns once the queue is empty.
+  Workers.sync();
 }
 
 std::shared_future<void> ThreadPool::asyncImpl(TaskTy Task) {
   /// Wrap the Task in a packaged_task to return a future object.
   PackagedTaskTy PackagedTask(std::move(Task));
   auto Future = PackagedTask.get_future();
+  bool NeedsWorker;
   {
     // Lock the queue and push the new task
     std::unique_lock<std::mutex> LockGuard(QueueLock);
-
-    // Don't allow enqueueing after disabling the pool
-    assert(EnableFlag && "Queuing a thread during ThreadPool destruction");
-
     Tasks.push(std::move(PackagedTask));
+    NeedsWorker = ActiveThreads < ThreadCount;
+    if (NeedsWorker)
+      ++ActiveThreads;
   }
-  QueueCondition.notify_one();
+  if (NeedsWorker)
+    Workers.spawn([this] { runTasks(); });
   return Future.share();
 }
 
-// The destructor joins all threads, waiting for completion.
-ThreadPool::~ThreadPool() {
-  {
-    std::unique_lock<std::mutex> LockGuard(QueueLock);
-    EnableFlag = false;
-  }
-  QueueCondition.notify_all();
-  for (auto &Worker : Threads)
-    Worker.join();
-}
+// The destructor waits for all the tasks to complete.
+ThreadPool::~ThreadPool() { wait(); }
 
 #else // LLVM_ENABLE_THREADS Disabled
 
 ThreadPool::ThreadPool() : ThreadPool(0) {}
 
 // No threads are launched, issue a warning if ThreadCount is not 0
-ThreadPool::ThreadPool(unsigned ThreadCount)
-    : ActiveThreads(0) {
+ThreadPool::ThreadPool(unsigned ThreadCount) {
   if (ThreadCount) {
     errs() << "Warning: request a ThreadPool with " << ThreadCount
            << " threads, but LLVM_ENABLE_THREADS has been turned off\n";
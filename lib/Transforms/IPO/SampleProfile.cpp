@@ -247,7 +247,8 @@ protected:
   /// Map from function name to Function *. Used to find the function from
   /// the function name. If the function name contains suffix, additional
   /// entry is added to map from the stripped name to the function if there
-  /// is one-to-one mapping.
+  /// is one-to-one mapping. If the profile uses MD5 names, the names are
+  /// replaced by their MD5 representation.
   StringMap<Function *> SymbolMap;
 
   /// \brief Dominance, post-dominance and loop information.
@@ -647,6 +648,8 @@ SampleProfileLoader::findCalleeFunctionSamples(const Instruction &Inst) const {
   if (FS == nullptr)
     return nullptr;
 
+  std::string CalleeGUID;
+  CalleeName = getRepInFormat(CalleeName, Reader->useMD5(), CalleeGUID);
   return FS->findFunctionSamplesAt(
       LineLocation(getOffset(DIL), DIL->getBaseDiscriminator()), CalleeName);
 }
@@ -719,7 +722,10 @@ SampleProfileLoader::findFunctionSamples(const Instruction &Inst) const {
     return Samples;
   const FunctionSamples *FS = Samples;
   for (int i = S.size() - 1; i >= 0 && FS != nullptr; i--) {
-    FS = FS->findFunctionSamplesAt(S[i].first, S[i].second);
+    std::string CalleeGUID;
+    StringRef CalleeName =
+        getRepInFormat(S[i].second, Reader->useMD5(), CalleeGUID);
+    FS = FS->findFunctionSamplesAt(S[i].first, CalleeName);
   }
   return FS;
 }
@@ -806,7 +812,8 @@ bool SampleProfileLoader::inlineHotFunctions(
           if (IsThinLTOPreLink) {
             FS->findInlinedFunctions(InlinedGUIDs, F.getParent(),
                                      Samples->getTotalSamples() *
-                                         SampleProfileHotThreshold / 100);
+                                         SampleProfileHotThreshold / 100,
+                                     Reader->useMD5());
             continue;
           }
           auto CalleeFunctionName = FS->getName();
@@ -815,7 +822,9 @@ bool SampleProfileLoader::inlineHotFunctions(
           // clone the caller first, and inline the cloned caller if it is
           // recursive. As llvm does not inline recursive calls, we will
           // simply ignore it instead of handling it explicitly.
-          if (CalleeFunctionName == F.getName())
+          std::string FGUID;
+          if (CalleeFunctionName ==
+              getRepInFormat(F.getName(), Reader->useMD5(), FGUID))
             continue;
 
           const char *Reason = "Callee function not available";
@@ -846,7 +855,8 @@ bool SampleProfileLoader::inlineHotFunctions(
       } else if (IsThinLTOPreLink) {
         findCalleeFunctionSamples(*I)->findInlinedFunctions(
             InlinedGUIDs, F.getParent(),
-            Samples->getTotalSamples() * SampleProfileHotThreshold / 100);
+            Samples->getTotalSamples() * SampleProfileHotThreshold / 100,
+            Reader->useMD5());
       }
     }
     if (LocalChanged) {
@@ -1184,13 +1194,17 @@ void SampleProfileLoader::buildEdges(Function &F) {
 
 /// Sorts the CallTargetMap \p M by count in descending order and stores the
 /// sorted result in \p Sorted. Returns the total counts.
+///
+/// If \p UseMD5 is true, the call targets of \p M are named by their GUIDs.
 static uint64_t SortCallTargets(SmallVector<InstrProfValueData, 2> &Sorted,
-                                const SampleRecord::CallTargetMap &M) {
+                                const SampleRecord::CallTargetMap &M,
+                                bool UseMD5) {
   Sorted.clear();
   uint64_t Sum = 0;
   for (auto I = M.begin(); I != M.end(); ++I) {
     Sum += I->getValue();
-    Sorted.push_back({Function::getGUID(I->getKey()), I->getValue()});
+    Sorted.push_back(
+        {FunctionSamples::getGUID(I->getKey(), UseMD5), I->getValue()});
   }
   std::sort(Sorted.begin(), Sorted.end(),
             [](const InstrProfValueData &L, const InstrProfValueData &R) {
@@ -1293,7 +1307,8 @@ void SampleProfileLoader::propagateWeights(Function &F) {
           if (!T || T.get().empty())
             continue;
           SmallVector<InstrProfValueData, 2> SortedCallTargets;
-          uint64_t Sum = SortCallTargets(SortedCallTargets, T.get());
+          uint64_t Sum = SortCallTargets(SortedCallTargets, T.get(),
+                                         Reader->useMD5());
           annotateValueSite(*I.getParent()->getParent()->getParent(), I,
                             SortedCallTargets, Sum, IPVK_IndirectCallTarget,
                             SortedCallTargets.size());
@@ -1526,6 +1541,9 @@ bool SampleProfileLoader::doInitialization(Module &M) {
     return false;
   }
   Reader = std::move(ReaderOrErr.get());
+  // Only the profiles of the functions defined in M are needed. Readers that
+  // support it skip decoding all the others.
+  Reader->collectFuncsToUse(M);
   ProfileIsValid = (Reader->read() == sampleprof_error::success);
   return true;
 }
@@ -1552,11 +1570,14 @@ bool SampleProfileLoader::runOnModule(Module &M, ModuleAnalysisManager *AM) {
     Function *F = dyn_cast<Function>(N_F.getValue());
     if (F == nullptr)
       continue;
-    SymbolMap[OrigName] = F;
+    std::string OrigGUID;
+    SymbolMap[getRepInFormat(OrigName, Reader->useMD5(), OrigGUID)] = F;
     auto pos = OrigName.find('.');
     if (pos != std::string::npos) {
       std::string NewName = OrigName.substr(0, pos);
-      auto r = SymbolMap.insert(std::make_pair(NewName, F));
+      std::string NewGUID;
+      auto r = SymbolMap.insert(std::make_pair(
+          getRepInFormat(NewName, Reader->useMD5(), NewGUID), F));
       // Failiing to insert means there is already an entry in SymbolMap,
       // thus there are multiple functions that are mapped to the same
       // stripped name. In this case of name conflicting, set the value
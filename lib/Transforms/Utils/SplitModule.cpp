@@ -22,9 +22,11 @@
 #include "llvm/IR/Comdat.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalAlias.h"
 #include "llvm/IR/GlobalObject.h"
+#include "llvm/IR/GlobalIFunc.h"
 #include "llvm/IR/GlobalIndirectSymbol.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/GlobalVariable.h"
@@ -245,6 +247,67 @@ static bool isInPartition(const GlobalValue *GV, unsigned I, unsigned N) {
   return (R[0] | (R[1] << 8)) % N == I;
 }
 
+// Turn M into the partition described by ShouldKeepDefinition in place, which
+// avoids copying the function bodies that stay in this partition. Functions,
+// variables and aliases end up as CloneModule would leave them for the same
+// predicate. CloneModule doesn't copy ifuncs at all; here an ifunc is kept in
+// the partitions that keep its definition, and is replaced with a declaration
+// elsewhere, like an alias.
+static void
+dropDefinitionsOutsidePartition(Module &M,
+                                function_ref<bool(const GlobalValue *)>
+                                    ShouldKeepDefinition) {
+  // Decide membership before touching the module, since dropping bodies and
+  // replacing aliases changes the comdats and base objects the predicate
+  // looks at.
+  SmallVector<Function *, 16> DroppedFunctions;
+  SmallVector<GlobalVariable *, 16> DroppedVariables;
+  SmallVector<GlobalIndirectSymbol *, 16> DroppedIndirectSymbols;
+  for (Function &F : M)
+    if (!F.isDeclaration() && !ShouldKeepDefinition(&F))
+      DroppedFunctions.push_back(&F);
+  for (GlobalVariable &GV : M.globals())
+    if (!GV.isDeclaration() && !ShouldKeepDefinition(&GV))
+      DroppedVariables.push_back(&GV);
+  for (GlobalAlias &GA : M.aliases())
+    if (!ShouldKeepDefinition(&GA))
+      DroppedIndirectSymbols.push_back(&GA);
+  for (GlobalIFunc &GIF : M.ifuncs())
+    if (!ShouldKeepDefinition(&GIF))
+      DroppedIndirectSymbols.push_back(&GIF);
+
+  for (Function *F : DroppedFunctions) {
+    // Also drops the personality function and attached metadata, neither of
+    // which is valid on a declaration.
+    F->deleteBody();
+    F->setComdat(nullptr);
+  }
+
+  for (GlobalVariable *GV : DroppedVariables) {
+    GV->setInitializer(nullptr);
+    GV->setLinkage(GlobalValue::ExternalLinkage);
+    GV->clearMetadata();
+    GV->setComdat(nullptr);
+  }
+
+  for (GlobalIndirectSymbol *GIS : DroppedIndirectSymbols) {
+    // An alias cannot act as an external reference, so replace it with either
+    // a function or a global variable declaration depending on the value type.
+    GlobalValue *Decl;
+    if (auto *FTy = dyn_cast<FunctionType>(GIS->getValueType()))
+      Decl = Function::Create(FTy, GlobalValue::ExternalLinkage, "", &M);
+    else
+      Decl = new GlobalVariable(M, GIS->getValueType(), false,
+                                GlobalValue::ExternalLinkage, nullptr, "",
+                                nullptr, GIS->getThreadLocalMode(),
+                                GIS->getType()->getAddressSpace());
+    Decl->takeName(GIS);
+    GIS->replaceAllUsesWith(
+        ConstantExpr::getPointerBitCastOrAddrSpaceCast(Decl, GIS->getType()));
+    GIS->eraseFromParent();
+  }
+}
+
 void llvm::SplitModule(
     std::unique_ptr<Module> M, unsigned N,
     function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback,
@@ -265,19 +328,30 @@ void llvm::SplitModule(
   ClusterIDMapType ClusterIDMap;
   findPartitions(M.get(), ClusterIDMap, N);
 
-  // FIXME: We should be able to reuse M as the last partition instead of
-  // cloning it.
-  for (unsigned I = 0; I < N; ++I) {
+  auto IsInPartition = [&](const GlobalValue *GV, unsigned I) {
+    auto It = ClusterIDMap.find(GV);
+    if (It != ClusterIDMap.end())
+      return It->second == I;
+    return isInPartition(GV, I, N);
+  };
+
+  for (unsigned I = 0; I + 1 < N; ++I) {
     ValueToValueMapTy VMap;
     std::unique_ptr<Module> MPart(
         CloneModule(M.get(), VMap, [&](const GlobalValue *GV) {
-          if (ClusterIDMap.count(GV))
-            return (ClusterIDMap[GV] == I);
-          else
-            return isInPartition(GV, I, N);
+          return IsInPartition(GV, I);
         }));
     if (I != 0)
       MPart->setModuleInlineAsm("");
     ModuleCallback(std::move(MPart));
   }
+
+  // Every other partition has been cloned by now, so M itself can become the
+  // last one.
+  unsigned Last = N - 1;
+  dropDefinitionsOutsidePartition(
+      *M, [&](const GlobalValue *GV) { return IsInPartition(GV, Last); });
+  if (Last != 0)
+    M->setModuleInlineAsm("");
+  ModuleCallback(std::move(M));
 }
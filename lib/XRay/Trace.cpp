@@ -16,6 +16,7 @@
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/XRay/YAMLXRayRecord.h"
+#include <set>
 
 using namespace llvm;
 using namespace llvm::xray;
@@ -25,6 +26,49 @@ namespace {
 using XRayRecordStorage =
     std::aligned_storage<sizeof(XRayRecord), alignof(XRayRecord)>::type;
 
+/// Receives the records decoded by the loaders below and hands the ones of the
+/// wanted threads to a consumer one at a time. The last record is held back
+/// until the next one starts (or the log ends), because the argument payloads
+/// that follow a function entry record still have to be attached to it.
+class RecordSink {
+  function_ref<bool(uint32_t)> WantThread;
+  function_ref<Error(XRayRecord &)> Consumer;
+  XRayRecord Pending;
+  bool HasPending = false;
+
+public:
+  RecordSink(function_ref<bool(uint32_t)> WantThread,
+             function_ref<Error(XRayRecord &)> Consumer)
+      : WantThread(WantThread), Consumer(Consumer) {}
+
+  /// Whether the records of thread \p TId are handed to the consumer. Loaders
+  /// can use this to skip over the records of other threads.
+  bool wantsThread(uint32_t TId) { return WantThread(TId); }
+
+  /// Hands the pending record to the consumer and starts a new one, which is
+  /// then available through last().
+  Error startRecord() {
+    if (auto E = finish())
+      return E;
+    Pending = XRayRecord();
+    HasPending = true;
+    return Error::success();
+  }
+
+  /// The record being decoded, or null if there is none yet.
+  XRayRecord *last() { return HasPending ? &Pending : nullptr; }
+
+  /// Hands the pending record, if any, to the consumer.
+  Error finish() {
+    if (!HasPending)
+      return Error::success();
+    HasPending = false;
+    if (!WantThread(Pending.TId))
+      return Error::success();
+    return Consumer(Pending);
+  }
+};
+
 // Populates the FileHeader reference by reading the first 32 bytes of the file.
 Error readBinaryFormatHeader(StringRef Data, XRayFileHeader &FileHeader) {
   // FIXME: Maybe deduce whether the data is little or big-endian using some
@@ -56,7 +100,7 @@ Error readBinaryFormatHeader(StringRef Data, XRayFileHeader &FileHeader) {
 }
 
 Error loadNaiveFormatLog(StringRef Data, XRayFileHeader &FileHeader,
-                         std::vector<XRayRecord> &Records) {
+                         RecordSink &Records) {
   if (Data.size() < 32)
     return make_error<StringError>(
         "Not enough bytes for an XRay log.",
@@ -84,8 +128,9 @@ Error loadNaiveFormatLog(StringRef Data, XRayFileHeader &FileHeader,
     uint32_t OffsetPtr = 0;
     switch (auto RecordType = RecordExtractor.getU16(&OffsetPtr)) {
     case 0: { // Normal records.
-      Records.emplace_back();
-      auto &Record = Records.back();
+      if (auto E = Records.startRecord())
+        return E;
+      auto &Record = *Records.last();
       Record.RecordType = RecordType;
       Record.CPU = RecordExtractor.getU8(&OffsetPtr);
       auto Type = RecordExtractor.getU8(&OffsetPtr);
@@ -113,7 +158,11 @@ Error loadNaiveFormatLog(StringRef Data, XRayFileHeader &FileHeader,
       break;
     }
     case 1: { // Arg payload record.
-      auto &Record = Records.back();
+      if (!Records.last())
+        return make_error<StringError>(
+            "Corrupted log, found payload without a preceding function record.",
+            std::make_error_code(std::errc::executable_format_error));
+      auto &Record = *Records.last();
       // Advance two bytes to avoid padding.
       OffsetPtr += 2;
       int32_t FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
@@ -136,7 +185,7 @@ Error loadNaiveFormatLog(StringRef Data, XRayFileHeader &FileHeader,
           std::make_error_code(std::errc::executable_format_error));
     }
   }
-  return Error::success();
+  return Records.finish();
 }
 
 /// When reading from a Flight Data Recorder mode log, metadata records are
@@ -274,16 +323,16 @@ Error processCustomEventMarker(FDRState &State, uint8_t RecordFirstByte,
 /// State transition when a CallArgumentRecord is encountered.
 Error processFDRCallArgumentRecord(FDRState &State, uint8_t RecordFirstByte,
                                    DataExtractor &RecordExtractor,
-                                   std::vector<XRayRecord> &Records) {
+                                   RecordSink &Records) {
   uint32_t OffsetPtr = 1; // Read starting after the first byte.
-  auto &Enter = Records.back();
+  XRayRecord *Enter = Records.last();
 
-  if (Enter.Type != RecordTypes::ENTER)
+  if (!Enter || Enter->Type != RecordTypes::ENTER)
     return make_error<StringError>(
         "CallArgument needs to be right after a function entry",
         std::make_error_code(std::errc::executable_format_error));
-  Enter.Type = RecordTypes::ENTER_ARG;
-  Enter.CallArgs.emplace_back(RecordExtractor.getU64(&OffsetPtr));
+  Enter->Type = RecordTypes::ENTER_ARG;
+  Enter->CallArgs.emplace_back(RecordExtractor.getU64(&OffsetPtr));
   return Error::success();
 }
 
@@ -294,8 +343,7 @@ Error processFDRCallArgumentRecord(FDRState &State, uint8_t RecordFirstByte,
 /// to determine that this is a metadata record as opposed to a function record.
 Error processFDRMetadataRecord(FDRState &State, uint8_t RecordFirstByte,
                                DataExtractor &RecordExtractor,
-                               size_t &RecordSize,
-                               std::vector<XRayRecord> &Records) {
+                               size_t &RecordSize, RecordSink &Records) {
   // The remaining 7 bits are the RecordKind enum.
   uint8_t RecordKind = RecordFirstByte >> 1;
   switch (RecordKind) {
@@ -303,6 +351,10 @@ Error processFDRMetadataRecord(FDRState &State, uint8_t RecordFirstByte,
     if (auto E =
             processFDRNewBufferRecord(State, RecordFirstByte, RecordExtractor))
       return E;
+    // The buffers of the threads that aren't wanted are skipped as a whole,
+    // without decoding their records.
+    if (!Records.wantsThread(State.ThreadId))
+      State.Expects = FDRState::Token::SCAN_TO_END_OF_THREAD_BUF;
     break;
   case 1: // EndOfBuffer
     if (auto E = processFDREndOfBufferRecord(State, RecordFirstByte,
@@ -353,7 +405,7 @@ Error processFDRMetadataRecord(FDRState &State, uint8_t RecordFirstByte,
 /// State.
 Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
                                DataExtractor &RecordExtractor,
-                               std::vector<XRayRecord> &Records) {
+                               RecordSink &Records) {
   switch (State.Expects) {
   case FDRState::Token::NEW_BUFFER_RECORD_OR_EOF:
     return make_error<StringError>(
@@ -368,8 +420,9 @@ Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
         "Malformed log. Received Function Record before first CPU record.",
         std::make_error_code(std::errc::executable_format_error));
   default:
-    Records.emplace_back();
-    auto &Record = Records.back();
+    if (auto E = Records.startRecord())
+      return E;
+    auto &Record = *Records.last();
     Record.RecordType = 0; // Record is type NORMAL.
     // Strip off record type bit and use the next three bits.
     uint8_t RecordType = (RecordFirstByte >> 1) & 0x07;
@@ -440,7 +493,7 @@ Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
 /// TSCWrap: 16 byte metadata record with a full 64 bit TSC reading.
 /// FunctionRecord: 8 byte record with FunctionId, entry/exit, and TSC delta.
 Error loadFDRLog(StringRef Data, XRayFileHeader &FileHeader,
-                 std::vector<XRayRecord> &Records) {
+                 RecordSink &Records) {
   if (Data.size() < 32)
     return make_error<StringError>(
         "Not enough bytes for an XRay log.",
@@ -512,11 +565,11 @@ Error loadFDRLog(StringRef Data, XRayFileHeader &FileHeader,
             Twine(State.CurrentBufferSize - State.CurrentBufferConsumed),
         std::make_error_code(std::errc::executable_format_error));
 
-  return Error::success();
+  return Records.finish();
 }
 
 Error loadYAMLLog(StringRef Data, XRayFileHeader &FileHeader,
-                  std::vector<XRayRecord> &Records) {
+                  RecordSink &Records) {
   YAMLXRayTrace Trace;
   Input In(Data);
   In >> Trace;
@@ -534,17 +587,18 @@ Error loadYAMLLog(StringRef Data, XRayFileHeader &FileHeader,
         Twine("Unsupported XRay file version: ") + Twine(FileHeader.Version),
         std::make_error_code(std::errc::invalid_argument));
 
-  Records.clear();
-  std::transform(Trace.Records.begin(), Trace.Records.end(),
-                 std::back_inserter(Records), [&](const YAMLXRayRecord &R) {
-                   return XRayRecord{R.RecordType, R.CPU, R.Type,    R.FuncId,
-                                     R.TSC,        R.TId, R.CallArgs};
-                 });
-  return Error::success();
+  for (const YAMLXRayRecord &R : Trace.Records) {
+    if (auto E = Records.startRecord())
+      return E;
+    *Records.last() = XRayRecord{R.RecordType, R.CPU, R.Type,    R.FuncId,
+                                 R.TSC,        R.TId, R.CallArgs};
+  }
+  return Records.finish();
 }
-} // namespace
 
-Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
+Error loadTrace(StringRef Filename, XRayFileHeader &FileHeader,
+                function_ref<bool(uint32_t)> WantThread,
+                function_ref<Error(XRayRecord &)> Consumer) {
   int Fd;
   if (auto EC = sys::fs::openFileForRead(Filename, Fd)) {
     return make_error<StringError>(
@@ -593,17 +647,54 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
 
   enum BinaryFormatType { NAIVE_FORMAT = 0, FLIGHT_DATA_RECORDER_FORMAT = 1 };
 
+  RecordSink Records(WantThread, Consumer);
+  if (Type == NAIVE_FORMAT && (Version == 1 || Version == 2))
+    return loadNaiveFormatLog(Data, FileHeader, Records);
+  if (Version == 1 && Type == FLIGHT_DATA_RECORDER_FORMAT)
+    return loadFDRLog(Data, FileHeader, Records);
+  return loadYAMLLog(Data, FileHeader, Records);
+}
+} // namespace
+
+Error llvm::xray::streamTraceFile(
+    StringRef Filename, XRayFileHeader &FileHeader,
+    function_ref<Error(const XRayRecord &)> Callback) {
+  return loadTrace(Filename, FileHeader, [](uint32_t) { return true; },
+                   [&](XRayRecord &R) { return Callback(R); });
+}
+
+Error llvm::xray::streamTraceFile(
+    StringRef Filename, uint32_t ThreadId, XRayFileHeader &FileHeader,
+    function_ref<Error(const XRayRecord &)> Callback) {
+  return loadTrace(Filename, FileHeader,
+                   [=](uint32_t TId) { return TId == ThreadId; },
+                   [&](XRayRecord &R) { return Callback(R); });
+}
+
+Error llvm::xray::listTraceThreads(StringRef Filename,
+                                   XRayFileHeader &FileHeader,
+                                   std::vector<uint32_t> &ThreadIds) {
+  // Nothing is wanted, so only the headers of the buffers of FDR logs are
+  // read.
+  std::set<uint32_t> Seen;
+  auto E = loadTrace(Filename, FileHeader,
+                     [&](uint32_t TId) {
+                       Seen.insert(TId);
+                       return false;
+                     },
+                     [](XRayRecord &) { return Error::success(); });
+  ThreadIds.assign(Seen.begin(), Seen.end());
+  return E;
+}
+
+Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
   Trace T;
-  if (Type == NAIVE_FORMAT && (Version == 1 || Version == 2)) {
-    if (auto E = loadNaiveFormatLog(Data, T.FileHeader, T.Records))
-      return std::move(E);
-  } else if (Version == 1 && Type == FLIGHT_DATA_RECORDER_FORMAT) {
-    if (auto E = loadFDRLog(Data, T.FileHeader, T.Records))
-      return std::move(E);
-  } else {
-    if (auto E = loadYAMLLog(Data, T.FileHeader, T.Records))
-      return std::move(E);
-  }
+  if (auto E = loadTrace(Filename, T.FileHeader, [](uint32_t) { return true; },
+                         [&](XRayRecord &R) {
+                           T.Records.push_back(std::move(R));
+                           return Error::success();
+                         }))
+    return std::move(E);
 
   if (Sort)
     std::sort(T.Records.begin(), T.Records.end(),
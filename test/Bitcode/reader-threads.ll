@@ -0,0 +1,71 @@
+; Check that decoding function blocks on other threads while materializing a
+; module gives the same module as parsing them one after another.
+; RUN: llvm-as %s -o %t.bc
+; RUN: llvm-dis %t.bc -o %t.ll
+; RUN: llvm-dis -bitcode-reader-threads=4 %t.bc -o %t.threads.ll
+; RUN: cmp %t.ll %t.threads.ll
+; RUN: FileCheck %s < %t.threads.ll
+
+@g = global i32 0
+
+; CHECK: define i8* @f0()
+; CHECK: ret i8* blockaddress(@f2, %target)
+define i8* @f0() {
+  ret i8* blockaddress(@f2, %target)
+}
+
+; CHECK: define i32 @f1(i32 %x)
+define i32 @f1(i32 %x) !dbg !6 {
+entry:
+  call void @llvm.dbg.value(metadata i32 %x, metadata !9, metadata !DIExpression()), !dbg !10
+  %a = add i32 %x, 1, !dbg !10
+  store i32 %a, i32* @g, !tbaa !11
+  ret i32 %a, !dbg !10
+}
+
+; CHECK: define void @f2()
+define void @f2() {
+entry:
+  br label %target
+
+target:
+  ret void
+}
+
+; CHECK: define i32 @f3(i32 %x)
+define i32 @f3(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %zero, label %other
+
+zero:
+  %r0 = call i32 @f1(i32 %x)
+  ret i32 %r0
+
+other:
+  %r1 = load i32, i32* @g
+  %v = insertelement <2 x i32> <i32 1, i32 2>, i32 %r1, i32 0
+  %r2 = extractelement <2 x i32> %v, i32 1
+  ret i32 %r2
+}
+
+declare void @llvm.dbg.value(metadata, metadata, metadata)
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: true, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "reader-threads.c", directory: "/")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!5 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
+!6 = distinct !DISubprogram(name: "f1", scope: !1, file: !1, line: 1, type: !7, isLocal: false, isDefinition: true, scopeLine: 1, isOptimized: true, unit: !0, variables: !2)
+!7 = !DISubroutineType(types: !8)
+!8 = !{!5, !5}
+!9 = !DILocalVariable(name: "x", arg: 1, scope: !6, file: !1, line: 1, type: !5)
+!10 = !DILocation(line: 1, column: 1, scope: !6)
+!11 = !{!12, !12, i64 0}
+!12 = !{!"int", !13, i64 0}
+!13 = !{!"omnipotent char", !14, i64 0}
+!14 = !{!"Simple C/C++ TBAA"}
@@ -0,0 +1,96 @@
+; Check that encoding function blocks concurrently produces the same bitcode
+; as encoding them one after another.
+; RUN: llvm-as %s -o %t.bc
+; RUN: llvm-as -bitcode-writer-threads=4 %s -o %t.threads.bc
+; RUN: cmp %t.bc %t.threads.bc
+; RUN: llvm-dis %t.threads.bc -o - | FileCheck %s
+
+; Use-list orders are written serially.
+; RUN: llvm-as -preserve-bc-uselistorder %s -o %t.uselist.bc
+; RUN: llvm-as -preserve-bc-uselistorder -bitcode-writer-threads=4 %s \
+; RUN:   -o %t.uselist.threads.bc
+; RUN: cmp %t.uselist.bc %t.uselist.threads.bc
+
+@g = global i32 0
+
+; CHECK: define i32 @f0(i32 %x)
+define i32 @f0(i32 %x) !dbg !6 {
+entry:
+  call void @llvm.dbg.value(metadata i32 %x, metadata !9, metadata !DIExpression()), !dbg !10
+  %a = add i32 %x, 1, !dbg !10
+  store i32 %a, i32* @g, !tbaa !11
+  ret i32 %a, !dbg !10
+}
+
+; CHECK: define i8* @f1()
+define i8* @f1() {
+entry:
+  br label %target
+
+target:
+  ret i8* blockaddress(@f1, %target)
+}
+
+; CHECK: define i32 @f2(i32 %x)
+define i32 @f2(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %zero, label %other
+
+zero:
+  %r0 = call i32 @f0(i32 %x)
+  ret i32 %r0
+
+other:
+  %r1 = load i32, i32* @g
+  ret i32 %r1
+}
+
+; CHECK: define void @f3()
+define void @f3() personality i32 (...)* @personality {
+entry:
+  invoke void @f4()
+          to label %cont unwind label %lpad
+
+cont:
+  ret void
+
+lpad:
+  %lp = landingpad { i8*, i32 }
+          cleanup
+  resume { i8*, i32 } %lp
+}
+
+; CHECK: define void @f4()
+define void @f4() {
+  ret void
+}
+
+; CHECK: define <4 x float> @f5(<4 x float> %v)
+define <4 x float> @f5(<4 x float> %v) {
+  %r = fadd <4 x float> %v, <float 1.0, float 2.0, float 3.0, float 4.0>
+  ret <4 x float> %r
+}
+
+declare i32 @personality(...)
+
+declare void @llvm.dbg.value(metadata, metadata, metadata)
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: true, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "writer-threads.c", directory: "/")
+!2 = !{}
+!3 = !{i32 2, !"Dwarf Version", i32 4}
+!4 = !{i32 2, !"Debug Info Version", i32 3}
+!5 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
+!6 = distinct !DISubprogram(name: "f0", scope: !1, file: !1, line: 1, type: !7, isLocal: false, isDefinition: true, scopeLine: 1, isOptimized: true, unit: !0, variables: !2)
+!7 = !DISubroutineType(types: !8)
+!8 = !{!5, !5}
+!9 = !DILocalVariable(name: "x", arg: 1, scope: !6, file: !1, line: 1, type: !5)
+!10 = !DILocation(line: 1, column: 1, scope: !6)
+!11 = !{!12, !12, i64 0}
+!12 = !{!"int", !13, i64 0}
+!13 = !{!"omnipotent char", !14, i64 0}
+!14 = !{!"Simple C/C++ TBAA"}
@@ -25,8 +25,8 @@
 ; CHECK-LABEL: debug_gnu_pubtypes contents:
 ; CHECK-NEXT: length = {{.*}} version = 0x0002 unit_offset = 0x00000000 unit_size = {{.*}}
 ; CHECK-NEXT: Offset     Linkage  Kind     Name
-; CHECK-NEXT: [[BAR]]    EXTERNAL TYPE     "bar"
 ; CHECK-NEXT: [[CU]]     EXTERNAL TYPE     "ns::foo"
+; CHECK-NEXT: [[BAR]]    EXTERNAL TYPE     "bar"
 
 %struct.bar = type { %"struct.ns::foo" }
 %"struct.ns::foo" = type { i8 }
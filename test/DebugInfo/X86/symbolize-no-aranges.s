@@ -0,0 +1,148 @@
+# Without .debug_aranges, the address ranges of the units are collected from
+# their DIEs. Those of the skeleton unit come from its .dwo unit, which lives in
+# the same object file, and are collected apart from those of the other units.
+
+# RUN: rm -rf %t && mkdir -p %t && cd %t
+# RUN: llvm-mc %s -filetype obj -triple x86_64-pc-linux -o split.o
+# RUN: echo "0x1004" > %t.input
+# RUN: echo "0x2004" >> %t.input
+# RUN: echo "0x3004" >> %t.input
+# RUN: echo "0x4004" >> %t.input
+# RUN: echo "0x5004" >> %t.input
+# RUN: llvm-symbolizer -obj=split.o < %t.input | FileCheck %s
+
+# CHECK:      {{^}}a{{$}}
+# CHECK-NEXT: ??:0:0
+# CHECK:      {{^}}b{{$}}
+# CHECK-NEXT: ??:0:0
+# CHECK:      {{^}}c{{$}}
+# CHECK-NEXT: ??:0:0
+# CHECK:      {{^}}d{{$}}
+# CHECK-NEXT: ??:0:0
+# CHECK:      {{^}}??{{$}}
+# CHECK-NEXT: ??:0:0
+
+	.section	.debug_abbrev,"",@progbits
+	.byte	1                       # Abbreviation Code
+	.byte	0x11                    # DW_TAG_compile_unit
+	.byte	1                       # DW_CHILDREN_yes
+	.byte	0x03                    # DW_AT_name
+	.byte	0x08                    # DW_FORM_string
+	.byte	0                       # EOM(1)
+	.byte	0                       # EOM(2)
+	.byte	2                       # Abbreviation Code
+	.byte	0x2e                    # DW_TAG_subprogram
+	.byte	0                       # DW_CHILDREN_no
+	.byte	0x03                    # DW_AT_name
+	.byte	0x08                    # DW_FORM_string
+	.byte	0x11                    # DW_AT_low_pc
+	.byte	0x01                    # DW_FORM_addr
+	.byte	0x12                    # DW_AT_high_pc
+	.byte	0x06                    # DW_FORM_data4
+	.byte	0                       # EOM(1)
+	.byte	0                       # EOM(2)
+	.byte	3                       # Abbreviation Code
+	.byte	0x11                    # DW_TAG_compile_unit
+	.byte	0                       # DW_CHILDREN_no
+	.ascii	"\260B"                 # DW_AT_GNU_dwo_name
+	.byte	0x08                    # DW_FORM_string
+	.ascii	"\261B"                 # DW_AT_GNU_dwo_id
+	.byte	0x07                    # DW_FORM_data8
+	.ascii	"\263B"                 # DW_AT_GNU_addr_base
+	.byte	0x17                    # DW_FORM_sec_offset
+	.byte	0                       # EOM(1)
+	.byte	0                       # EOM(2)
+	.byte	0                       # EOM(3)
+
+	.section	.debug_info,"",@progbits
+	.long	.LA_end-.LA_begin       # Length of Unit
+.LA_begin:
+	.short	4                       # DWARF version number
+	.long	0                       # Offset Into Abbrev. Section
+	.byte	8                       # Address Size (in bytes)
+	.byte	1                       # Abbrev [1] DW_TAG_compile_unit
+	.asciz	"a.c"                   # DW_AT_name
+	.byte	2                       # Abbrev [2] DW_TAG_subprogram
+	.asciz	"a"                     # DW_AT_name
+	.quad	0x1000                  # DW_AT_low_pc
+	.long	0x10                    # DW_AT_high_pc
+	.byte	0                       # End Of Children Mark
+.LA_end:
+	.long	.LB_end-.LB_begin       # Length of Unit
+.LB_begin:
+	.short	4                       # DWARF version number
+	.long	0                       # Offset Into Abbrev. Section
+	.byte	8                       # Address Size (in bytes)
+	.byte	1                       # Abbrev [1] DW_TAG_compile_unit
+	.asciz	"b.c"                   # DW_AT_name
+	.byte	2                       # Abbrev [2] DW_TAG_subprogram
+	.asciz	"b"                     # DW_AT_name
+	.quad	0x2000                  # DW_AT_low_pc
+	.long	0x10                    # DW_AT_high_pc
+	.byte	0                       # End Of Children Mark
+.LB_end:
+	.long	.LC_end-.LC_begin       # Length of Unit
+.LC_begin:
+	.short	4                       # DWARF version number
+	.long	0                       # Offset Into Abbrev. Section
+	.byte	8                       # Address Size (in bytes)
+	.byte	3                       # Abbrev [3] DW_TAG_compile_unit
+	.asciz	"split.o"               # DW_AT_GNU_dwo_name
+	.quad	0x1234                  # DW_AT_GNU_dwo_id
+	.long	0                       # DW_AT_GNU_addr_base
+.LC_end:
+	.long	.LD_end-.LD_begin       # Length of Unit
+.LD_begin:
+	.short	4                       # DWARF version number
+	.long	0                       # Offset Into Abbrev. Section
+	.byte	8                       # Address Size (in bytes)
+	.byte	1                       # Abbrev [1] DW_TAG_compile_unit
+	.asciz	"d.c"                   # DW_AT_name
+	.byte	2                       # Abbrev [2] DW_TAG_subprogram
+	.asciz	"d"                     # DW_AT_name
+	.quad	0x4000                  # DW_AT_low_pc
+	.long	0x10                    # DW_AT_high_pc
+	.byte	0                       # End Of Children Mark
+.LD_end:
+
+	.section	.debug_addr,"",@progbits
+	.quad	0x3000
+
+	.section	.debug_abbrev.dwo,"",@progbits
+	.byte	1                       # Abbreviation Code
+	.byte	0x11                    # DW_TAG_compile_unit
+	.byte	1                       # DW_CHILDREN_yes
+	.byte	0x03                    # DW_AT_name
+	.byte	0x08                    # DW_FORM_string
+	.ascii	"\261B"                 # DW_AT_GNU_dwo_id
+	.byte	0x07                    # DW_FORM_data8
+	.byte	0                       # EOM(1)
+	.byte	0                       # EOM(2)
+	.byte	2                       # Abbreviation Code
+	.byte	0x2e                    # DW_TAG_subprogram
+	.byte	0                       # DW_CHILDREN_no
+	.byte	0x03                    # DW_AT_name
+	.byte	0x08                    # DW_FORM_string
+	.byte	0x11                    # DW_AT_low_pc
+	.ascii	"\201>"                 # DW_FORM_GNU_addr_index
+	.byte	0x12                    # DW_AT_high_pc
+	.byte	0x06                    # DW_FORM_data4
+	.byte	0                       # EOM(1)
+	.byte	0                       # EOM(2)
+	.byte	0                       # EOM(3)
+
+	.section	.debug_info.dwo,"",@progbits
+	.long	.LCdwo_end-.LCdwo_begin # Length of Unit
+.LCdwo_begin:
+	.short	4                       # DWARF version number
+	.long	0                       # Offset Into Abbrev. Section
+	.byte	8                       # Address Size (in bytes)
+	.byte	1                       # Abbrev [1] DW_TAG_compile_unit
+	.asciz	"c.c"                   # DW_AT_name
+	.quad	0x1234                  # DW_AT_GNU_dwo_id
+	.byte	2                       # Abbrev [2] DW_TAG_subprogram
+	.asciz	"c"                     # DW_AT_name
+	.byte	0                       # DW_AT_low_pc
+	.long	0x10                    # DW_AT_high_pc
+	.byte	0                       # End Of Children Mark
+.LCdwo_end:
@@ -0,0 +1,24 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: lli -jit-kind=orc-lazy -stats %t.bc 2>&1 | FileCheck %s
+; REQUIRES: asserts
+;
+; Only the bodies of the functions that are called are read from the bitcode,
+; @cold is never materialized.
+;
+; CHECK: 2 bitcode-reader - Number of function bodies materialized
+
+define i32 @cold() {
+entry:
+  ret i32 1
+}
+
+define i32 @hot() {
+entry:
+  ret i32 0
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %0 = call i32 @hot()
+  ret i32 %0
+}
@@ -0,0 +1,26 @@
+; RUN: llvm-as %s -o %t.bc
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-debug=funcs-to-stdout %t.bc | FileCheck %s
+;
+; Bitcode input is loaded lazily: only the bodies of the functions that are
+; called get materialized and compiled.
+;
+; The partition of @main also holds the inlined stub of @hot.
+; CHECK: [ main {{.*}}]
+; CHECK-NEXT: [ hot ]
+; CHECK-NOT: cold
+
+define i32 @cold() {
+entry:
+  ret i32 1
+}
+
+define i32 @hot() {
+entry:
+  ret i32 0
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %0 = call i32 @hot()
+  ret i32 %0
+}
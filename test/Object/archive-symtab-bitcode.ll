@@ -0,0 +1,39 @@
+; Check the archive symbol table of bitcode members. The symbols of a module
+; with a data layout are read from its irsymtab, and those of a module without
+; one from the module itself.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: llvm-as %p/Inputs/trivial.ll -o %t.nodl.bc
+; RUN: rm -f %t.a
+; RUN: llvm-ar rcs %t.a %t.bc %t.nodl.bc
+; RUN: llvm-nm -M %t.a | FileCheck %s
+
+; CHECK:      Archive map
+; CHECK-NEXT: f in {{.*}}.tmp.bc
+; CHECK-NEXT: g in {{.*}}.tmp.bc
+; CHECK-NEXT: w in {{.*}}.tmp.bc
+; CHECK-NEXT: a in {{.*}}.tmp.bc
+; CHECK-NEXT: main in {{.*}}.tmp.nodl.bc
+; CHECK-NEXT: var in {{.*}}.tmp.nodl.bc
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@g = global i32 0
+@h = private global i32 0
+@w = weak global i32 0
+@llvm.used = appending global [1 x i8*] [i8* bitcast (i32* @g to i8*)], section "llvm.metadata"
+
+@a = alias i32, i32* @g
+
+define void @f() {
+  call void @u()
+  call void @i()
+  ret void
+}
+
+define internal void @i() {
+  ret void
+}
+
+declare void @u()
@@ -0,0 +1,43 @@
+; Check that the backend jobs queued behind the running ones, which are looked
+; up in the cache and parsed ahead of time, produce the same objects.
+; RUN: opt -module-hash -module-summary %s -o %t1.bc
+; RUN: opt -module-hash -module-summary %p/Inputs/funcimport2.ll -o %t2.bc
+
+; RUN: llvm-lto2 run %t1.bc %t2.bc -o %t.noprefetch -thinlto-threads=1 \
+; RUN:     -thinlto-backend-prefetch=0 \
+; RUN:     -r=%t1.bc,_foo,plx \
+; RUN:     -r=%t2.bc,_main,plx \
+; RUN:     -r=%t2.bc,_foo,l
+; RUN: llvm-lto2 run %t1.bc %t2.bc -o %t.prefetch -thinlto-threads=1 \
+; RUN:     -thinlto-backend-prefetch=1 \
+; RUN:     -r=%t1.bc,_foo,plx \
+; RUN:     -r=%t2.bc,_main,plx \
+; RUN:     -r=%t2.bc,_foo,l
+; RUN: cmp %t.noprefetch.0 %t.prefetch.0
+; RUN: cmp %t.noprefetch.1 %t.prefetch.1
+
+; The second link hits the cache for every job, including the prefetched one.
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run %t1.bc %t2.bc -o %t.cached -thinlto-threads=1 \
+; RUN:     -cache-dir %t.cache \
+; RUN:     -r=%t1.bc,_foo,plx \
+; RUN:     -r=%t2.bc,_main,plx \
+; RUN:     -r=%t2.bc,_foo,l
+; RUN: ls %t.cache/llvmcache-* | count 2
+; RUN: rm %t.cached.0 %t.cached.1
+; RUN: llvm-lto2 run %t1.bc %t2.bc -o %t.cached -thinlto-threads=1 \
+; RUN:     -cache-dir %t.cache \
+; RUN:     -r=%t1.bc,_foo,plx \
+; RUN:     -r=%t2.bc,_main,plx \
+; RUN:     -r=%t2.bc,_foo,l
+; RUN: ls %t.cache/llvmcache-* | count 2
+; RUN: cmp %t.noprefetch.0 %t.cached.0
+; RUN: cmp %t.noprefetch.1 %t.cached.1
+
+target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.11.0"
+
+define void @foo() #0 {
+entry:
+  ret void
+}
@@ -43,6 +43,136 @@
 ; RUN: ls %t.cache | count 2
 ; RUN: ls %t.cache/llvmcache-* | count 2
 
+; Verify that -cache-codegen adds an entry for the object file of each
+; optimized module.
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache -cache-codegen \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache/llvmcache-* | count 4
+; A second link hits the entries of the whole backends and adds none.
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache -cache-codegen \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache/llvmcache-* | count 4
+; Remove the entries of the whole backends, which are the ones a link without
+; -cache-codegen creates. The next link hits the object file entries and adds
+; the backend entries back, so that the link after it skips the optimizer.
+; RUN: rm -Rf %t.cache.backend
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache.backend \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: cd %t.cache.backend && ls llvmcache-* > %t.backend-entries
+; RUN: cd %t.cache && xargs rm < %t.backend-entries
+; RUN: ls %t.cache/llvmcache-* | count 2
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache -cache-codegen \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache/llvmcache-* | count 4
+; RUN: cd %t.cache && ls $(cat %t.backend-entries) | count 2
+; The module is still passed to the hooks of -save-temps when its object file
+; is a hit. -save-temps keeps the value names, so the first link adds object
+; file entries of its own.
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.savetemps.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -cache-codegen -save-temps \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: cd %t.cache && xargs rm < %t.backend-entries
+; RUN: rm %t.savetemps.o.0.5.precodegen.bc %t.savetemps.o.1.5.precodegen.bc
+; RUN: llvm-lto2 run -o %t.savetemps.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -cache-codegen -save-temps \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache/llvmcache-* | count 4
+; RUN: ls %t.savetemps.o.0.5.precodegen.bc %t.savetemps.o.1.5.precodegen.bc
+
+; Verify that a pruning policy makes llvm-lto2 track the entries in the cache
+; index, and prune them as new entries are added and once the link is done,
+; which creates the timestamp file.
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -cache-policy=cache_size_bytes=1g \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache | count 4
+; RUN: ls %t.cache/llvmcache.index
+; RUN: ls %t.cache/llvmcache.timestamp
+; RUN: ls %t.cache/llvmcache-* | count 2
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -cache-policy=cache_size_bytes=1 \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache | count 2
+; RUN: ls %t.cache/llvmcache.index
+
+; The object file entries of -cache-codegen are tracked and pruned the same way.
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache -cache-codegen \
+; RUN:  -cache-policy=cache_size_bytes=1g \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache | count 6
+; RUN: ls %t.cache/llvmcache-* | count 4
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache -cache-codegen \
+; RUN:  -cache-policy=cache_size_bytes=1 \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache | count 2
+; RUN: ls %t.cache/llvmcache.index
+
+; Entries expire even when every lookup of a link hits. The first link has no
+; pruning policy, so the second one creates the index from the directory, which
+; tracks the old file.
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: touch -t 197001011200 %t.cache/llvmcache-foo
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -cache-policy=prune_after=1h \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: not ls %t.cache/llvmcache-foo
+; RUN: ls %t.cache/llvmcache-* | count 2
+
+; Entries that ThinLTOCodeGenerator adds to a cache with an index aren't tracked
+; by the index, but are pruned all the same once the link is done.
+; RUN: rm -Rf %t.cache
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -cache-policy=cache_size_bytes=1g \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache/llvmcache.index
+; RUN: cd %t.cache && ls llvmcache-* > %t.lto2-entries
+; RUN: llvm-lto -thinlto-action=run -exported-symbol=globalfunc %t2.bc  %t.bc -thinlto-cache-dir %t.cache
+; RUN: cd %t.cache && ls llvmcache-* | \
+; RUN:   grep -v -x -F -f %t.lto2-entries > %t.lto-entries
+; RUN: count 2 < %t.lto-entries
+; RUN: cd %t.cache && xargs touch -t 197001011200 < %t.lto-entries
+; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache \
+; RUN:  -cache-policy=prune_interval=0s:prune_after=1h \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: ls %t.cache/llvmcache-* | count 2
+; RUN: cd %t.cache && ls $(cat %t.lto2-entries) | count 2
+
 target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
 target triple = "x86_64-apple-macosx10.11.0"
 
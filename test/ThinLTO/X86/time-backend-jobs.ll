@@ -0,0 +1,27 @@
+; Check that -time-thinlto-backend-jobs reports the time taken by each backend
+; job, also when several of them run in parallel.
+; RUN: opt -module-summary %s -o %t1.bc
+; RUN: opt -module-summary %p/Inputs/funcimport2.ll -o %t2.bc
+
+; RUN: llvm-lto2 run %t1.bc %t2.bc -o %t.o -thinlto-threads=2 \
+; RUN:     -time-thinlto-backend-jobs \
+; RUN:     -r=%t1.bc,_foo,plx \
+; RUN:     -r=%t2.bc,_main,plx \
+; RUN:     -r=%t2.bc,_foo,l 2>&1 | FileCheck %s
+; CHECK: ThinLTO Backend Jobs
+; CHECK-DAG: Task 0: {{.*}}1.bc
+; CHECK-DAG: Task 1: {{.*}}2.bc
+
+; RUN: llvm-lto2 run %t1.bc %t2.bc -o %t.o -thinlto-threads=2 \
+; RUN:     -r=%t1.bc,_foo,plx \
+; RUN:     -r=%t2.bc,_main,plx \
+; RUN:     -r=%t2.bc,_foo,l 2>&1 | FileCheck %s --check-prefix=NOTIME --allow-empty
+; NOTIME-NOT: ThinLTO Backend Jobs
+
+target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.11.0"
+
+define void @foo() #0 {
+entry:
+  ret void
+}
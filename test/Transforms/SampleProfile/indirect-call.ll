@@ -1,4 +1,6 @@
 ; RUN: opt < %s -sample-profile -sample-profile-file=%S/Inputs/indirect-call.prof -S | FileCheck %s
+; RUN: llvm-profdata merge -sample -compbinary -use-md5 %S/Inputs/indirect-call.prof -o %t.md5
+; RUN: opt < %s -sample-profile -sample-profile-file=%t.md5 -S | FileCheck %s
 
 ; CHECK-LABEL: @test
 define void @test(void ()*) !dbg !3 {
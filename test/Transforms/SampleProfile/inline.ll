@@ -1,5 +1,9 @@
 ; RUN: opt < %s -sample-profile -sample-profile-file=%S/Inputs/inline.prof -sample-profile-inline-hot-threshold=1 -S | FileCheck %s
 ; RUN: opt < %s -passes=sample-profile -sample-profile-file=%S/Inputs/inline.prof -sample-profile-inline-hot-threshold=1 -S | FileCheck %s
+; RUN: llvm-profdata merge -sample -compbinary %S/Inputs/inline.prof -o %t.compbinary
+; RUN: opt < %s -sample-profile -sample-profile-file=%t.compbinary -sample-profile-inline-hot-threshold=1 -S | FileCheck %s
+; RUN: llvm-profdata merge -sample -compbinary -use-md5 %S/Inputs/inline.prof -o %t.md5
+; RUN: opt < %s -passes=sample-profile -sample-profile-file=%t.md5 -sample-profile-inline-hot-threshold=1 -S | FileCheck %s
 
 ; Original C++ test case
 ;
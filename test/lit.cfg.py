@@ -156,7 +156,10 @@ tools.extend([
     ToolSubst('Kaleidoscope-Ch5', unresolved='ignore'),
     ToolSubst('Kaleidoscope-Ch6', unresolved='ignore'),
     ToolSubst('Kaleidoscope-Ch7', unresolved='ignore'),
-    ToolSubst('Kaleidoscope-Ch8', unresolved='ignore')])
+    ToolSubst('Kaleidoscope-Ch8', unresolved='ignore'),
+    ToolSubst('llvm-bitcode-bench', unresolved='ignore'),
+    ToolSubst('llvm-hashmap-bench', unresolved='ignore'),
+    ToolSubst('llvm-stringmap-bench', unresolved='ignore')])
 
 llvm_config.add_tool_substitutions(tools, config.llvm_tools_dir)
 
@@ -26,7 +26,8 @@
 
 
 ; Create two files that would be removed by cache pruning due to age.
-; We should only remove files matching the pattern "llvmcache-*".
+; We should only remove files matching the pattern "llvmcache-*". Every lookup
+; of this link hits, so the cache is only pruned once the link is done.
 
 ; RUN: touch -t 197001011200 %t.cache/llvmcache-foo %t.cache/foo
 ; RUN: %gold -m elf_x86_64 -plugin %llvmshlibdir/LLVMgold.so \
@@ -35,30 +36,46 @@
 ; RUN:     --plugin-opt=cache-policy=prune_after=1h \
 ; RUN:     -o %t3.o %t2.o %t.o
 
-; Two cached objects, plus a timestamp file and "foo", minus the file we removed.
-; RUN: ls %t.cache | count 4
+; Two cached objects, plus a timestamp file, the cache index and "foo", minus
+; the file we removed.
+; RUN: ls %t.cache | count 5
+; RUN: ls %t.cache/llvmcache.index
+; RUN: not ls %t.cache/llvmcache-foo
 
 
-; Create a file of size 64KB.
+; Create a file of size 64KB. Remove the index, so that the next link rebuilds
+; it from the directory and tracks the file.
 ; RUN: %python -c "print(' ' * 65536)" > %t.cache/llvmcache-foo
+; RUN: rm %t.cache/llvmcache.index
 
 ; This should leave the file in place.
 ; RUN: %gold -m elf_x86_64 -plugin %llvmshlibdir/LLVMgold.so \
 ; RUN:     --plugin-opt=thinlto \
 ; RUN:     --plugin-opt=cache-dir=%t.cache \
-; RUN:     --plugin-opt=cache-policy=cache_size_bytes=128k \
+; RUN:     --plugin-opt=cache-policy=cache_size_bytes=128k:prune_interval=0s \
 ; RUN:     -o %t3.o %t2.o %t.o
-; RUN: ls %t.cache | count 5
+; RUN: ls %t.cache | count 6
 
 
 ; This should remove it.
 ; RUN: %gold -m elf_x86_64 -plugin %llvmshlibdir/LLVMgold.so \
 ; RUN:     --plugin-opt=thinlto \
 ; RUN:     --plugin-opt=cache-dir=%t.cache \
-; RUN:     --plugin-opt=cache-policy=cache_size_bytes=32k \
+; RUN:     --plugin-opt=cache-policy=cache_size_bytes=32k:prune_interval=0s \
 ; RUN:     -o %t3.o %t2.o %t.o
-; RUN: ls %t.cache | count 4
+; RUN: ls %t.cache | count 5
+
 
+; The cache was just pruned, so with the default pruning interval this should
+; leave the file in place.
+; RUN: %python -c "print(' ' * 65536)" > %t.cache/llvmcache-foo
+; RUN: rm %t.cache/llvmcache.index
+; RUN: %gold -m elf_x86_64 -plugin %llvmshlibdir/LLVMgold.so \
+; RUN:     --plugin-opt=thinlto \
+; RUN:     --plugin-opt=cache-dir=%t.cache \
+; RUN:     --plugin-opt=cache-policy=cache_size_bytes=32k \
+; RUN:     -o %t3.o %t2.o %t.o
+; RUN: ls %t.cache | count 6
 
 target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
 target triple = "x86_64-unknown-linux-gnu"
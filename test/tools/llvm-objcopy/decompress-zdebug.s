@@ -0,0 +1,16 @@
+# REQUIRES: zlib
+# RUN: llvm-mc -filetype=obj -compress-debug-sections=zlib-gnu \
+# RUN:   -triple x86_64-pc-linux-gnu %s -o %t
+# RUN: llvm-objcopy --decompress-debug-sections %t %t2
+# RUN: llvm-readobj -sections -section-data %t2 | FileCheck %s
+
+# CHECK-NOT: .zdebug_str
+# CHECK:     Name: .debug_str
+# CHECK-NOT: SHF_COMPRESSED
+# CHECK:     SectionData (
+# CHECK-NEXT:  0000: 61626364 65666768 696A6B6C 6D6E6F70  |abcdefghijklmnop|
+
+  .section .debug_str,"MS",@progbits,1
+  .rept 8
+  .asciz "abcdefghijklmnopqrstuvwxyz"
+  .endr
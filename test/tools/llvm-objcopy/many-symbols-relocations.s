@@ -0,0 +1,32 @@
+# The symbol and relocation tables here are large enough to be written in
+# several chunks. Check they are copied unchanged.
+# RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu %s -o %t
+# RUN: llvm-objcopy %t %t2
+# RUN: llvm-nm -p %t > %t.syms
+# RUN: llvm-nm -p %t2 | diff %t.syms -
+# RUN: llvm-objdump -r %t | tail -n +3 > %t.relocs
+# RUN: llvm-objdump -r %t2 | tail -n +3 | diff %t.relocs -
+# RUN: FileCheck %s < %t.relocs
+
+# CHECK:      RELOCATION RECORDS FOR [.rela.data]:
+# CHECK-NEXT: 0000000000000000 R_X86_64_64 sym0000+0
+# CHECK:      0000000000009c38 R_X86_64_64 sym4999+0
+# CHECK-NEXT: 0000000000009c40 R_X86_64_64 sym5000+0
+# CHECK:      0000000000013878 R_X86_64_64 sym9999+0
+
+  .data
+  .macro sym n
+  .globl sym\n
+sym\n:
+  .quad sym\n
+  .endm
+
+  .irp i,0,1,2,3,4,5,6,7,8,9
+  .irp j,0,1,2,3,4,5,6,7,8,9
+  .irp k,0,1,2,3,4,5,6,7,8,9
+  .irp l,0,1,2,3,4,5,6,7,8,9
+  sym \i\j\k\l
+  .endr
+  .endr
+  .endr
+  .endr
@@ -0,0 +1,56 @@
+; The last partition is made from the input module in place, and must match
+; what cloning it would produce.
+; RUN: llvm-split -o %t %s
+; RUN: llvm-dis -o - %t0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-dis -o - %t1 | FileCheck --check-prefix=CHECK1 %s
+
+; Only the first partition keeps the module asm.
+; CHECK0: module asm "nop"
+; CHECK1-NOT: module asm
+module asm "nop"
+
+; Variables defined elsewhere lose their initializer and metadata.
+; CHECK0: @var0 = external global i32{{$}}
+; CHECK0: @var1 = global i32 1, !type !0
+; CHECK1: @var0 = global i32 0, !type !0
+; CHECK1: @var1 = external global i32{{$}}
+@var0 = global i32 0, !type !0
+@var1 = global i32 1, !type !0
+
+; Aliases and ifuncs defined elsewhere become declarations.
+; CHECK0: @alias0 = external global i32
+; CHECK0: @alias1 = alias i32, i32* @var1
+; CHECK1: @alias1 = external global i32
+; CHECK1: @alias0 = alias i32, i32* @var0
+; CHECK1: @ifunc0 = ifunc void (), i8* ()* @resolver0
+@alias0 = alias i32, i32* @var0
+@alias1 = alias i32, i32* @var1
+@ifunc0 = ifunc void (), i8* ()* @resolver0
+@ifunc1 = ifunc void (), i8* ()* @resolver1
+
+; CHECK1: define i8* @resolver0()
+define i8* @resolver0() {
+  ret i8* null
+}
+
+; CHECK1: declare i8* @resolver1()
+define i8* @resolver1() {
+  ret i8* null
+}
+
+; Functions defined elsewhere lose their personality and metadata.
+; CHECK0: define void @f0() personality i8* null !foo !0
+; CHECK1: declare void @f0(){{$}}
+define void @f0() personality i8* null !foo !0 {
+  ret void
+}
+
+; CHECK0: declare void @f1(){{$}}
+; CHECK1: define void @f1() personality i8* null !foo !0
+define void @f1() personality i8* null !foo !0 {
+  ret void
+}
+
+; CHECK1: declare void @ifunc1()
+
+!0 = !{i32 0, !"typeid"}
@@ -73,20 +73,24 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/thread.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include <algorithm>
 #include <cassert>
 #include <cinttypes>
 #include <climits>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <system_error>
 #include <tuple>
@@ -1211,8 +1215,7 @@ namespace {
 class DwarfLinker {
 public:
   DwarfLinker(StringRef OutputFilename, const LinkOptions &Options)
-      : OutputFilename(OutputFilename), Options(Options),
-        BinHolder(Options.Verbose) {}
+      : OutputFilename(OutputFilename), Options(Options) {}
 
   /// Link the contents of the DebugMap.
   bool link(const DebugMap &);
@@ -1220,6 +1223,12 @@ public:
   void reportWarning(const Twine &Warning,
                      const DWARFDie *DIE = nullptr) const;
 
+  /// Report a warning about \p DMO. Unlike the overload above this can be
+  /// used while loading objects ahead of the link: warnings about an object
+  /// that isn't being linked yet are printed when its link starts.
+  void reportWarning(const Twine &Warning, const DebugMapObject &DMO,
+                     const DWARFDie *DIE = nullptr) const;
+
 private:
   /// Called at the start of a debug object link.
   void startDebugObject(DWARFContext &, DebugMapObject &);
@@ -1294,6 +1303,31 @@ private:
                           bool isLittleEndian);
   };
 
+  /// The per-object state that can be set up without looking at the
+  /// objects linked before it.
+  struct LinkContext {
+    DebugMapObject &DMO;
+    const object::ObjectFile *ObjectFile = nullptr;
+    RelocationManager RelocMgr;
+    std::unique_ptr<DWARFContext> DwarfContext;
+
+    /// Set when the object doesn't contribute any debug info to the link.
+    bool Skip = false;
+
+    LinkContext(DwarfLinker &Linker, DebugMapObject &DMO)
+        : DMO(DMO), RelocMgr(Linker) {}
+  };
+
+  /// Map the object described by \p Context, find its valid relocations
+  /// and parse its debug info. This doesn't touch any state shared between
+  /// objects, so it can run while the previous object is being linked.
+  void loadDebugObject(BinaryHolder &BinHolder, LinkContext &Context,
+                       const DebugMap &Map);
+
+  /// Analyze the debug info loaded into \p Context, then clone and emit
+  /// the parts of it that need to be in the linked output.
+  void linkDebugObject(LinkContext &Context, DebugMap &ModuleMap);
+
   /// \defgroup FindRootDIEs Find DIEs corresponding to debug map entries.
   ///
   /// @{
@@ -1537,15 +1571,15 @@ private:
   /// @{
   bool createStreamer(const Triple &TheTriple, StringRef OutputFilename);
 
-  /// Attempt to load a debug object from disk.
-  ErrorOr<const object::ObjectFile &> loadObject(BinaryHolder &BinaryHolder,
-                                                 DebugMapObject &Obj,
-                                                 const DebugMap &Map);
+  /// Attempt to load a debug object from disk. Warnings are reported in
+  /// the context of \p Referrer.
+  ErrorOr<const object::ObjectFile &>
+  loadObject(BinaryHolder &BinaryHolder, DebugMapObject &Obj,
+             const DebugMap &Map, const DebugMapObject &Referrer);
   /// @}
 
   std::string OutputFilename;
   LinkOptions Options;
-  BinaryHolder BinHolder;
   std::unique_ptr<DwarfStreamer> Streamer;
   uint64_t OutputDebugInfoSize;
 
@@ -1558,7 +1592,14 @@ private:
   std::vector<std::unique_ptr<CompileUnit>> Units;
 
   /// The debug map object currently under consideration.
-  DebugMapObject *CurrentDebugObject;
+  DebugMapObject *CurrentDebugObject = nullptr;
+
+  /// Warnings about the objects loaded ahead of the link, which are printed
+  /// once the object is linked so that they don't depend on scheduling.
+  mutable std::map<const DebugMapObject *, std::string> PendingWarnings;
+
+  /// Protects PendingWarnings and the updates of CurrentDebugObject.
+  mutable std::mutex PendingWarningsMutex;
 
   /// The Dwarf string pool.
   NonRelocatableStringpool StringPool;
@@ -1875,6 +1916,23 @@ void DwarfLinker::reportWarning(const Twine &Warning,
   DIE->dump(errs(), 6 /* Indent */, DumpOpts);
 }
 
+void DwarfLinker::reportWarning(const Twine &Warning,
+                                const DebugMapObject &DMO,
+                                const DWARFDie *DIE) const {
+  {
+    std::lock_guard<std::mutex> Lock(PendingWarningsMutex);
+    if (&DMO != CurrentDebugObject) {
+      // Only the loading thread reports about the objects after the current
+      // one, and it doesn't look at DIEs.
+      raw_string_ostream OS(PendingWarnings[&DMO]);
+      OS << "while processing " << DMO.getObjectFilename() << ":\n"
+         << "warning: " << Warning << "\n";
+      return;
+    }
+  }
+  reportWarning(Warning, DIE);
+}
+
 bool DwarfLinker::createStreamer(const Triple &TheTriple,
                                  StringRef OutputFilename) {
   if (Options.NoOutput)
@@ -2048,14 +2106,16 @@ findValidRelocsMachO(const object::SectionRef &Section,
     if (isMachOPairedReloc(Obj.getAnyRelocationType(MachOReloc),
                            Obj.getArch())) {
       SkipNext = true;
-      Linker.reportWarning(" unsupported relocation in debug_info section.");
+      Linker.reportWarning(" unsupported relocation in debug_info section.",
+                           DMO);
       continue;
     }
 
     unsigned RelocSize = 1 << Obj.getAnyRelocationLength(MachOReloc);
     uint64_t Offset64 = Reloc.getOffset();
     if ((RelocSize != 4 && RelocSize != 8)) {
-      Linker.reportWarning(" unsupported relocation in debug_info section.");
+      Linker.reportWarning(" unsupported relocation in debug_info section.",
+                           DMO);
       continue;
     }
     uint32_t Offset = Offset64;
@@ -2080,7 +2140,7 @@ findValidRelocsMachO(const object::SectionRef &Section,
       Expected<StringRef> SymbolName = Sym->getName();
       if (!SymbolName) {
         consumeError(SymbolName.takeError());
-        Linker.reportWarning("error getting relocation symbol name.");
+        Linker.reportWarning("error getting relocation symbol name.", DMO);
         continue;
       }
       if (const auto *Mapping = DMO.lookupSymbol(*SymbolName))
@@ -2104,7 +2164,8 @@ bool DwarfLinker::RelocationManager::findValidRelocs(
     findValidRelocsMachO(Section, *MachOObj, DMO);
   else
     Linker.reportWarning(Twine("unsupported object file type: ") +
-                         Obj.getFileName());
+                             Obj.getFileName(),
+                         DMO);
 
   if (ValidRelocs.empty())
     return false;
@@ -3431,16 +3492,18 @@ bool DwarfLinker::registerModuleReference(
 
 ErrorOr<const object::ObjectFile &>
 DwarfLinker::loadObject(BinaryHolder &BinaryHolder, DebugMapObject &Obj,
-                        const DebugMap &Map) {
+                        const DebugMap &Map, const DebugMapObject &Referrer) {
   auto ErrOrObjs =
       BinaryHolder.GetObjectFiles(Obj.getObjectFilename(), Obj.getTimestamp());
   if (std::error_code EC = ErrOrObjs.getError()) {
-    reportWarning(Twine(Obj.getObjectFilename()) + ": " + EC.message());
+    reportWarning(Twine(Obj.getObjectFilename()) + ": " + EC.message(),
+                  Referrer);
     return EC;
   }
   auto ErrOrObj = BinaryHolder.Get(Map.getTriple());
   if (std::error_code EC = ErrOrObj.getError())
-    reportWarning(Twine(Obj.getObjectFilename()) + ": " + EC.message());
+    reportWarning(Twine(Obj.getObjectFilename()) + ": " + EC.message(),
+                  Referrer);
   return ErrOrObj;
 }
 
@@ -3455,7 +3518,7 @@ void DwarfLinker::loadClangModule(StringRef Filename, StringRef ModulePath,
   BinaryHolder ObjHolder(Options.Verbose);
   auto &Obj = ModuleMap.addDebugMapObject(
       Path, sys::TimePoint<std::chrono::seconds>(), MachO::N_OSO);
-  auto ErrOrObj = loadObject(ObjHolder, Obj, ModuleMap);
+  auto ErrOrObj = loadObject(ObjHolder, Obj, ModuleMap, *CurrentDebugObject);
   if (!ErrOrObj) {
     // Try and emit more helpful warnings by applying some heuristics.
     StringRef ObjFile = CurrentDebugObject->getObjectFilename();
@@ -3583,6 +3646,132 @@ void DwarfLinker::DIECloner::cloneAllCompileUnits(DWARFContext &DwarfContext) {
   }
 }
 
+void DwarfLinker::loadDebugObject(BinaryHolder &BinHolder,
+                                  LinkContext &Context, const DebugMap &Map) {
+  DebugMapObject &Obj = Context.DMO;
+  if (Options.Verbose)
+    outs() << "DEBUG MAP OBJECT: " << Obj.getObjectFilename() << "\n";
+
+  // N_AST objects are copied verbatim by linkDebugObject().
+  if (Obj.getType() == MachO::N_AST)
+    return;
+
+  auto ErrOrObj = loadObject(BinHolder, Obj, Map, Obj);
+  if (!ErrOrObj) {
+    Context.Skip = true;
+    return;
+  }
+  Context.ObjectFile = &*ErrOrObj;
+
+  // Look for relocations that correspond to debug map entries.
+  if (!Context.RelocMgr.findValidRelocsInDebugInfo(*ErrOrObj, Obj)) {
+    if (Options.Verbose)
+      outs() << "No valid relocations found. Skipping.\n";
+    Context.Skip = true;
+    return;
+  }
+
+  // Setup access to the debug info and extract all the DIEs now, rather than
+  // when the units are first walked during the link.
+  Context.DwarfContext = DWARFContext::create(*ErrOrObj);
+  for (const auto &CU : Context.DwarfContext->compile_units())
+    CU->getNumDIEs();
+}
+
+void DwarfLinker::linkDebugObject(LinkContext &Context, DebugMap &ModuleMap) {
+  DebugMapObject &Obj = Context.DMO;
+  {
+    std::lock_guard<std::mutex> Lock(PendingWarningsMutex);
+    CurrentDebugObject = &Obj;
+    auto Pending = PendingWarnings.find(&Obj);
+    if (Pending != PendingWarnings.end()) {
+      errs() << Pending->second;
+      PendingWarnings.erase(Pending);
+    }
+  }
+
+  // N_AST objects (swiftmodule files) should get dumped directly into the
+  // appropriate DWARF section.
+  if (Obj.getType() == MachO::N_AST) {
+    StringRef File = Obj.getObjectFilename();
+    auto ErrorOrMem = MemoryBuffer::getFile(File);
+    if (!ErrorOrMem) {
+      errs() << "Warning: Could not open " << File << "\n";
+      return;
+    }
+    sys::fs::file_status Stat;
+    if (auto errc = sys::fs::status(File, Stat)) {
+      errs() << "Warning: " << errc.message() << "\n";
+      return;
+    }
+    if (!Options.NoTimestamp && Stat.getLastModificationTime() !=
+                                    sys::TimePoint<>(Obj.getTimestamp())) {
+      errs() << "Warning: Timestamp mismatch for " << File << ": "
+             << Stat.getLastModificationTime() << " and "
+             << sys::TimePoint<>(Obj.getTimestamp()) << "\n";
+      return;
+    }
+
+    // Copy the module into the .swift_ast section.
+    if (!Options.NoOutput)
+      Streamer->emitSwiftAST((*ErrorOrMem)->getBuffer());
+    return;
+  }
+
+  if (Context.Skip)
+    return;
+
+  DWARFContext &DwarfContext = *Context.DwarfContext;
+  RelocationManager &RelocMgr = Context.RelocMgr;
+  startDebugObject(DwarfContext, Obj);
+
+  // In a first phase, just read in the debug info and load all clang modules.
+  for (const auto &CU : DwarfContext.compile_units()) {
+    auto CUDie = CU->getUnitDIE(false);
+    if (Options.Verbose) {
+      outs() << "Input compilation unit:";
+      DIDumpOptions DumpOpts;
+      DumpOpts.RecurseDepth = 0;
+      DumpOpts.Verbose = Options.Verbose;
+      CUDie.dump(outs(), 0, DumpOpts);
+    }
+
+    if (!registerModuleReference(CUDie, *CU, ModuleMap)) {
+      Units.push_back(llvm::make_unique<CompileUnit>(*CU, UnitID++,
+                                                     !Options.NoODR, ""));
+      maybeUpdateMaxDwarfVersion(CU->getVersion());
+    }
+  }
+
+  // Now build the DIE parent links that we will use during the next phase.
+  for (auto &CurrentUnit : Units)
+    analyzeContextInfo(CurrentUnit->getOrigUnit().getUnitDIE(), 0, *CurrentUnit,
+                       &ODRContexts.getRoot(), StringPool, ODRContexts);
+
+  // Then mark all the DIEs that need to be present in the linked
+  // output and collect some information about them. Note that this
+  // loop can not be merged with the previous one becaue cross-cu
+  // references require the ParentIdx to be setup for every CU in
+  // the object file before calling this.
+  for (auto &CurrentUnit : Units)
+    lookForDIEsToKeep(RelocMgr, CurrentUnit->getOrigUnit().getUnitDIE(), Obj,
+                      *CurrentUnit, 0);
+
+  // The calls to applyValidRelocs inside cloneDIE will walk the
+  // reloc array again (in the same way findValidRelocsInDebugInfo()
+  // did). We need to reset the NextValidReloc index to the beginning.
+  RelocMgr.resetValidRelocs();
+  if (RelocMgr.hasValidRelocs())
+    DIECloner(*this, RelocMgr, DIEAlloc, Units, Options)
+        .cloneAllCompileUnits(DwarfContext);
+  if (!Options.NoOutput && !Units.empty())
+    patchFrameInfoForObject(Obj, DwarfContext,
+                            Units[0]->getOrigUnit().getAddressByteSize());
+
+  // Clean-up before starting working on the next object.
+  endDebugObject();
+}
+
 bool DwarfLinker::link(const DebugMap &Map) {
   if (!createStreamer(Map.getTriple(), OutputFilename))
     return false;
@@ -3593,101 +3782,72 @@ bool DwarfLinker::link(const DebugMap &Map) {
   UnitID = 0;
   DebugMap ModuleMap(Map.getTriple(), Map.getBinaryPath());
 
-  for (const auto &Obj : Map.objects()) {
-    CurrentDebugObject = Obj.get();
-
-    if (Options.Verbose)
-      outs() << "DEBUG MAP OBJECT: " << Obj->getObjectFilename() << "\n";
-
-    // N_AST objects (swiftmodule files) should get dumped directly into the
-    // appropriate DWARF section.
-    if (Obj->getType() == MachO::N_AST) {
-      StringRef File = Obj->getObjectFilename();
-      auto ErrorOrMem = MemoryBuffer::getFile(File);
-      if (!ErrorOrMem) {
-        errs() << "Warning: Could not open " << File << "\n";
-        continue;
-      }
-      sys::fs::file_status Stat;
-      if (auto errc = sys::fs::status(File, Stat)) {
-        errs() << "Warning: " << errc.message() << "\n";
-        continue;
-      }
-      if (!Options.NoTimestamp && Stat.getLastModificationTime() !=
-                                      sys::TimePoint<>(Obj->getTimestamp())) {
-        errs() << "Warning: Timestamp mismatch for " << File << ": "
-               << Stat.getLastModificationTime() << " and "
-               << sys::TimePoint<>(Obj->getTimestamp()) << "\n";
-        continue;
-      }
-
-      // Copy the module into the .swift_ast section.
-      if (!Options.NoOutput)
-        Streamer->emitSwiftAST((*ErrorOrMem)->getBuffer());
-      continue;
-    }
-
-    auto ErrOrObj = loadObject(BinHolder, *Obj, Map);
-    if (!ErrOrObj)
-      continue;
+  std::vector<std::unique_ptr<LinkContext>> ObjectContexts;
+  for (const auto &Obj : Map.objects())
+    ObjectContexts.push_back(llvm::make_unique<LinkContext>(*this, *Obj));
+
+  // Loading an object never runs more than one object ahead of the link, so
+  // two binary holders are enough to keep both mappings alive. Each of them
+  // still sees successive objects from the same archive, which is what
+  // BinaryHolder optimizes for.
+  BinaryHolder BinHolders[] = {BinaryHolder(Options.Verbose),
+                               BinaryHolder(Options.Verbose)};
+  auto LoadLambda = [&](unsigned I) {
+    loadDebugObject(BinHolders[I % 2], *ObjectContexts[I], Map);
+  };
+  auto LinkLambda = [&](unsigned I) {
+    linkDebugObject(*ObjectContexts[I], ModuleMap);
+    // Release the object file and its parsed debug info as soon as possible.
+    ObjectContexts[I].reset();
+  };
 
-    // Look for relocations that correspond to debug map entries.
-    RelocationManager RelocMgr(*this);
-    if (!RelocMgr.findValidRelocsInDebugInfo(*ErrOrObj, *Obj)) {
-      if (Options.Verbose)
-        outs() << "No valid relocations found. Skipping.\n";
-      continue;
+  unsigned NumObjects = ObjectContexts.size();
+  if (Options.Threads == 1 || !llvm_is_multithreaded()) {
+    for (unsigned I = 0; I != NumObjects; ++I) {
+      LoadLambda(I);
+      LinkLambda(I);
     }
-
-    // Setup access to the debug info.
-    auto DwarfContext = DWARFContext::create(*ErrOrObj);
-    startDebugObject(*DwarfContext, *Obj);
-
-    // In a first phase, just read in the debug info and load all clang modules.
-    for (const auto &CU : DwarfContext->compile_units()) {
-      auto CUDie = CU->getUnitDIE(false);
-      if (Options.Verbose) {
-        outs() << "Input compilation unit:";
-        DIDumpOptions DumpOpts;
-        DumpOpts.RecurseDepth = 0;
-        DumpOpts.Verbose = Options.Verbose;
-        CUDie.dump(outs(), 0, DumpOpts);
+  } else {
+    // Load the next object on a separate thread while the current one is
+    // being linked. Everything that depends on the previous objects (ODR
+    // uniquing, string offsets, the output streamer) stays on this thread
+    // and happens in debug map order, so the output doesn't depend on the
+    // scheduling. The link itself stays on the calling thread because of
+    // the deep recursion in the DIE cloning. The loader gets a thread of its
+    // own rather than a ThreadPool task: both sides block on each other, and
+    // a pool task could sit queued behind the workers of the shared executor.
+    std::mutex Mutex;
+    std::condition_variable CondVar;
+    unsigned NumLoaded = 0;
+    unsigned NumLinkStarted = 0;
+
+    llvm::thread Loader([&]() {
+      for (unsigned I = 0; I != NumObjects; ++I) {
+        {
+          // Wait for the link of the previous object to start, to bound the
+          // amount of parsed debug info waiting to be linked.
+          std::unique_lock<std::mutex> Lock(Mutex);
+          CondVar.wait(Lock, [&]() { return I <= NumLinkStarted; });
+        }
+        LoadLambda(I);
+        {
+          std::lock_guard<std::mutex> Lock(Mutex);
+          NumLoaded = I + 1;
+        }
+        CondVar.notify_all();
       }
+    });
 
-      if (!registerModuleReference(CUDie, *CU, ModuleMap)) {
-        Units.push_back(llvm::make_unique<CompileUnit>(*CU, UnitID++,
-                                                       !Options.NoODR, ""));
-        maybeUpdateMaxDwarfVersion(CU->getVersion());
+    for (unsigned I = 0; I != NumObjects; ++I) {
+      {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        CondVar.wait(Lock, [&]() { return I < NumLoaded; });
+        NumLinkStarted = I + 1;
       }
+      CondVar.notify_all();
+      LinkLambda(I);
     }
-
-    // Now build the DIE parent links that we will use during the next phase.
-    for (auto &CurrentUnit : Units)
-      analyzeContextInfo(CurrentUnit->getOrigUnit().getUnitDIE(), 0, *CurrentUnit,
-                         &ODRContexts.getRoot(), StringPool, ODRContexts);
-
-    // Then mark all the DIEs that need to be present in the linked
-    // output and collect some information about them. Note that this
-    // loop can not be merged with the previous one becaue cross-cu
-    // references require the ParentIdx to be setup for every CU in
-    // the object file before calling this.
-    for (auto &CurrentUnit : Units)
-      lookForDIEsToKeep(RelocMgr, CurrentUnit->getOrigUnit().getUnitDIE(), *Obj,
-                        *CurrentUnit, 0);
-
-    // The calls to applyValidRelocs inside cloneDIE will walk the
-    // reloc array again (in the same way findValidRelocsInDebugInfo()
-    // did). We need to reset the NextValidReloc index to the beginning.
-    RelocMgr.resetValidRelocs();
-    if (RelocMgr.hasValidRelocs())
-      DIECloner(*this, RelocMgr, DIEAlloc, Units, Options)
-          .cloneAllCompileUnits(*DwarfContext);
-    if (!Options.NoOutput && !Units.empty())
-      patchFrameInfoForObject(*Obj, *DwarfContext,
-                              Units[0]->getOrigUnit().getAddressByteSize());
-
-    // Clean-up before starting working on the next object.
-    endDebugObject();
+    Loader.join();
   }
 
   // Emit everything that's global.
@@ -71,7 +71,8 @@ static alias FlatOutA("f", desc("Alias for --flat"), aliasopt(FlatOut));
 static opt<unsigned> NumThreads(
     "num-threads",
     desc("Specifies the maximum number (n) of simultaneous threads to use\n"
-         "when linking multiple architectures."),
+         "when linking multiple architectures, or to overlap the loading and\n"
+         "the linking of objects within one architecture."),
     value_desc("n"), init(0), cat(DsymCategory));
 static alias NumThreadsA("j", desc("Alias for --num-threads"),
                          aliasopt(NumThreads));
@@ -336,6 +337,9 @@ int main(int argc, char **argv) {
       NumThreads = llvm::thread::hardware_concurrency();
     if (DumpDebugMap || Verbose)
       NumThreads = 1;
+    // The architectures are linked one after the other, so each link gets all
+    // the threads to overlap loading and linking its objects.
+    Options.Threads = NumThreads;
     NumThreads = std::min<unsigned>(NumThreads, DebugMapPtrsOrErr->size());
 
 
@@ -923,8 +923,14 @@ static ld_plugin_status allSymbolsReadHook() {
   };
 
   NativeObjectCache Cache;
-  if (!options::cache_dir.empty())
-    Cache = check(localCache(options::cache_dir, AddBuffer));
+  if (!options::cache_dir.empty()) {
+    // With a pruning policy, also track the entries in the cache index so that
+    // the cache is pruned incrementally as entries are added.
+    Optional<CachePruningPolicy> Policy;
+    if (!options::cache_policy.empty())
+      Policy = check(parseCachePruningPolicy(options::cache_policy));
+    Cache = check(localCache(options::cache_dir, AddBuffer, Policy));
+  }
 
   check(Lto->run(AddStream, Cache));
 
@@ -980,7 +986,8 @@ static ld_plugin_status cleanup_hook(void) {
 
   // Prune cache
   if (!options::cache_policy.empty()) {
-    CachePruningPolicy policy = check(parseCachePruningPolicy(options::cache_policy));
+    CachePruningPolicy policy =
+        check(parseCachePruningPolicy(options::cache_policy));
     pruneCache(options::cache_dir, policy);
   }
 
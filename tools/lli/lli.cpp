@@ -341,7 +341,14 @@ int main(int argc, char **argv, char * const *envp) {
 
   // Load the bitcode...
   SMDiagnostic Err;
-  std::unique_ptr<Module> Owner = parseIRFile(InputFile, Err, Context);
+  // The lazy JIT only needs the bodies of the functions it compiles, so let it
+  // materialize them on demand.
+  auto LoadIRFile = [&](StringRef Filename) -> std::unique_ptr<Module> {
+    if (UseJITKind == JITKind::OrcLazy)
+      return getLazyIRFileModule(Filename, Err, Context);
+    return parseIRFile(Filename, Err, Context);
+  };
+  std::unique_ptr<Module> Owner = LoadIRFile(InputFile);
   Module *Mod = Owner.get();
   if (!Mod)
     reportError(Err, argv[0]);
@@ -350,7 +357,7 @@ int main(int argc, char **argv, char * const *envp) {
     std::vector<std::unique_ptr<Module>> Ms;
     Ms.push_back(std::move(Owner));
     for (auto &ExtraMod : ExtraModules) {
-      Ms.push_back(parseIRFile(ExtraMod, Err, Context));
+      Ms.push_back(LoadIRFile(ExtraMod));
       if (!Ms.back())
         reportError(Err, argv[0]);
     }
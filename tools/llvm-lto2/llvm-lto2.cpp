@@ -49,6 +49,15 @@ static cl::opt<std::string> OutputFilename("o", cl::Required,
 static cl::opt<std::string> CacheDir("cache-dir", cl::desc("Cache Directory"),
                                      cl::value_desc("directory"));
 
+static cl::opt<std::string>
+    CachePolicy("cache-policy",
+                cl::desc("Prune the cache incrementally with this policy"),
+                cl::value_desc("policy"));
+
+static cl::opt<bool> CacheCodeGen(
+    "cache-codegen",
+    cl::desc("Also cache object files by the hash of the optimized module"));
+
 static cl::opt<std::string> OptPipeline("opt-pipeline",
                                         cl::desc("Optimizer Pipeline"),
                                         cl::value_desc("pipeline"));
@@ -217,6 +226,14 @@ static int run(int argc, char **argv) {
 
   Conf.OptLevel = OptLevel - '0';
   Conf.UseNewPM = UseNewPM;
+  Optional<CachePruningPolicy> Policy;
+  if (!CachePolicy.empty())
+    Policy =
+        check(parseCachePruningPolicy(CachePolicy), "invalid cache policy");
+  if (CacheCodeGen) {
+    Conf.CodeGenCacheDir = CacheDir;
+    Conf.CodeGenCachePolicy = Policy;
+  }
   switch (CGOptLevel) {
   case '0':
     Conf.CGOptLevel = CodeGenOpt::None;
@@ -302,10 +319,17 @@ static int run(int argc, char **argv) {
   };
 
   NativeObjectCache Cache;
-  if (!CacheDir.empty())
-    Cache = check(localCache(CacheDir, AddBuffer), "failed to create cache");
+  if (!CacheDir.empty()) {
+    Cache = check(localCache(CacheDir, AddBuffer, Policy),
+                  "failed to create cache");
+  }
 
   check(Lto.run(AddStream, Cache), "LTO::run failed");
+
+  // The cache is only pruned as entries are added. Also prune it once the link
+  // is done, so that entries expire even when every lookup hits.
+  if (!CacheDir.empty() && Policy)
+    pruneCache(CacheDir, *Policy);
   return 0;
 }
 
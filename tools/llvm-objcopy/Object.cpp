@@ -11,17 +11,24 @@
 #include "llvm-objcopy.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/BinaryFormat/ELF.h"
 #include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileOutputBuffer.h"
+#include "llvm/Support/Parallel.h"
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iterator>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -29,6 +36,35 @@ using namespace llvm;
 using namespace object;
 using namespace ELF;
 
+// Call Fn(Begin, End) for consecutive ranges of at most ChunkSize indexes
+// covering [0, Size). The ranges are processed concurrently; inputs that fit
+// in a single range are processed on the calling thread.
+template <class FuncTy>
+static void forEachChunk(size_t Size, size_t ChunkSize, FuncTy Fn) {
+  if (Size <= ChunkSize) {
+    Fn(size_t(0), Size);
+    return;
+  }
+  size_t NumChunks = (Size + ChunkSize - 1) / ChunkSize;
+  parallel::for_each_n(parallel::par, size_t(0), NumChunks, [&](size_t I) {
+    size_t Begin = I * ChunkSize;
+    Fn(Begin, std::min(Size, Begin + ChunkSize));
+  });
+}
+
+// The number of symbols or relocations handled by one task. Filling in an
+// entry is a handful of stores, so a task needs thousands of them to be worth
+// spawning.
+static const size_t EntriesPerTask = 4096;
+
+// Copy Data to Buf. Section contents can be gigabytes of debug info, so large
+// copies are split into chunks copied concurrently.
+static void copyContents(ArrayRef<uint8_t> Data, uint8_t *Buf) {
+  forEachChunk(Data.size(), 1 << 20, [&](size_t Begin, size_t End) {
+    std::copy(Data.begin() + Begin, Data.begin() + End, Buf + Begin);
+  });
+}
+
 template <class ELFT> void Segment::writeHeader(FileOutputBuffer &Out) const {
   using Elf_Ehdr = typename ELFT::Ehdr;
   using Elf_Phdr = typename ELFT::Phdr;
@@ -50,7 +86,7 @@ void Segment::writeSegment(FileOutputBuffer &Out) const {
   uint8_t *Buf = Out.getBufferStart() + Offset;
   // We want to maintain segments' interstitial data and contents exactly.
   // This lets us just copy segments directly.
-  std::copy(std::begin(Contents), std::end(Contents), Buf);
+  copyContents(Contents, Buf);
 }
 
 void SectionBase::removeSectionReferences(const SectionBase *Sec) {}
@@ -74,11 +110,16 @@ void SectionBase::writeHeader(FileOutputBuffer &Out) const {
   Shdr.sh_entsize = EntrySize;
 }
 
+void Section::setContents(std::vector<uint8_t> Data) {
+  OwnedContents = std::move(Data);
+  Contents = OwnedContents;
+  Size = OwnedContents.size();
+}
+
 void Section::writeSection(FileOutputBuffer &Out) const {
   if (Type == SHT_NOBITS)
     return;
-  uint8_t *Buf = Out.getBufferStart() + Offset;
-  std::copy(std::begin(Contents), std::end(Contents), Buf);
+  copyContents(Contents, Out.getBufferStart() + Offset);
 }
 
 void StringTableSection::addString(StringRef Name) {
@@ -182,12 +223,17 @@ void SymbolTableSection::finalize() {
   // Make sure SymbolNames is finalized before getting name indexes.
   SymbolNames->finalize();
 
+  // Looking up the names only reads the finalized string table, so it can be
+  // done for many symbols at once.
+  forEachChunk(Symbols.size(), EntriesPerTask, [&](size_t Begin, size_t End) {
+    for (size_t I = Begin; I != End; ++I)
+      Symbols[I]->NameIndex = SymbolNames->findIndex(Symbols[I]->Name);
+  });
+
   uint32_t MaxLocalIndex = 0;
-  for (auto &Sym : Symbols) {
-    Sym->NameIndex = SymbolNames->findIndex(Sym->Name);
+  for (auto &Sym : Symbols)
     if (Sym->Binding == STB_LOCAL)
       MaxLocalIndex = std::max(MaxLocalIndex, Sym->Index);
-  }
   // Now we need to set the Link and Info fields.
   Link = SymbolNames->Index;
   Info = MaxLocalIndex + 1;
@@ -210,17 +256,21 @@ template <class ELFT>
 void SymbolTableSectionImpl<ELFT>::writeSection(FileOutputBuffer &Out) const {
   uint8_t *Buf = Out.getBufferStart();
   Buf += Offset;
-  typename ELFT::Sym *Sym = reinterpret_cast<typename ELFT::Sym *>(Buf);
-  // Loop though symbols setting each entry of the symbol table.
-  for (auto &Symbol : Symbols) {
-    Sym->st_name = Symbol->NameIndex;
-    Sym->st_value = Symbol->Value;
-    Sym->st_size = Symbol->Size;
-    Sym->setBinding(Symbol->Binding);
-    Sym->setType(Symbol->Type);
-    Sym->st_shndx = Symbol->getShndx();
-    ++Sym;
-  }
+  typename ELFT::Sym *Syms = reinterpret_cast<typename ELFT::Sym *>(Buf);
+  // Set each entry of the symbol table. The entries are independent, so large
+  // symbol tables are written by several threads.
+  forEachChunk(Symbols.size(), EntriesPerTask, [&](size_t Begin, size_t End) {
+    for (size_t I = Begin; I != End; ++I) {
+      const Symbol &S = *Symbols[I];
+      typename ELFT::Sym &Sym = Syms[I];
+      Sym.st_name = S.NameIndex;
+      Sym.st_value = S.Value;
+      Sym.st_size = S.Size;
+      Sym.setBinding(S.Binding);
+      Sym.setType(S.Type);
+      Sym.st_shndx = S.getShndx();
+    }
+  });
 }
 
 template <class SymTabType>
@@ -270,12 +320,17 @@ void setAddend(Elf_Rel_Impl<ELFT, true> &Rela, uint64_t Addend) {
 template <class ELFT>
 template <class T>
 void RelocationSection<ELFT>::writeRel(T *Buf) const {
-  for (const auto &Reloc : Relocations) {
-    Buf->r_offset = Reloc.Offset;
-    setAddend(*Buf, Reloc.Addend);
-    Buf->setSymbolAndType(Reloc.RelocSymbol->Index, Reloc.Type, false);
-    ++Buf;
-  }
+  forEachChunk(Relocations.size(), EntriesPerTask,
+               [&](size_t Begin, size_t End) {
+                 for (size_t I = Begin; I != End; ++I) {
+                   const Relocation &Reloc = Relocations[I];
+                   T &Rel = Buf[I];
+                   Rel.r_offset = Reloc.Offset;
+                   setAddend(Rel, Reloc.Addend);
+                   Rel.setSymbolAndType(Reloc.RelocSymbol->Index, Reloc.Type,
+                                        false);
+                 }
+               });
 }
 
 template <class ELFT>
@@ -288,8 +343,7 @@ void RelocationSection<ELFT>::writeSection(FileOutputBuffer &Out) const {
 }
 
 void DynamicRelocationSection::writeSection(FileOutputBuffer &Out) const {
-  std::copy(std::begin(Contents), std::end(Contents),
-            Out.getBufferStart() + Offset);
+  copyContents(Contents, Out.getBufferStart() + Offset);
 }
 
 void SectionWithStrTab::removeSectionReferences(const SectionBase *Sec) {
@@ -636,8 +690,12 @@ void Object<ELFT>::writeSectionHeaders(FileOutputBuffer &Out) const {
 
 template <class ELFT>
 void Object<ELFT>::writeSectionData(FileOutputBuffer &Out) const {
-  for (auto &Section : Sections)
-    Section->writeSection(Out);
+  // Sections are written to their own ranges of the output, so they can be
+  // written concurrently. Sections only overlap when they overlapped in the
+  // input, and then they write the same bytes.
+  parallel::for_each(
+      parallel::par, Sections.begin(), Sections.end(),
+      [&](const SecPtr &Section) { Section->writeSection(Out); });
 }
 
 template <class ELFT>
@@ -675,6 +733,127 @@ void Object<ELFT>::removeSections(
   Sections.erase(Iter, std::end(Sections));
 }
 
+template <class ELFT>
+void Object<ELFT>::compressSections(
+    std::function<bool(const SectionBase &)> ToCompress) {
+  std::vector<Section *> ToReplace;
+  for (auto &Sec : Sections) {
+    auto *S = dyn_cast<Section>(Sec.get());
+    if (!S || S->Type == SHT_NOBITS ||
+        (S->Flags & (SHF_ALLOC | SHF_COMPRESSED)))
+      continue;
+    if (S->Name.startswith(".zdebug") || !ToCompress(*S))
+      continue;
+    ToReplace.push_back(S);
+  }
+  if (ToReplace.empty())
+    return;
+  if (!zlib::isAvailable())
+    error("LLVM was not compiled with zlib support");
+
+  // compressParallel already spreads each section over all threads, so the
+  // sections themselves are compressed one after another.
+  for (Section *S : ToReplace) {
+    ArrayRef<uint8_t> Data = S->getContents();
+    SmallVector<char, 0> Compressed;
+    if (Error E = zlib::compressParallel(toStringRef(Data), Compressed))
+      error("failed to compress section '" + S->Name +
+            "': " + toString(std::move(E)));
+    // Like GNU objcopy, leave sections alone that compression doesn't shrink.
+    if (sizeof(Elf_Chdr) + Compressed.size() >= Data.size())
+      continue;
+
+    std::vector<uint8_t> NewContents(sizeof(Elf_Chdr) + Compressed.size());
+    auto *Chdr = reinterpret_cast<Elf_Chdr *>(NewContents.data());
+    Chdr->ch_type = ELFCOMPRESS_ZLIB;
+    Chdr->ch_size = Data.size();
+    Chdr->ch_addralign = S->Align;
+    std::copy(Compressed.begin(), Compressed.end(),
+              NewContents.begin() + sizeof(Elf_Chdr));
+    S->setContents(std::move(NewContents));
+    S->Flags |= SHF_COMPRESSED;
+    S->Align = ELFT::Is64Bits ? 8 : 4;
+  }
+}
+
+template <class ELFT> void Object<ELFT>::decompressSections() {
+  std::vector<Section *> ToReplace;
+  for (auto &Sec : Sections) {
+    auto *S = dyn_cast<Section>(Sec.get());
+    if (S && ((S->Flags & SHF_COMPRESSED) || S->Name.startswith(".zdebug")))
+      ToReplace.push_back(S);
+  }
+  if (ToReplace.empty())
+    return;
+  if (!zlib::isAvailable())
+    error("LLVM was not compiled with zlib support");
+
+  // Inflating a single zlib stream can't be split up, so decompress the
+  // sections concurrently instead. Workers can't call error, so failures are
+  // collected and reported afterwards.
+  std::vector<std::string> Errors(ToReplace.size());
+  std::vector<uint64_t> Aligns(ToReplace.size());
+  parallel::for_each_n(parallel::par, size_t(0), Errors.size(), [&](size_t I) {
+    Section *S = ToReplace[I];
+    ArrayRef<uint8_t> Data = S->getContents();
+    uint64_t DecompressedSize;
+    if (S->Flags & SHF_COMPRESSED) {
+      if (Data.size() < sizeof(Elf_Chdr)) {
+        Errors[I] = "corrupted compression header";
+        return;
+      }
+      auto *Chdr = reinterpret_cast<const Elf_Chdr *>(Data.data());
+      if (Chdr->ch_type != ELFCOMPRESS_ZLIB) {
+        Errors[I] = "unsupported compression type";
+        return;
+      }
+      DecompressedSize = Chdr->ch_size;
+      Aligns[I] = Chdr->ch_addralign;
+      Data = Data.drop_front(sizeof(Elf_Chdr));
+    } else {
+      // GNU style .zdebug sections start with "ZLIB" and the decompressed size
+      // as a 64-bit big-endian integer.
+      if (Data.size() < 12 || toStringRef(Data.take_front(4)) != "ZLIB") {
+        Errors[I] = "corrupted compression header";
+        return;
+      }
+      DecompressedSize = support::endian::read64be(Data.data() + 4);
+      Aligns[I] = S->Align;
+      Data = Data.drop_front(12);
+    }
+
+    // Don't trust the header with the size of the buffer to allocate: deflate
+    // can't expand data by more than a factor of 1032.
+    if (DecompressedSize / 1032 > Data.size()) {
+      Errors[I] = "decompressed size in the compression header is too large";
+      return;
+    }
+    std::vector<uint8_t> NewContents(DecompressedSize);
+    size_t Size = DecompressedSize;
+    if (Error E = zlib::uncompress(
+            toStringRef(Data), reinterpret_cast<char *>(NewContents.data()),
+            Size)) {
+      Errors[I] = toString(std::move(E));
+      return;
+    }
+    if (Size != DecompressedSize) {
+      Errors[I] = "decompressed size does not match the compression header";
+      return;
+    }
+    S->setContents(std::move(NewContents));
+  });
+
+  for (size_t I = 0, E = ToReplace.size(); I != E; ++I) {
+    Section *S = ToReplace[I];
+    if (!Errors[I].empty())
+      error("failed to decompress section '" + S->Name + "': " + Errors[I]);
+    if (S->Name.startswith(".zdebug"))
+      S->Name = Saver.save(".debug" + S->Name.drop_front(strlen(".zdebug")));
+    S->Flags &= ~static_cast<uint64_t>(SHF_COMPRESSED);
+    S->Align = Aligns[I];
+  }
+}
+
 template <class ELFT> void ELFObject<ELFT>::sortSections() {
   // Put all sections in offset order. Maintain the ordering as closely as
   // possible while meeting that demand however.
@@ -823,13 +1002,17 @@ template <class ELFT> size_t BinaryObject<ELFT>::totalSize() const {
 
 template <class ELFT>
 void BinaryObject<ELFT>::write(FileOutputBuffer &Out) const {
-  for (auto &Segment : this->Segments) {
-    // GNU objcopy does not output segments that do not cover a section. Such
-    // segments can sometimes be produced by LLD due to how LLD handles PT_PHDR.
-    if (Segment->Type == PT_LOAD && Segment->firstSection() != nullptr) {
-      Segment->writeSegment(Out);
-    }
-  }
+  // The segments written are laid out one after the other by finalize, so
+  // they can be written concurrently.
+  parallel::for_each(
+      parallel::par, this->Segments.begin(), this->Segments.end(),
+      [&](const SegPtr &Segment) {
+        // GNU objcopy does not output segments that do not cover a section.
+        // Such segments can sometimes be produced by LLD due to how LLD
+        // handles PT_PHDR.
+        if (Segment->Type == PT_LOAD && Segment->firstSection() != nullptr)
+          Segment->writeSegment(Out);
+      });
 }
 
 template <class ELFT> void BinaryObject<ELFT>::finalize() {
@@ -16,6 +16,8 @@
 #include "llvm/BinaryFormat/ELF.h"
 #include "llvm/MC/StringTableBuilder.h"
 #include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
 #include <cstddef>
 #include <cstdint>
 #include <functional>
@@ -119,11 +121,31 @@ public:
 class Section : public SectionBase {
 private:
   ArrayRef<uint8_t> Contents;
+  // Holds the contents once they have been replaced, for instance by
+  // compressing or decompressing the section.
+  std::vector<uint8_t> OwnedContents;
 
 public:
   Section(ArrayRef<uint8_t> Data) : Contents(Data) {}
 
+  ArrayRef<uint8_t> getContents() const { return Contents; }
+  void setContents(std::vector<uint8_t> Data);
   void writeSection(FileOutputBuffer &Out) const override;
+
+  // Section is what makeSection falls back to for any section it doesn't have
+  // a more specific type for, so this mirrors the cases handled there.
+  static bool classof(const SectionBase *S) {
+    switch (S->Type) {
+    case ELF::SHT_SYMTAB:
+    case ELF::SHT_REL:
+    case ELF::SHT_RELA:
+      return false;
+    case ELF::SHT_STRTAB:
+      return S->Flags & ELF::SHF_ALLOC;
+    default:
+      return true;
+    }
+  }
 };
 
 // There are two types of string tables that can exist, dynamic and not dynamic.
@@ -336,6 +358,10 @@ private:
   using Elf_Shdr = typename ELFT::Shdr;
   using Elf_Ehdr = typename ELFT::Ehdr;
   using Elf_Phdr = typename ELFT::Phdr;
+  using Elf_Chdr = typename ELFT::Chdr;
+
+  BumpPtrAllocator Alloc;
+  StringSaver Saver{Alloc};
 
   void initSymbolTable(const object::ELFFile<ELFT> &ElfFile,
                        SymbolTableSection *SymTab, SectionTableRef SecTable);
@@ -370,6 +396,8 @@ public:
 
   const SectionBase *getSectionHeaderStrTab() const { return SectionNames; }
   void removeSections(std::function<bool(const SectionBase &)> ToRemove);
+  void compressSections(std::function<bool(const SectionBase &)> ToCompress);
+  void decompressSections();
   virtual size_t totalSize() const = 0;
   virtual void finalize() = 0;
   virtual void write(FileOutputBuffer &Out) const = 0;
@@ -93,6 +93,12 @@ static cl::opt<std::string>
              cl::desc("equivalent to extract-dwo on the input file to "
                       "<dwo-file>, then strip-dwo on the input file"),
              cl::value_desc("dwo-file"));
+static cl::opt<bool> CompressDebugSections(
+    "compress-debug-sections",
+    cl::desc("compress DWARF debug sections using zlib (SHF_COMPRESSED)"));
+static cl::opt<bool> DecompressDebugSections(
+    "decompress-debug-sections",
+    cl::desc("decompress DWARF debug sections compressed with zlib"));
 
 using SectionPred = std::function<bool(const SectionBase &Sec)>;
 
@@ -100,6 +106,10 @@ bool IsDWOSection(const SectionBase &Sec) {
   return Sec.Name.endswith(".dwo");
 }
 
+bool IsDebugSection(const SectionBase &Sec) {
+  return Sec.Name.startswith(".debug");
+}
+
 template <class ELFT>
 bool OnlyKeepDWOPred(const Object<ELFT> &Obj, const SectionBase &Sec) {
   // We can't remove the section header string table.
@@ -142,6 +152,9 @@ void CopyBinary(const ELFObjectFile<ELF64LE> &ObjFile) {
 
   if (!OutputFormat.empty() && OutputFormat != "binary")
     error("invalid output format '" + OutputFormat + "'");
+  if (CompressDebugSections && DecompressDebugSections)
+    error("cannot specify both --compress-debug-sections and "
+          "--decompress-debug-sections");
   if (!OutputFormat.empty() && OutputFormat == "binary")
     Obj = llvm::make_unique<BinaryObject<ELF64LE>>(ObjFile);
   else
@@ -177,6 +190,10 @@ void CopyBinary(const ELFObjectFile<ELF64LE> &ObjFile) {
   }
 
   Obj->removeSections(RemovePred);
+  if (DecompressDebugSections)
+    Obj->decompressSections();
+  if (CompressDebugSections)
+    Obj->compressSections(IsDebugSection);
   Obj->finalize();
   WriteObjectFile(*Obj, OutputFilename.getValue());
 }
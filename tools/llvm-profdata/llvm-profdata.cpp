@@ -11,6 +11,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
@@ -35,7 +36,13 @@
 
 using namespace llvm;
 
-enum ProfileFormat { PF_None = 0, PF_Text, PF_Binary, PF_GCC };
+enum ProfileFormat {
+  PF_None = 0,
+  PF_Text,
+  PF_Binary,
+  PF_GCC,
+  PF_Compact_Binary
+};
 
 static void exitWithError(const Twine &Message, StringRef Whence = "",
                           StringRef Hint = "") {
@@ -45,6 +52,9 @@ static void exitWithError(const Twine &Message, StringRef Whence = "",
   errs() << Message << "\n";
   if (!Hint.empty())
     errs() << Hint << "\n";
+  // exit() doesn't destroy the profile writers, so remove their spill files
+  // here.
+  sys::RunInterruptHandlers();
   ::exit(1);
 }
 
@@ -123,10 +133,12 @@ struct WriterContext {
   std::mutex &ErrLock;
   SmallSet<instrprof_error, 4> &WriterErrorCodes;
 
-  WriterContext(bool IsSparse, std::mutex &ErrLock,
+  WriterContext(bool IsSparse, size_t SpillThreshold, std::mutex &ErrLock,
                 SmallSet<instrprof_error, 4> &WriterErrorCodes)
       : Lock(), Writer(IsSparse), Err(Error::success()), ErrWhence(""),
-        ErrLock(ErrLock), WriterErrorCodes(WriterErrorCodes) {}
+        ErrLock(ErrLock), WriterErrorCodes(WriterErrorCodes) {
+    Writer.setSpillThreshold(SpillThreshold);
+  }
 };
 
 /// Load an input into a writer context.
@@ -194,7 +206,7 @@ static void mergeWriterContexts(WriterContext *Dst, WriterContext *Src) {
 static void mergeInstrProfile(const WeightedFileVector &Inputs,
                               StringRef OutputFilename,
                               ProfileFormat OutputFormat, bool OutputSparse,
-                              unsigned NumThreads) {
+                              unsigned NumThreads, size_t SpillThreshold) {
   if (OutputFilename.compare("-") == 0)
     exitWithError("Cannot write indexed profdata format to stdout.");
 
@@ -218,7 +230,7 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
   SmallVector<std::unique_ptr<WriterContext>, 4> Contexts;
   for (unsigned I = 0; I < NumThreads; ++I)
     Contexts.emplace_back(llvm::make_unique<WriterContext>(
-        OutputSparse, ErrorLock, WriterErrorCodes));
+        OutputSparse, SpillThreshold, ErrorLock, WriterErrorCodes));
 
   if (NumThreads == 1) {
     for (const auto &Input : Inputs)
@@ -258,60 +270,198 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
     if (WC->Err)
       exitWithError(std::move(WC->Err), WC->ErrWhence);
 
+  // Records spilled to disk are only merged when the output is written, so
+  // conflicts between them are reported here. The spilled records don't
+  // remember which input they came from, so the output is named instead.
+  auto Warn = [&](Error E, StringRef FuncName) {
+    instrprof_error IPE = InstrProfError::take(std::move(E));
+    bool FirstTime = WriterErrorCodes.insert(IPE).second;
+    handleMergeWriterError(make_error<InstrProfError>(IPE), OutputFilename,
+                           FuncName, FirstTime);
+  };
   InstrProfWriter &Writer = Contexts[0]->Writer;
   if (OutputFormat == PF_Text) {
-    if (Error E = Writer.writeText(Output))
+    if (Error E = Writer.writeText(Output, Warn))
       exitWithError(std::move(E));
   } else {
-    Writer.write(Output);
+    if (Error E = Writer.write(Output, Warn))
+      exitWithError(std::move(E));
   }
 }
 
 static sampleprof::SampleProfileFormat FormatMap[] = {
     sampleprof::SPF_None, sampleprof::SPF_Text, sampleprof::SPF_Binary,
-    sampleprof::SPF_GCC};
+    sampleprof::SPF_GCC, sampleprof::SPF_Compact_Binary};
 
-static void mergeSampleProfile(const WeightedFileVector &Inputs,
-                               StringRef OutputFilename,
-                               ProfileFormat OutputFormat) {
+/// A shard of the merged sample profile. Functions are assigned to shards by
+/// name, so threads merging different inputs rarely wait for each other.
+struct SampleMergeShard {
+  std::mutex Lock;
+  StringMap<sampleprof::FunctionSamples> Profiles;
+};
+
+/// State shared by the threads merging sample profiles.
+struct SampleMergeContext {
+  std::vector<SampleMergeShard> Shards;
+  std::mutex ErrLock;
+  Error Err;
+  std::string ErrWhence;
+  /// Whether the inputs use MD5 names, known once an input has been read.
+  Optional<bool> InputsUseMD5;
+
+  SampleMergeContext(unsigned NumShards)
+      : Shards(NumShards), Err(Error::success()) {}
+
+  /// Record a hard error. Only the first one is reported.
+  void setError(Error E, StringRef Whence) {
+    std::lock_guard<std::mutex> Guard(ErrLock);
+    if (Err) {
+      consumeError(std::move(E));
+      return;
+    }
+    Err = std::move(E);
+    ErrWhence = Whence;
+  }
+
+  bool hasError() {
+    std::lock_guard<std::mutex> Guard(ErrLock);
+    return bool(Err);
+  }
+};
+
+/// Load a sample profile and merge it into the shards of \p Ctx.
+///
+/// The reader is destroyed on return, so each thread holds at most one
+/// decoded input in memory.
+static void loadSampleInput(const WeightedFile &Input,
+                            SampleMergeContext *Ctx) {
   using namespace sampleprof;
-  auto WriterOrErr =
-      SampleProfileWriter::create(OutputFilename, FormatMap[OutputFormat]);
-  if (std::error_code EC = WriterOrErr.getError())
-    exitWithErrorCode(EC, OutputFilename);
 
-  auto Writer = std::move(WriterOrErr.get());
-  StringMap<FunctionSamples> ProfileMap;
-  SmallVector<std::unique_ptr<sampleprof::SampleProfileReader>, 5> Readers;
+  // If there's a pending hard error, don't do more work.
+  if (Ctx->hasError())
+    return;
+
+  // LLVMContext is not thread-safe, so every input gets its own.
   LLVMContext Context;
-  for (const auto &Input : Inputs) {
-    auto ReaderOrErr = SampleProfileReader::create(Input.Filename, Context);
-    if (std::error_code EC = ReaderOrErr.getError())
-      exitWithErrorCode(EC, Input.Filename);
-
-    // We need to keep the readers around until after all the files are
-    // read so that we do not lose the function names stored in each
-    // reader's memory. The function names are needed to write out the
-    // merged profile map.
-    Readers.push_back(std::move(ReaderOrErr.get()));
-    const auto Reader = Readers.back().get();
-    if (std::error_code EC = Reader->read())
-      exitWithErrorCode(EC, Input.Filename);
-
-    StringMap<FunctionSamples> &Profiles = Reader->getProfiles();
-    for (StringMap<FunctionSamples>::iterator I = Profiles.begin(),
-                                              E = Profiles.end();
-         I != E; ++I) {
-      StringRef FName = I->first();
-      FunctionSamples &Samples = I->second;
-      sampleprof_error Result = ProfileMap[FName].merge(Samples, Input.Weight);
+  auto ReaderOrErr = SampleProfileReader::create(Input.Filename, Context);
+  if (std::error_code EC = ReaderOrErr.getError())
+    return Ctx->setError(errorCodeToError(EC), Input.Filename);
+
+  auto Reader = std::move(ReaderOrErr.get());
+  if (std::error_code EC = Reader->read())
+    return Ctx->setError(errorCodeToError(EC), Input.Filename);
+
+  // The names of profiles with MD5 names cannot be mixed with plain names.
+  bool MixesMD5 = false;
+  {
+    std::lock_guard<std::mutex> Guard(Ctx->ErrLock);
+    if (!Ctx->InputsUseMD5.hasValue())
+      Ctx->InputsUseMD5 = Reader->useMD5();
+    MixesMD5 = *Ctx->InputsUseMD5 != Reader->useMD5();
+  }
+  if (MixesMD5)
+    return Ctx->setError(
+        make_error<StringError>(
+            "cannot merge profiles with and without MD5 names",
+            make_error_code(errc::invalid_argument)),
+        Input.Filename);
+
+  // Bucket the functions by shard, so that each shard is locked only once.
+  unsigned NumShards = Ctx->Shards.size();
+  std::vector<std::vector<StringMapEntry<FunctionSamples> *>> Buckets(
+      NumShards);
+  for (auto &I : Reader->getProfiles())
+    Buckets[hash_value(I.getKey()) % NumShards].push_back(&I);
+
+  for (unsigned S = 0; S < NumShards; ++S) {
+    if (Buckets[S].empty())
+      continue;
+    SampleMergeShard &Shard = Ctx->Shards[S];
+    std::lock_guard<std::mutex> ShardGuard(Shard.Lock);
+    for (StringMapEntry<FunctionSamples> *I : Buckets[S]) {
+      StringRef FName = I->getKey();
+      auto &Merged = *Shard.Profiles.try_emplace(FName).first;
+      sampleprof_error Result = Merged.second.merge(I->second, Input.Weight);
+      // The merged profile outlives the reader, so use the name it owns.
+      Merged.second.setName(Merged.getKey());
       if (Result != sampleprof_error::success) {
+        std::lock_guard<std::mutex> ErrGuard(Ctx->ErrLock);
         std::error_code EC = make_error_code(Result);
         handleMergeWriterError(errorCodeToError(EC), Input.Filename, FName);
       }
     }
   }
-  Writer->write(ProfileMap);
+}
+
+static void mergeSampleProfile(const WeightedFileVector &Inputs,
+                               StringRef OutputFilename,
+                               ProfileFormat OutputFormat, bool UseMD5,
+                               unsigned NumThreads) {
+  using namespace sampleprof;
+  if (UseMD5 && OutputFormat != PF_Compact_Binary)
+    exitWithError("MD5 names are only supported by the compact binary format",
+                  OutputFilename);
+
+  // If NumThreads is not specified, auto-detect a good default.
+  if (NumThreads == 0)
+    NumThreads =
+        std::min(hardware_concurrency(), unsigned((Inputs.size() + 1) / 2));
+
+  // Use more shards than threads, so that two threads rarely need the same
+  // shard at the same time.
+  SampleMergeContext Ctx(NumThreads == 1 ? 1 : NumThreads * 4);
+  if (NumThreads == 1) {
+    for (const auto &Input : Inputs)
+      loadSampleInput(Input, &Ctx);
+  } else {
+    ThreadPool Pool(NumThreads);
+    for (const auto &Input : Inputs)
+      Pool.async(loadSampleInput, Input, &Ctx);
+    Pool.wait();
+  }
+
+  // Handle deferred hard errors encountered during merging.
+  if (Ctx.Err)
+    exitWithError(std::move(Ctx.Err), Ctx.ErrWhence);
+
+  bool InputsUseMD5 = Ctx.InputsUseMD5.getValueOr(false);
+  if (InputsUseMD5 && OutputFormat != PF_Compact_Binary)
+    exitWithError("profiles with MD5 names can only be written in the "
+                  "compact binary format",
+                  OutputFilename);
+
+  // Gather the shards into a single map for the writer. The order in which
+  // the inputs reached a shard depends on scheduling, so insert the profiles
+  // in name order to keep the output stable. The profiles are moved, which
+  // keeps the names of their inlined callees valid.
+  std::vector<StringMapEntry<FunctionSamples> *> Merged;
+  for (SampleMergeShard &Shard : Ctx.Shards)
+    for (auto &I : Shard.Profiles)
+      Merged.push_back(&I);
+  std::sort(Merged.begin(), Merged.end(),
+            [](const StringMapEntry<FunctionSamples> *A,
+               const StringMapEntry<FunctionSamples> *B) {
+              return A->getKey() < B->getKey();
+            });
+  StringMap<FunctionSamples> ProfileMap;
+  for (StringMapEntry<FunctionSamples> *I : Merged) {
+    auto &Entry =
+        *ProfileMap.try_emplace(I->getKey(), std::move(I->second)).first;
+    Entry.second.setName(Entry.getKey());
+  }
+  for (SampleMergeShard &Shard : Ctx.Shards)
+    Shard.Profiles.clear();
+
+  auto WriterOrErr =
+      SampleProfileWriter::create(OutputFilename, FormatMap[OutputFormat]);
+  if (std::error_code EC = WriterOrErr.getError())
+    exitWithErrorCode(EC, OutputFilename);
+
+  auto Writer = std::move(WriterOrErr.get());
+  if (UseMD5 || InputsUseMD5)
+    Writer->setUseMD5(InputsUseMD5);
+  if (std::error_code EC = Writer->write(ProfileMap))
+    exitWithErrorCode(EC, OutputFilename);
 }
 
 static WeightedFile parseWeightedFile(const StringRef &WeightedFilename) {
@@ -418,16 +568,28 @@ static int merge_main(int argc, const char *argv[]) {
   cl::opt<ProfileFormat> OutputFormat(
       cl::desc("Format of output profile"), cl::init(PF_Binary),
       cl::values(clEnumValN(PF_Binary, "binary", "Binary encoding (default)"),
+                 clEnumValN(PF_Compact_Binary, "compbinary",
+                            "Compact binary encoding with an index of the "
+                            "function profiles (only meaningful for -sample)"),
                  clEnumValN(PF_Text, "text", "Text encoding"),
                  clEnumValN(PF_GCC, "gcc",
                             "GCC encoding (only meaningful for -sample)")));
   cl::opt<bool> OutputSparse("sparse", cl::init(false),
       cl::desc("Generate a sparse profile (only meaningful for -instr)"));
+  cl::opt<bool> UseMD5(
+      "use-md5", cl::init(false),
+      cl::desc("Store function names as MD5 hashes (only meaningful for "
+               "-sample -compbinary)"));
   cl::opt<unsigned> NumThreads(
       "num-threads", cl::init(0),
       cl::desc("Number of merge threads to use (default: autodetect)"));
   cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
                         cl::aliasopt(NumThreads));
+  cl::opt<unsigned> SpillThreshold(
+      "spill-threshold", cl::init(0),
+      cl::desc("Spill the merged records to temporary files whenever more "
+               "than this many functions are held in memory (only meaningful "
+               "for -instr; default: never spill)"));
 
   cl::ParseCommandLineOptions(argc, argv, "LLVM profile data merger\n");
 
@@ -454,9 +616,10 @@ static int merge_main(int argc, const char *argv[]) {
 
   if (ProfileKind == instr)
     mergeInstrProfile(WeightedInputs, OutputFilename, OutputFormat,
-                      OutputSparse, NumThreads);
+                      OutputSparse, NumThreads, SpillThreshold);
   else
-    mergeSampleProfile(WeightedInputs, OutputFilename, OutputFormat);
+    mergeSampleProfile(WeightedInputs, OutputFilename, OutputFormat, UseMD5,
+                       NumThreads);
 
   return 0;
 }
@@ -26,10 +26,15 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <string>
+#include <tuple>
+#include <vector>
 
 using namespace llvm;
 using namespace symbolize;
@@ -73,6 +78,12 @@ static cl::opt<std::string>
     ClDwpName("dwp", cl::init(""),
               cl::desc("Path to DWP file to be use for any split CUs"));
 
+static cl::opt<std::string>
+    ClCacheDir("cache-dir", cl::init(""),
+               cl::desc("Directory to save the address-to-line index of each "
+                        "object file in, so that later runs skip parsing its "
+                        "DWARF"));
+
 static cl::list<std::string>
 ClDsymHint("dsym-hint", cl::ZeroOrMore,
            cl::desc("Path to .dSYM bundles to search for debug info for the "
@@ -92,11 +103,22 @@ static cl::opt<int> ClPrintSourceContextLines(
 static cl::opt<bool> ClVerbose("verbose", cl::init(false),
                                cl::desc("Print verbose line info"));
 
+static cl::opt<bool>
+    ClBatch("batch", cl::init(false),
+            cl::desc("Read the whole input before symbolizing it. Addresses "
+                     "are grouped by module and sorted, results are printed "
+                     "in input order"));
+
+static cl::opt<unsigned> ClNumThreads(
+    "num-threads", cl::init(1),
+    cl::desc("Number of threads used to symbolize the input in batch mode "
+             "(0 = number of hardware threads)"));
+
 template<typename T>
-static bool error(Expected<T> &ResOrErr) {
+static bool error(Expected<T> &ResOrErr, raw_ostream &ErrOS) {
   if (ResOrErr)
     return false;
-  logAllUnhandledErrors(ResOrErr.takeError(), errs(),
+  logAllUnhandledErrors(ResOrErr.takeError(), ErrOS,
                         "LLVMSymbolizer: error reading file: ");
   return true;
 }
@@ -144,6 +166,93 @@ static bool parseCommand(StringRef InputString, bool &IsData,
   return !StringRef(pos, offset_length).getAsInteger(0, ModuleOffset);
 }
 
+static void symbolizeInput(LLVMSymbolizer &Symbolizer, bool IsData,
+                           const std::string &ModuleName,
+                           uint64_t ModuleOffset, raw_ostream &OS,
+                           raw_ostream &ErrOS) {
+  DIPrinter Printer(OS, ClPrintFunctions != FunctionNameKind::None,
+                    ClPrettyPrint, ClPrintSourceContextLines, ClVerbose);
+
+  if (ClPrintAddress) {
+    OS << "0x";
+    OS.write_hex(ModuleOffset);
+    StringRef Delimiter = (ClPrettyPrint == true) ? ": " : "\n";
+    OS << Delimiter;
+  }
+  if (IsData) {
+    auto ResOrErr = Symbolizer.symbolizeData(ModuleName, ModuleOffset);
+    Printer << (error(ResOrErr, ErrOS) ? DIGlobal() : ResOrErr.get());
+  } else if (ClPrintInlining) {
+    auto ResOrErr =
+        Symbolizer.symbolizeInlinedCode(ModuleName, ModuleOffset, ClDwpName);
+    Printer << (error(ResOrErr, ErrOS) ? DIInliningInfo()
+                                       : ResOrErr.get());
+  } else {
+    auto ResOrErr =
+        Symbolizer.symbolizeCode(ModuleName, ModuleOffset, ClDwpName);
+    Printer << (error(ResOrErr, ErrOS) ? DILineInfo() : ResOrErr.get());
+  }
+  OS << "\n";
+}
+
+namespace {
+/// One line of input in batch mode, along with its results.
+struct BatchQuery {
+  std::string Input;
+  bool Valid = false;
+  bool IsData = false;
+  std::string ModuleName;
+  uint64_t ModuleOffset = 0;
+  std::string Output;
+  std::string Errors;
+};
+} // end anonymous namespace
+
+static void symbolizeBatch(LLVMSymbolizer &Symbolizer,
+                           std::vector<BatchQuery> &Queries) {
+  // Group the queries by module and sort them by address, so that each module
+  // is handled by a single task walking its debug info in address order.
+  std::vector<BatchQuery *> Sorted;
+  for (BatchQuery &Q : Queries)
+    if (Q.Valid)
+      Sorted.push_back(&Q);
+  std::stable_sort(Sorted.begin(), Sorted.end(),
+                   [](const BatchQuery *A, const BatchQuery *B) {
+                     return std::tie(A->ModuleName, A->ModuleOffset) <
+                            std::tie(B->ModuleName, B->ModuleOffset);
+                   });
+
+  auto SymbolizeRange = [&Symbolizer](BatchQuery **Begin, BatchQuery **End) {
+    for (BatchQuery **I = Begin; I != End; ++I) {
+      BatchQuery &Q = **I;
+      raw_string_ostream OS(Q.Output);
+      raw_string_ostream ErrOS(Q.Errors);
+      symbolizeInput(Symbolizer, Q.IsData, Q.ModuleName, Q.ModuleOffset, OS,
+                     ErrOS);
+    }
+  };
+
+  unsigned NumThreads = ClNumThreads;
+  if (NumThreads == 0)
+    NumThreads = llvm::hardware_concurrency();
+  if (NumThreads <= 1) {
+    SymbolizeRange(Sorted.data(), Sorted.data() + Sorted.size());
+    return;
+  }
+
+  ThreadPool Pool(NumThreads);
+  for (size_t I = 0, E = Sorted.size(); I != E;) {
+    size_t End = I + 1;
+    while (End != E && Sorted[End]->ModuleName == Sorted[I]->ModuleName)
+      ++End;
+    BatchQuery **Begin = Sorted.data() + I;
+    BatchQuery **GroupEnd = Sorted.data() + End;
+    Pool.async([=] { SymbolizeRange(Begin, GroupEnd); });
+    I = End;
+  }
+  Pool.wait();
+}
+
 int main(int argc, char **argv) {
   // Print stack trace if we signal out.
   sys::PrintStackTraceOnErrorSignal(argv[0]);
@@ -155,6 +264,7 @@ int main(int argc, char **argv) {
   cl::ParseCommandLineOptions(argc, argv, "llvm-symbolizer\n");
   LLVMSymbolizer::Options Opts(ClPrintFunctions, ClUseSymbolTable, ClDemangle,
                                ClUseRelativeAddress, ClDefaultArch);
+  Opts.CacheDir = ClCacheDir;
 
   for (const auto &hint : ClDsymHint) {
     if (sys::path::extension(hint) == ".dSYM") {
@@ -166,12 +276,31 @@ int main(int argc, char **argv) {
   }
   LLVMSymbolizer Symbolizer(Opts);
 
-  DIPrinter Printer(outs(), ClPrintFunctions != FunctionNameKind::None,
-                    ClPrettyPrint, ClPrintSourceContextLines, ClVerbose);
-
   const int kMaxInputStringLength = 1024;
   char InputString[kMaxInputStringLength];
 
+  if (ClBatch) {
+    std::vector<BatchQuery> Queries;
+    while (fgets(InputString, sizeof(InputString), stdin)) {
+      Queries.emplace_back();
+      BatchQuery &Q = Queries.back();
+      Q.Input = InputString;
+      Q.Valid = parseCommand(StringRef(InputString), Q.IsData, Q.ModuleName,
+                             Q.ModuleOffset);
+    }
+    symbolizeBatch(Symbolizer, Queries);
+    for (const BatchQuery &Q : Queries) {
+      if (!Q.Valid) {
+        outs() << Q.Input;
+        continue;
+      }
+      errs() << Q.Errors;
+      outs() << Q.Output;
+      outs().flush();
+    }
+    return 0;
+  }
+
   while (true) {
     if (!fgets(InputString, sizeof(InputString), stdin))
       break;
@@ -185,26 +314,8 @@ int main(int argc, char **argv) {
       continue;
     }
 
-    if (ClPrintAddress) {
-      outs() << "0x";
-      outs().write_hex(ModuleOffset);
-      StringRef Delimiter = (ClPrettyPrint == true) ? ": " : "\n";
-      outs() << Delimiter;
-    }
-    if (IsData) {
-      auto ResOrErr = Symbolizer.symbolizeData(ModuleName, ModuleOffset);
-      Printer << (error(ResOrErr) ? DIGlobal() : ResOrErr.get());
-    } else if (ClPrintInlining) {
-      auto ResOrErr =
-          Symbolizer.symbolizeInlinedCode(ModuleName, ModuleOffset, ClDwpName);
-      Printer << (error(ResOrErr) ? DIInliningInfo()
-                                             : ResOrErr.get());
-    } else {
-      auto ResOrErr =
-          Symbolizer.symbolizeCode(ModuleName, ModuleOffset, ClDwpName);
-      Printer << (error(ResOrErr) ? DILineInfo() : ResOrErr.get());
-    }
-    outs() << "\n";
+    symbolizeInput(Symbolizer, IsData, ModuleName, ModuleOffset, outs(),
+                   errs());
     outs().flush();
   }
 
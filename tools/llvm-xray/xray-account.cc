@@ -21,6 +21,7 @@
 #include "xray-registry.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/XRay/InstrumentationMap.h"
 #include "llvm/XRay/Trace.h"
 
@@ -215,6 +216,22 @@ bool LatencyAccountant::accountRecord(const XRayRecord &Record) {
   return true;
 }
 
+void LatencyAccountant::merge(LatencyAccountant &&Other) {
+  for (auto &FL : Other.FunctionLatencies) {
+    auto &Latencies = FunctionLatencies[FL.first];
+    Latencies.insert(Latencies.end(), FL.second.begin(), FL.second.end());
+  }
+  for (auto &MM : Other.PerCPUMinMaxTSC) {
+    setMinMax(PerCPUMinMaxTSC[MM.first], MM.second.first);
+    setMinMax(PerCPUMinMaxTSC[MM.first], MM.second.second);
+  }
+  PerThreadMinMaxTSC.insert(Other.PerThreadMinMaxTSC.begin(),
+                            Other.PerThreadMinMaxTSC.end());
+  PerThreadFunctionStack.insert(
+      std::make_move_iterator(Other.PerThreadFunctionStack.begin()),
+      std::make_move_iterator(Other.PerThreadFunctionStack.end()));
+}
+
 namespace {
 
 // We consolidate the data into a struct which we can output in various forms.
@@ -244,7 +261,7 @@ ResultRow getStats(std::vector<uint64_t> &Timings) {
   std::nth_element(Timings.begin(), Timings.begin() + Pct90Off, Timings.end());
   R.Pct90 = Timings[Pct90Off];
   auto Pct99Off = std::floor(Timings.size() * 0.99);
-  std::nth_element(Timings.begin(), Timings.begin() + Pct90Off, Timings.end());
+  std::nth_element(Timings.begin(), Timings.begin() + Pct99Off, Timings.end());
   R.Pct99 = Timings[Pct99Off];
   R.Count = Timings.size();
   return R;
@@ -457,49 +474,111 @@ static CommandRegistration Unused(&Account, []() -> Error {
   symbolize::LLVMSymbolizer Symbolizer(Opts);
   llvm::xray::FuncIdConversionHelper FuncIdHelper(AccountInstrMap, Symbolizer,
                                                   FunctionAddresses);
-  xray::LatencyAccountant FCA(FuncIdHelper, AccountDeduceSiblingCalls);
-  auto TraceOrErr = loadTraceFile(AccountInput);
-  if (!TraceOrErr)
+  // Accounting only needs a single pass over the records of each thread, so
+  // stream them rather than loading the whole trace in memory. The threads are
+  // accounted in parallel, and merged in thread id order.
+  XRayFileHeader Header;
+  std::vector<uint32_t> ThreadIds;
+  if (auto E = listTraceThreads(AccountInput, Header, ThreadIds))
     return joinErrors(
         make_error<StringError>(
             Twine("Failed loading input file '") + AccountInput + "'",
             std::make_error_code(std::errc::executable_format_error)),
-        TraceOrErr.takeError());
-
-  auto &T = *TraceOrErr;
-  for (const auto &Record : T) {
-    if (FCA.accountRecord(Record))
-      continue;
-    errs()
-        << "Error processing record: "
-        << llvm::formatv(
-               R"({{type: {0}; cpu: {1}; record-type: {2}; function-id: {3}; tsc: {4}; thread-id: {5}}})",
-               Record.RecordType, Record.CPU, Record.Type, Record.FuncId,
-               Record.TId)
-        << '\n';
-    for (const auto &ThreadStack : FCA.getPerThreadFunctionStack()) {
-      errs() << "Thread ID: " << ThreadStack.first << "\n";
-      if (ThreadStack.second.empty()) {
+        std::move(E));
+
+  struct ThreadAccount {
+    xray::LatencyAccountant FCA;
+    // The records that failed to be accounted, with the stack of the thread
+    // when they were seen. They are only symbolized and reported once all the
+    // threads are done, as the symbolizer isn't thread-safe.
+    std::vector<std::pair<XRayRecord, LatencyAccountant::FunctionStack>>
+        Failures;
+    Optional<Error> Err;
+    bool AccountingFailed = false;
+
+    explicit ThreadAccount(FuncIdConversionHelper &FuncIdHelper)
+        : FCA(FuncIdHelper, AccountDeduceSiblingCalls) {}
+    ThreadAccount(ThreadAccount &&) = default;
+  };
+  std::vector<ThreadAccount> Threads;
+  Threads.reserve(ThreadIds.size());
+  for (size_t I = 0, E = ThreadIds.size(); I != E; ++I)
+    Threads.emplace_back(FuncIdHelper);
+
+  auto AccountThread = [&](size_t I) {
+    ThreadAccount &T = Threads[I];
+    XRayFileHeader ThreadHeader;
+    auto E = streamTraceFile(
+        AccountInput, ThreadIds[I], ThreadHeader,
+        [&](const XRayRecord &Record) -> Error {
+          if (T.FCA.accountRecord(Record))
+            return Error::success();
+          const auto *Stack = T.FCA.getThreadFunctionStack(Record.TId);
+          T.Failures.emplace_back(
+              Record, Stack ? *Stack : LatencyAccountant::FunctionStack());
+          if (AccountKeepGoing)
+            return Error::success();
+          T.AccountingFailed = true;
+          return make_error<StringError>(
+              Twine("Failed accounting function calls in file '") +
+                  AccountInput + "'.",
+              std::make_error_code(std::errc::executable_format_error));
+        });
+    T.Err = std::move(E);
+  };
+  parallel::for_each_n(parallel::par, size_t(0), ThreadIds.size(),
+                       AccountThread);
+
+  Optional<Error> Err;
+  xray::LatencyAccountant FCA(FuncIdHelper, AccountDeduceSiblingCalls);
+  for (ThreadAccount &T : Threads) {
+    for (const auto &Failure : T.Failures) {
+      const XRayRecord &Record = Failure.first;
+      errs()
+          << "Error processing record: "
+          << llvm::formatv(
+                 R"({{type: {0}; cpu: {1}; record-type: {2}; function-id: {3}; tsc: {4}; thread-id: {5}}})",
+                 Record.RecordType, Record.CPU, Record.Type, Record.FuncId,
+                 Record.TId)
+          << '\n';
+      errs() << "Thread ID: " << Record.TId << "\n";
+      if (Failure.second.empty()) {
         errs() << "  (empty stack)\n";
         continue;
       }
-      auto Level = ThreadStack.second.size();
-      for (const auto &Entry : llvm::reverse(ThreadStack.second))
+      auto Level = Failure.second.size();
+      for (const auto &Entry : llvm::reverse(Failure.second))
         errs() << "  #" << Level-- << "\t"
                << FuncIdHelper.SymbolOrNumber(Entry.first) << '\n';
     }
-    if (!AccountKeepGoing)
-      return make_error<StringError>(
-          Twine("Failed accounting function calls in file '") + AccountInput +
-              "'.",
-          std::make_error_code(std::errc::executable_format_error));
+
+    // Report the first error in thread id order.
+    if (!*T.Err) {
+      FCA.merge(std::move(T.FCA));
+      continue;
+    }
+    if (Err) {
+      consumeError(std::move(*T.Err));
+      continue;
+    }
+    if (T.AccountingFailed)
+      Err = std::move(*T.Err);
+    else
+      Err = joinErrors(
+          make_error<StringError>(
+              Twine("Failed loading input file '") + AccountInput + "'",
+              std::make_error_code(std::errc::executable_format_error)),
+          std::move(*T.Err));
   }
+  if (Err)
+    return std::move(*Err);
+
   switch (AccountOutputFormat) {
   case AccountOutputFormats::TEXT:
-    FCA.exportStatsAsText(OS, T.getFileHeader());
+    FCA.exportStatsAsText(OS, Header);
     break;
   case AccountOutputFormats::CSV:
-    FCA.exportStatsAsCSV(OS, T.getFileHeader());
+    FCA.exportStatsAsCSV(OS, Header);
     break;
   }
 
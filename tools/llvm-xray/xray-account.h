@@ -79,6 +79,10 @@ public:
   ///
   bool accountRecord(const XRayRecord &Record);
 
+  /// Adds the latencies and the per-thread and per-CPU data accounted by
+  /// \p Other, which must have accounted the records of other threads.
+  void merge(LatencyAccountant &&Other);
+
   const FunctionStack *
   getThreadFunctionStack(llvm::sys::ProcessInfo::ProcessId TId) const {
     auto I = PerThreadFunctionStack.find(TId);
@@ -26,6 +26,7 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormatAdapters.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/XRay/Graph.h"
 #include "llvm/XRay/InstrumentationMap.h"
 #include "llvm/XRay/Trace.h"
@@ -382,6 +383,28 @@ class StackTrie {
     return (I == RootsByThread.end()) ? nullptr : *I;
   }
 
+  /// Adds the callees and durations of \p From, a node of another trie, to
+  /// \p To. The callees that \p To doesn't have are moved over, so this must
+  /// only be used once the nodes of the other trie have been moved to this
+  /// one's NodeStore.
+  static void mergeInto(TrieNode &To, TrieNode &From) {
+    To.TerminalDurations.append(From.TerminalDurations.begin(),
+                                From.TerminalDurations.end());
+    To.IntermediateDurations.append(From.IntermediateDurations.begin(),
+                                    From.IntermediateDurations.end());
+    for (auto *Callee : From.Callees) {
+      auto I = find_if(To.Callees, [&](TrieNode *N) {
+        return N->FuncId == Callee->FuncId;
+      });
+      if (I != To.Callees.end()) {
+        mergeInto(**I, *Callee);
+      } else {
+        Callee->Parent = &To;
+        To.Callees.push_back(Callee);
+      }
+    }
+  }
+
 public:
   enum class AccountRecordStatus {
     OK,              // Successfully processed
@@ -479,6 +502,23 @@ public:
 
   bool isEmpty() const { return Roots.empty(); }
 
+  /// Adds the stacks accounted in \p Other to this trie, as if its records had
+  /// been accounted here. The call stacks still open in \p Other are dropped.
+  void merge(StackTrie &&Other) {
+    NodeStore.splice_after(NodeStore.before_begin(), Other.NodeStore);
+    for (auto &ThreadRoots : Other.Roots) {
+      auto &RootsByThread = Roots[ThreadRoots.first];
+      for (auto *Root : ThreadRoots.second) {
+        if (auto *Existing = findRootNode(ThreadRoots.first, Root->FuncId))
+          mergeInto(*Existing, *Root);
+        else
+          RootsByThread.push_back(Root);
+      }
+    }
+    Other.Roots.clear();
+    Other.ThreadStackMap.clear();
+  }
+
   void printStack(raw_ostream &OS, const TrieNode *Top,
                   FuncIdConversionHelper &FN) {
     // Traverse the pointers up to the parent, noting the sums, then print
@@ -755,30 +795,99 @@ static CommandRegistration Unused(&Stack, []() -> Error {
   // TODO: Someday, support output to files instead of just directly to
   // standard output.
   for (const auto &Filename : StackInputs) {
-    auto TraceOrErr = loadTraceFile(Filename);
-    if (!TraceOrErr) {
+    // Stacks are built in a single pass over the records of each thread, so
+    // stream them rather than loading the whole trace in memory. The threads
+    // are accounted in parallel to tries of their own, which are merged in
+    // thread id order. With -keep-going a file that fails to load is skipped
+    // as a whole: its tries are only merged once all of its records were
+    // decoded.
+    XRayFileHeader Header;
+    std::vector<uint32_t> ThreadIds;
+    if (auto E = listTraceThreads(Filename, Header, ThreadIds)) {
       if (!StackKeepGoing)
         return joinErrors(
             make_error<StringError>(
                 Twine("Failed loading input file '") + Filename + "'",
                 std::make_error_code(std::errc::invalid_argument)),
-            TraceOrErr.takeError());
-      logAllUnhandledErrors(TraceOrErr.takeError(), errs(), "");
+            std::move(E));
+      logAllUnhandledErrors(std::move(E), errs(), "");
       continue;
     }
-    auto &T = *TraceOrErr;
-    StackTrie::AccountRecordState AccountRecordState =
-        StackTrie::AccountRecordState::CreateInitialState();
-    for (const auto &Record : T) {
-      auto error = ST.accountRecord(Record, &AccountRecordState);
-      if (error != StackTrie::AccountRecordStatus::OK) {
-        if (!StackKeepGoing)
-          return make_error<StringError>(
-              CreateErrorMessage(error, Record, FuncIdHelper),
-              make_error_code(errc::illegal_byte_sequence));
-        errs() << CreateErrorMessage(error, Record, FuncIdHelper);
+
+    struct ThreadStacks {
+      StackTrie ST;
+      // The records that failed to be accounted. They are only symbolized
+      // and reported once all the threads are done, as the symbolizer isn't
+      // thread-safe.
+      std::vector<std::pair<StackTrie::AccountRecordStatus, XRayRecord>>
+          Failures;
+      Optional<Error> Err;
+    };
+    std::vector<ThreadStacks> Threads(ThreadIds.size());
+    auto AccountThread = [&](size_t I) {
+      ThreadStacks &T = Threads[I];
+      XRayFileHeader ThreadHeader;
+      StackTrie::AccountRecordState AccountRecordState =
+          StackTrie::AccountRecordState::CreateInitialState();
+      auto E = streamTraceFile(
+          Filename, ThreadIds[I], ThreadHeader,
+          [&](const XRayRecord &Record) -> Error {
+            auto error = T.ST.accountRecord(Record, &AccountRecordState);
+            if (error == StackTrie::AccountRecordStatus::OK)
+              return Error::success();
+            T.Failures.emplace_back(error, Record);
+            if (StackKeepGoing)
+              return Error::success();
+            // Stop at the failure, which is reported below.
+            return make_error<StringError>(
+                "Failed accounting the record",
+                make_error_code(errc::illegal_byte_sequence));
+          });
+      T.Err = std::move(E);
+    };
+    parallel::for_each_n(parallel::par, size_t(0), ThreadIds.size(),
+                         AccountThread);
+
+    // Report the first error in thread id order.
+    Optional<Error> LoadErr;
+    for (ThreadStacks &T : Threads) {
+      if (!*T.Err) {
+        for (const auto &Failure : T.Failures)
+          errs() << CreateErrorMessage(Failure.first, Failure.second,
+                                       FuncIdHelper);
+        continue;
+      }
+      if (LoadErr) {
+        consumeError(std::move(*T.Err));
+        continue;
       }
+      if (!StackKeepGoing && !T.Failures.empty()) {
+        consumeError(std::move(*T.Err));
+        for (ThreadStacks &Rest : Threads)
+          if (&Rest != &T && *Rest.Err)
+            consumeError(std::move(*Rest.Err));
+        return make_error<StringError>(
+            CreateErrorMessage(T.Failures.back().first,
+                               T.Failures.back().second, FuncIdHelper),
+            make_error_code(errc::illegal_byte_sequence));
+      }
+      for (const auto &Failure : T.Failures)
+        errs() << CreateErrorMessage(Failure.first, Failure.second,
+                                     FuncIdHelper);
+      LoadErr = std::move(*T.Err);
+    }
+    if (LoadErr) {
+      if (!StackKeepGoing)
+        return joinErrors(
+            make_error<StringError>(
+                Twine("Failed loading input file '") + Filename + "'",
+                std::make_error_code(std::errc::invalid_argument)),
+            std::move(*LoadErr));
+      logAllUnhandledErrors(std::move(*LoadErr), errs(), "");
+      continue;
     }
+    for (ThreadStacks &T : Threads)
+      ST.merge(std::move(T.ST));
   }
   if (ST.isEmpty()) {
     return make_error<StringError>(
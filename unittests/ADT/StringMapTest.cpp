@@ -258,15 +258,25 @@ TEST_F(StringMapTest, InsertPairTest) {
 TEST_F(StringMapTest, InsertRehashingPairTest) {
   // Check that the correct iterator is returned when the inserted element is
   // moved to a different bucket during internal rehashing. This depends on
-  // the particular key, and the implementation of StringMap and HashString.
+  // the particular key, and the implementation of StringMap and its hash.
   // Changes to those might result in this test not actually checking that.
   StringMap<uint32_t> t(0);
   EXPECT_EQ(0u, t.getNumBuckets());
 
-  StringMap<uint32_t>::iterator It =
-    t.insert(std::make_pair("abcdef", 42)).first;
+  // Fill 16 buckets up to the load limit, so that the next insertion grows
+  // the table to 32 buckets.
+  for (unsigned I = 0; I != 12; ++I)
+    t.insert(std::make_pair("key" + std::to_string(I), I));
   EXPECT_EQ(16u, t.getNumBuckets());
-  EXPECT_EQ("abcdef", It->first());
+
+  // The key has a different home bucket in each table, so it moves when the
+  // table grows.
+  StringRef Key = "new key";
+  ASSERT_NE(StringMapImpl::hash(Key) & 15, StringMapImpl::hash(Key) & 31);
+
+  StringMap<uint32_t>::iterator It = t.insert(std::make_pair(Key, 42)).first;
+  EXPECT_EQ(32u, t.getNumBuckets());
+  EXPECT_EQ("new key", It->first());
   EXPECT_EQ(42u, It->second);
 }
 
@@ -0,0 +1,376 @@
+//===- llvm/unittest/ADT/SwissMapTest.cpp - SwissMap unit tests -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SwissMap.h"
+#include "gtest/gtest.h"
+#include <map>
+#include <set>
+#include <string>
+
+using namespace llvm;
+
+namespace {
+
+uint32_t getTestKey(int i, uint32_t *) { return i; }
+uint32_t getTestValue(int i, uint32_t *) { return 42 + i; }
+
+uint32_t *getTestKey(int i, uint32_t **) {
+  static uint32_t dummy_arr1[8192];
+  assert(i < 8192 && "Only support 8192 dummy keys.");
+  return &dummy_arr1[i];
+}
+uint32_t *getTestValue(int i, uint32_t **) {
+  static uint32_t dummy_arr1[8192];
+  assert(i < 8192 && "Only support 8192 dummy keys.");
+  return &dummy_arr1[i];
+}
+
+/// A test class that checks that construction and destruction occur
+/// correctly.
+class CtorTester {
+  static std::set<CtorTester *> Constructed;
+  int Value;
+
+public:
+  explicit CtorTester(int Value = 0) : Value(Value) {
+    EXPECT_TRUE(Constructed.insert(this).second);
+  }
+  CtorTester(const CtorTester &Arg) : Value(Arg.Value) {
+    EXPECT_TRUE(Constructed.insert(this).second);
+  }
+  CtorTester &operator=(const CtorTester &) = default;
+  ~CtorTester() { EXPECT_EQ(1u, Constructed.erase(this)); }
+
+  int getValue() const { return Value; }
+  bool operator==(const CtorTester &RHS) const { return Value == RHS.Value; }
+  bool operator<(const CtorTester &RHS) const { return Value < RHS.Value; }
+
+  static size_t getNumConstructed() { return Constructed.size(); }
+};
+
+std::set<CtorTester *> CtorTester::Constructed;
+
+// SwissMap only needs the hash and the equality of the keys.
+struct CtorTesterMapInfo {
+  static unsigned getHashValue(const CtorTester &Val) {
+    return Val.getValue() * 37u;
+  }
+  static bool isEqual(const CtorTester &LHS, const CtorTester &RHS) {
+    return LHS == RHS;
+  }
+};
+
+CtorTester getTestKey(int i, CtorTester *) { return CtorTester(i); }
+CtorTester getTestValue(int i, CtorTester *) { return CtorTester(42 + i); }
+
+template <typename T> class SwissMapTest : public ::testing::Test {
+protected:
+  T Map;
+
+  static typename T::key_type *const dummy_key_ptr;
+  static typename T::mapped_type *const dummy_value_ptr;
+
+  typename T::key_type getKey(int i = 0) {
+    return getTestKey(i, dummy_key_ptr);
+  }
+  typename T::mapped_type getValue(int i = 0) {
+    return getTestValue(i, dummy_value_ptr);
+  }
+};
+
+template <typename T>
+typename T::key_type *const SwissMapTest<T>::dummy_key_ptr = nullptr;
+template <typename T>
+typename T::mapped_type *const SwissMapTest<T>::dummy_value_ptr = nullptr;
+
+typedef ::testing::Types<SwissMap<uint32_t, uint32_t>,
+                         SwissMap<uint32_t *, uint32_t *>,
+                         SwissMap<CtorTester, CtorTester, CtorTesterMapInfo>>
+    SwissMapTestTypes;
+TYPED_TEST_CASE(SwissMapTest, SwissMapTestTypes);
+
+TYPED_TEST(SwissMapTest, EmptyMapTest) {
+  EXPECT_EQ(0u, this->Map.size());
+  EXPECT_TRUE(this->Map.empty());
+  EXPECT_TRUE(this->Map.begin() == this->Map.end());
+  EXPECT_EQ(0u, this->Map.getMemorySize());
+
+  EXPECT_FALSE(this->Map.count(this->getKey()));
+  EXPECT_TRUE(this->Map.find(this->getKey()) == this->Map.end());
+  EXPECT_FALSE(this->Map.erase(this->getKey()));
+
+  const TypeParam &ConstMap = this->Map;
+  EXPECT_TRUE(ConstMap.begin() == ConstMap.end());
+  EXPECT_TRUE(ConstMap.find(this->getKey()) == ConstMap.end());
+}
+
+TYPED_TEST(SwissMapTest, SingleEntryMapTest) {
+  this->Map[this->getKey()] = this->getValue();
+
+  EXPECT_EQ(1u, this->Map.size());
+  EXPECT_FALSE(this->Map.empty());
+
+  typename TypeParam::iterator it = this->Map.begin();
+  EXPECT_EQ(this->getKey(), it->first);
+  EXPECT_EQ(this->getValue(), it->second);
+  ++it;
+  EXPECT_TRUE(it == this->Map.end());
+
+  EXPECT_TRUE(this->Map.count(this->getKey()));
+  EXPECT_TRUE(this->Map.find(this->getKey()) == this->Map.begin());
+  EXPECT_EQ(this->getValue(), this->Map.lookup(this->getKey()));
+  EXPECT_EQ(this->getValue(), this->Map[this->getKey()]);
+}
+
+TYPED_TEST(SwissMapTest, InsertTest) {
+  auto Result =
+      this->Map.insert(std::make_pair(this->getKey(), this->getValue()));
+  EXPECT_TRUE(Result.second);
+  EXPECT_EQ(this->getValue(), Result.first->second);
+
+  // A second insertion of the key doesn't update the value.
+  Result = this->Map.insert(std::make_pair(this->getKey(), this->getValue(1)));
+  EXPECT_FALSE(Result.second);
+  EXPECT_EQ(1u, this->Map.size());
+  EXPECT_EQ(this->getValue(), this->Map[this->getKey()]);
+
+  Result = this->Map.try_emplace(this->getKey(1), this->getValue(1));
+  EXPECT_TRUE(Result.second);
+  EXPECT_EQ(2u, this->Map.size());
+  EXPECT_EQ(this->getValue(1), this->Map.lookup(this->getKey(1)));
+}
+
+TYPED_TEST(SwissMapTest, EraseTest) {
+  this->Map[this->getKey()] = this->getValue();
+  this->Map.erase(this->Map.begin());
+  EXPECT_TRUE(this->Map.empty());
+  EXPECT_TRUE(this->Map.begin() == this->Map.end());
+
+  this->Map[this->getKey()] = this->getValue();
+  EXPECT_TRUE(this->Map.erase(this->getKey()));
+  EXPECT_FALSE(this->Map.erase(this->getKey()));
+  EXPECT_TRUE(this->Map.empty());
+  EXPECT_FALSE(this->Map.count(this->getKey()));
+}
+
+TYPED_TEST(SwissMapTest, ClearTest) {
+  for (int i = 0; i < 100; ++i)
+    this->Map[this->getKey(i)] = this->getValue(i);
+  this->Map.clear();
+
+  EXPECT_EQ(0u, this->Map.size());
+  EXPECT_TRUE(this->Map.empty());
+  EXPECT_TRUE(this->Map.begin() == this->Map.end());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_FALSE(this->Map.count(this->getKey(i)));
+}
+
+TYPED_TEST(SwissMapTest, CopyAndMoveTest) {
+  TypeParam EmptyCopy(this->Map);
+  EXPECT_TRUE(EmptyCopy.empty());
+
+  for (int i = 0; i < 100; ++i)
+    this->Map[this->getKey(i)] = this->getValue(i);
+
+  TypeParam Copy(this->Map);
+  EXPECT_EQ(100u, Copy.size());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(this->getValue(i), Copy.lookup(this->getKey(i)));
+
+  Copy = Copy;
+  EXPECT_EQ(100u, Copy.size());
+
+  EmptyCopy = Copy;
+  EXPECT_EQ(100u, EmptyCopy.size());
+
+  TypeParam Moved(std::move(Copy));
+  EXPECT_EQ(100u, Moved.size());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(this->getValue(i), Moved.lookup(this->getKey(i)));
+
+  Moved = TypeParam();
+  EXPECT_TRUE(Moved.empty());
+}
+
+TYPED_TEST(SwissMapTest, SwapTest) {
+  for (int i = 0; i < 100; ++i)
+    this->Map[this->getKey(i)] = this->getValue(i);
+  TypeParam OtherMap;
+
+  this->Map.swap(OtherMap);
+  EXPECT_TRUE(this->Map.empty());
+  EXPECT_EQ(100u, OtherMap.size());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(this->getValue(i), OtherMap[this->getKey(i)]);
+}
+
+TYPED_TEST(SwissMapTest, IterationTest) {
+  bool visited[100];
+  std::map<typename TypeParam::key_type, unsigned> visitedIndex;
+
+  for (int i = 0; i < 100; ++i) {
+    visited[i] = false;
+    visitedIndex[this->getKey(i)] = i;
+    this->Map[this->getKey(i)] = this->getValue(i);
+  }
+
+  for (typename TypeParam::iterator it = this->Map.begin();
+       it != this->Map.end(); ++it)
+    visited[visitedIndex[it->first]] = true;
+
+  for (int i = 0; i < 100; ++i)
+    ASSERT_TRUE(visited[i]) << "Entry #" << i << " was never visited";
+
+  // Check conversion from iterator to const_iterator.
+  typename TypeParam::iterator it = this->Map.begin();
+  typename TypeParam::const_iterator cit(it);
+  EXPECT_TRUE(it == cit);
+}
+
+// Erase and reinsert keys so that the table fills up with deleted buckets,
+// which must be reclaimed without losing entries.
+TYPED_TEST(SwissMapTest, EraseChurnTest) {
+  for (int i = 0; i < 64; ++i)
+    this->Map[this->getKey(i)] = this->getValue(i);
+  size_t MemorySize = this->Map.getMemorySize();
+
+  for (int Round = 0; Round < 20; ++Round) {
+    for (int i = 0; i < 64; i += 2)
+      EXPECT_TRUE(this->Map.erase(this->getKey(i)));
+    for (int i = 0; i < 64; i += 2)
+      this->Map[this->getKey(i)] = this->getValue(i);
+    EXPECT_EQ(64u, this->Map.size());
+  }
+  EXPECT_EQ(MemorySize, this->Map.getMemorySize());
+  for (int i = 0; i < 64; ++i)
+    EXPECT_EQ(this->getValue(i), this->Map.lookup(this->getKey(i)));
+}
+
+TEST(SwissMapCustomTest, DestructionTest) {
+  {
+    SwissMap<CtorTester, CtorTester, CtorTesterMapInfo> Map;
+    for (int i = 0; i < 1000; ++i)
+      Map.try_emplace(CtorTester(i), i);
+    for (int i = 0; i < 1000; i += 3)
+      Map.erase(CtorTester(i));
+    EXPECT_EQ(2 * Map.size(), CtorTester::getNumConstructed());
+    Map.clear();
+    EXPECT_EQ(0u, CtorTester::getNumConstructed());
+    for (int i = 0; i < 10; ++i)
+      Map.try_emplace(CtorTester(i), i);
+  }
+  EXPECT_EQ(0u, CtorTester::getNumConstructed());
+}
+
+// SwissMap has no reserved keys, unlike DenseMap.
+TEST(SwissMapCustomTest, AllKeysTest) {
+  SwissMap<unsigned, int> Map;
+  Map[DenseMapInfo<unsigned>::getEmptyKey()] = 1;
+  Map[DenseMapInfo<unsigned>::getTombstoneKey()] = 2;
+  EXPECT_EQ(2u, Map.size());
+  EXPECT_EQ(1, Map.lookup(DenseMapInfo<unsigned>::getEmptyKey()));
+  EXPECT_EQ(2, Map.lookup(DenseMapInfo<unsigned>::getTombstoneKey()));
+}
+
+// Make sure reserving room for N items gives us enough buckets to insert N
+// items without increasing allocation size.
+TEST(SwissMapCustomTest, ReserveTest) {
+  for (unsigned Size : {1, 7, 8, 14, 15, 56, 57, 1000}) {
+    SwissMap<unsigned, unsigned> Map(Size);
+    size_t MemorySize = Map.getMemorySize();
+    for (unsigned i = 0; i < Size; ++i)
+      Map[i] = i;
+    EXPECT_EQ(MemorySize, Map.getMemorySize());
+
+    SwissMap<unsigned, unsigned> Reserved;
+    Reserved.reserve(Size);
+    EXPECT_EQ(MemorySize, Reserved.getMemorySize());
+  }
+}
+
+TEST(SwissMapCustomTest, InitializerListTest) {
+  SwissMap<int, int> Map({{0, 1}, {1, 2}, {2, 3}});
+  EXPECT_EQ(3u, Map.size());
+  EXPECT_EQ(1, Map.lookup(0));
+  EXPECT_EQ(2, Map.lookup(1));
+  EXPECT_EQ(3, Map.lookup(2));
+}
+
+// A hash that puts all the keys in the same group, so that lookups have to
+// compare many keys and probe many groups.
+struct CollidingMapInfo {
+  static unsigned getHashValue(int) { return 0; }
+  static bool isEqual(int LHS, int RHS) { return LHS == RHS; }
+};
+
+TEST(SwissMapCustomTest, CollisionTest) {
+  SwissMap<int, int, CollidingMapInfo> Map;
+  for (int i = 0; i < 200; ++i)
+    EXPECT_TRUE(Map.try_emplace(i, i + 1).second);
+  for (int i = 0; i < 200; i += 2)
+    Map.erase(i);
+  for (int i = 0; i < 200; ++i)
+    EXPECT_EQ(i % 2 ? i + 1 : 0, Map.lookup(i));
+  EXPECT_EQ(0, Map.lookup(-1));
+}
+
+struct StringRefMapInfo {
+  static unsigned getHashValue(const std::string &Val) {
+    return hash_value(StringRef(Val));
+  }
+  static unsigned getHashValue(StringRef Val) { return hash_value(Val); }
+  static bool isEqual(const std::string &LHS, const std::string &RHS) {
+    return LHS == RHS;
+  }
+  static bool isEqual(StringRef LHS, const std::string &RHS) {
+    return LHS == RHS;
+  }
+};
+
+TEST(SwissMapCustomTest, FindAsTest) {
+  SwissMap<std::string, int, StringRefMapInfo> Map;
+  for (int i = 0; i < 100; ++i)
+    Map[std::to_string(i)] = i;
+
+  EXPECT_EQ(100u, Map.size());
+  for (int i = 0; i < 100; ++i) {
+    auto It = Map.find_as(StringRef(std::to_string(i)));
+    ASSERT_TRUE(It != Map.end());
+    EXPECT_EQ(i, It->second);
+  }
+  EXPECT_TRUE(Map.find_as(StringRef("100")) == Map.end());
+}
+
+// Compare against std::map on a random sequence of operations.
+TEST(SwissMapCustomTest, RandomOperationsTest) {
+  SwissMap<unsigned, unsigned> Map;
+  std::map<unsigned, unsigned> Reference;
+  uint32_t State = 1;
+  for (unsigned i = 0; i < 20000; ++i) {
+    State = State * 1103515245 + 12345;
+    unsigned Key = (State >> 8) % 2048;
+    if ((State >> 4) % 3 == 0) {
+      EXPECT_EQ(Reference.erase(Key), size_t(Map.erase(Key)));
+    } else {
+      Map[Key] = i;
+      Reference[Key] = i;
+    }
+  }
+  ASSERT_EQ(Reference.size(), Map.size());
+  for (auto &KV : Reference)
+    EXPECT_EQ(KV.second, Map.lookup(KV.first));
+  size_t NumIterated = 0;
+  for (auto &KV : Map) {
+    EXPECT_EQ(Reference[KV.first], KV.second);
+    ++NumIterated;
+  }
+  EXPECT_EQ(Reference.size(), NumIterated);
+}
+
+} // end anonymous namespace
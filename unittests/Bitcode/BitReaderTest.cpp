@@ -15,6 +15,7 @@
 #include "llvm/Bitcode/BitstreamReader.h"
 #include "llvm/Bitcode/BitstreamWriter.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
@@ -195,4 +196,68 @@ TEST(BitReaderTest, MaterializeFunctionsForBlockAddrInFunctionAfter) {
   EXPECT_FALSE(verifyModule(*M, &dbgs()));
 }
 
+// Tests that lazy-loading a module for importing doesn't load the lists of the
+// compile unit, while the nodes they list that an imported function references
+// are still loaded.
+TEST(BitReaderTest, LazyLoadCompileUnitListsForImporting) {
+  std::string Assembly = "define void @f() !dbg !7 {\n"
+                         "  ret void, !dbg !10\n"
+                         "}\n"
+                         "define void @g() !dbg !11 {\n"
+                         "  ret void\n"
+                         "}\n"
+                         "!llvm.dbg.cu = !{!0}\n"
+                         "!llvm.module.flags = !{!5, !6}\n"
+                         "!0 = distinct !DICompileUnit(language: DW_LANG_C99, "
+                         "file: !1, emissionKind: FullDebug, enums: !2, "
+                         "retainedTypes: !3)\n"
+                         "!1 = !DIFile(filename: \"t.c\", directory: \"/\")\n"
+                         "!2 = !{}\n"
+                         "!5 = !{i32 2, !\"Dwarf Version\", i32 4}\n"
+                         "!6 = !{i32 2, !\"Debug Info Version\", i32 3}\n"
+                         "!7 = distinct !DISubprogram(name: \"f\", file: !1, "
+                         "type: !8, isDefinition: true, unit: !0)\n"
+                         "!8 = !DISubroutineType(types: !9)\n"
+                         "!9 = !{!20}\n"
+                         "!10 = !DILocation(line: 1, scope: !7)\n"
+                         "!11 = distinct !DISubprogram(name: \"g\", file: !1, "
+                         "type: !8, isDefinition: true, unit: !0)\n";
+  // Retain enough types for the module to get a metadata index, the first of
+  // which is referenced by @f.
+  std::string RetainedTypes = "!3 = !{";
+  for (unsigned I = 0; I != 32; ++I) {
+    std::string ID = std::to_string(20 + I);
+    Assembly += "!" + ID + " = !DIBasicType(name: \"t" + ID + "\")\n";
+    RetainedTypes += (I ? ", !" : "!") + ID;
+  }
+  Assembly += RetainedTypes + "}\n";
+
+  SmallString<1024> Mem;
+  LLVMContext WriteContext;
+  writeModuleToBuffer(parseAssembly(WriteContext, Assembly.c_str()), Mem);
+
+  for (bool IsImporting : {false, true}) {
+    LLVMContext Context;
+    Expected<std::unique_ptr<Module>> ModuleOrErr =
+        getLazyBitcodeModule(MemoryBufferRef(Mem.str(), "test"), Context,
+                             /*ShouldLazyLoadMetadata=*/true, IsImporting);
+    ASSERT_TRUE(!!ModuleOrErr);
+    std::unique_ptr<Module> M = std::move(*ModuleOrErr);
+    Function *F = M->getFunction("f");
+    ASSERT_FALSE(F->materialize());
+
+    DISubprogram *SP = F->getSubprogram();
+    ASSERT_TRUE(SP);
+    DICompileUnit *CU = SP->getUnit();
+    ASSERT_TRUE(CU);
+    EXPECT_EQ("t.c", CU->getFilename());
+    EXPECT_EQ(IsImporting, !CU->getRawRetainedTypes());
+    EXPECT_EQ(IsImporting, !CU->getRawEnumTypes());
+
+    DITypeRefArray Types = SP->getType()->getTypeArray();
+    ASSERT_EQ(1u, Types.size());
+    EXPECT_EQ("t20", cast<DIBasicType>(Types[0].resolve())->getName());
+  }
+}
+
 } // end namespace
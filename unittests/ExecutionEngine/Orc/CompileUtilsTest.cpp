@@ -0,0 +1,82 @@
+//===--- CompileUtilsTest.cpp - Unit tests for the Orc compile utilities --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "OrcTestCommon.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Mangler.h"
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+namespace {
+
+class ConcurrentIRCompilerTest : public testing::Test,
+                                 public OrcExecutionTest {};
+
+#if LLVM_ENABLE_THREADS
+TEST_F(ConcurrentIRCompilerTest, CompileOnSeveralThreads) {
+  if (!TM)
+    return;
+
+  ConcurrentIRCompiler Compile([]() {
+    return std::unique_ptr<TargetMachine>(EngineBuilder().selectTarget());
+  });
+
+  // Compile modules defining int fI() { return I; } on separate threads, each
+  // with its own context.
+  const unsigned NumModules = 4;
+  std::vector<ConcurrentIRCompiler::CompileResult> Objs(NumModules);
+  std::vector<std::thread> Threads;
+  for (unsigned I = 0; I != NumModules; ++I)
+    Threads.emplace_back([&, I]() {
+      LLVMContext Ctx;
+      ModuleBuilder MB(Ctx, TM->getTargetTriple().str(), "dummy");
+      MB.getModule()->setDataLayout(TM->createDataLayout());
+      Function *F =
+          MB.createFunctionDecl<int32_t(void)>("f" + std::to_string(I));
+      IRBuilder<> Builder(BasicBlock::Create(Ctx, "entry", F));
+      Builder.CreateRet(ConstantInt::get(Type::getInt32Ty(Ctx), I));
+      Objs[I] = Compile(*MB.getModule());
+    });
+  for (auto &T : Threads)
+    T.join();
+
+  RTDyldObjectLinkingLayer ObjLayer(
+      []() { return std::make_shared<SectionMemoryManager>(); });
+  auto Resolver = createLambdaResolver(
+      [](const std::string &Name) { return JITSymbol(nullptr); },
+      [](const std::string &Name) { return JITSymbol(nullptr); });
+  for (auto &Obj : Objs)
+    cantFail(ObjLayer.addObject(
+        std::make_shared<object::OwningBinary<object::ObjectFile>>(
+            std::move(Obj)),
+        Resolver));
+
+  DataLayout DL = TM->createDataLayout();
+  for (unsigned I = 0; I != NumModules; ++I) {
+    std::string Name;
+    raw_string_ostream NameStream(Name);
+    Mangler::getNameWithPrefix(NameStream, "f" + std::to_string(I), DL);
+    auto Sym = ObjLayer.findSymbol(NameStream.str(), true);
+    ASSERT_TRUE(bool(Sym));
+    auto *FI = (int32_t(*)())cantFail(Sym.getAddress());
+    EXPECT_EQ(int32_t(I), FI());
+  }
+}
+#endif
+
+} // end anonymous namespace
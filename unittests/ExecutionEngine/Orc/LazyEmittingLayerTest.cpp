@@ -8,8 +8,17 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ExecutionEngine/Orc/LazyEmittingLayer.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
 #include "gtest/gtest.h"
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
 
 namespace {
 
@@ -30,4 +39,92 @@ TEST(LazyEmittingLayerTest, Empty) {
   cantFail(L.addModule(std::unique_ptr<llvm::Module>(), nullptr));
 }
 
+#if LLVM_ENABLE_THREADS
+// A base layer whose addModule blocks until the test releases it, so that the
+// test can look symbols up while a module is being emitted.
+struct BlockingBaseLayer {
+  typedef int ModuleHandleT;
+  std::atomic<unsigned> NumAdded{0};
+  std::promise<void> EmissionStarted;
+  std::shared_future<void> EmissionReleased;
+
+  llvm::Expected<ModuleHandleT>
+  addModule(std::shared_ptr<llvm::Module>,
+            std::shared_ptr<llvm::JITSymbolResolver>) {
+    if (NumAdded++ == 0)
+      EmissionStarted.set_value();
+    EmissionReleased.wait();
+    return 42;
+  }
+
+  llvm::Error removeModule(ModuleHandleT) { return llvm::Error::success(); }
+
+  llvm::JITSymbol findSymbol(const std::string &, bool) { return nullptr; }
+
+  llvm::JITSymbol findSymbolIn(ModuleHandleT H, const std::string &, bool) {
+    return llvm::JITSymbol(0x1000 + H, llvm::JITSymbolFlags::Exported);
+  }
+};
+
+static std::shared_ptr<llvm::Module>
+createModuleDefining(llvm::LLVMContext &Ctx, llvm::StringRef Name) {
+  auto M = std::make_shared<llvm::Module>("M", Ctx);
+  auto *F = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(Ctx), false),
+      llvm::GlobalValue::ExternalLinkage, Name, M.get());
+  llvm::ReturnInst::Create(Ctx, llvm::BasicBlock::Create(Ctx, "entry", F));
+  return M;
+}
+
+TEST(LazyEmittingLayerTest, ConcurrentEmission) {
+  llvm::LLVMContext Ctx;
+  std::promise<void> Release;
+  BlockingBaseLayer B;
+  B.EmissionReleased = Release.get_future().share();
+  llvm::orc::LazyEmittingLayer<BlockingBaseLayer> L(B);
+  cantFail(L.addModule(createModuleDefining(Ctx, "foo"), nullptr));
+
+  std::vector<llvm::JITTargetAddress> Addrs(8);
+  std::vector<std::thread> Threads;
+  auto GetFoo = [&L, &Addrs](unsigned I) {
+    Addrs[I] = cantFail(L.findSymbol("foo", false).getAddress());
+  };
+  Threads.emplace_back(GetFoo, 0);
+  B.EmissionStarted.get_future().wait();
+
+  // Looking for a symbol the module doesn't define doesn't wait for it.
+  EXPECT_FALSE(bool(L.findSymbol("bar", false)));
+
+  // The other threads asking for foo wait for the emission in progress.
+  for (unsigned I = 1; I != Addrs.size(); ++I)
+    Threads.emplace_back(GetFoo, I);
+  Release.set_value();
+  for (auto &T : Threads)
+    T.join();
+
+  EXPECT_EQ(1u, B.NumAdded);
+  for (auto Addr : Addrs)
+    EXPECT_EQ(0x1000u + 42, Addr);
+}
+
+TEST(LazyEmittingLayerTest, RemovedModule) {
+  llvm::LLVMContext Ctx;
+  std::promise<void> Release;
+  Release.set_value();
+  BlockingBaseLayer B;
+  B.EmissionReleased = Release.get_future().share();
+  llvm::orc::LazyEmittingLayer<BlockingBaseLayer> L(B);
+  auto H = cantFail(L.addModule(createModuleDefining(Ctx, "foo"), nullptr));
+
+  // A symbol found before its module was removed no longer materializes it.
+  auto Foo = L.findSymbol("foo", false);
+  EXPECT_TRUE(bool(Foo));
+  cantFail(L.removeModule(H));
+  auto Addr = Foo.getAddress();
+  EXPECT_FALSE(bool(Addr));
+  llvm::consumeError(Addr.takeError());
+  EXPECT_EQ(0u, B.NumAdded);
+}
+#endif
+
 }
@@ -9,6 +9,7 @@
 
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "OrcTestCommon.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
@@ -16,7 +17,10 @@
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Mangler.h"
 #include "gtest/gtest.h"
+#include <future>
+#include <thread>
 
 using namespace llvm;
 using namespace llvm::orc;
@@ -255,6 +259,84 @@ TEST_F(RTDyldObjectLinkingLayerExecutionTest, NoPrematureAllocation) {
          "(multiple unrelated objects loaded prior to finalization)";
 }
 
+#if LLVM_ENABLE_THREADS
+TEST_F(RTDyldObjectLinkingLayerExecutionTest, LookupDuringFinalization) {
+  if (!TM)
+    return;
+
+  // Looks up foo from another thread while the object defining it is being
+  // finalized. The lookups must not race with the finalizing thread filling in
+  // the symbol addresses (run under ThreadSanitizer to check this), and must
+  // resolve to the same address as a lookup after finalization.
+  class BlockingMemoryManager : public SectionMemoryManager {
+  public:
+    std::promise<void> Loading;
+    std::shared_future<void> LookedUp;
+
+    bool needsToReserveAllocationSpace() override {
+      // Hold the object in the middle of finalization until the other thread
+      // has seen its symbol.
+      Loading.set_value();
+      LookedUp.wait();
+      return SectionMemoryManager::needsToReserveAllocationSpace();
+    }
+  };
+
+  auto MM = std::make_shared<BlockingMemoryManager>();
+  std::promise<void> LookedUp;
+  MM->LookedUp = LookedUp.get_future().share();
+  auto Loading = MM->Loading.get_future();
+
+  RTDyldObjectLinkingLayer ObjLayer([&MM]() { return MM; });
+  SimpleCompiler Compile(*TM);
+
+  ModuleBuilder MB(Context, "", "dummy");
+  {
+    MB.getModule()->setDataLayout(TM->createDataLayout());
+    Function *FooImpl = MB.createFunctionDecl<int32_t(void)>("foo");
+    BasicBlock *FooEntry = BasicBlock::Create(Context, "entry", FooImpl);
+    IRBuilder<> Builder(FooEntry);
+    IntegerType *Int32Ty = IntegerType::get(Context, 32);
+    Builder.CreateRet(ConstantInt::getSigned(Int32Ty, 42));
+  }
+  auto Obj =
+    std::make_shared<object::OwningBinary<object::ObjectFile>>(
+      Compile(*MB.getModule()));
+
+  std::string FooName;
+  {
+    raw_string_ostream FooNameStream(FooName);
+    Mangler::getNameWithPrefix(FooNameStream, "foo",
+                               TM->createDataLayout());
+  }
+
+  auto H = cantFail(ObjLayer.addObject(std::move(Obj),
+                                       std::make_shared<NullResolver>()));
+
+  JITTargetAddress LookupAddr = 0;
+  std::thread Lookup([&]() {
+    Loading.wait();
+    auto Foo = ObjLayer.findSymbol(FooName, true);
+    EXPECT_TRUE(!!Foo) << "foo not found during finalization";
+    LookedUp.set_value();
+    // Keep looking foo up, without synchronizing with the finalizing thread,
+    // while its address is being filled in.
+    for (unsigned I = 0; I != 1000; ++I)
+      EXPECT_TRUE(!!ObjLayer.findSymbol(FooName, true));
+    LookupAddr = cantFail(Foo.getAddress());
+  });
+
+  cantFail(ObjLayer.emitAndFinalize(H));
+  Lookup.join();
+
+  auto Foo = ObjLayer.findSymbol(FooName, true);
+  EXPECT_NE(LookupAddr, 0U) << "foo not resolved during finalization";
+  EXPECT_EQ(cantFail(Foo.getAddress()), LookupAddr)
+      << "foo resolved to different addresses";
+  cantFail(ObjLayer.removeObject(H));
+}
+#endif
+
 TEST_F(RTDyldObjectLinkingLayerExecutionTest, TestNotifyLoadedSignature) {
   RTDyldObjectLinkingLayer ObjLayer(
       []() { return nullptr; },
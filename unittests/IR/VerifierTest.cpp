@@ -16,6 +16,7 @@
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "gtest/gtest.h"
@@ -190,5 +191,85 @@ TEST(VerifierTest, DetectInvalidDebugInfo) {
   }
 }
 
+TEST(VerifierTest, ConcurrentVerification) {
+  LLVMContext C;
+  Module M("M", C);
+  DIBuilder DIB(M);
+  auto *File = DIB.createFile("concurrent.c", "/");
+  auto *CU = DIB.createCompileUnit(dwarf::DW_LANG_C89, File, "unittest", false,
+                                   "", 0);
+  FunctionType *FTy = FunctionType::get(Type::getVoidTy(C), false);
+  SmallVector<Function *, 16> Functions;
+  for (unsigned I = 0; I != 16; ++I) {
+    std::string Name = "f" + std::to_string(I);
+    auto *F = cast<Function>(M.getOrInsertFunction(Name, FTy));
+    IRBuilder<> Builder(BasicBlock::Create(C, "", F));
+    Builder.CreateRetVoid();
+    F->setSubprogram(
+        DIB.createFunction(CU, Name, Name, File, I, nullptr, true, true, I));
+    Functions.push_back(F);
+  }
+  DIB.finalize();
+  EXPECT_FALSE(verifyModule(M, nullptr, nullptr, 4));
+
+  // The module-level checks see the compile units visited by every thread.
+  NamedMDNode *CUs = M.getNamedMetadata("llvm.dbg.cu");
+  M.eraseNamedMetadata(CUs);
+  EXPECT_TRUE(verifyModule(M, nullptr, nullptr, 4));
+  M.getOrInsertNamedMetadata("llvm.dbg.cu")->addOperand(CU);
+  EXPECT_FALSE(verifyModule(M, nullptr, nullptr, 4));
+
+  // A subprogram shared by functions verified on different threads is caught.
+  DISubprogram *SP = Functions.back()->getSubprogram();
+  Functions.back()->setSubprogram(Functions.front()->getSubprogram());
+  EXPECT_TRUE(verifyModule(M, nullptr, nullptr, 4));
+  Functions.back()->setSubprogram(SP);
+
+  // Broken functions are reported the same way as by the serial verifier.
+  for (Function *F : {Functions[3], Functions[11]}) {
+    BasicBlock &Entry = F->getEntryBlock();
+    Entry.getTerminator()->eraseFromParent();
+    BasicBlock *Exit = BasicBlock::Create(C, "exit", F);
+    ReturnInst::Create(C, Exit);
+    BranchInst *BI =
+        BranchInst::Create(Exit, Exit, ConstantInt::getFalse(C), &Entry);
+    BI->setOperand(0, ConstantInt::get(Type::getInt32Ty(C), 0));
+  }
+  std::string Serial, Concurrent;
+  raw_string_ostream SerialOS(Serial), ConcurrentOS(Concurrent);
+  EXPECT_TRUE(verifyModule(M, &SerialOS));
+  EXPECT_TRUE(verifyModule(M, &ConcurrentOS, nullptr, 4));
+  EXPECT_FALSE(SerialOS.str().empty());
+  EXPECT_EQ(SerialOS.str(), ConcurrentOS.str());
+}
+
+TEST(VerifierTest, ConcurrentVerificationOfIntrinsics) {
+  LLVMContext C;
+  Module M("M", C);
+  // The threads call an overloaded intrinsic, whose prototype is matched
+  // before they start.
+  Type *VecTy = VectorType::get(Type::getInt64Ty(C), 4);
+  Function *Ctpop = Intrinsic::getDeclaration(&M, Intrinsic::ctpop, VecTy);
+  FunctionType *FTy = FunctionType::get(VecTy, VecTy, false);
+  for (unsigned I = 0; I != 16; ++I) {
+    auto *F = cast<Function>(
+        M.getOrInsertFunction("f" + std::to_string(I), FTy));
+    IRBuilder<> Builder(BasicBlock::Create(C, "", F));
+    Builder.CreateRet(Builder.CreateCall(Ctpop, {&*F->arg_begin()}));
+  }
+  EXPECT_FALSE(verifyModule(M, nullptr, nullptr, 4));
+
+  // A misnamed declaration is reported the same way as by the serial
+  // verifier.
+  Ctpop->setName("llvm.ctpop.v4i32");
+  std::string Serial, Concurrent;
+  raw_string_ostream SerialOS(Serial), ConcurrentOS(Concurrent);
+  EXPECT_TRUE(verifyModule(M, &SerialOS));
+  EXPECT_TRUE(verifyModule(M, &ConcurrentOS, nullptr, 4));
+  EXPECT_NE(SerialOS.str().find("Intrinsic name not mangled correctly"),
+            std::string::npos);
+  EXPECT_EQ(SerialOS.str(), ConcurrentOS.str());
+}
+
 } // end anonymous namespace
 } // end namespace llvm
@@ -993,6 +993,93 @@ TEST_P(MaybeSparseInstrProfTest, instr_prof_symtab_compression_test) {
   }
 }
 
+TEST_P(MaybeSparseInstrProfTest, spilled_write_matches_in_memory_write) {
+  InstrProfWriter SpillWriter(GetParam());
+  SpillWriter.setSpillThreshold(2);
+
+  InstrProfValueData VD[] = {{(uint64_t)callee1, 1}, {(uint64_t)callee2, 2}};
+  for (uint64_t Round = 0; Round < 3; ++Round) {
+    for (InstrProfWriter *W : {&Writer, &SpillWriter}) {
+      W->addRecord({"foo", 0x1234, {1, 2}}, Err);
+      W->addRecord({"foo", 0x5678, {Round}}, Err);
+      W->addRecord({"bar", 0x1234, {0, 0, 0}}, Err);
+      W->addRecord({"baz", 0x1234, {Round, 3}}, 2, Err);
+      NamedInstrProfRecord Record("qux", 0x1234, {4});
+      Record.reserveSites(IPVK_IndirectCallTarget, 1);
+      Record.addValueData(IPVK_IndirectCallTarget, 0, VD, 2, nullptr);
+      W->addRecord(std::move(Record), Err);
+    }
+  }
+
+  auto InMemoryProfile = Writer.writeBuffer();
+  auto SpilledProfile = SpillWriter.writeBuffer();
+  ASSERT_EQ(InMemoryProfile->getBuffer(), SpilledProfile->getBuffer());
+
+  readProfile(std::move(SpilledProfile));
+  Expected<InstrProfRecord> R = Reader->getInstrProfRecord("baz", 0x1234);
+  EXPECT_THAT_ERROR(R.takeError(), Succeeded());
+  ASSERT_EQ(2U, R->Counts.size());
+  ASSERT_EQ(6U, R->Counts[0]);
+  ASSERT_EQ(18U, R->Counts[1]);
+
+  R = Reader->getInstrProfRecord("qux", 0x1234);
+  EXPECT_THAT_ERROR(R.takeError(), Succeeded());
+  ASSERT_EQ(12U, R->Counts[0]);
+  ASSERT_EQ(2U, R->getNumValueDataForSite(IPVK_IndirectCallTarget, 0));
+}
+
+TEST_F(InstrProfTest, spilled_writer_merge) {
+  Writer.setSpillThreshold(1);
+  Writer.addRecord({"func1", 0x1234, {42}}, Err);
+  Writer.addRecord({"func2", 0x1234, {1, 1}}, Err);
+
+  InstrProfWriter Writer2;
+  Writer2.setSpillThreshold(1);
+  Writer2.addRecord({"func2", 0x1234, {2, 3}}, Err);
+  Writer2.addRecord({"func3", 0x1234, {7}}, Err);
+
+  Writer.mergeRecordsFromWriter(std::move(Writer2), Err);
+
+  auto Profile = Writer.writeBuffer();
+  readProfile(std::move(Profile));
+
+  Expected<InstrProfRecord> R = Reader->getInstrProfRecord("func1", 0x1234);
+  EXPECT_THAT_ERROR(R.takeError(), Succeeded());
+  ASSERT_EQ(42U, R->Counts[0]);
+
+  R = Reader->getInstrProfRecord("func2", 0x1234);
+  EXPECT_THAT_ERROR(R.takeError(), Succeeded());
+  ASSERT_EQ(2U, R->Counts.size());
+  ASSERT_EQ(3U, R->Counts[0]);
+  ASSERT_EQ(4U, R->Counts[1]);
+
+  R = Reader->getInstrProfRecord("func3", 0x1234);
+  EXPECT_THAT_ERROR(R.takeError(), Succeeded());
+  ASSERT_EQ(7U, R->Counts[0]);
+}
+
+TEST_F(InstrProfTest, spilled_writer_merge_keeps_add_order) {
+  // The records of this writer were added first, so they win the conflict
+  // even though only the other writer's records were spilled.
+  Writer.addRecord({"func1", 0x1234, {1, 2}}, Err);
+
+  InstrProfWriter Writer2;
+  Writer2.setSpillThreshold(1);
+  Writer2.addRecord({"func1", 0x1234, {3}}, Err);
+  Writer2.addRecord({"func2", 0x1234, {4}}, Err);
+
+  Writer.mergeRecordsFromWriter(std::move(Writer2), Err);
+
+  auto Profile = Writer.writeBuffer();
+  readProfile(std::move(Profile));
+
+  Expected<InstrProfRecord> R = Reader->getInstrProfRecord("func1", 0x1234);
+  EXPECT_THAT_ERROR(R.takeError(), Succeeded());
+  ASSERT_EQ(2U, R->Counts.size());
+  ASSERT_EQ(1U, R->Counts[0]);
+  ASSERT_EQ(2U, R->Counts[1]);
+}
+
 TEST_F(SparseInstrProfTest, preserve_no_records) {
   Writer.addRecord({"foo", 0x1234, {0}}, Err);
   Writer.addRecord({"bar", 0x4321, {0, 0}}, Err);
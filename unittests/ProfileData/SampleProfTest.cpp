@@ -10,6 +10,9 @@
 #include "llvm/ProfileData/SampleProf.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
@@ -63,8 +66,10 @@ struct SampleProfTest : ::testing::Test {
     Reader = std::move(ReaderOrErr.get());
   }
 
-  void testRoundTrip(SampleProfileFormat Format) {
+  void testRoundTrip(SampleProfileFormat Format, bool UseMD5 = false) {
     createWriter(Format);
+    if (UseMD5)
+      Writer->setUseMD5();
 
     StringRef FooName("_Z3fooi");
     FunctionSamples FooSamples;
@@ -102,14 +107,17 @@ struct SampleProfTest : ::testing::Test {
 
     StringMap<FunctionSamples> &ReadProfiles = Reader->getProfiles();
     ASSERT_EQ(2u, ReadProfiles.size());
+    ASSERT_EQ(UseMD5, Reader->useMD5());
 
-    FunctionSamples &ReadFooSamples = ReadProfiles[FooName];
-    ASSERT_EQ(7711u, ReadFooSamples.getTotalSamples());
-    ASSERT_EQ(610u, ReadFooSamples.getHeadSamples());
+    FunctionSamples *ReadFooSamples = Reader->getSamplesFor(FooName);
+    ASSERT_TRUE(ReadFooSamples != nullptr);
+    ASSERT_EQ(7711u, ReadFooSamples->getTotalSamples());
+    ASSERT_EQ(610u, ReadFooSamples->getHeadSamples());
 
-    FunctionSamples &ReadBarSamples = ReadProfiles[BarName];
-    ASSERT_EQ(20301u, ReadBarSamples.getTotalSamples());
-    ASSERT_EQ(1437u, ReadBarSamples.getHeadSamples());
+    FunctionSamples *ReadBarSamples = Reader->getSamplesFor(BarName);
+    ASSERT_TRUE(ReadBarSamples != nullptr);
+    ASSERT_EQ(20301u, ReadBarSamples->getTotalSamples());
+    ASSERT_EQ(1437u, ReadBarSamples->getHeadSamples());
 
     auto VerifySummary = [](ProfileSummary &Summary) mutable {
       ASSERT_EQ(ProfileSummary::PSK_Sample, Summary.getKind());
@@ -168,6 +176,62 @@ TEST_F(SampleProfTest, roundtrip_binary_profile) {
   testRoundTrip(SampleProfileFormat::SPF_Binary);
 }
 
+TEST_F(SampleProfTest, roundtrip_compact_binary_profile) {
+  testRoundTrip(SampleProfileFormat::SPF_Compact_Binary);
+}
+
+TEST_F(SampleProfTest, roundtrip_compact_binary_md5_profile) {
+  testRoundTrip(SampleProfileFormat::SPF_Compact_Binary, /*UseMD5=*/true);
+}
+
+TEST_F(SampleProfTest, compact_binary_reads_module_functions_only) {
+  createWriter(SampleProfileFormat::SPF_Compact_Binary);
+
+  StringRef FooName("_Z3fooi");
+  FunctionSamples FooSamples;
+  FooSamples.setName(FooName);
+  FooSamples.addTotalSamples(7711);
+  FooSamples.addHeadSamples(610);
+  FooSamples.addBodySamples(1, 0, 610);
+
+  StringRef BarName("_Z3bari");
+  FunctionSamples BarSamples;
+  BarSamples.setName(BarName);
+  BarSamples.addTotalSamples(20301);
+  BarSamples.addHeadSamples(1437);
+  BarSamples.addBodySamples(1, 0, 1437);
+
+  StringMap<FunctionSamples> Profiles;
+  Profiles[FooName] = std::move(FooSamples);
+  Profiles[BarName] = std::move(BarSamples);
+
+  ASSERT_TRUE(NoError(Writer->write(Profiles)));
+  Writer->getOutputStream().flush();
+
+  auto Profile = MemoryBuffer::getMemBufferCopy(Data);
+  readProfile(Profile);
+
+  // Only _Z3bari is defined in the module, with a suffix that the profile
+  // does not have. _Z3fooi is only declared.
+  Module M("my_module", Context);
+  FunctionType *FnType =
+      FunctionType::get(Type::getVoidTy(Context), /*isVarArg=*/false);
+  Function::Create(FnType, GlobalValue::ExternalLinkage, FooName, &M);
+  Function *Bar = Function::Create(FnType, GlobalValue::InternalLinkage,
+                                   BarName + ".llvm.42", &M);
+  ReturnInst::Create(Context, BasicBlock::Create(Context, "entry", Bar));
+
+  Reader->collectFuncsToUse(M);
+  ASSERT_TRUE(NoError(Reader->read()));
+
+  ASSERT_EQ(1u, Reader->getProfiles().size());
+  ASSERT_TRUE(Reader->getSamplesFor(FooName) == nullptr);
+  FunctionSamples *ReadBarSamples = Reader->getSamplesFor(*Bar);
+  ASSERT_TRUE(ReadBarSamples != nullptr);
+  ASSERT_EQ(20301u, ReadBarSamples->getTotalSamples());
+  ASSERT_EQ(1437u, ReadBarSamples->getHeadSamples());
+}
+
 TEST_F(SampleProfTest, sample_overflow_saturation) {
   const uint64_t Max = std::numeric_limits<uint64_t>::max();
   sampleprof_error Result;
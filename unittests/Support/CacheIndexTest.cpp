@@ -0,0 +1,308 @@
+//===- CacheIndexTest.cpp -------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CacheIndex.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Testing/Support/Error.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+using namespace llvm;
+
+namespace {
+
+class CacheIndexTest : public ::testing::Test {
+protected:
+  SmallString<128> Dir;
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("cache-index-test", Dir));
+  }
+
+  void TearDown() override { ASSERT_FALSE(sys::fs::remove_directories(Dir)); }
+
+  std::unique_ptr<CacheIndex> openIndex(uint32_t NumSlots) {
+    auto IndexOrErr = CacheIndex::open(Dir, NumSlots);
+    EXPECT_THAT_ERROR(IndexOrErr.takeError(), Succeeded());
+    return std::move(*IndexOrErr);
+  }
+
+  SmallString<128> getEntryPath(StringRef Key) {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, "llvmcache-" + Key);
+    return Path;
+  }
+
+  void addEntry(CacheIndex &Index, StringRef Key, uint64_t Size) {
+    std::error_code EC;
+    raw_fd_ostream OS(getEntryPath(Key), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << std::string(Size, 'x');
+    ASSERT_TRUE(Index.insert(Key, Size));
+  }
+};
+
+TEST_F(CacheIndexTest, InsertAndErase) {
+  auto Index = openIndex(16);
+  EXPECT_EQ(0u, Index->getNumEntries());
+  EXPECT_FALSE(Index->touch("a"));
+
+  EXPECT_TRUE(Index->insert("a", 10));
+  EXPECT_TRUE(Index->insert("b", 20));
+  EXPECT_TRUE(Index->touch("a"));
+  EXPECT_EQ(2u, Index->getNumEntries());
+  EXPECT_EQ(30u, Index->getTotalSize());
+
+  // Inserting an existing key updates its size.
+  EXPECT_TRUE(Index->insert("a", 5));
+  EXPECT_EQ(2u, Index->getNumEntries());
+  EXPECT_EQ(25u, Index->getTotalSize());
+
+  EXPECT_TRUE(Index->erase("a"));
+  EXPECT_FALSE(Index->erase("a"));
+  EXPECT_FALSE(Index->touch("a"));
+  EXPECT_EQ(1u, Index->getNumEntries());
+  EXPECT_EQ(20u, Index->getTotalSize());
+
+  // Keys that don't fit in a slot are not tracked.
+  std::string LongKey(CacheIndex::MaxKeySize + 1, 'k');
+  EXPECT_FALSE(Index->insert(LongKey, 1));
+  EXPECT_TRUE(Index->insert(std::string(CacheIndex::MaxKeySize, 'k'), 1));
+}
+
+TEST_F(CacheIndexTest, SharedBetweenInstances) {
+  auto Index1 = openIndex(16);
+  EXPECT_TRUE(Index1->insert("a", 10));
+
+  // The second instance maps the existing index, ignoring the requested size.
+  auto Index2 = openIndex(1024);
+  EXPECT_TRUE(Index2->touch("a"));
+  EXPECT_TRUE(Index2->insert("b", 20));
+  EXPECT_EQ(30u, Index1->getTotalSize());
+  EXPECT_TRUE(Index1->touch("b"));
+}
+
+TEST_F(CacheIndexTest, ConcurrentInserts) {
+  auto Index = openIndex(1024);
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T != 4; ++T)
+    Threads.emplace_back([&, T] {
+      for (unsigned I = 0; I != 64; ++I)
+        EXPECT_TRUE(Index->insert(std::to_string(T * 64 + I), 1));
+    });
+  for (std::thread &T : Threads)
+    T.join();
+  EXPECT_EQ(256u, Index->getNumEntries());
+  EXPECT_EQ(256u, Index->getTotalSize());
+}
+
+TEST_F(CacheIndexTest, ConcurrentInsertsOfSameKeys) {
+  auto Index = openIndex(1024);
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T != 4; ++T)
+    Threads.emplace_back([&] {
+      for (unsigned I = 0; I != 64; ++I)
+        Index->insert(std::to_string(I), 1);
+    });
+  for (std::thread &T : Threads)
+    T.join();
+
+  // Every key is tracked once.
+  EXPECT_EQ(64u, Index->getNumEntries());
+  EXPECT_EQ(64u, Index->getTotalSize());
+  for (unsigned I = 0; I != 64; ++I) {
+    EXPECT_TRUE(Index->erase(std::to_string(I)));
+    EXPECT_FALSE(Index->erase(std::to_string(I)));
+  }
+  EXPECT_EQ(0u, Index->getNumEntries());
+}
+
+TEST_F(CacheIndexTest, NewIndexTracksExistingEntries) {
+  for (StringRef Key : {"a", "b"}) {
+    std::error_code EC;
+    raw_fd_ostream OS(getEntryPath(Key), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << "xxxx";
+  }
+
+  auto Index = openIndex(16);
+  EXPECT_EQ(2u, Index->getNumEntries());
+  EXPECT_EQ(8u, Index->getTotalSize());
+  EXPECT_TRUE(Index->touch("a"));
+  EXPECT_TRUE(Index->touch("b"));
+}
+
+TEST_F(CacheIndexTest, InvalidIndexIsReplaced) {
+  SmallString<128> IndexPath(Dir);
+  sys::path::append(IndexPath, "llvmcache.index");
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(IndexPath, EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << "not an index";
+  }
+  addEntry(*openIndex(16), "a", 10);
+
+  // The replacement is used by later instances.
+  auto Index = openIndex(16);
+  EXPECT_EQ(1u, Index->getNumEntries());
+  EXPECT_TRUE(Index->touch("a"));
+}
+
+TEST_F(CacheIndexTest, PruneBySize) {
+  auto Index = openIndex(16);
+  addEntry(*Index, "a", 100);
+  addEntry(*Index, "b", 100);
+  addEntry(*Index, "c", 100);
+
+  CachePruningPolicy Policy;
+  Policy.Expiration = std::chrono::seconds(0);
+  Policy.MaxSizePercentageOfAvailableSpace = 0;
+  Policy.MaxSizeBytes = 1000;
+  EXPECT_EQ(0u, Index->prune(Policy));
+  EXPECT_EQ(3u, Index->getNumEntries());
+
+  Policy.MaxSizeBytes = 150;
+  EXPECT_EQ(2u, Index->prune(Policy));
+  EXPECT_EQ(1u, Index->getNumEntries());
+  EXPECT_EQ(100u, Index->getTotalSize());
+
+  unsigned NumFiles = 0;
+  for (StringRef Key : {"a", "b", "c"})
+    NumFiles += sys::fs::exists(getEntryPath(Key));
+  EXPECT_EQ(1u, NumFiles);
+}
+
+TEST_F(CacheIndexTest, PruneIsIncremental) {
+  auto Index = openIndex(64);
+  for (unsigned I = 0; I != 32; ++I)
+    addEntry(*Index, std::to_string(I), 1);
+
+  CachePruningPolicy Policy;
+  Policy.Expiration = std::chrono::seconds(0);
+  Policy.MaxSizePercentageOfAvailableSpace = 0;
+  Policy.MaxSizeBytes = 1;
+
+  // Each call only visits a window of the table, but successive calls cover
+  // all of it.
+  unsigned NumRemoved = 0;
+  for (unsigned I = 0; I != 8; ++I) {
+    unsigned Removed = Index->prune(Policy, 8);
+    EXPECT_LE(Removed, 8u);
+    NumRemoved += Removed;
+  }
+  EXPECT_EQ(31u, NumRemoved);
+  EXPECT_EQ(1u, Index->getNumEntries());
+}
+
+TEST_F(CacheIndexTest, PruneSparseTable) {
+  auto Index = openIndex(1024);
+  addEntry(*Index, "a", 100);
+
+  // The only entry is found even though it is outside the first window.
+  CachePruningPolicy Policy;
+  Policy.Expiration = std::chrono::seconds(0);
+  Policy.MaxSizePercentageOfAvailableSpace = 0;
+  Policy.MaxSizeBytes = 10;
+  EXPECT_EQ(1u, Index->prune(Policy, 1));
+  EXPECT_EQ(0u, Index->getNumEntries());
+  EXPECT_FALSE(sys::fs::exists(getEntryPath("a")));
+}
+
+TEST_F(CacheIndexTest, SyncTracksUntrackedEntries) {
+  // With a single slot, every key probes the same slot.
+  auto Index = openIndex(1);
+  addEntry(*Index, "a", 10);
+  EXPECT_FALSE(Index->hasUntrackedEntries());
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(getEntryPath("b"), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << "xxxx";
+  }
+  EXPECT_FALSE(Index->insert("b", 4));
+  EXPECT_TRUE(Index->hasUntrackedEntries());
+
+  // Once "a" is gone, syncing forgets it and makes room for "b".
+  ASSERT_FALSE(sys::fs::remove(getEntryPath("a")));
+  Index->sync();
+  EXPECT_FALSE(Index->hasUntrackedEntries());
+  EXPECT_FALSE(Index->touch("a"));
+  EXPECT_TRUE(Index->touch("b"));
+  EXPECT_EQ(1u, Index->getNumEntries());
+  EXPECT_EQ(4u, Index->getTotalSize());
+
+  // Keys that don't fit in a slot stay untracked.
+  std::string LongKey(CacheIndex::MaxKeySize + 1, 'k');
+  EXPECT_FALSE(Index->insert(LongKey, 1));
+  Index->sync();
+  EXPECT_FALSE(Index->hasUntrackedEntries());
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(getEntryPath(LongKey), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+  }
+  Index->sync();
+  EXPECT_TRUE(Index->hasUntrackedEntries());
+}
+
+TEST_F(CacheIndexTest, PruneCacheSyncsIndex) {
+  auto Index = openIndex(1024);
+  addEntry(*Index, "a", 100);
+  addEntry(*Index, "b", 100);
+
+  CachePruningPolicy Policy;
+  Policy.Interval = std::chrono::seconds(0);
+  Policy.Expiration = std::chrono::hours(1);
+  Policy.MaxSizePercentageOfAvailableSpace = 0;
+  Policy.MaxSizeBytes = 150;
+
+  // The index forgets the entry that was removed.
+  EXPECT_TRUE(pruneCache(Dir, Policy));
+  EXPECT_EQ(1u, Index->getNumEntries());
+  EXPECT_EQ(100u, Index->getTotalSize());
+  EXPECT_NE(sys::fs::exists(getEntryPath("a")),
+            sys::fs::exists(getEntryPath("b")));
+
+  // An entry added without going through the index, as ThinLTOCodeGenerator
+  // does, is still pruned, and the index then tracks the entries left.
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(getEntryPath("c"), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << std::string(200, 'x');
+  }
+  EXPECT_FALSE(Index->hasUntrackedEntries());
+  EXPECT_TRUE(pruneCache(Dir, Policy));
+  EXPECT_FALSE(sys::fs::exists(getEntryPath("c")));
+  EXPECT_EQ(1u, Index->getNumEntries());
+  EXPECT_EQ(100u, Index->getTotalSize());
+
+  // So are the entries that the index can't track.
+  std::string LongKey(CacheIndex::MaxKeySize + 1, 'k');
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(getEntryPath(LongKey), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << std::string(200, 'x');
+  }
+  EXPECT_FALSE(Index->insert(LongKey, 200));
+  Policy.MaxSizeBytes = 50;
+  EXPECT_TRUE(pruneCache(Dir, Policy));
+  EXPECT_FALSE(sys::fs::exists(getEntryPath(LongKey)));
+  EXPECT_FALSE(sys::fs::exists(getEntryPath("a")));
+  EXPECT_FALSE(sys::fs::exists(getEntryPath("b")));
+  EXPECT_EQ(0u, Index->getNumEntries());
+  EXPECT_EQ(0u, Index->getTotalSize());
+  EXPECT_FALSE(Index->hasUntrackedEntries());
+}
+
+} // end anonymous namespace
@@ -66,6 +66,45 @@ TEST(CompressionTest, Zlib) {
   TestZlibCompression(BinaryDataStr, zlib::DefaultCompression);
 }
 
+void TestZlibParallelCompression(StringRef Input, zlib::CompressionLevel Level,
+                                 size_t ChunkSize) {
+  SmallString<32> Compressed;
+  SmallString<32> Uncompressed;
+
+  Error E = zlib::compressParallel(Input, Compressed, Level, ChunkSize);
+  EXPECT_FALSE(E);
+  consumeError(std::move(E));
+
+  // The stream has the same header as the one of compress.
+  SmallString<32> Reference;
+  E = zlib::compress(Input, Reference, Level);
+  EXPECT_FALSE(E);
+  consumeError(std::move(E));
+  EXPECT_EQ(Reference.substr(0, 2), Compressed.substr(0, 2));
+
+  E = zlib::uncompress(Compressed, Uncompressed, Input.size());
+  EXPECT_FALSE(E);
+  consumeError(std::move(E));
+  EXPECT_EQ(Input, Uncompressed);
+}
+
+TEST(CompressionTest, ZlibParallel) {
+  const size_t kSize = 10000;
+  std::string Data;
+  for (size_t i = 0; i < kSize; ++i)
+    Data += "abcdefgh"[(i * i) % 7];
+
+  for (zlib::CompressionLevel Level :
+       {zlib::NoCompression, zlib::BestSpeedCompression,
+        zlib::DefaultCompression, zlib::BestSizeCompression}) {
+    TestZlibParallelCompression("", Level, 16);
+    TestZlibParallelCompression(StringRef(Data).take_front(100), Level, 1);
+    TestZlibParallelCompression(Data, Level, 1000);
+    TestZlibParallelCompression(Data, Level, 4097);
+    TestZlibParallelCompression(Data, Level, kSize);
+  }
+}
+
 TEST(CompressionTest, ZlibCRC32) {
   EXPECT_EQ(
       0x414FA339U,
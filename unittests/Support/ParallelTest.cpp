@@ -15,6 +15,8 @@
 #include "llvm/Support/Parallel.h"
 #include "gtest/gtest.h"
 #include <array>
+#include <atomic>
+#include <cstdlib>
 #include <random>
 
 uint32_t array[1024 * 1024];
@@ -50,4 +52,26 @@ TEST(Parallel, parallel_for) {
   ASSERT_EQ(range[2049], 1u);
 }
 
+TEST(Parallel, nested_parallel_for) {
+  // Every outer task waits on a nested parallel loop. This must not deadlock
+  // even when there are more outer tasks than worker threads.
+  std::atomic<uint32_t> count{0};
+  for_each_n(parallel::par, 0, 64, [&count](size_t I) {
+    for_each_n(parallel::par, 0, 64, [&count](size_t J) { ++count; });
+  });
+  ASSERT_EQ(count, 64u * 64u);
+}
+
+#if GTEST_HAS_DEATH_TEST
+TEST(Parallel, exit_in_forked_child) {
+  // Start the workers, then exit from a forked child, which has none of them.
+  // The child's copy of the executor must not wait for its workers, whether
+  // they were running tasks or asleep when it was forked.
+  parallel::detail::Latch TasksRun(64);
+  for_each_n(parallel::par, 0, 64, [&TasksRun](size_t I) { TasksRun.dec(); });
+  TasksRun.sync();
+  EXPECT_EXIT(exit(0), ::testing::ExitedWithCode(0), "");
+}
+#endif
+
 #endif
@@ -9,6 +9,7 @@
 
 #include "llvm/Support/Process.h"
 #include "gtest/gtest.h"
+#include <vector>
 
 #ifdef LLVM_ON_WIN32
 #include <windows.h>
@@ -26,6 +27,14 @@ TEST(ProcessTest, GetRandomNumberTest) {
   EXPECT_NE((r1 | r2), 0u);
 }
 
+#if defined(LLVM_ON_WIN32) || defined(__linux__) || defined(__APPLE__)
+TEST(ProcessTest, GetPeakMemoryUsage) {
+  // Touch a megabyte, so that the peak usage is at least that much.
+  std::vector<char> Buffer(1 << 20, 1);
+  EXPECT_GE(Process::GetPeakMemoryUsage(), Buffer.size());
+}
+#endif
+
 #ifdef _MSC_VER
 #define setenv(name, var, ignore) _putenv_s(name, var)
 #endif
@@ -13,10 +13,15 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
 
 #include "gtest/gtest.h"
 
+#include <set>
+#include <thread>
+
 using namespace llvm;
 
 // Fixture for the unittests, allowing to *temporarily* disable the unittests
@@ -133,6 +138,10 @@ TEST_F(ThreadPoolTest, Async) {
 
 TEST_F(ThreadPoolTest, GetFuture) {
   CHECK_UNSUPPORTED();
+  // The blocked task holds a worker of the shared executor, so the other one
+  // needs a second worker.
+  if (hardware_concurrency() < 2)
+    return;
   ThreadPool Pool{2};
   std::atomic_int i{0};
   Pool.async([this, &i] {
@@ -164,3 +173,74 @@ TEST_F(ThreadPoolTest, PoolDestruction) {
   }
   ASSERT_EQ(5, checked_in);
 }
+
+TEST_F(ThreadPoolTest, ConcurrencyCap) {
+  CHECK_UNSUPPORTED();
+  // A pool never runs more than its thread count of tasks at once.
+  std::mutex Lock;
+  unsigned Running = 0;
+  unsigned MaxRunning = 0;
+  {
+    ThreadPool Pool(2);
+    for (size_t i = 0; i < 50; ++i) {
+      Pool.async([&] {
+        {
+          std::lock_guard<std::mutex> Guard(Lock);
+          MaxRunning = std::max(MaxRunning, ++Running);
+        }
+        std::this_thread::yield();
+        std::lock_guard<std::mutex> Guard(Lock);
+        --Running;
+      });
+    }
+  }
+  ASSERT_EQ(0u, Running);
+  ASSERT_LE(MaxRunning, 2u);
+}
+
+#if LLVM_ENABLE_THREADS
+TEST_F(ThreadPoolTest, NestedUseSharesThreads) {
+  CHECK_UNSUPPORTED();
+  // Pools created by the tasks of a pool, and the parallel algorithms they
+  // use, run on the same hardware_concurrency() threads rather than each
+  // bringing their own.
+  unsigned Budget = hardware_concurrency();
+  std::mutex Lock;
+  std::set<std::thread::id> ThreadIDs;
+  unsigned Running = 0;
+  unsigned MaxRunning = 0;
+  std::atomic_int checked_in{0};
+  auto Work = [&] {
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      ThreadIDs.insert(std::this_thread::get_id());
+      MaxRunning = std::max(MaxRunning, ++Running);
+    }
+    std::this_thread::yield();
+    ++checked_in;
+    std::lock_guard<std::mutex> Guard(Lock);
+    --Running;
+  };
+
+  ThreadPool Outer(Budget + 4);
+  for (size_t i = 0; i < 8; ++i) {
+    Outer.async([&] {
+      ThreadPool Inner(Budget + 4);
+      for (size_t j = 0; j < 8; ++j)
+        Inner.async([&] {
+          std::vector<int> V(4);
+          parallel::for_each(parallel::par, V.begin(), V.end(),
+                             [&](int) { Work(); });
+        });
+      Inner.wait();
+    });
+  }
+  Outer.wait();
+  ASSERT_EQ(8 * 8 * 4, checked_in);
+  // Neither the thread calling wait() nor anyone else ran a task outside of
+  // the budget.
+  ASSERT_EQ(0u, ThreadIDs.count(std::this_thread::get_id()));
+  ASSERT_LE(ThreadIDs.size(), Budget);
+  ASSERT_LE(MaxRunning, Budget);
+}
+#endif
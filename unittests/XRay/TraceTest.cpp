@@ -0,0 +1,281 @@
+//===- llvm/unittest/XRay/TraceTest.cpp - XRay Trace unit tests -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/XRay/Trace.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+
+using namespace llvm;
+using namespace xray;
+
+namespace {
+
+// Builds a log in the "naive" binary format, 32 bytes per record.
+class NaiveLog {
+  std::string Data;
+
+  void write(const void *P, size_t N) {
+    Data.append(static_cast<const char *>(P), N);
+  }
+  template <typename T> void write(T V) { write(&V, sizeof(V)); }
+  void pad(size_t N) { Data.append(N, '\0'); }
+
+public:
+  NaiveLog() {
+    write<uint16_t>(2); // version
+    write<uint16_t>(0); // type
+    write<uint32_t>(3); // constant and nonstop TSC
+    write<uint64_t>(1000);
+    pad(16);
+  }
+
+  void function(uint8_t Type, int32_t FuncId, uint64_t TSC, uint32_t TId) {
+    write<uint16_t>(0);
+    write<uint8_t>(0); // CPU
+    write(Type);
+    write(FuncId);
+    write(TSC);
+    write(TId);
+    pad(12);
+  }
+
+  void payload(int32_t FuncId, uint32_t TId, uint64_t Arg) {
+    write<uint16_t>(1);
+    pad(2);
+    write(FuncId);
+    write(TId);
+    pad(4);
+    write(Arg);
+    pad(8);
+  }
+
+  // Writes the log to a new temporary file.
+  void save(SmallVectorImpl<char> &Path) {
+    int FD;
+    ASSERT_FALSE(sys::fs::createTemporaryFile("xray-trace", "log", FD, Path));
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Data;
+  }
+};
+
+// Builds a log in FDR mode, made of fixed-size per-thread buffers.
+class FDRLog {
+  static const uint64_t BufferSize = 96;
+  std::string Data;
+  size_t BufferStart = 0;
+
+  void write(const void *P, size_t N) {
+    Data.append(static_cast<const char *>(P), N);
+  }
+  template <typename T> void write(T V) { write(&V, sizeof(V)); }
+  void pad(size_t N) { Data.append(N, '\0'); }
+
+public:
+  FDRLog() {
+    write<uint16_t>(1); // version
+    write<uint16_t>(1); // type
+    write<uint32_t>(3); // constant and nonstop TSC
+    write<uint64_t>(1000);
+    write(BufferSize);
+    pad(8);
+  }
+
+  // Starts the buffer of thread TId, running on CPU 0 from time BaseTSC.
+  void newBuffer(uint16_t TId, uint64_t BaseTSC) {
+    BufferStart = Data.size();
+    write<uint8_t>(0 << 1 | 1); // NewBuffer
+    write(TId);
+    pad(13);
+    write<uint8_t>(4 << 1 | 1); // WallTimeMarker
+    pad(15);
+    write<uint8_t>(2 << 1 | 1); // NewCPUId
+    write<uint16_t>(0);
+    write(BaseTSC);
+    pad(5);
+  }
+
+  void function(uint8_t Type, uint32_t FuncId, uint32_t TSCDelta) {
+    write<uint32_t>(FuncId << 4 | Type << 1);
+    write(TSCDelta);
+  }
+
+  // Ends the current buffer, filling it up to BufferSize with garbage.
+  void endBuffer() {
+    write<uint8_t>(1 << 1 | 1); // EndOfBuffer
+    pad(15);
+    Data.append(BufferSize - (Data.size() - BufferStart), '\xff');
+  }
+
+  void save(SmallVectorImpl<char> &Path) {
+    int FD;
+    ASSERT_FALSE(sys::fs::createTemporaryFile("xray-trace", "log", FD, Path));
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Data;
+  }
+};
+
+TEST(XRayTraceTest, StreamRecordsInOrder) {
+  NaiveLog Log;
+  Log.function(3, 1, 10, 7); // entry with arguments
+  Log.payload(1, 7, 42);
+  Log.function(1, 1, 20, 7); // exit
+  SmallString<128> Path;
+  Log.save(Path);
+
+  XRayFileHeader Header;
+  std::vector<XRayRecord> Records;
+  Error E = streamTraceFile(Path, Header, [&](const XRayRecord &R) {
+    Records.push_back(R);
+    return Error::success();
+  });
+  sys::fs::remove(Path);
+  ASSERT_FALSE(bool(E)) << toString(std::move(E));
+
+  EXPECT_EQ(2, Header.Version);
+  EXPECT_EQ(1000u, Header.CycleFrequency);
+  ASSERT_EQ(2u, Records.size());
+  EXPECT_EQ(RecordTypes::ENTER_ARG, Records[0].Type);
+  EXPECT_EQ(1, Records[0].FuncId);
+  EXPECT_EQ(10u, Records[0].TSC);
+  EXPECT_EQ(std::vector<uint64_t>({42}), Records[0].CallArgs);
+  EXPECT_EQ(RecordTypes::EXIT, Records[1].Type);
+  EXPECT_EQ(20u, Records[1].TSC);
+}
+
+TEST(XRayTraceTest, StreamStopsAtCorruptRecord) {
+  NaiveLog Log;
+  Log.function(0, 1, 10, 7);
+  Log.function(3, 2, 20, 7);
+  Log.payload(3, 7, 42); // doesn't match the record it follows
+  Log.function(1, 1, 30, 7);
+  SmallString<128> Path;
+  Log.save(Path);
+
+  XRayFileHeader Header;
+  std::vector<XRayRecord> Records;
+  Error E = streamTraceFile(Path, Header, [&](const XRayRecord &R) {
+    Records.push_back(R);
+    return Error::success();
+  });
+  sys::fs::remove(Path);
+  EXPECT_TRUE(bool(E));
+  consumeError(std::move(E));
+
+  // The records before the corrupt one are passed on, the one whose payload
+  // is corrupt is not.
+  ASSERT_EQ(1u, Records.size());
+  EXPECT_EQ(1, Records[0].FuncId);
+}
+
+TEST(XRayTraceTest, StreamStopsOnCallbackError) {
+  NaiveLog Log;
+  Log.function(0, 1, 10, 7);
+  Log.function(1, 1, 20, 7);
+  SmallString<128> Path;
+  Log.save(Path);
+
+  XRayFileHeader Header;
+  unsigned Calls = 0;
+  Error E = streamTraceFile(Path, Header, [&](const XRayRecord &) {
+    ++Calls;
+    return make_error<StringError>("stop", inconvertibleErrorCode());
+  });
+  sys::fs::remove(Path);
+  EXPECT_EQ("stop", toString(std::move(E)));
+  EXPECT_EQ(1u, Calls);
+}
+
+TEST(XRayTraceTest, StreamNaiveLogThread) {
+  NaiveLog Log;
+  Log.function(3, 1, 10, 7);
+  Log.payload(1, 7, 42);
+  Log.function(0, 2, 15, 9);
+  Log.function(1, 1, 20, 7);
+  Log.function(1, 2, 25, 9);
+  SmallString<128> Path;
+  Log.save(Path);
+
+  XRayFileHeader Header;
+  std::vector<uint32_t> ThreadIds;
+  Error E = listTraceThreads(Path, Header, ThreadIds);
+  ASSERT_FALSE(bool(E)) << toString(std::move(E));
+  EXPECT_EQ(1000u, Header.CycleFrequency);
+  EXPECT_EQ(std::vector<uint32_t>({7, 9}), ThreadIds);
+
+  std::vector<XRayRecord> Records;
+  E = streamTraceFile(Path, 7, Header, [&](const XRayRecord &R) {
+    Records.push_back(R);
+    return Error::success();
+  });
+  sys::fs::remove(Path);
+  ASSERT_FALSE(bool(E)) << toString(std::move(E));
+
+  ASSERT_EQ(2u, Records.size());
+  EXPECT_EQ(RecordTypes::ENTER_ARG, Records[0].Type);
+  EXPECT_EQ(std::vector<uint64_t>({42}), Records[0].CallArgs);
+  EXPECT_EQ(RecordTypes::EXIT, Records[1].Type);
+  EXPECT_EQ(7u, Records[1].TId);
+}
+
+TEST(XRayTraceTest, StreamFDRLogThread) {
+  FDRLog Log;
+  Log.newBuffer(7, 100);
+  Log.function(0, 1, 10);
+  Log.function(1, 1, 10);
+  Log.endBuffer();
+  Log.newBuffer(9, 200);
+  Log.function(0, 2, 10);
+  Log.function(7, 2, 10); // not a valid function record type
+  Log.endBuffer();
+  Log.newBuffer(7, 300);
+  Log.function(0, 3, 10);
+  Log.function(1, 3, 10);
+  Log.endBuffer();
+  SmallString<128> Path;
+  Log.save(Path);
+
+  XRayFileHeader Header;
+  std::vector<uint32_t> ThreadIds;
+  Error E = listTraceThreads(Path, Header, ThreadIds);
+  ASSERT_FALSE(bool(E)) << toString(std::move(E));
+  EXPECT_EQ(std::vector<uint32_t>({7, 9}), ThreadIds);
+
+  // The buffer of thread 9 is skipped without being decoded.
+  std::vector<XRayRecord> Records;
+  E = streamTraceFile(Path, 7, Header, [&](const XRayRecord &R) {
+    Records.push_back(R);
+    return Error::success();
+  });
+  ASSERT_FALSE(bool(E)) << toString(std::move(E));
+  ASSERT_EQ(4u, Records.size());
+  EXPECT_EQ(1, Records[0].FuncId);
+  EXPECT_EQ(110u, Records[0].TSC);
+  EXPECT_EQ(120u, Records[1].TSC);
+  EXPECT_EQ(3, Records[2].FuncId);
+  EXPECT_EQ(310u, Records[2].TSC);
+  EXPECT_EQ(RecordTypes::EXIT, Records[3].Type);
+  EXPECT_EQ(7u, Records[3].TId);
+
+  Records.clear();
+  E = streamTraceFile(Path, 9, Header, [&](const XRayRecord &R) {
+    Records.push_back(R);
+    return Error::success();
+  });
+  sys::fs::remove(Path);
+  EXPECT_TRUE(bool(E));
+  consumeError(std::move(E));
+  ASSERT_EQ(1u, Records.size());
+  EXPECT_EQ(2, Records[0].FuncId);
+}
+
+} // namespace